@@ -8,14 +8,39 @@
  * Licensed under the Open Software License version 3.0.
  */
 
+/*
+ * Argv/env-style vectors.
+ *
+ * Vectors built by aev_new() and aev_new_prefix() are private copies freed
+ * with free().  Vectors kept for longer can be interned by content using
+ * aev_intern(), after which they are shared, immutable and reference counted,
+ * and must be released with aev_unref() instead.  With full environment
+ * logging, processes across a whole process tree carry near-identical
+ * environments; a vector that differs from its delta base in only a few
+ * strings is stored as a vector pointing into the strings of the base,
+ * followed by copies of only the strings that differ.  Interned vectors can
+ * also cache their serialization for the log format in use.
+ */
+
 #include "aev.h"
 
 #include "str.h"
+#include "tommyhashdyn.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
+
+#define AEV_DELTA_MAX           8       /* strings not found in base */
+#define AEV_DELTA_DEPTH         8       /* deltas to deltas */
+#define AEV_DELTA_VECMAX        1024    /* strings in vector */
 
 /*
  * sz is the total length of all the strings in aev including terminating
@@ -91,3 +116,374 @@ aev_new_prefix(size_t aec, char **aev, const char *prefix) {
 	return aev_new_internal(filtered_aec, filtered_aev, sz);
 }
 
+/*
+ * Like aev_new_prefix, but only copies entries as long as the strings fit
+ * into maxsz bytes in total; later entries are left out and *truncated is
+ * set.  Entries are never cut in the middle.
+ */
+char **
+aev_new_bounded(size_t aec, char **aev, const char *prefix, size_t maxsz,
+                bool *truncated) {
+	size_t sz = 0, len;
+	char *bounded_aev[aec];
+	size_t bounded_aec = 0;
+
+	*truncated = false;
+	errno = 0;
+	if (aec == 0 || !aev)
+		return NULL;
+	for (size_t i = 0; i < aec; i++) {
+		if (prefix && !str_beginswith(aev[i], prefix))
+			continue;
+		len = strlen(aev[i]) + 1;
+		if (sz + len > maxsz) {
+			*truncated = true;
+			break;
+		}
+		bounded_aev[bounded_aec++] = aev[i];
+		sz += len;
+	}
+	if (sz == 0)
+		return NULL;
+	return aev_new_internal(bounded_aec, bounded_aev, sz);
+}
+
+typedef struct aev_blk {
+	tommy_hashdyn_node node;
+	XXH128_hash_t key;
+	size_t refs;
+	size_t sz;              /* allocated for this block */
+	size_t fullsz;          /* allocated for a private copy */
+	struct aev_blk *base;   /* holding shared strings, or NULL */
+	unsigned int depth;     /* of base chain */
+	const void *renderfmt;
+	const char *renderlabel;
+	char *render;
+	size_t rendersz;
+	char *v[];
+} aev_blk_t;
+
+#define AEV_BLK(V) \
+	((aev_blk_t *)((uintptr_t)(V) - offsetof(aev_blk_t, v)))
+
+typedef struct {
+	XXH128_hash_t key;
+	char **v;
+} aev_lookup_t;
+
+static tommy_hashdyn pool;
+static bool initialized = false;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t deltas;
+static uint64_t bytes;
+static uint64_t refbytes;
+static uint64_t hits;
+static uint64_t renders;
+
+static int
+aev_blk_cmp(const void *arg, const void *obj) {
+	const aev_lookup_t *lookup = arg;
+	const aev_blk_t *blk = obj;
+	size_t i;
+
+	if (!XXH128_isEqual(blk->key, lookup->key))
+		return 1;
+	for (i = 0; lookup->v[i] && blk->v[i]; i++) {
+		if (strcmp(lookup->v[i], blk->v[i]))
+			return 1;
+	}
+	return !!lookup->v[i] || !!blk->v[i];
+}
+
+static void
+aev_blk_free(void *arg) {
+	aev_blk_t *blk = arg;
+
+	if (blk->render)
+		free(blk->render);
+	free(blk);
+}
+
+/*
+ * Build a new block for v as a delta to base.  Returns NULL if v differs from
+ * base in too many strings or on memory allocation failure.  Must be called
+ * with mutex held.
+ */
+static aev_blk_t *
+aev_blk_new_delta(char **v, size_t n, char **base) {
+	aev_blk_t *blk, *bblk;
+	size_t bn, j, k, own, scans, misses, len;
+	char *dp;
+
+	bblk = AEV_BLK(base);
+	if (bblk->depth >= AEV_DELTA_DEPTH || n > AEV_DELTA_VECMAX)
+		return NULL;
+	for (bn = 0; base[bn]; bn++);
+
+	char *from[n];
+	j = 0;
+	own = 0;
+	scans = 0;
+	misses = 0;
+	for (size_t i = 0; i < n; i++) {
+		from[i] = NULL;
+		if (j < bn && !strcmp(v[i], base[j])) {
+			from[i] = base[j++];
+			continue;
+		}
+		/* out of sequence, bounded to limit work on unrelated vectors */
+		if (++scans > 2 * AEV_DELTA_MAX)
+			return NULL;
+		for (k = 0; k < bn; k++) {
+			if (!strcmp(v[i], base[k])) {
+				from[i] = base[k];
+				j = k + 1;
+				break;
+			}
+		}
+		if (!from[i]) {
+			if (++misses > AEV_DELTA_MAX)
+				return NULL;
+			own += strlen(v[i]) + 1;
+		}
+	}
+	if (misses * 2 > n)
+		return NULL;
+
+	blk = malloc(sizeof(aev_blk_t) + sizeof(char *) * (n + 1) + own);
+	if (!blk)
+		return NULL;
+	bzero(blk, sizeof(aev_blk_t));
+	blk->sz = sizeof(aev_blk_t) + sizeof(char *) * (n + 1) + own;
+	dp = (char *)&blk->v[n+1];
+	for (size_t i = 0; i < n; i++) {
+		if (from[i]) {
+			blk->v[i] = from[i];
+		} else {
+			len = strlen(v[i]) + 1;
+			memcpy(dp, v[i], len);
+			blk->v[i] = dp;
+			dp += len;
+		}
+	}
+	blk->v[n] = NULL;
+	blk->base = bblk;
+	blk->depth = bblk->depth + 1;
+	bblk->refs++;
+	deltas++;
+	return blk;
+}
+
+/*
+ * Build a new block holding a full copy of v, the strings of which are
+ * contiguous in memory, starting at strs and spanning sz bytes.
+ */
+static aev_blk_t *
+aev_blk_new_full(char **v, size_t n, const char *strs, size_t sz) {
+	aev_blk_t *blk;
+	char *dp;
+
+	blk = malloc(sizeof(aev_blk_t) + sizeof(char *) * (n + 1) + sz);
+	if (!blk)
+		return NULL;
+	bzero(blk, sizeof(aev_blk_t));
+	blk->sz = sizeof(aev_blk_t) + sizeof(char *) * (n + 1) + sz;
+	dp = (char *)&blk->v[n+1];
+	memcpy(dp, strs, sz);
+	for (size_t i = 0; i < n; i++)
+		blk->v[i] = dp + (v[i] - strs);
+	blk->v[n] = NULL;
+	return blk;
+}
+
+/*
+ * Intern vector v, which must have been created by aev_new() or
+ * aev_new_prefix(), and free it.  Returns a shared vector with the same
+ * content, or NULL with errno set to ENOMEM.  If base is not NULL, it must be
+ * an interned vector, which is used as the delta base if v is new and only
+ * differs from base in a few strings, such as the environment of the parent
+ * process.
+ *
+ * Thread-safe.
+ */
+char **
+aev_intern(char **v, char **base) {
+	aev_lookup_t lookup;
+	aev_blk_t *blk;
+	tommy_hash_t h;
+	const char *strs;
+	size_t n, sz;
+
+	for (n = 0; v[n]; n++);
+	assert(n > 0);
+	strs = v[0];
+	sz = (size_t)(v[n-1] - strs) + strlen(v[n-1]) + 1;
+	lookup.key = XXH3_128bits(strs, sz);
+	lookup.v = v;
+	h = (tommy_hash_t)lookup.key.low64;
+
+	pthread_mutex_lock(&mutex);
+	if (!initialized) {
+		tommy_hashdyn_init(&pool);
+		initialized = true;
+	}
+	blk = tommy_hashdyn_search(&pool, aev_blk_cmp, &lookup, h);
+	if (blk) {
+		blk->refs++;
+		hits++;
+		goto out;
+	}
+	if (base)
+		blk = aev_blk_new_delta(v, n, base);
+	if (!blk)
+		blk = aev_blk_new_full(v, n, strs, sz);
+	if (!blk) {
+		pthread_mutex_unlock(&mutex);
+		free(v);
+		errno = ENOMEM;
+		return NULL;
+	}
+	blk->key = lookup.key;
+	blk->refs = 1;
+	blk->fullsz = sizeof(char *) * (n + 1) + sz;
+	tommy_hashdyn_insert(&pool, &blk->node, blk, h);
+	bytes += blk->sz;
+out:
+	refbytes += blk->fullsz;
+	pthread_mutex_unlock(&mutex);
+	free(v);
+	return blk->v;
+}
+
+/*
+ * Take another reference to an interned vector.
+ */
+char **
+aev_ref(char **v) {
+	aev_blk_t *blk = AEV_BLK(v);
+
+	pthread_mutex_lock(&mutex);
+	assert(blk->refs > 0);
+	blk->refs++;
+	refbytes += blk->fullsz;
+	hits++;
+	pthread_mutex_unlock(&mutex);
+	return v;
+}
+
+/*
+ * Release a reference to an interned vector, and to its delta bases if it
+ * was the last reference.
+ */
+void
+aev_unref(char **v) {
+	aev_blk_t *blk = AEV_BLK(v);
+	aev_blk_t *base;
+
+	pthread_mutex_lock(&mutex);
+	refbytes -= blk->fullsz;
+	while (blk) {
+		assert(blk->refs > 0);
+		if (--blk->refs > 0)
+			break;
+		base = blk->base;
+		tommy_hashdyn_remove_existing(&pool, &blk->node);
+		if (base)
+			deltas--;
+		bytes -= blk->sz + blk->rendersz;
+		aev_blk_free(blk);
+		blk = base;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Returns true if more than one reference to the interned vector v exists,
+ * i.e. if it is likely to be rendered more than once.
+ */
+bool
+aev_shared(char **v) {
+	bool shared;
+
+	pthread_mutex_lock(&mutex);
+	shared = AEV_BLK(v)->refs > 1;
+	pthread_mutex_unlock(&mutex);
+	return shared;
+}
+
+/*
+ * Look up a cached serialization of interned vector v, rendered by fmt for
+ * label.  The buffer remains valid for as long as the caller holds its
+ * reference to v.
+ */
+bool
+aev_render_get(char **v, const void *fmt, const char *label,
+               const char **buf, size_t *sz) {
+	aev_blk_t *blk = AEV_BLK(v);
+	bool found;
+
+	pthread_mutex_lock(&mutex);
+	found = blk->render && blk->renderfmt == fmt &&
+	        !strcmp(blk->renderlabel, label);
+	if (found) {
+		*buf = blk->render;
+		*sz = blk->rendersz;
+		renders++;
+	}
+	pthread_mutex_unlock(&mutex);
+	return found;
+}
+
+/*
+ * Store a serialization of interned vector v, rendered by fmt for label.
+ * Ownership of buf is transfered; label must be a static string.
+ */
+void
+aev_render_put(char **v, const void *fmt, const char *label,
+               char *buf, size_t sz) {
+	aev_blk_t *blk = AEV_BLK(v);
+
+	pthread_mutex_lock(&mutex);
+	if (blk->render) {
+		pthread_mutex_unlock(&mutex);
+		free(buf);
+		return;
+	}
+	blk->renderfmt = fmt;
+	blk->renderlabel = label;
+	blk->render = buf;
+	blk->rendersz = sz;
+	bytes += sz;
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Free all vectors still in the pool.
+ */
+void
+aev_fini(void) {
+	pthread_mutex_lock(&mutex);
+	if (initialized) {
+		tommy_hashdyn_foreach(&pool, aev_blk_free);
+		tommy_hashdyn_done(&pool);
+		initialized = false;
+	}
+	deltas = 0;
+	bytes = 0;
+	refbytes = 0;
+	hits = 0;
+	renders = 0;
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+aev_stats(aev_stat_t *st) {
+	pthread_mutex_lock(&mutex);
+	st->blocks = initialized ? tommy_hashdyn_count(&pool) : 0;
+	st->deltas = deltas;
+	st->bytes = bytes;
+	st->refbytes = refbytes;
+	st->hits = hits;
+	st->renders = renders;
+	pthread_mutex_unlock(&mutex);
+}
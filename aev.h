@@ -14,9 +14,33 @@
 #include "attrib.h"
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	uint32_t blocks;        /* unique vectors in pool */
+	uint32_t deltas;        /* of which stored as delta to a base */
+	uint64_t bytes;         /* bytes held by pool, including renders */
+	uint64_t refbytes;      /* bytes that private copies would hold */
+	uint64_t hits;          /* vectors found in pool */
+	uint64_t renders;       /* serializations reused */
+} aev_stat_t;
 
 char ** aev_new(size_t, char **) MALLOC;
 char ** aev_new_prefix(size_t, char **, const char *) MALLOC;
+char ** aev_new_bounded(size_t, char **, const char *, size_t, bool *)
+        MALLOC NONNULL(5);
+
+char ** aev_intern(char **, char **) NONNULL(1) WUNRES;
+char ** aev_ref(char **) NONNULL(1);
+void aev_unref(char **) NONNULL(1);
+bool aev_shared(char **) NONNULL(1) WUNRES;
+bool aev_render_get(char **, const void *, const char *,
+                    const char **, size_t *) NONNULL(1,2,3,4,5) WUNRES;
+void aev_render_put(char **, const void *, const char *,
+                    char *, size_t) NONNULL(1,2,3,4);
+void aev_fini(void);
+void aev_stats(aev_stat_t *) NONNULL(1);
 
 #endif
 
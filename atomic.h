@@ -43,10 +43,10 @@
 #include <stdint.h>
 #define atomic32_t              volatile uint32_t
 #define atomic64_t              volatile uint64_t
-#define atomic32_fenced_inc(X)  __sync_add_and_fetch(X, 1)
-#define atomic64_fenced_inc(X)  __sync_add_and_fetch(X, 1)
-#define atomic32_fenced_dec(X)  __sync_sub_and_fetch(X, 1)
-#define atomic64_fenced_dec(X)  __sync_sub_and_fetch(X, 1)
+#define atomic32_fenced_inc(X)  __sync_fetch_and_add(X, 1)
+#define atomic64_fenced_inc(X)  __sync_fetch_and_add(X, 1)
+#define atomic32_fenced_dec(X)  __sync_fetch_and_sub(X, 1)
+#define atomic64_fenced_dec(X)  __sync_fetch_and_sub(X, 1)
 inline atomic32_t
 atomic32_fenced_load(atomic32_t *ptr) {
 	atomic32_t x;
@@ -111,6 +111,9 @@ const uint16_t auclass_xnumon_events_filemon[] = {
 	AUE_FCLONEFILEAT, /* fclonefileat */
 	AUE_UNLINK,     /* unlink */
 	AUE_UNLINKAT,   /* unlinkat */
+	AUE_RMDIR,      /* rmdir, for cached directory invalidation */
+	AUE_MOUNT,      /* mount, ditto */
+	AUE_UNMOUNT,    /* unmount, ditto */
 	/*
 	 * AUE_CREAT          - syscall not implemented on macOS
 	 * AUE_UTIME          - syscall not implemented on macOS
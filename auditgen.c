@@ -0,0 +1,1156 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Test utility generating synthetic BSM audit trails for benchmarks and soak
+ * tests.  Writes records of the kinds xnumon consumes, in the token layout
+ * produced by XNU, at a configurable rate and mix of fork, exec, posix_spawn,
+ * exit, socket, accept, close, ptrace and task_for_pid records.
+ *
+ * Processes form a tree below a synthetic session root spawned by launchd,
+ * with bounded depth and fanout; new processes preferably descend from the
+ * most recently started one, yielding shell-like chains next to broad
+ * subtrees.  A number of long-lived servers hold many open file descriptors
+ * and accept connections throughout the run.  Synthetic pids start above the
+ * macOS pid_max and thus never collide with live processes.
+ *
+ * The trail can be written to a file or a FIFO and fed to xnumon -t, or be
+ * inspected with praudit(1).
+ */
+
+#include "attrib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <sys/ptrace.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <bsm/libbsm.h>
+#include <bsm/audit_kevents.h>
+#include <bsm/audit_domain.h>
+#include <bsm/audit_socket_type.h>
+
+#ifndef __BSD__
+#include <getopt.h>
+#endif /* !__BSD__ */
+
+#define PIDBASE         100000  /* above macOS pid_max */
+#define RECBUF_SIZE     8192
+#define MAXIMAGES       64
+#define MAXFDS          64      /* per transient process */
+#define PENDQ_SIZE      256     /* forked processes awaiting exec */
+
+#define UID_USER        501
+#define GID_STAFF       20
+
+static void
+fusage(FILE *f, const char *argv0) {
+	fprintf(f,
+"Usage: %s [-f] [-o trail] [-r rate] [-n count] [-d secs] [-m mix]\n"
+"       [-P procs] [-D depth] [-B fanout] [-S servers] [-F fds]\n"
+"       [-p pid] [-s seed] [-i image ...]\n"
+" -o trail       write records to trail (file or FIFO) instead of stdout\n"
+" -r rate        records per second, 0 for unpaced (default 1000)\n"
+" -f             do not sleep; stamp records as if paced at rate\n"
+" -n count       stop after count records (default unlimited)\n"
+" -d secs        stop after secs seconds of trail time (default unlimited)\n"
+" -m mix         comma-separated kind=weight list; kinds are fork, exec,\n"
+"                spawn, exit, socket, accept, close, ptrace and tfp\n"
+"                (default fork=10,exec=15,spawn=5,exit=15,socket=15,\n"
+"                accept=15,close=20,ptrace=1,tfp=4)\n"
+" -P procs       max live transient processes (default 1024)\n"
+" -D depth       max process tree depth (default 8)\n"
+" -B fanout      max live children per process (default 16)\n"
+" -S servers     long-lived server processes (default 4)\n"
+" -F fds         open file descriptors per server (default 1024)\n"
+" -p pid         first synthetic pid (default %i)\n"
+" -s seed        random seed (default time)\n"
+" -i image       add executable image path; the first given replaces the\n"
+"                default list of system binaries\n"
+, argv0, PIDBASE);
+}
+
+enum {
+	KIND_FORK,
+	KIND_EXEC,
+	KIND_SPAWN,
+	KIND_EXIT,
+	KIND_SOCKET,
+	KIND_ACCEPT,
+	KIND_CLOSE,
+	KIND_PTRACE,
+	KIND_TFP,
+	KIND_SIZE
+};
+
+static const char *kind_names[KIND_SIZE] = {
+	"fork", "exec", "spawn", "exit", "socket",
+	"accept", "close", "ptrace", "tfp"
+};
+
+static unsigned int kind_weights[KIND_SIZE] = {
+	10, 15, 5, 15, 15, 15, 20, 1, 4
+};
+
+static const char *default_images[] = {
+	"/bin/sh",
+	"/bin/bash",
+	"/bin/ls",
+	"/bin/cat",
+	"/bin/ps",
+	"/bin/date",
+	"/usr/bin/env",
+	"/usr/bin/grep",
+	"/usr/bin/sed",
+	"/usr/bin/awk",
+	"/usr/bin/git",
+	"/usr/bin/curl",
+	"/usr/bin/ssh",
+	"/usr/bin/codesign",
+	"/usr/sbin/sysctl",
+	"/usr/libexec/xpcproxy",
+};
+
+#define SERVER_IMAGE    "/usr/sbin/sshd"
+#define ROOT_IMAGE      "/usr/bin/login"
+#define IMAGE_ROOT      -1
+#define IMAGE_SERVER    -2
+
+typedef struct {
+	const char *path;
+	struct stat st;
+} image_t;
+
+typedef struct {
+	pid_t pid;
+	pid_t ppid;
+	int parent;             /* slot of parent, -1 if none */
+	int live;               /* position in live, -1 if slot unused */
+	int depth;
+	int children;           /* live children */
+	int image;              /* index into images or IMAGE_* */
+	bool server;
+	bool pending;           /* forked, awaiting exec */
+	uid_t uid;
+	int nfds;               /* fds above 2, or accepted fds for servers */
+	uint64_t sockets;       /* bit set for fds that are sockets */
+} proc_t;
+
+typedef struct {
+	unsigned char buf[RECBUF_SIZE];
+	size_t len;
+} rec_t;
+
+/* options */
+static const char *trail = NULL;
+static uint64_t rate = 1000;
+static bool fast = false;
+static uint64_t maxrecs = 0;
+static uint64_t maxsecs = 0;
+static int maxprocs = 1024;
+static int maxdepth = 8;
+static int maxfanout = 16;
+static int nservers = 4;
+static int serverfds = 1024;
+static pid_t nextpid = PIDBASE;
+static uint64_t seed = 0;
+
+/* state */
+static image_t images[MAXIMAGES];
+static size_t nimages = 0;
+static image_t server_image;
+static image_t root_image;
+static proc_t *procs;
+static int nslots;
+static int *live;
+static int nlive;
+static int ntransient;
+static int root;
+static int last;                /* most recently started transient slot */
+static int pendq[PENDQ_SIZE];
+static size_t pendq_head, pendq_tail;
+static uint32_t devnull;
+
+static FILE *f;
+static rec_t rec;
+static struct timespec t0;
+static uint64_t nrecs;
+static uint64_t nbytes;
+static uint64_t kind_counts[KIND_SIZE];
+static uint64_t rng;
+static volatile sig_atomic_t active = 1;
+
+static void
+handle_sig(UNUSED int signum) {
+	active = 0;
+}
+
+/*
+ * xorshift64*; good enough for shaping workloads.
+ */
+static uint64_t
+rand64(void) {
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 2685821657736338717ULL;
+}
+
+static unsigned int
+rand_below(unsigned int n) {
+	assert(n > 0);
+	return (unsigned int)((rand64() >> 32) % n);
+}
+
+/*
+ * Skewed towards low indices, so that a few images account for most execs.
+ */
+static unsigned int
+rand_skewed(unsigned int n) {
+	return rand_below(rand_below(n) + 1);
+}
+
+static uint64_t
+hash_str(const char *s) {
+	uint64_t h = 14695981039346656037ULL;
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static void
+image_init(image_t *image, const char *path) {
+	image->path = path;
+	if (stat(path, &image->st) == -1) {
+		/* synthesize plausible attributes for missing images */
+		bzero(&image->st, sizeof(image->st));
+		image->st.st_mode = S_IFREG|0755;
+		image->st.st_dev = 1;
+		image->st.st_ino = (ino_t)hash_str(path);
+	}
+}
+
+/*
+ * Record and token construction; BSM is big endian throughout.
+ */
+
+static void
+put_u8(rec_t *r, uint8_t v) {
+	assert(r->len + 1 <= sizeof(r->buf));
+	r->buf[r->len++] = v;
+}
+
+static void
+put_u16(rec_t *r, uint16_t v) {
+	put_u8(r, (uint8_t)(v >> 8));
+	put_u8(r, (uint8_t)v);
+}
+
+static void
+put_u32(rec_t *r, uint32_t v) {
+	put_u16(r, (uint16_t)(v >> 16));
+	put_u16(r, (uint16_t)v);
+}
+
+static void
+put_u64(rec_t *r, uint64_t v) {
+	put_u32(r, (uint32_t)(v >> 32));
+	put_u32(r, (uint32_t)v);
+}
+
+static void
+put_bytes(rec_t *r, const void *p, size_t sz) {
+	assert(r->len + sz <= sizeof(r->buf));
+	memcpy(r->buf + r->len, p, sz);
+	r->len += sz;
+}
+
+static void
+put_str(rec_t *r, const char *s) {
+	put_bytes(r, s, strlen(s) + 1);
+}
+
+static void
+tok_arg32(rec_t *r, uint8_t no, const char *text, uint32_t val) {
+	put_u8(r, AUT_ARG32);
+	put_u8(r, no);
+	put_u32(r, val);
+	put_u16(r, (uint16_t)(strlen(text) + 1));
+	put_str(r, text);
+}
+
+static void
+tok_return32(rec_t *r, uint32_t val) {
+	put_u8(r, AUT_RETURN32);
+	put_u8(r, 0);
+	put_u32(r, val);
+}
+
+static void
+tok_proc32(rec_t *r, uint8_t id, proc_t *proc) {
+	put_u8(r, id);
+	put_u32(r, proc->uid);                  /* auid */
+	put_u32(r, proc->uid);                  /* euid */
+	put_u32(r, GID_STAFF);                  /* egid */
+	put_u32(r, proc->uid);                  /* ruid */
+	put_u32(r, GID_STAFF);                  /* rgid */
+	put_u32(r, (uint32_t)proc->pid);
+	put_u32(r, (uint32_t)procs[root].pid);  /* sid */
+	put_u32(r, devnull);                    /* no tty */
+	put_u32(r, 0);                          /* no addr */
+}
+
+static void
+tok_path(rec_t *r, const char *path) {
+	put_u8(r, AUT_PATH);
+	put_u16(r, (uint16_t)(strlen(path) + 1));
+	put_str(r, path);
+}
+
+static void
+tok_attr32(rec_t *r, struct stat *st) {
+	put_u8(r, AUT_ATTR32);
+	put_u32(r, st->st_mode);
+	put_u32(r, st->st_uid);
+	put_u32(r, st->st_gid);
+	put_u32(r, (uint32_t)st->st_dev);
+	put_u64(r, st->st_ino);
+	put_u32(r, 0);                          /* rdev */
+}
+
+static void
+tok_exec_strs(rec_t *r, uint8_t id, const char *strs[], size_t n) {
+	put_u8(r, id);
+	put_u32(r, (uint32_t)n);
+	for (size_t i = 0; i < n; i++)
+		put_str(r, strs[i]);
+}
+
+static void
+tok_exit(rec_t *r, uint32_t status) {
+	put_u8(r, AUT_EXIT);
+	put_u32(r, status);
+	put_u32(r, 0);
+}
+
+static void
+tok_sockinet(rec_t *r, bool v6, const uint8_t addr[16], uint16_t port) {
+	uint16_t nport;
+
+	if (!v6) {
+		put_u8(r, AUT_SOCKINET32);
+		put_u16(r, BSM_PF_INET);
+		nport = htons(port);
+		put_bytes(r, &nport, sizeof(nport));
+		put_bytes(r, addr, 4);
+	} else {
+		/* XNU writes AUT_SOCKINET128 ports in host byte order,
+		 * see radar 43063872 in auevent.c */
+		put_u8(r, AUT_SOCKINET128);
+		put_u16(r, BSM_PF_INET6);
+		put_bytes(r, &port, sizeof(port));
+		put_bytes(r, addr, 16);
+	}
+}
+
+/*
+ * Returns the timestamp of the next record without pacing.
+ */
+static void
+trail_tv(struct timespec *tv) {
+	uint64_t ns;
+
+	if (rate == 0) {
+		clock_gettime(CLOCK_REALTIME, tv);
+		return;
+	}
+	ns = (nrecs / rate) * 1000000000ULL +
+	     (nrecs % rate) * 1000000000ULL / rate;
+	tv->tv_sec = t0.tv_sec + (time_t)(ns / 1000000000ULL);
+	tv->tv_nsec = t0.tv_nsec + (long)(ns % 1000000000ULL);
+	if (tv->tv_nsec >= 1000000000L) {
+		tv->tv_sec++;
+		tv->tv_nsec -= 1000000000L;
+	}
+}
+
+/*
+ * Returns the timestamp of the next record, sleeping as needed to keep the
+ * configured rate unless running unpaced or fast.
+ */
+static void
+next_tv(struct timespec *tv) {
+	struct timespec now, ts;
+
+	trail_tv(tv);
+	if (rate == 0 || fast)
+		return;
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (tv->tv_sec > now.tv_sec ||
+	    (tv->tv_sec == now.tv_sec && tv->tv_nsec > now.tv_nsec + 1000000)) {
+		fflush(f);
+		ts.tv_sec = tv->tv_sec - now.tv_sec;
+		ts.tv_nsec = tv->tv_nsec - now.tv_nsec;
+		if (ts.tv_nsec < 0) {
+			ts.tv_sec--;
+			ts.tv_nsec += 1000000000L;
+		}
+		nanosleep(&ts, NULL);
+	}
+}
+
+static bool
+done(void) {
+	struct timespec tv;
+
+	if (!active)
+		return true;
+	if (maxrecs && nrecs >= maxrecs)
+		return true;
+	if (maxsecs) {
+		trail_tv(&tv);
+		if (tv.tv_sec > t0.tv_sec + (time_t)maxsecs ||
+		    (tv.tv_sec == t0.tv_sec + (time_t)maxsecs &&
+		     tv.tv_nsec >= t0.tv_nsec))
+			return true;
+	}
+	return false;
+}
+
+static void
+rec_begin(uint16_t type) {
+	struct timespec tv;
+
+	next_tv(&tv);
+	rec.len = 0;
+	put_u8(&rec, AUT_HEADER32);
+	put_u32(&rec, 0);                       /* size, see rec_end */
+	put_u8(&rec, AUDIT_HEADER_VERSION_OPENBSM);
+	put_u16(&rec, type);
+	put_u16(&rec, 0);                       /* modifier */
+	put_u32(&rec, (uint32_t)tv.tv_sec);
+	put_u32(&rec, (uint32_t)(tv.tv_nsec / 1000000));
+}
+
+static void
+rec_end(proc_t *subject, uint32_t retval) {
+	uint32_t size;
+
+	tok_proc32(&rec, AUT_SUBJECT32, subject);
+	tok_return32(&rec, retval);
+	size = (uint32_t)rec.len + 7;
+	put_u8(&rec, AUT_TRAILER);
+	put_u16(&rec, AUT_TRAILER_MAGIC);
+	put_u32(&rec, size);
+	rec.buf[1] = (uint8_t)(size >> 24);
+	rec.buf[2] = (uint8_t)(size >> 16);
+	rec.buf[3] = (uint8_t)(size >> 8);
+	rec.buf[4] = (uint8_t)size;
+
+	if (fwrite(rec.buf, rec.len, 1, f) != 1) {
+		if (active)
+			fprintf(stderr, "fwrite(): %s (%i)\n",
+			                strerror(errno), errno);
+		active = 0;
+	}
+	nrecs++;
+	nbytes += rec.len;
+}
+
+/*
+ * Process table.
+ */
+
+static int
+proc_new(int parent, int image, bool server) {
+	proc_t *proc;
+	int slot;
+
+	for (slot = 0; slot < nslots; slot++) {
+		if (procs[slot].live == -1)
+			break;
+	}
+	assert(slot < nslots);
+	proc = &procs[slot];
+	bzero(proc, sizeof(proc_t));
+	proc->pid = nextpid++;
+	proc->parent = parent;
+	if (parent != -1) {
+		proc->ppid = procs[parent].pid;
+		proc->depth = procs[parent].depth + 1;
+		procs[parent].children++;
+	} else {
+		proc->ppid = 1;
+	}
+	proc->image = image;
+	proc->server = server;
+	proc->uid = server ? 0 : UID_USER;
+	proc->live = nlive;
+	live[nlive++] = slot;
+	if (!server && parent != -1)
+		ntransient++;
+	return slot;
+}
+
+static void
+proc_free(int slot) {
+	proc_t *proc = &procs[slot];
+	int moved;
+
+	if (proc->parent != -1 && procs[proc->parent].live != -1 &&
+	    procs[proc->parent].pid == proc->ppid)
+		procs[proc->parent].children--;
+	moved = live[--nlive];
+	live[proc->live] = moved;
+	procs[moved].live = proc->live;
+	proc->live = -1;
+	ntransient--;
+	if (last == slot)
+		last = -1;
+}
+
+static image_t *
+proc_image(proc_t *proc) {
+	switch (proc->image) {
+	case IMAGE_ROOT:
+		return &root_image;
+	case IMAGE_SERVER:
+		return &server_image;
+	default:
+		return &images[proc->image];
+	}
+}
+
+/*
+ * Returns a random live transient process, or -1 if there is none.
+ */
+static int
+pick_transient(bool leaf) {
+	int slot = -1;
+
+	if (ntransient == 0)
+		return -1;
+	for (int i = 0; i < 8; i++) {
+		slot = live[rand_below((unsigned int)nlive)];
+		if (procs[slot].server || slot == root)
+			continue;
+		if (!leaf || procs[slot].children == 0)
+			return slot;
+	}
+	/* fall back to a linear scan from a random position */
+	for (int i = 0, j = (int)rand_below((unsigned int)nlive);
+	     i < nlive; i++) {
+		slot = live[(i + j) % nlive];
+		if (!procs[slot].server && slot != root)
+			return slot;
+	}
+	return -1;
+}
+
+static bool
+can_parent(int slot) {
+	return slot != -1 && procs[slot].live != -1 &&
+	       procs[slot].depth < maxdepth &&
+	       procs[slot].children < maxfanout;
+}
+
+/*
+ * Prefer the most recently started process, yielding shell-like chains,
+ * otherwise pick a random one with room for children.
+ */
+static int
+pick_parent(void) {
+	int slot;
+
+	if (rand_below(4) != 0 && can_parent(last))
+		return last;
+	for (int i = 0; i < 8; i++) {
+		slot = live[rand_below((unsigned int)nlive)];
+		if (can_parent(slot))
+			return slot;
+	}
+	return root;
+}
+
+/*
+ * Records.
+ */
+
+static void
+emit_exec_tokens(proc_t *proc) {
+	char arg[16];
+	const char *argv[3];
+	const char *envv[] = {
+		"PATH=/usr/bin:/bin:/usr/sbin:/sbin",
+		"HOME=/Users/auditgen",
+		"LANG=en_US.UTF-8",
+	};
+	image_t *image = proc_image(proc);
+	const char *base = strrchr(image->path, '/');
+
+	snprintf(arg, sizeof(arg), "%u", rand_skewed(64));
+	argv[0] = base ? base + 1 : image->path;
+	argv[1] = proc->server ? "-D" : "-n";
+	argv[2] = arg;
+	tok_exec_strs(&rec, AUT_EXEC_ARGS, argv, 3);
+	tok_exec_strs(&rec, AUT_EXEC_ENV, envv, sizeof(envv)/sizeof(envv[0]));
+	tok_path(&rec, image->path);
+	tok_path(&rec, image->path);
+	tok_attr32(&rec, &image->st);
+}
+
+static void
+emit_spawn(int parent, int child) {
+	rec_begin(AUE_POSIX_SPAWN);
+	tok_arg32(&rec, 0, "child PID", (uint32_t)procs[child].pid);
+	emit_exec_tokens(&procs[child]);
+	rec_end(&procs[parent], 0);
+}
+
+static void
+emit_exec(int slot) {
+	rec_begin(AUE_EXECVE);
+	emit_exec_tokens(&procs[slot]);
+	rec_end(&procs[slot], 0);
+}
+
+static void
+file_path(char *buf, size_t sz, proc_t *proc, int fd) {
+	snprintf(buf, sz, "/private/var/tmp/auditgen.%i.%i", proc->pid, fd);
+}
+
+static void
+emit_file_attr(const char *path) {
+	struct stat st;
+
+	bzero(&st, sizeof(st));
+	st.st_mode = S_IFREG|0644;
+	st.st_uid = UID_USER;
+	st.st_gid = GID_STAFF;
+	st.st_dev = 1;
+	st.st_ino = (ino_t)hash_str(path);
+	tok_attr32(&rec, &st);
+}
+
+static void
+emit_open(int slot, int fd) {
+	char path[64];
+
+	file_path(path, sizeof(path), &procs[slot], fd);
+	rec_begin(AUE_OPEN_RWC);
+	tok_arg32(&rec, 2, "flags", O_RDWR|O_CREAT);
+	tok_arg32(&rec, 3, "mode", 0644);
+	tok_path(&rec, path);
+	tok_path(&rec, path);
+	emit_file_attr(path);
+	rec_end(&procs[slot], (uint32_t)fd);
+}
+
+static void
+emit_close(int slot, int fd, bool file) {
+	char path[64];
+
+	rec_begin(AUE_CLOSE);
+	tok_arg32(&rec, 2, "fd", (uint32_t)fd);
+	if (file) {
+		file_path(path, sizeof(path), &procs[slot], fd);
+		tok_path(&rec, path);
+		tok_path(&rec, path);
+		emit_file_attr(path);
+	}
+	rec_end(&procs[slot], 0);
+}
+
+static void
+emit_socket(int slot, int fd, bool v6) {
+	rec_begin(AUE_SOCKET);
+	tok_arg32(&rec, 1, "domain", v6 ? BSM_PF_INET6 : BSM_PF_INET);
+	tok_arg32(&rec, 2, "type", BSM_SOCK_STREAM);
+	tok_arg32(&rec, 3, "protocol", IPPROTO_TCP);
+	rec_end(&procs[slot], (uint32_t)fd);
+}
+
+static void
+emit_sockaddr(uint16_t type, int slot, int fd, bool v6,
+              const uint8_t addr[16], uint16_t port, uint32_t retval) {
+	rec_begin(type);
+	tok_arg32(&rec, 1, "fd", (uint32_t)fd);
+	tok_sockinet(&rec, v6, addr, port);
+	rec_end(&procs[slot], retval);
+}
+
+static void
+emit_listen(int slot, int fd) {
+	rec_begin(AUE_LISTEN);
+	tok_arg32(&rec, 1, "fd", (uint32_t)fd);
+	tok_arg32(&rec, 2, "backlog", 128);
+	rec_end(&procs[slot], 0);
+}
+
+static void
+emit_exit(int slot) {
+	rec_begin(AUE_EXIT);
+	tok_arg32(&rec, 1, "exit status", 0);
+	tok_exit(&rec, 0);
+	rec_end(&procs[slot], 0);
+}
+
+/*
+ * Peers from the documentation address ranges; few enough to repeat.
+ */
+static void
+peer_addr(uint8_t addr[16], bool v6, unsigned int n) {
+	static const uint8_t nets[3][3] = {
+		{192, 0, 2}, {198, 51, 100}, {203, 0, 113}
+	};
+
+	bzero(addr, 16);
+	if (!v6) {
+		memcpy(addr, nets[n % 3], 3);
+		addr[3] = (uint8_t)(1 + n % 64);
+	} else {
+		addr[0] = 0x20;
+		addr[1] = 0x01;
+		addr[2] = 0x0d;
+		addr[3] = 0xb8;
+		addr[15] = (uint8_t)(1 + n % 64);
+	}
+}
+
+/*
+ * Workload operations.
+ */
+
+static void op_exit(void);
+
+static void
+op_spawn(bool fork) {
+	int parent, child;
+
+	if (ntransient >= maxprocs) {
+		op_exit();
+		return;
+	}
+	parent = pick_parent();
+	if (fork) {
+		child = proc_new(parent, procs[parent].image, false);
+		procs[child].pending = true;
+		pendq[pendq_tail++ % PENDQ_SIZE] = child;
+		rec_begin(AUE_FORK);
+		tok_arg32(&rec, 0, "child PID", (uint32_t)procs[child].pid);
+		rec_end(&procs[parent], (uint32_t)procs[child].pid);
+	} else {
+		child = proc_new(parent, (int)rand_skewed((unsigned int)nimages),
+		                 false);
+		emit_spawn(parent, child);
+	}
+	last = child;
+}
+
+static void
+op_exec(void) {
+	int slot = -1;
+
+	/* forked processes typically exec soon after */
+	while (pendq_head != pendq_tail) {
+		slot = pendq[pendq_head++ % PENDQ_SIZE];
+		if (procs[slot].live != -1 && procs[slot].pending)
+			break;
+		slot = -1;
+	}
+	if (slot == -1)
+		slot = pick_transient(false);
+	if (slot == -1) {
+		op_spawn(false);
+		return;
+	}
+	procs[slot].pending = false;
+	procs[slot].image = (int)rand_skewed((unsigned int)nimages);
+	emit_exec(slot);
+	last = slot;
+}
+
+static void
+op_exit(void) {
+	int slot;
+
+	slot = pick_transient(true);
+	if (slot == -1) {
+		op_spawn(false);
+		return;
+	}
+	emit_exit(slot);
+	proc_free(slot);
+}
+
+static void
+op_socket(void) {
+	uint8_t addr[16];
+	static const uint16_t ports[] = {443, 80, 22, 53, 993, 5223, 8080};
+	unsigned int n;
+	bool v6;
+	proc_t *proc;
+	int slot, fd;
+
+	slot = pick_transient(false);
+	if (slot == -1) {
+		op_spawn(false);
+		return;
+	}
+	proc = &procs[slot];
+	if (proc->nfds == MAXFDS) {
+		fd = 3 + --proc->nfds;
+		emit_close(slot, fd, !(proc->sockets & (1ULL << proc->nfds)));
+		return;
+	}
+	fd = 3 + proc->nfds;
+	proc->sockets |= 1ULL << proc->nfds;
+	proc->nfds++;
+	n = rand_skewed(192);
+	v6 = (n % 8) == 7;
+	peer_addr(addr, v6, n);
+	emit_socket(slot, fd, v6);
+	emit_sockaddr(AUE_CONNECT, slot, fd, v6, addr,
+	              ports[n % (sizeof(ports)/sizeof(ports[0]))], 0);
+}
+
+static void
+op_accept(void) {
+	uint8_t addr[16];
+	unsigned int n;
+	proc_t *proc;
+	int slot, fd;
+
+	if (nservers == 0) {
+		op_socket();
+		return;
+	}
+	slot = live[1 + rand_below((unsigned int)nservers)];
+	proc = &procs[slot];
+	assert(proc->server);
+	if (proc->nfds >= MAXFDS) {
+		/* close the most recently accepted connection */
+		fd = 4 + serverfds + --proc->nfds;
+		emit_close(slot, fd, false);
+		return;
+	}
+	fd = 4 + serverfds + proc->nfds++;
+	n = rand_skewed(192);
+	peer_addr(addr, false, n);
+	emit_sockaddr(AUE_ACCEPT, slot, 3, false, addr,
+	              (uint16_t)(49152 + rand_below(16384)), (uint32_t)fd);
+}
+
+static void
+op_close(void) {
+	proc_t *proc;
+	int slot, fd;
+
+	if (nservers > 0 && rand_below(4) == 0) {
+		slot = live[1 + rand_below((unsigned int)nservers)];
+		proc = &procs[slot];
+		if (proc->nfds > 0) {
+			fd = 4 + serverfds + --proc->nfds;
+			emit_close(slot, fd, false);
+		} else if (serverfds > 0) {
+			/* reopen one of the long-lived files */
+			fd = 4 + (int)rand_below((unsigned int)serverfds);
+			emit_close(slot, fd, true);
+			emit_open(slot, fd);
+		}
+		return;
+	}
+	slot = pick_transient(false);
+	if (slot == -1) {
+		op_spawn(false);
+		return;
+	}
+	proc = &procs[slot];
+	if (proc->nfds == 0 || (proc->nfds < MAXFDS && rand_below(2))) {
+		fd = 3 + proc->nfds;
+		proc->sockets &= ~(1ULL << proc->nfds);
+		proc->nfds++;
+		emit_open(slot, fd);
+		return;
+	}
+	fd = 3 + --proc->nfds;
+	emit_close(slot, fd, !(proc->sockets & (1ULL << proc->nfds)));
+}
+
+static void
+op_access(bool ptrace) {
+	int subject, object;
+
+	subject = pick_transient(false);
+	object = live[rand_below((unsigned int)nlive)];
+	if (subject == -1 || subject == object) {
+		op_spawn(false);
+		return;
+	}
+	if (ptrace) {
+		rec_begin(AUE_PTRACE);
+		tok_arg32(&rec, 1, "request", PT_ATTACHEXC);
+	} else {
+		rec_begin(AUE_TASKFORPID);
+	}
+	tok_arg32(&rec, 2, "pid", (uint32_t)procs[object].pid);
+	tok_proc32(&rec, AUT_PROCESS32, &procs[object]);
+	rec_end(&procs[subject], 0);
+}
+
+/*
+ * Spawn the session root from launchd and the servers from the root; each
+ * server listens on a port and holds serverfds open files.
+ */
+static void
+setup(void) {
+	proc_t launchd;
+	uint8_t any[16];
+	int slot;
+
+	bzero(&launchd, sizeof(launchd));
+	launchd.pid = 1;
+	launchd.live = -1;
+
+	root = proc_new(-1, IMAGE_ROOT, false);
+	procs[root].uid = 0;
+	rec_begin(AUE_POSIX_SPAWN);
+	tok_arg32(&rec, 0, "child PID", (uint32_t)procs[root].pid);
+	emit_exec_tokens(&procs[root]);
+	rec_end(&launchd, 0);
+
+	bzero(any, sizeof(any));
+	for (int i = 0; i < nservers && active; i++) {
+		slot = proc_new(root, IMAGE_SERVER, true);
+		emit_spawn(root, slot);
+		emit_socket(slot, 3, false);
+		emit_sockaddr(AUE_BIND, slot, 3, false, any,
+		              (uint16_t)(8000 + i), 0);
+		emit_listen(slot, 3);
+		for (int fd = 4; fd < 4 + serverfds && active; fd++)
+			emit_open(slot, fd);
+	}
+	last = -1;
+}
+
+static int
+parse_mix(char *mix) {
+	char *tok, *val;
+	int k;
+
+	bzero(kind_weights, sizeof(kind_weights));
+	for (tok = strtok(mix, ","); tok; tok = strtok(NULL, ",")) {
+		val = strchr(tok, '=');
+		if (!val)
+			return -1;
+		*val++ = '\0';
+		for (k = 0; k < KIND_SIZE; k++) {
+			if (!strcmp(tok, kind_names[k]))
+				break;
+		}
+		if (k == KIND_SIZE)
+			return -1;
+		kind_weights[k] = (unsigned int)atoi(val);
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int total, r;
+	struct stat st;
+	int ch, k;
+	const char *argv0 = argv[0];
+
+	while ((ch = getopt(argc, argv, "o:r:fn:d:m:P:D:B:S:F:p:s:i:h")) != -1) {
+		switch (ch) {
+			case 'o':
+				trail = optarg;
+				break;
+			case 'r':
+				rate = strtoull(optarg, NULL, 10);
+				break;
+			case 'f':
+				fast = true;
+				break;
+			case 'n':
+				maxrecs = strtoull(optarg, NULL, 10);
+				break;
+			case 'd':
+				maxsecs = strtoull(optarg, NULL, 10);
+				break;
+			case 'm':
+				if (parse_mix(optarg) == -1) {
+					fprintf(stderr, "%s: invalid mix\n",
+					                argv0);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'P':
+				maxprocs = atoi(optarg);
+				break;
+			case 'D':
+				maxdepth = atoi(optarg);
+				break;
+			case 'B':
+				maxfanout = atoi(optarg);
+				break;
+			case 'S':
+				nservers = atoi(optarg);
+				break;
+			case 'F':
+				serverfds = atoi(optarg);
+				break;
+			case 'p':
+				nextpid = atoi(optarg);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'i':
+				if (nimages == MAXIMAGES) {
+					fprintf(stderr, "%s: too many images\n",
+					                argv0);
+					exit(EXIT_FAILURE);
+				}
+				image_init(&images[nimages++], optarg);
+				break;
+			case 'h':
+				fusage(stdout, argv0);
+				exit(EXIT_SUCCESS);
+			case '?':
+				exit(EXIT_FAILURE);
+			default:
+				fusage(stderr, argv0);
+				exit(EXIT_FAILURE);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 0) {
+		fusage(stderr, argv0);
+		exit(EXIT_FAILURE);
+	}
+
+	total = 0;
+	for (k = 0; k < KIND_SIZE; k++)
+		total += kind_weights[k];
+	if (total == 0 || maxprocs < 1 || maxdepth < 1 || maxfanout < 1 ||
+	    nservers < 0 || serverfds < 0 || nextpid < 2) {
+		fprintf(stderr, "%s: invalid parameters\n", argv0);
+		exit(EXIT_FAILURE);
+	}
+
+	if (nimages == 0) {
+		for (size_t i = 0; i < sizeof(default_images) /
+		                       sizeof(default_images[0]); i++)
+			image_init(&images[nimages++], default_images[i]);
+	}
+	image_init(&server_image, SERVER_IMAGE);
+	image_init(&root_image, ROOT_IMAGE);
+	devnull = (stat("/dev/null", &st) == 0) ? (uint32_t)st.st_rdev : 0;
+
+	nslots = maxprocs + nservers + 1;
+	procs = malloc(sizeof(proc_t) * (size_t)nslots);
+	live = malloc(sizeof(int) * (size_t)nslots);
+	if (!procs || !live) {
+		fprintf(stderr, "%s: out of memory\n", argv0);
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < nslots; i++)
+		procs[i].live = -1;
+
+	if (trail) {
+		/* opening a FIFO blocks until the reader opens it */
+		if ((f = fopen(trail, "w")) == NULL) {
+			fprintf(stderr, "fopen(%s): %s (%i)\n",
+			                trail, strerror(errno), errno);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		f = stdout;
+	}
+
+	signal(SIGINT, handle_sig);
+	signal(SIGQUIT, handle_sig);
+	signal(SIGTERM, handle_sig);
+	signal(SIGPIPE, SIG_IGN);
+
+	rng = seed ? seed : (uint64_t)time(NULL);
+	rng |= 1;
+	clock_gettime(CLOCK_REALTIME, &t0);
+
+	/* the root and the servers never exit and thus keep the first
+	 * positions in live, see op_accept */
+	setup();
+
+	while (!done()) {
+		r = rand_below(total);
+		for (k = 0; r >= kind_weights[k]; k++)
+			r -= kind_weights[k];
+		kind_counts[k]++;
+		switch (k) {
+		case KIND_FORK:
+			op_spawn(true);
+			break;
+		case KIND_EXEC:
+			op_exec();
+			break;
+		case KIND_SPAWN:
+			op_spawn(false);
+			break;
+		case KIND_EXIT:
+			op_exit();
+			break;
+		case KIND_SOCKET:
+			op_socket();
+			break;
+		case KIND_ACCEPT:
+			op_accept();
+			break;
+		case KIND_CLOSE:
+			op_close();
+			break;
+		case KIND_PTRACE:
+			op_access(true);
+			break;
+		case KIND_TFP:
+			op_access(false);
+			break;
+		}
+	}
+
+	if (fclose(f) == EOF)
+		fprintf(stderr, "fclose(): %s (%i)\n", strerror(errno), errno);
+	fprintf(stderr, "%"PRIu64" records, %"PRIu64" bytes, "
+	                "%i live processes, next pid %i\n",
+	                nrecs, nbytes, nlive, nextpid);
+	for (k = 0; k < KIND_SIZE; k++)
+		fprintf(stderr, "%s:%"PRIu64" ", kind_names[k], kind_counts[k]);
+	fprintf(stderr, "\n");
+	free(procs);
+	free(live);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,118 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#include "aueprof.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#ifndef CLOCK_MONOTONIC
+#include <mach/mach_time.h>
+#endif
+
+/*
+ * Open addressing hash table keyed by audit event type.  The number of
+ * distinct audit event types is bounded by the audit class mask in use and
+ * in practice far below SLOTS; should the table ever fill up, remaining
+ * types are accounted to type 0.
+ */
+#define SLOTS 512
+
+static aueprof_entry_t slots[SLOTS];
+static bool slotused[SLOTS];
+static size_t types;
+
+/*
+ * Monotonic time in nsec.  clock_gettime(2) is only available on macOS 10.12
+ * and later, older SDKs fall back to mach_absolute_time(3).
+ */
+uint64_t
+aueprof_now(void) {
+#ifdef CLOCK_MONOTONIC
+	struct timespec tv;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tv) == -1)
+		return 0;
+	return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_nsec;
+#else
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0 && mach_timebase_info(&tb) != KERN_SUCCESS)
+		return 0;
+	return mach_absolute_time() * tb.numer / tb.denom;
+#endif
+}
+
+static aueprof_entry_t *
+aueprof_lookup(uint16_t type) {
+	size_t i = (type * 40503u) % SLOTS;
+
+	for (size_t n = 0; n < SLOTS; n++) {
+		if (!slotused[i]) {
+			if (types == SLOTS - 1 && type != 0)
+				break;
+			slotused[i] = true;
+			slots[i].type = type;
+			types++;
+			return &slots[i];
+		}
+		if (slots[i].type == type)
+			return &slots[i];
+		i = (i + 1) % SLOTS;
+	}
+	/* table full, fall back to type 0 */
+	return type == 0 ? NULL : aueprof_lookup(0);
+}
+
+void
+aueprof_record(uint16_t type, size_t bytes, uint64_t parsetime,
+               uint64_t handletime) {
+	aueprof_entry_t *e;
+
+	e = aueprof_lookup(type);
+	if (!e)
+		return;
+	e->count++;
+	e->parsetime += parsetime;
+	e->handletime += handletime;
+	e->bytes += bytes;
+}
+
+static int
+aueprof_cmp(const void *a, const void *b) {
+	const aueprof_entry_t *ea = a, *eb = b;
+	uint64_t ta = ea->parsetime + ea->handletime;
+	uint64_t tb = eb->parsetime + eb->handletime;
+
+	if (ta == tb)
+		return 0;
+	return ta > tb ? -1 : 1;
+}
+
+void
+aueprof_stats(aueprof_stat_t *st) {
+	aueprof_entry_t all[SLOTS];
+	size_t n = 0;
+
+	assert(st);
+
+	for (size_t i = 0; i < SLOTS; i++) {
+		if (slotused[i])
+			all[n++] = slots[i];
+	}
+	qsort(all, n, sizeof(aueprof_entry_t), aueprof_cmp);
+	st->types = n;
+	st->top_count = n < AUEPROF_TOP ? n : AUEPROF_TOP;
+	memcpy(st->top, all, st->top_count * sizeof(aueprof_entry_t));
+}
+
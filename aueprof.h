@@ -0,0 +1,44 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef AUEPROF_H
+#define AUEPROF_H
+
+#include "attrib.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Per audit event type dispatch profile of the event loop.  Not thread-safe;
+ * must only be used from the event loop thread.
+ */
+typedef struct {
+	uint16_t type;          /* AUE_* */
+	uint64_t count;
+	uint64_t parsetime;     /* nsec reading and parsing records */
+	uint64_t handletime;    /* nsec in event handlers */
+	uint64_t bytes;         /* bytes of audit records */
+} aueprof_entry_t;
+
+#define AUEPROF_TOP 16
+
+typedef struct {
+	size_t types;           /* number of audit event types seen */
+	size_t top_count;       /* number of valid entries in top */
+	aueprof_entry_t top[AUEPROF_TOP]; /* by total time, descending */
+} aueprof_stat_t;
+
+uint64_t aueprof_now(void);
+void aueprof_record(uint16_t, size_t, uint64_t, uint64_t);
+void aueprof_stats(aueprof_stat_t *) NONNULL(1);
+
+#endif
+
@@ -128,6 +128,7 @@ auevent_fread(audit_event_t *ev, const uint16_t aues[], int flags, FILE *f) {
 	}
 	if (reclen == 0)
 		goto skip_rec;
+	ev->reclen = (size_t)reclen;
 
 	textc = 0;
 	pathc = 0;
@@ -424,7 +425,18 @@ auevent_fread(audit_event_t *ev, const uint16_t aues[], int flags, FILE *f) {
 			assert(ev->execenv == NULL);
 			if (ev->execenv)
 				free(ev->execenv);
-			if (flags & AUEVENT_FLAG_ENV_DYLD) {
+			if (flags & AUEVENT_FLAG_ENV_TRUNC) {
+				bool truncated;
+				ev->execenv = aev_new_bounded(
+				              tok.tt.execenv.count,
+				              tok.tt.execenv.text,
+				              (flags & AUEVENT_FLAG_ENV_DYLD) ?
+				              "DYLD_" : NULL,
+				              AUEVENT_ENV_TRUNCSZ,
+				              &truncated);
+				if (truncated)
+					ev->flags |= AEFLAG_ENVTRUNC;
+			} else if (flags & AUEVENT_FLAG_ENV_DYLD) {
 				ev->execenv = aev_new_prefix(
 				              tok.tt.execenv.count,
 				              tok.tt.execenv.text,
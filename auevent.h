@@ -56,8 +56,10 @@ typedef struct {
 
 typedef struct {
 	u_char *        recbuf;                 /* free */
+	size_t          reclen;
 	int             flags;
 #define AEFLAG_ENOMEM 1                         /* ENOMEM encountered */
+#define AEFLAG_ENVTRUNC 2                       /* execenv truncated */
 
 	uint16_t        type;
 	uint16_t        mod;
@@ -104,6 +106,8 @@ ssize_t auevent_fread(audit_event_t *ev, const uint16_t[], int, FILE *)
         NONNULL(1,4);
 #define AUEVENT_FLAG_ENV_DYLD 1
 #define AUEVENT_FLAG_ENV_FULL 2
+#define AUEVENT_FLAG_ENV_TRUNC 4        /* bound env to AUEVENT_ENV_TRUNCSZ */
+#define AUEVENT_ENV_TRUNCSZ 1024
 void auevent_destroy(audit_event_t *) NONNULL(1);
 void auevent_fprint(FILE *, audit_event_t *) NONNULL(1,2);
 
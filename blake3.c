@@ -0,0 +1,347 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * BLAKE3 in default hashing mode with 256 bit output, as specified in
+ * https://github.com/BLAKE3-team/BLAKE3-specs.
+ *
+ * The input is split into 1 KiB chunks which form the leaves of a binary
+ * tree.  Runs of four whole chunks are compressed side by side in SSE2
+ * registers, one chunk per 32 bit lane; the remaining chunks, the tree's
+ * parent nodes and the root are compressed with the portable code.  A full
+ * chunk is only added to the tree once more input arrives, because the last
+ * chunk must be finalized as root if it is the only one.
+ */
+
+#include "blake3.h"
+
+#include <string.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BLAKE3_SSE2
+#endif
+
+#define CHUNK_START     (1 << 0)
+#define CHUNK_END       (1 << 1)
+#define PARENT          (1 << 2)
+#define ROOT            (1 << 3)
+
+static const uint32_t blake3_iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+/* message word permutation applied cumulatively for each of the 7 rounds */
+static const uint8_t blake3_sched[7][16] = {
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+	{ 2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8},
+	{ 3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1},
+	{10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6},
+	{12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4},
+	{ 9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7},
+	{11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13}
+};
+
+static inline uint32_t
+load32(const uint8_t *p) {
+	return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void
+store32(uint8_t *p, uint32_t w) {
+	p[0] = (uint8_t)w;
+	p[1] = (uint8_t)(w >> 8);
+	p[2] = (uint8_t)(w >> 16);
+	p[3] = (uint8_t)(w >> 24);
+}
+
+#define ROTR32(x, n)    (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define G(s, a, b, c, d, x, y) \
+	do { \
+		s[a] = s[a] + s[b] + (x); \
+		s[d] = ROTR32(s[d] ^ s[a], 16); \
+		s[c] = s[c] + s[d]; \
+		s[b] = ROTR32(s[b] ^ s[c], 12); \
+		s[a] = s[a] + s[b] + (y); \
+		s[d] = ROTR32(s[d] ^ s[a], 8); \
+		s[c] = s[c] + s[d]; \
+		s[b] = ROTR32(s[b] ^ s[c], 7); \
+	} while (0)
+
+/*
+ * Compress one block of message words m into out.  The first 8 words of out
+ * are the chaining value; all 16 words are only needed for root output.
+ */
+static void
+blake3_compress(uint32_t out[16], const uint32_t cv[8], const uint32_t m[16],
+                uint64_t counter, uint32_t blocklen, uint32_t flags) {
+	uint32_t s[16];
+	const uint8_t *r;
+
+	memcpy(s, cv, 8 * sizeof(uint32_t));
+	memcpy(s + 8, blake3_iv, 4 * sizeof(uint32_t));
+	s[12] = (uint32_t)counter;
+	s[13] = (uint32_t)(counter >> 32);
+	s[14] = blocklen;
+	s[15] = flags;
+
+	for (int i = 0; i < 7; i++) {
+		r = blake3_sched[i];
+		G(s, 0, 4,  8, 12, m[r[ 0]], m[r[ 1]]);
+		G(s, 1, 5,  9, 13, m[r[ 2]], m[r[ 3]]);
+		G(s, 2, 6, 10, 14, m[r[ 4]], m[r[ 5]]);
+		G(s, 3, 7, 11, 15, m[r[ 6]], m[r[ 7]]);
+		G(s, 0, 5, 10, 15, m[r[ 8]], m[r[ 9]]);
+		G(s, 1, 6, 11, 12, m[r[10]], m[r[11]]);
+		G(s, 2, 7,  8, 13, m[r[12]], m[r[13]]);
+		G(s, 3, 4,  9, 14, m[r[14]], m[r[15]]);
+	}
+
+	for (int i = 0; i < 8; i++) {
+		out[i] = s[i] ^ s[i + 8];
+		out[i + 8] = s[i + 8] ^ cv[i];
+	}
+}
+
+static void
+blake3_load_block(uint32_t m[16], const uint8_t *block) {
+	for (int i = 0; i < 16; i++)
+		m[i] = load32(block + i * 4);
+}
+
+#ifdef BLAKE3_SSE2
+#define ADD(a, b)       _mm_add_epi32((a), (b))
+#define XOR(a, b)       _mm_xor_si128((a), (b))
+#define ROTR(x, n)      _mm_or_si128(_mm_srli_epi32((x), (n)), \
+                                     _mm_slli_epi32((x), 32 - (n)))
+#define ROTR16(x)       _mm_shufflehi_epi16(_mm_shufflelo_epi16((x), 0xB1), \
+                                            0xB1)
+
+#define G4(v, a, b, c, d, x, y) \
+	do { \
+		v[a] = ADD(ADD(v[a], v[b]), (x)); \
+		v[d] = ROTR16(XOR(v[d], v[a])); \
+		v[c] = ADD(v[c], v[d]); \
+		v[b] = ROTR(XOR(v[b], v[c]), 12); \
+		v[a] = ADD(ADD(v[a], v[b]), (y)); \
+		v[d] = ROTR(XOR(v[d], v[a]), 8); \
+		v[c] = ADD(v[c], v[d]); \
+		v[b] = ROTR(XOR(v[b], v[c]), 7); \
+	} while (0)
+
+/*
+ * Transpose four rows of four words, turning the same four message words of
+ * four chunks into four vectors of one message word each.
+ */
+static inline void
+blake3_transpose4(__m128i *m, const uint8_t *in, size_t off) {
+	__m128i a, b, c, d, ablo, abhi, cdlo, cdhi;
+
+	a = _mm_loadu_si128((const __m128i *)(in + 0 * BLAKE3_CHUNKSZ + off));
+	b = _mm_loadu_si128((const __m128i *)(in + 1 * BLAKE3_CHUNKSZ + off));
+	c = _mm_loadu_si128((const __m128i *)(in + 2 * BLAKE3_CHUNKSZ + off));
+	d = _mm_loadu_si128((const __m128i *)(in + 3 * BLAKE3_CHUNKSZ + off));
+	ablo = _mm_unpacklo_epi32(a, b);
+	abhi = _mm_unpackhi_epi32(a, b);
+	cdlo = _mm_unpacklo_epi32(c, d);
+	cdhi = _mm_unpackhi_epi32(c, d);
+	m[0] = _mm_unpacklo_epi64(ablo, cdlo);
+	m[1] = _mm_unpackhi_epi64(ablo, cdlo);
+	m[2] = _mm_unpacklo_epi64(abhi, cdhi);
+	m[3] = _mm_unpackhi_epi64(abhi, cdhi);
+}
+
+/*
+ * Compress four whole consecutive chunks at in, the first of which has chunk
+ * index counter, into their four chaining values.
+ */
+static void
+blake3_hash4(uint32_t cvs[4][8], const uint8_t *in, uint64_t counter) {
+	__m128i h[8], v[16], m[16], lo, hi, blen;
+	uint32_t out[8][4];
+	const uint8_t *r;
+	uint32_t flags;
+
+	for (int i = 0; i < 8; i++)
+		h[i] = _mm_set1_epi32((int)blake3_iv[i]);
+	lo = _mm_set_epi32((int)(uint32_t)(counter + 3),
+	                   (int)(uint32_t)(counter + 2),
+	                   (int)(uint32_t)(counter + 1),
+	                   (int)(uint32_t)(counter));
+	hi = _mm_set_epi32((int)(uint32_t)((counter + 3) >> 32),
+	                   (int)(uint32_t)((counter + 2) >> 32),
+	                   (int)(uint32_t)((counter + 1) >> 32),
+	                   (int)(uint32_t)(counter >> 32));
+	blen = _mm_set1_epi32(BLAKE3_BLOCKSZ);
+
+	for (size_t blk = 0; blk < BLAKE3_CHUNKSZ / BLAKE3_BLOCKSZ; blk++) {
+		for (size_t i = 0; i < 4; i++)
+			blake3_transpose4(&m[i * 4], in,
+			                  blk * BLAKE3_BLOCKSZ + i * 16);
+		flags = 0;
+		if (blk == 0)
+			flags |= CHUNK_START;
+		if (blk == BLAKE3_CHUNKSZ / BLAKE3_BLOCKSZ - 1)
+			flags |= CHUNK_END;
+		for (int i = 0; i < 8; i++)
+			v[i] = h[i];
+		for (int i = 0; i < 4; i++)
+			v[i + 8] = _mm_set1_epi32((int)blake3_iv[i]);
+		v[12] = lo;
+		v[13] = hi;
+		v[14] = blen;
+		v[15] = _mm_set1_epi32((int)flags);
+
+		for (int i = 0; i < 7; i++) {
+			r = blake3_sched[i];
+			G4(v, 0, 4,  8, 12, m[r[ 0]], m[r[ 1]]);
+			G4(v, 1, 5,  9, 13, m[r[ 2]], m[r[ 3]]);
+			G4(v, 2, 6, 10, 14, m[r[ 4]], m[r[ 5]]);
+			G4(v, 3, 7, 11, 15, m[r[ 6]], m[r[ 7]]);
+			G4(v, 0, 5, 10, 15, m[r[ 8]], m[r[ 9]]);
+			G4(v, 1, 6, 11, 12, m[r[10]], m[r[11]]);
+			G4(v, 2, 7,  8, 13, m[r[12]], m[r[13]]);
+			G4(v, 3, 4,  9, 14, m[r[14]], m[r[15]]);
+		}
+
+		for (int i = 0; i < 8; i++)
+			h[i] = XOR(v[i], v[i + 8]);
+	}
+
+	for (int i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i *)out[i], h[i]);
+	for (int j = 0; j < 4; j++)
+		for (int i = 0; i < 8; i++)
+			cvs[j][i] = out[i][j];
+}
+#endif /* BLAKE3_SSE2 */
+
+void
+blake3_init(blake3_ctx_t *ctx) {
+	memcpy(ctx->cv, blake3_iv, sizeof(ctx->cv));
+	ctx->chunk = 0;
+	ctx->buflen = 0;
+	ctx->blocks = 0;
+	ctx->stacklen = 0;
+}
+
+/*
+ * Add the chaining value of chunk number total - 1 to the tree, merging
+ * completed subtrees: the number of trailing zero bits in the total number
+ * of chunks is the number of subtrees that are complete after this chunk.
+ */
+static void
+blake3_push(blake3_ctx_t *ctx, const uint32_t cv[8], uint64_t total) {
+	uint32_t m[16], out[16];
+
+	memcpy(m + 8, cv, 8 * sizeof(uint32_t));
+	while (!(total & 1)) {
+		assert(ctx->stacklen > 0);
+		memcpy(m, ctx->stack[--ctx->stacklen], 8 * sizeof(uint32_t));
+		blake3_compress(out, blake3_iv, m, 0, BLAKE3_BLOCKSZ, PARENT);
+		memcpy(m + 8, out, 8 * sizeof(uint32_t));
+		total >>= 1;
+	}
+	assert(ctx->stacklen < BLAKE3_STACKSZ);
+	memcpy(ctx->stack[ctx->stacklen++], m + 8, 8 * sizeof(uint32_t));
+}
+
+void
+blake3_update(blake3_ctx_t *ctx, const void *data, size_t n) {
+	const uint8_t *p = data;
+	uint32_t m[16], out[16];
+	size_t take;
+
+	while (n > 0) {
+		if (ctx->blocks * BLAKE3_BLOCKSZ + ctx->buflen ==
+		    BLAKE3_CHUNKSZ) {
+			blake3_load_block(m, ctx->buf);
+			blake3_compress(out, ctx->cv, m, ctx->chunk,
+			                BLAKE3_BLOCKSZ, CHUNK_END);
+			ctx->chunk++;
+			blake3_push(ctx, out, ctx->chunk);
+			memcpy(ctx->cv, blake3_iv, sizeof(ctx->cv));
+			ctx->buflen = 0;
+			ctx->blocks = 0;
+		}
+#ifdef BLAKE3_SSE2
+		if (ctx->buflen == 0 && ctx->blocks == 0) {
+			uint32_t cvs[4][8];
+
+			while (n > 4 * BLAKE3_CHUNKSZ) {
+				blake3_hash4(cvs, p, ctx->chunk);
+				for (int i = 0; i < 4; i++) {
+					ctx->chunk++;
+					blake3_push(ctx, cvs[i], ctx->chunk);
+				}
+				p += 4 * BLAKE3_CHUNKSZ;
+				n -= 4 * BLAKE3_CHUNKSZ;
+			}
+		}
+#endif
+		if (ctx->buflen == BLAKE3_BLOCKSZ) {
+			blake3_load_block(m, ctx->buf);
+			blake3_compress(out, ctx->cv, m, ctx->chunk,
+			                BLAKE3_BLOCKSZ,
+			                ctx->blocks == 0 ? CHUNK_START : 0);
+			memcpy(ctx->cv, out, sizeof(ctx->cv));
+			ctx->blocks++;
+			ctx->buflen = 0;
+		}
+		take = BLAKE3_BLOCKSZ - ctx->buflen;
+		if (take > n)
+			take = n;
+		memcpy(ctx->buf + ctx->buflen, p, take);
+		ctx->buflen += take;
+		p += take;
+		n -= take;
+	}
+}
+
+/*
+ * Write the 32 byte digest to digest.  Does not modify the tree, but ctx
+ * must not be updated afterwards.
+ */
+void
+blake3_final(unsigned char *digest, blake3_ctx_t *ctx) {
+	uint32_t cv[8], m[16], out[16];
+	uint64_t counter;
+	uint32_t blocklen, flags;
+	size_t i;
+
+	/* output node of the current chunk */
+	memset(ctx->buf + ctx->buflen, 0, BLAKE3_BLOCKSZ - ctx->buflen);
+	blake3_load_block(m, ctx->buf);
+	memcpy(cv, ctx->cv, sizeof(cv));
+	counter = ctx->chunk;
+	blocklen = ctx->buflen;
+	flags = CHUNK_END | (ctx->blocks == 0 ? CHUNK_START : 0);
+
+	/* fold the stack of subtrees from right to left */
+	i = ctx->stacklen;
+	while (i > 0) {
+		blake3_compress(out, cv, m, counter, blocklen, flags);
+		memcpy(m, ctx->stack[--i], 8 * sizeof(uint32_t));
+		memcpy(m + 8, out, 8 * sizeof(uint32_t));
+		memcpy(cv, blake3_iv, sizeof(cv));
+		counter = 0;
+		blocklen = BLAKE3_BLOCKSZ;
+		flags = PARENT;
+	}
+	blake3_compress(out, cv, m, counter, blocklen, flags | ROOT);
+
+	for (i = 0; i < 8; i++)
+		store32(digest + i * 4, out[i]);
+}
+
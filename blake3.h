@@ -0,0 +1,39 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include "attrib.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLAKE3SZ        32
+#define BLAKE3_BLOCKSZ  64
+#define BLAKE3_CHUNKSZ  1024
+#define BLAKE3_STACKSZ  54      /* 2^54 chunks is more than 2^64 bytes */
+
+typedef struct {
+	uint32_t cv[8];                 /* chaining value of current chunk */
+	uint64_t chunk;                 /* index of current chunk */
+	uint8_t buf[BLAKE3_BLOCKSZ];
+	uint8_t buflen;
+	uint8_t blocks;                 /* blocks compressed in chunk */
+	uint8_t stacklen;
+	uint32_t stack[BLAKE3_STACKSZ][8];
+} blake3_ctx_t;
+
+void blake3_init(blake3_ctx_t *) NONNULL(1);
+void blake3_update(blake3_ctx_t *, const void *, size_t) NONNULL(1,2);
+void blake3_final(unsigned char *, blake3_ctx_t *) NONNULL(1,2);
+
+#endif
+
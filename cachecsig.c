@@ -20,7 +20,7 @@
 #define CACHECSIG_BUCKETS       LRUCACHE_BUCKETS
 
 typedef struct {
-	hashes_t hashes;
+	unsigned char key[HASHES_KEYSZ];
 	codesign_t *codesign;
 
 	lrucache_node_t node;
@@ -48,14 +48,21 @@ cachecsig_obj_free(void *vobj) {
 
 static lrucache_t lrucache;
 static pthread_mutex_t mutex;
+static int hflags;
+static size_t keysz;
 
+/*
+ * Key the cache on the strongest of the configured digests only; hashing
+ * and comparing the full hashes_t would only add cycles.
+ */
 void
-cachecsig_init(void) {
+cachecsig_init(int flags) {
 	pthread_mutex_init(&mutex, NULL);
-	/* we could use only MD5SZ if we were sure that MD5 is present */
+	hflags = flags;
+	keysz = hashes_keysz(flags);
 	lrucache_init(&lrucache, CACHECSIG_BUCKETS,
-	              sizeof(hashes_t), sizeof(hashes_t), 0,
-	              cachecsig_obj_free);
+	              sizeof(cachecsig_obj_t) + sizeof(codesign_t),
+	              keysz, keysz, 0, cachecsig_obj_free);
 }
 
 void
@@ -71,11 +78,13 @@ codesign_t *
 cachecsig_get(hashes_t *hashes) {
 	cachecsig_obj_t *obj;
 	codesign_t *cs;
+	unsigned char *key;
 
 	assert(hashes);
 
+	key = hashes_key(hashes, hflags);
 	pthread_mutex_lock(&mutex);
-	obj = lrucache_get(&lrucache, hashes);
+	obj = lrucache_get(&lrucache, key);
 #ifdef DEBUG_CACHE
 	fprintf(stderr, "DEBUG_CACHE: codesig get %s\n",
 	                obj ? "HIT" : "MISS");
@@ -92,6 +101,7 @@ cachecsig_get(hashes_t *hashes) {
 void
 cachecsig_put(hashes_t *hashes, codesign_t *codesign) {
 	cachecsig_obj_t *obj;
+	unsigned char *key;
 
 	assert(hashes);
 	assert(codesign);
@@ -103,13 +113,31 @@ cachecsig_put(hashes_t *hashes, codesign_t *codesign) {
 	obj = cachecsig_obj_new();
 	if (!obj)
 		return;
-	memcpy(&obj->hashes, hashes, sizeof(hashes_t));
+	key = hashes_key(hashes, hflags);
+	memcpy(obj->key, key, keysz);
 	obj->codesign = codesign_dup(codesign);
 	pthread_mutex_lock(&mutex);
 	lrucache_put(&lrucache, &obj->node, obj);
 	pthread_mutex_unlock(&mutex);
 }
 
+/*
+ * Limit the cache to pct percent of its size under memory pressure.
+ */
+void
+cachecsig_scale(unsigned int pct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_scale(&lrucache, pct);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cachecsig_adapt(unsigned int minpct, unsigned int maxpct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_adapt(&lrucache, minpct, maxpct);
+	pthread_mutex_unlock(&mutex);
+}
+
 void
 cachecsig_stats(lrucache_stat_t *st) {
 	pthread_mutex_lock(&mutex);
@@ -16,10 +16,12 @@
 #include "codesign.h"
 #include "attrib.h"
 
-void cachecsig_init(void);
+void cachecsig_init(int);
 void cachecsig_fini(void);
 codesign_t * cachecsig_get(hashes_t *) MALLOC NONNULL(1);
 void cachecsig_put(hashes_t *, codesign_t *) NONNULL(1,2);
+void cachecsig_scale(unsigned int);
+void cachecsig_adapt(unsigned int, unsigned int);
 void cachecsig_stats(lrucache_stat_t *) NONNULL(1);
 
 #endif
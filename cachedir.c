@@ -0,0 +1,335 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Cache for resolved directories, keyed by the unresolved absolute directory
+ * portion of a path.  Resolving a path with realpath(3) costs one lstat per
+ * path component; with a cached directory, a path is resolved with a single
+ * getattrlist(2) on the last component, which also yields its on-disk name
+ * like realpath(3) does, falling back to realpath(3) if it turns out to be a
+ * symlink.
+ *
+ * Since symlinks can make any cached entry depend on any directory, the
+ * cache is flushed as a whole on changes to the namespace that can affect
+ * how directories resolve; renames and unlinks of regular files, which are
+ * the common case, do not.  Entries expire after CACHEDIR_TTL seconds to
+ * bound the effect of changes not observed through audit events.
+ */
+
+#include "cachedir.h"
+
+#include "sys.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/attr.h>
+#include <sys/vnode.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define CACHEDIR_BUCKETS        2048
+#define CACHEDIR_TTL            60      /* sec */
+#define CACHEDIR_STRSZ          128     /* typical udir and rdir, accounting */
+
+typedef struct {
+	XXH128_hash_t key;      /* of udir */
+	char *udir;
+	char *rdir;
+	time_t expiry;
+	lrucache_node_t node;
+} cachedir_obj_t;
+
+static void
+cachedir_obj_free(void *vobj) {
+	cachedir_obj_t *obj = vobj;
+	assert(obj);
+	if (obj->udir)
+		free(obj->udir);
+	if (obj->rdir)
+		free(obj->rdir);
+	free(obj);
+}
+
+static lrucache_t lrucache;
+static pthread_mutex_t mutex;
+static uint64_t expired;
+static uint64_t fastpaths;
+static uint64_t flushes;
+
+/*
+ * Returns a newly allocated copy of the resolved directory for the absolute
+ * unresolved directory udir, or NULL with errno set.  Must be called with
+ * mutex held.
+ */
+static char *
+cachedir_resolve(const char *udir) {
+	cachedir_obj_t *obj;
+	XXH128_hash_t key;
+	char *rdir, *udircp;
+	time_t now;
+
+	key = XXH3_128bits(udir, strlen(udir));
+	now = time(NULL);
+	obj = lrucache_get(&lrucache, &key);
+	if (obj) {
+		if (obj->expiry > now && !strcmp(obj->udir, udir))
+			return strdup(obj->rdir);
+		if (obj->expiry <= now)
+			expired++;
+	}
+
+	rdir = realpath(udir, NULL);
+	if (!rdir)
+		return NULL;
+
+	if (obj) {
+		/* expired or hash collision, reuse in place */
+		udircp = strdup(udir);
+		if (!udircp)
+			return rdir;
+		free(obj->udir);
+		obj->udir = udircp;
+	} else {
+		obj = malloc(sizeof(cachedir_obj_t));
+		if (!obj)
+			return rdir;
+		bzero(obj, sizeof(cachedir_obj_t));
+		obj->key = key;
+		obj->udir = strdup(udir);
+		if (!obj->udir) {
+			free(obj);
+			return rdir;
+		}
+		lrucache_put(&lrucache, &obj->node, obj);
+	}
+	if (obj->rdir)
+		free(obj->rdir);
+	obj->rdir = strdup(rdir);
+	obj->expiry = obj->rdir ? now + CACHEDIR_TTL : 0;
+	return rdir;
+}
+
+/*
+ * Returns a newly allocated absolute unresolved path constructed from path and
+ * cwd, or NULL with errno set.  Returns NULL with errno 0 if path is relative
+ * and there is no cwd.
+ */
+static char *
+cachedir_abspath(const char *restrict path, const char *restrict cwd) {
+	char *upath;
+
+	if (path[0] == '/')
+		return strdup(path);
+	if (!cwd)
+		return NULL;
+	if (asprintf(&upath, "%s/%s", cwd, path) == -1)
+		return NULL;
+	return upath;
+}
+
+/*
+ * Resolve the directory portion of path through the cache and append the
+ * unresolved file portion.  Returns NULL if the path is not suitable for the
+ * cache, with *fallback set to true.
+ */
+static char *
+cachedir_resolve_dir(const char *restrict path, const char *restrict cwd,
+                     bool *fallback) {
+	char *upath, *sep, *rdir, *res;
+	int rerrno;
+
+	*fallback = false;
+	errno = 0;
+	upath = cachedir_abspath(path, cwd);
+	if (!upath)
+		return NULL;
+	sep = strrchr(upath, '/');
+	assert(sep);
+	if (sep == upath || !sep[1] ||
+	    !strcmp(sep + 1, ".") || !strcmp(sep + 1, "..")) {
+		/* entries in the root dir, trailing slashes, dot entries */
+		free(upath);
+		*fallback = true;
+		return NULL;
+	}
+	*sep = '\0';
+	pthread_mutex_lock(&mutex);
+	rdir = cachedir_resolve(upath);
+	pthread_mutex_unlock(&mutex);
+	if (!rdir) {
+		rerrno = errno;
+		free(upath);
+		errno = rerrno;
+		return NULL;
+	}
+	if (asprintf(&res, "%s/%s",
+	             strcmp(rdir, "/") ? rdir : "", sep + 1) == -1)
+		res = NULL;
+	rerrno = errno;
+	free(rdir);
+	free(upath);
+	errno = rerrno;
+	return res;
+}
+
+typedef struct {
+	uint32_t len;
+	attrreference_t name;
+	fsobj_type_t type;
+	char buf[NAME_MAX * 3 + 1];
+} __attribute__((aligned(4), packed)) cachedir_attrs_t;
+
+/*
+ * Drop-in replacement for sys_realpath.  Like realpath(3), the last path
+ * component is returned as spelled on disk, which matters on case-insensitive
+ * file systems.  Names not matching case-insensitively, as with hard links,
+ * are kept as spelled by the caller.
+ */
+char *
+cachedir_realpath(const char *restrict path, const char *restrict cwd) {
+	static struct attrlist al = {
+		.bitmapcount = ATTR_BIT_MAP_COUNT,
+		.commonattr = ATTR_CMN_NAME|ATTR_CMN_OBJTYPE,
+	};
+	cachedir_attrs_t attrs;
+	char *res, *rp, *sep, *name;
+	size_t dirsz, namesz;
+	bool fallback;
+	int rerrno;
+
+	if (!path) {
+		errno = 0;
+		return NULL;
+	}
+	res = cachedir_resolve_dir(path, cwd, &fallback);
+	if (fallback)
+		return sys_realpath(path, cwd);
+	if (!res)
+		return NULL;
+	if (getattrlist(res, &al, &attrs, sizeof(attrs), FSOPT_NOFOLLOW) == -1) {
+		rerrno = errno;
+		free(res);
+		errno = rerrno;
+		return NULL;
+	}
+	if (attrs.type == VLNK) {
+		rp = realpath(res, NULL);
+		rerrno = errno;
+		free(res);
+		errno = rerrno;
+		return rp;
+	}
+	name = (char *)&attrs.name + attrs.name.attr_dataoffset;
+	sep = strrchr(res, '/');
+	assert(sep);
+	if (attrs.name.attr_length > 0 &&
+	    name + attrs.name.attr_length <= (char *)&attrs + sizeof(attrs) &&
+	    strcmp(sep + 1, name) && !strcasecmp(sep + 1, name)) {
+		dirsz = sep - res + 1;
+		namesz = strlen(name) + 1;
+		rp = malloc(dirsz + namesz);
+		if (!rp) {
+			rerrno = errno;
+			free(res);
+			errno = rerrno;
+			return NULL;
+		}
+		memcpy(rp, res, dirsz);
+		memcpy(rp + dirsz, name, namesz);
+		free(res);
+		res = rp;
+	}
+	pthread_mutex_lock(&mutex);
+	fastpaths++;
+	pthread_mutex_unlock(&mutex);
+	return res;
+}
+
+/*
+ * Drop-in replacement for sys_realdir.
+ */
+char *
+cachedir_realdir(const char *restrict path, const char *restrict cwd) {
+	char *res;
+	bool fallback;
+
+	res = cachedir_resolve_dir(path, cwd, &fallback);
+	if (fallback)
+		return sys_realdir(path, cwd);
+	return res;
+}
+
+/*
+ * Drop all cached directories after a change to the namespace.
+ */
+void
+cachedir_flush(void) {
+	pthread_mutex_lock(&mutex);
+	lrucache_flush(&lrucache);
+	flushes++;
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cachedir_init(void) {
+	pthread_mutex_init(&mutex, NULL);
+	expired = 0;
+	fastpaths = 0;
+	flushes = 0;
+	lrucache_init(&lrucache, CACHEDIR_BUCKETS,
+	              sizeof(cachedir_obj_t) + CACHEDIR_STRSZ,
+	              sizeof(XXH128_hash_t), sizeof(XXH128_hash_t), 0,
+	              cachedir_obj_free);
+}
+
+void
+cachedir_fini(void) {
+	lrucache_destroy(&lrucache);
+	pthread_mutex_destroy(&mutex);
+}
+
+/*
+ * Limit the cache to pct percent of its size under memory pressure.
+ */
+void
+cachedir_scale(unsigned int pct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_scale(&lrucache, pct);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cachedir_adapt(unsigned int minpct, unsigned int maxpct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_adapt(&lrucache, minpct, maxpct);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cachedir_stats(cachedir_stat_t *st) {
+	pthread_mutex_lock(&mutex);
+	lrucache_stats(&lrucache, &st->lru);
+	st->expired = expired;
+	st->fastpaths = fastpaths;
+	st->flushes = flushes;
+	pthread_mutex_unlock(&mutex);
+}
+
@@ -0,0 +1,36 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef CACHEDIR_H
+#define CACHEDIR_H
+
+#include "lrucache.h"
+#include "attrib.h"
+
+#include <stdint.h>
+
+typedef struct {
+	lrucache_stat_t lru;
+	uint64_t expired;       /* hits on entries past their TTL */
+	uint64_t fastpaths;     /* paths resolved with a single lstat */
+	uint64_t flushes;
+} cachedir_stat_t;
+
+void cachedir_init(void);
+void cachedir_fini(void);
+char * cachedir_realpath(const char *restrict, const char *restrict) MALLOC;
+char * cachedir_realdir(const char *restrict, const char *restrict) MALLOC;
+void cachedir_flush(void);
+void cachedir_scale(unsigned int);
+void cachedir_adapt(unsigned int, unsigned int);
+void cachedir_stats(cachedir_stat_t *) NONNULL(1);
+
+#endif
+
@@ -59,7 +59,7 @@ static pthread_mutex_t mutex;
 void
 cachehash_init(void) {
 	pthread_mutex_init(&mutex, NULL);
-	lrucache_init(&lrucache, CACHEHASH_BUCKETS,
+	lrucache_init(&lrucache, CACHEHASH_BUCKETS, sizeof(cachehash_obj_t),
 	              sizeof(dev_t) + sizeof(ino_t),
 	              sizeof(dev_t) + sizeof(ino_t),
 	              sizeof(cachehash_key_t),
@@ -137,6 +137,23 @@ cachehash_put(dev_t dev, ino_t ino,
 	pthread_mutex_unlock(&mutex);
 }
 
+/*
+ * Limit the cache to pct percent of its size under memory pressure.
+ */
+void
+cachehash_scale(unsigned int pct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_scale(&lrucache, pct);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cachehash_adapt(unsigned int minpct, unsigned int maxpct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_adapt(&lrucache, minpct, maxpct);
+	pthread_mutex_unlock(&mutex);
+}
+
 void
 cachehash_stats(lrucache_stat_t *st) {
 	pthread_mutex_lock(&mutex);
@@ -31,6 +31,8 @@ void cachehash_put(dev_t, ino_t,
                    struct timespec *,
                    struct timespec *,
                    hashes_t *) NONNULL(3,4,5,6);
+void cachehash_scale(unsigned int);
+void cachehash_adapt(unsigned int, unsigned int);
 void cachehash_stats(lrucache_stat_t *) NONNULL(1);
 
 #endif
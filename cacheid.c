@@ -0,0 +1,325 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Cache for user and group names by id.
+ *
+ * On directory-bound systems, getpwuid(3) and getgrgid(3) can turn into
+ * IPC to opendirectoryd and further into network lookups, which would
+ * stall the log thread for every uid and gid field rendered.  Names are
+ * cached for CACHEID_TTL seconds, ids without name for CACHEID_NEGTTL
+ * seconds.  Only the first lookup of an id blocks; once an entry expires,
+ * the stale name is still returned and a refresh is handed to a separate
+ * thread.  The cache is flushed on SIGHUP.
+ */
+
+#include "cacheid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pwd.h>
+#include <grp.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define CACHEID_BUCKETS         1024
+#define CACHEID_TTL             600     /* sec until names are refreshed */
+#define CACHEID_NEGTTL          60      /* sec until missing names retried */
+#define CACHEID_REFRESH_MAX     64      /* queued refreshes */
+#define CACHEID_BUFSZ_MAX       (1024*1024)
+#define CACHEID_STRSZ           16      /* typical name, accounting */
+
+#define KIND_USER       0
+#define KIND_GROUP      1
+
+typedef struct __attribute__((packed)) {
+	uint32_t id;
+	uint32_t kind;
+} cacheid_key_t;
+
+typedef struct {
+	cacheid_key_t key;
+	char *name;             /* NULL if id has no name */
+	time_t expiry;
+	bool refreshing;
+	lrucache_node_t node;
+} cacheid_obj_t;
+
+static cacheid_obj_t *
+cacheid_obj_new(const cacheid_key_t *key, char *name, time_t now) {
+	cacheid_obj_t *obj;
+
+	obj = malloc(sizeof(cacheid_obj_t));
+	if (!obj)
+		return NULL;
+	bzero(obj, sizeof(cacheid_obj_t));
+	obj->key = *key;
+	obj->name = name;
+	obj->expiry = now + (name ? CACHEID_TTL : CACHEID_NEGTTL);
+	return obj;
+}
+
+static void
+cacheid_obj_free(void *vobj) {
+	cacheid_obj_t *obj = vobj;
+	assert(obj);
+	if (obj->name)
+		free(obj->name);
+	free(obj);
+}
+
+static lrucache_t lrucache;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refresh_cond = PTHREAD_COND_INITIALIZER;
+static cacheid_key_t refq[CACHEID_REFRESH_MAX];
+static size_t refqlen;
+static pthread_t refresh_thr;
+static bool running = false;
+static bool stopping;
+
+static uint64_t negative;
+static uint64_t stale;
+static uint64_t refreshes;
+static uint64_t flushes;
+
+/*
+ * Look up the name for key using the reentrant variants, as lookups happen
+ * on both the log thread and the refresh thread.  Returns a malloc'd name,
+ * or NULL if the id has no name or the lookup failed.
+ */
+static char *
+cacheid_lookup(const cacheid_key_t *key) {
+	struct passwd pw, *pwp;
+	struct group gr, *grp;
+	char *buf, *name;
+	size_t bufsz;
+	int rv;
+
+	bufsz = 1024;
+	for (;;) {
+		buf = malloc(bufsz);
+		if (!buf)
+			return NULL;
+		name = NULL;
+		if (key->kind == KIND_USER) {
+			rv = getpwuid_r((uid_t)key->id, &pw, buf, bufsz, &pwp);
+			if (rv == 0 && pwp)
+				name = pwp->pw_name;
+		} else {
+			rv = getgrgid_r((gid_t)key->id, &gr, buf, bufsz, &grp);
+			if (rv == 0 && grp)
+				name = grp->gr_name;
+		}
+		if (rv != ERANGE || bufsz >= CACHEID_BUFSZ_MAX)
+			break;
+		free(buf);
+		bufsz *= 2;
+	}
+	if (name)
+		name = strdup(name);
+	free(buf);
+	return name;
+}
+
+/*
+ * Must be called with mutex held.
+ */
+static void
+cacheid_refresh_enqueue(cacheid_obj_t *obj) {
+	if (refqlen == CACHEID_REFRESH_MAX)
+		return; /* retried on next expired hit */
+	refq[refqlen++] = obj->key;
+	obj->refreshing = true;
+	pthread_cond_signal(&refresh_cond);
+}
+
+static void *
+cacheid_refresh_thread(UNUSED void *arg) {
+	cacheid_key_t key;
+	cacheid_obj_t *obj;
+	char *name;
+
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (!stopping && refqlen == 0)
+			pthread_cond_wait(&refresh_cond, &mutex);
+		if (stopping)
+			break;
+		key = refq[--refqlen];
+		pthread_mutex_unlock(&mutex);
+
+		/* can block on directory services */
+		name = cacheid_lookup(&key);
+
+		pthread_mutex_lock(&mutex);
+		refreshes++;
+		/* must not promote the entry or count as a hit */
+		obj = lrucache_peek(&lrucache, &key);
+		if (!obj) {
+			/* flushed or evicted in the meantime */
+			if (name)
+				free(name);
+			continue;
+		}
+		if (obj->name)
+			free(obj->name);
+		obj->name = name;
+		obj->expiry = time(NULL) + (name ? CACHEID_TTL : CACHEID_NEGTTL);
+		obj->refreshing = false;
+	}
+	pthread_mutex_unlock(&mutex);
+	return NULL;
+}
+
+/*
+ * Copy the name for id into buf.  Returns 0 on success, -1 if the id has no
+ * name or could not be looked up.
+ */
+static int
+cacheid_get(char *buf, size_t sz, uint32_t kind, uint32_t id) {
+	cacheid_key_t key;
+	cacheid_obj_t *obj;
+	time_t now;
+	char *name;
+	int rv;
+
+	key.id = id;
+	key.kind = kind;
+	now = time(NULL);
+
+	pthread_mutex_lock(&mutex);
+	obj = lrucache_get(&lrucache, &key);
+	if (obj) {
+		if (obj->expiry <= now) {
+			stale++;
+			if (!obj->refreshing)
+				cacheid_refresh_enqueue(obj);
+		}
+		if (obj->name) {
+			strlcpy(buf, obj->name, sz);
+			rv = 0;
+		} else {
+			negative++;
+			rv = -1;
+		}
+		pthread_mutex_unlock(&mutex);
+		return rv;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	/* first lookup of this id, resolve synchronously */
+	name = cacheid_lookup(&key);
+	if (name)
+		strlcpy(buf, name, sz);
+	rv = name ? 0 : -1;
+	obj = cacheid_obj_new(&key, name, now);
+	if (!obj) {
+		if (name)
+			free(name);
+		return rv;
+	}
+	pthread_mutex_lock(&mutex);
+	lrucache_put(&lrucache, &obj->node, obj);
+	pthread_mutex_unlock(&mutex);
+	return rv;
+}
+
+int
+cacheid_user(char *buf, size_t sz, uid_t uid) {
+	return cacheid_get(buf, sz, KIND_USER, (uint32_t)uid);
+}
+
+int
+cacheid_group(char *buf, size_t sz, gid_t gid) {
+	return cacheid_get(buf, sz, KIND_GROUP, (uint32_t)gid);
+}
+
+/*
+ * Drop all cached names, for instance after directory changes.
+ */
+void
+cacheid_flush(void) {
+	pthread_mutex_lock(&mutex);
+	lrucache_flush(&lrucache);
+	refqlen = 0;
+	flushes++;
+	pthread_mutex_unlock(&mutex);
+}
+
+int
+cacheid_init(void) {
+	assert(!running);
+	refqlen = 0;
+	stopping = false;
+	negative = 0;
+	stale = 0;
+	refreshes = 0;
+	flushes = 0;
+	lrucache_init(&lrucache, CACHEID_BUCKETS,
+	              sizeof(cacheid_obj_t) + CACHEID_STRSZ,
+	              sizeof(cacheid_key_t), sizeof(cacheid_key_t), 0,
+	              cacheid_obj_free);
+	if (pthread_create(&refresh_thr, NULL,
+	                   cacheid_refresh_thread, NULL) != 0) {
+		lrucache_destroy(&lrucache);
+		return -1;
+	}
+	running = true;
+	return 0;
+}
+
+void
+cacheid_fini(void) {
+	if (!running)
+		return;
+	pthread_mutex_lock(&mutex);
+	stopping = true;
+	pthread_cond_broadcast(&refresh_cond);
+	pthread_mutex_unlock(&mutex);
+	if (pthread_join(refresh_thr, NULL) != 0) {
+		fprintf(stderr, "Failed to join id cache thread - exiting\n");
+		exit(EXIT_FAILURE);
+	}
+	running = false;
+	lrucache_destroy(&lrucache);
+}
+
+/*
+ * Limit the cache to pct percent of its size under memory pressure.
+ */
+void
+cacheid_scale(unsigned int pct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_scale(&lrucache, pct);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cacheid_adapt(unsigned int minpct, unsigned int maxpct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_adapt(&lrucache, minpct, maxpct);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cacheid_stats(cacheid_stat_t *st) {
+	pthread_mutex_lock(&mutex);
+	lrucache_stats(&lrucache, &st->lru);
+	st->negative = negative;
+	st->stale = stale;
+	st->refreshes = refreshes;
+	st->flushes = flushes;
+	pthread_mutex_unlock(&mutex);
+}
+
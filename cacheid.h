@@ -0,0 +1,40 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef CACHEID_H
+#define CACHEID_H
+
+#include "lrucache.h"
+#include "attrib.h"
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#define CACHEID_NAMESZ  256
+
+typedef struct {
+	lrucache_stat_t lru;
+	uint64_t negative;      /* hits on ids without a name */
+	uint64_t stale;         /* hits on expired entries, refreshed async */
+	uint64_t refreshes;     /* async lookups done */
+	uint64_t flushes;
+} cacheid_stat_t;
+
+int cacheid_init(void) WUNRES;
+void cacheid_fini(void);
+int cacheid_user(char *, size_t, uid_t) NONNULL(1) WUNRES;
+int cacheid_group(char *, size_t, gid_t) NONNULL(1) WUNRES;
+void cacheid_flush(void);
+void cacheid_scale(unsigned int);
+void cacheid_adapt(unsigned int, unsigned int);
+void cacheid_stats(cacheid_stat_t *) NONNULL(1);
+
+#endif
+
@@ -60,7 +60,7 @@ static pthread_mutex_t mutex;
 void
 cacheldpl_init(void) {
 	pthread_mutex_init(&mutex, NULL);
-	lrucache_init(&lrucache, CACHELDPL_BUCKETS,
+	lrucache_init(&lrucache, CACHELDPL_BUCKETS, sizeof(cacheldpl_obj_t),
 	              sizeof(dev_t) + sizeof(ino_t),
 	              sizeof(dev_t) + sizeof(ino_t),
 	              sizeof(cacheldpl_key_t),
@@ -117,6 +117,23 @@ cacheldpl_put(dev_t dev, ino_t ino, time_t mtime, time_t ctime, time_t btime) {
 	pthread_mutex_unlock(&mutex);
 }
 
+/*
+ * Limit the cache to pct percent of its size under memory pressure.
+ */
+void
+cacheldpl_scale(unsigned int pct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_scale(&lrucache, pct);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+cacheldpl_adapt(unsigned int minpct, unsigned int maxpct) {
+	pthread_mutex_lock(&mutex);
+	lrucache_adapt(&lrucache, minpct, maxpct);
+	pthread_mutex_unlock(&mutex);
+}
+
 void
 cacheldpl_stats(lrucache_stat_t *st) {
 	pthread_mutex_lock(&mutex);
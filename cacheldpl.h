@@ -22,6 +22,8 @@ void cacheldpl_init(void);
 void cacheldpl_fini(void);
 bool cacheldpl_get(dev_t, ino_t, time_t, time_t, time_t);
 void cacheldpl_put(dev_t, ino_t, time_t, time_t, time_t);
+void cacheldpl_scale(unsigned int);
+void cacheldpl_adapt(unsigned int, unsigned int);
 void cacheldpl_stats(lrucache_stat_t *) NONNULL(1);
 
 #endif
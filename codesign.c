@@ -11,6 +11,7 @@
 #include "codesign.h"
 
 #include "cf.h"
+#include "strpool.h"
 #include "debug.h"
 
 #include <stdio.h>
@@ -84,16 +85,29 @@ codesign_fini() {
 
 #undef CREATE_REQ
 
+/*
+ * Returns an interned copy of s, or NULL if out of memory.
+ */
+static const char *
+codesign_cstr(CFStringRef s) {
+	char *cstr;
+
+	cstr = cf_cstr(s);
+	if (!cstr)
+		return NULL;
+	return strpool_adopt(cstr);
+}
+
 void
 codesign_free(codesign_t *cs) {
 	if (cs->cdhash)
 		free(cs->cdhash);
 	if (cs->ident)
-		free(cs->ident);
+		strpool_unref(cs->ident);
 	if (cs->teamid)
-		free(cs->teamid);
+		strpool_unref(cs->teamid);
 	if (cs->certcn)
-		free(cs->certcn);
+		strpool_unref(cs->certcn);
 	free(cs);
 }
 
@@ -108,11 +122,8 @@ codesign_dup(const codesign_t *other) {
 
 	cs->result = other->result;
 	cs->origin = other->origin;
-	if (other->ident) {
-		cs->ident = strdup(other->ident);
-		if (!cs->ident)
-			goto errout;
-	}
+	if (other->ident)
+		cs->ident = strpool_ref(other->ident);
 	if (other->cdhash) {
 		cs->cdhashsz = other->cdhashsz;
 		cs->cdhash = malloc(cs->cdhashsz);
@@ -120,16 +131,10 @@ codesign_dup(const codesign_t *other) {
 			goto errout;
 		memcpy(cs->cdhash, other->cdhash, cs->cdhashsz);
 	}
-	if (other->teamid) {
-		cs->teamid = strdup(other->teamid);
-		if (!cs->teamid)
-			goto errout;
-	}
-	if (other->certcn) {
-		cs->certcn = strdup(other->certcn);
-		if (!cs->certcn)
-			goto errout;
-	}
+	if (other->teamid)
+		cs->teamid = strpool_ref(other->teamid);
+	if (other->certcn)
+		cs->certcn = strpool_ref(other->certcn);
 	return cs;
 errout:
 	codesign_free(cs);
@@ -335,7 +340,7 @@ codesign_new(const char *cpath, pid_t pid) {
 	/* extract ident */
 	CFStringRef ident = CFDictionaryGetValue(dict, kSecCodeInfoIdentifier);
 	if (ident && cf_is_string(ident)) {
-		cs->ident = cf_cstr(ident);
+		cs->ident = codesign_cstr(ident);
 		if (!cs->ident) {
 			CFRelease(dict);
 			goto enomemout;
@@ -346,7 +351,7 @@ codesign_new(const char *cpath, pid_t pid) {
 	CFStringRef teamid = CFDictionaryGetValue(dict,
 	                                          kSecCodeInfoTeamIdentifier);
 	if (teamid && cf_is_string(teamid)) {
-		cs->teamid = cf_cstr(teamid);
+		cs->teamid = codesign_cstr(teamid);
 		if (!cs->teamid) {
 			CFRelease(dict);
 			goto enomemout;
@@ -370,7 +375,7 @@ codesign_new(const char *cpath, pid_t pid) {
 				CFRelease(dict);
 				goto enomemout;
 			}
-			cs->certcn = cf_cstr(s);
+			cs->certcn = codesign_cstr(s);
 			CFRelease(s);
 			if (!cs->certcn) {
 				CFRelease(dict);
@@ -35,9 +35,9 @@ typedef struct {
 #define CODESIGN_ORIGIN_TRUSTED_CA    5
 	unsigned char *cdhash;
 	size_t cdhashsz;
-	char *ident;
-	char *teamid;
-	char *certcn;
+	const char *ident;      /* strpool */
+	const char *teamid;     /* strpool */
+	const char *certcn;     /* strpool */
 } codesign_t;
 
 #define codesign_is_good(CS) \
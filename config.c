@@ -11,6 +11,7 @@
 #include "config.h"
 
 #include "log.h"
+#include "queue.h"
 #include "cf.h"
 #include "sys.h"
 #include "memstream.h"
@@ -19,6 +20,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <assert.h>
 
 #include <CoreFoundation/CoreFoundation.h>
@@ -83,9 +85,24 @@ config_parse_events(const char *spec) {
 	return flags;
 }
 
-char *
-config_events_s(config_t *cfg) {
-	int i = cfg->events;
+/*
+ * Parse a string of comma-separated eventcodes into a bitmask of events,
+ * allowing for an empty list.
+ */
+static int
+config_parse_prio(const char *spec) {
+	if (spec[0] == '\0')
+		return 0;
+	return config_parse_events(spec);
+}
+
+/*
+ * Format a bitmask of events as a string of comma-separated eventcodes.
+ * Returns an empty string for an empty bitmask.
+ */
+static char *
+config_flags_s(int flags) {
+	int i = flags;
 	int code = 0;
 
 	char *msg;
@@ -117,6 +134,90 @@ config_events_s(config_t *cfg) {
 	return msg;
 }
 
+char *
+config_events_s(config_t *cfg) {
+	return config_flags_s(cfg->events);
+}
+
+char *
+config_prio_s(config_t *cfg, int prio) {
+	switch (prio) {
+	case QUEUE_PRIO_HIGH:
+		return config_flags_s(cfg->prio_high);
+	case QUEUE_PRIO_LOW:
+		return config_flags_s(cfg->prio_low);
+	default:
+		return config_flags_s(((1 << LOGEVT_SIZE) - 1) &
+		                      ~(cfg->prio_high|cfg->prio_low));
+	}
+}
+
+/*
+ * Map an eventcode to the priority lane it is queued into.  High takes
+ * precedence over low if an eventcode is configured for both.
+ */
+int
+config_prio(config_t *cfg, int code) {
+	if (LOGEVT_WANT(cfg->prio_high, LOGEVT_FLAG(code)))
+		return QUEUE_PRIO_HIGH;
+	if (LOGEVT_WANT(cfg->prio_low, LOGEVT_FLAG(code)))
+		return QUEUE_PRIO_LOW;
+	return QUEUE_PRIO_NORMAL;
+}
+
+/*
+ * Parse a size in bytes with an optional K, M or G suffix.
+ */
+static int
+config_set_size(size_t *sz, const char *value) {
+	unsigned long long n;
+	char *end;
+
+	errno = 0;
+	n = strtoull(value, &end, 10);
+	if (errno || end == value)
+		return -1;
+	switch (*end) {
+	case 'G':
+	case 'g':
+		n *= 1024;
+		/* fall through */
+	case 'M':
+	case 'm':
+		n *= 1024;
+		/* fall through */
+	case 'K':
+	case 'k':
+		n *= 1024;
+		end++;
+		break;
+	default:
+		break;
+	}
+	if (*end != '\0')
+		return -1;
+	*sz = (size_t)n;
+	return 0;
+}
+
+/*
+ * Parse a non-negative number of seconds.
+ */
+static int
+config_set_secs(size_t *secs, const char *value) {
+	unsigned long n;
+	char *end;
+
+	if (*value < '0' || *value > '9')
+		return -1;
+	errno = 0;
+	n = strtoul(value, &end, 10);
+	if (errno || *end != '\0' || n > INT_MAX)
+		return -1;
+	*secs = (size_t)n;
+	return 0;
+}
+
 static int
 config_set_bool(bool *b, const char *value) {
 	if (!strcmp(value, "true")
@@ -165,11 +266,40 @@ config_str(config_t *cfg, const char *key, const char *value) {
 		return cfg->events == -1 ? -1 : 0;
 	}
 
+	if (!strcmp(key, "priority_high")) {
+		cfg->prio_high = config_parse_prio(value);
+		return cfg->prio_high == -1 ? -1 : 0;
+	}
+
+	if (!strcmp(key, "priority_low")) {
+		cfg->prio_low = config_parse_prio(value);
+		return cfg->prio_low == -1 ? -1 : 0;
+	}
+
 	if (!strcmp(key, "stats_interval")) {
 		cfg->stats_interval = atoi(value);
 		return 0;
 	}
 
+	if (!strcmp(key, "adaptive_degradation")) {
+		if (config_set_bool(&cfg->adaptive_degradation, value) == -1)
+			return -1;
+		return 0;
+	}
+
+	if (!strcmp(key, "memory_budget"))
+		return config_set_size(&cfg->memory_budget, value);
+
+	if (!strcmp(key, "cache_size_min")) {
+		cfg->cache_size_min = atoi(value);
+		return 0;
+	}
+
+	if (!strcmp(key, "cache_size_max")) {
+		cfg->cache_size_max = atoi(value);
+		return 0;
+	}
+
 	if (!strcmp(key, "kextlevel"))
 		return config_kextlevel(cfg, value);
 
@@ -184,6 +314,45 @@ config_str(config_t *cfg, const char *key, const char *value) {
 		return 0;
 	}
 
+	if (!strcmp(key, "codesign_threads")) {
+		cfg->codesign_threads = atoi(value);
+		return 0;
+	}
+
+	if (!strcmp(key, "codesign_timeout")) {
+		cfg->codesign_timeout = atoi(value);
+		return 0;
+	}
+
+	if (!strcmp(key, "prehash_dirs")) {
+		if (cfg->prehashdirs)
+			free(cfg->prehashdirs);
+		if (!value[0]) {
+			cfg->prehashdirs = NULL;
+			return 0;
+		}
+		cfg->prehashdirs = strdup(value);
+		if (!cfg->prehashdirs)
+			return -1;
+		return 0;
+	}
+
+	if (!strcmp(key, "prehash_history")) {
+		if (cfg->prehashhistory)
+			free(cfg->prehashhistory);
+		if (!value[0]) {
+			cfg->prehashhistory = NULL;
+			return 0;
+		}
+		cfg->prehashhistory = strdup(value);
+		if (!cfg->prehashhistory)
+			return -1;
+		return 0;
+	}
+
+	if (!strcmp(key, "prehash_rate"))
+		return config_set_size(&cfg->prehashrate, value);
+
 	if (!strcmp(key, "envlevel"))
 		return config_envlevel(cfg, value);
 
@@ -267,6 +436,38 @@ config_str(config_t *cfg, const char *key, const char *value) {
 		return 0;
 	}
 
+	if (!strcmp(key, "log_rotate_size"))
+		return config_set_size(&cfg->logrotatesize, value);
+
+	if (!strcmp(key, "log_rotate_interval"))
+		return config_set_secs(&cfg->logrotateinterval, value);
+
+	if (!strcmp(key, "log_framing")) {
+		if (!strcmp(value, "rfc5424"))
+			cfg->logframing = LOGFRAMING_RFC5424;
+		else if (!strcmp(value, "ndjson"))
+			cfg->logframing = LOGFRAMING_NDJSON;
+		else
+			return -1;
+		return 0;
+	}
+
+	if (!strcmp(key, "log_spill_file")) {
+		if (cfg->logspillfile)
+			free(cfg->logspillfile);
+		if (!value[0]) {
+			cfg->logspillfile = NULL;
+			return 0;
+		}
+		cfg->logspillfile = strdup(value);
+		if (!cfg->logspillfile)
+			return -1;
+		return 0;
+	}
+
+	if (!strcmp(key, "log_spill_size"))
+		return config_set_size(&cfg->logspillsize, value);
+
 	if (!strcmp(key, "log_mode")) {
 		if (!strcmp(value, "oneline"))
 			cfg->logoneline = 1;
@@ -291,6 +492,12 @@ config_str(config_t *cfg, const char *key, const char *value) {
 		return 0;
 	}
 
+	if (!strcmp(key, "socket_aggregate_window"))
+		return config_set_secs(&cfg->socket_aggregate_window, value);
+
+	if (!strcmp(key, "exec_summary_window"))
+		return config_set_secs(&cfg->exec_summary_window, value);
+
 	return -1;
 }
 
@@ -392,15 +599,23 @@ config_new(const char *cfgpath) {
 	/* set defaults that differ from all zeroes */
 	cfg->limit_nofile = 8192;
 	cfg->events = (1 << LOGEVT_SIZE) - 1;
+	cfg->prio_high = LOGEVT_FLAG(LOGEVT_PROCESS_ACCESS)|
+	                 LOGEVT_FLAG(LOGEVT_LAUNCHD_ADD);
 	cfg->stats_interval = 3600;
+	cfg->cache_size_min = 25;
+	cfg->cache_size_max = 800;
 	cfg->kextlevel = KEXTLEVEL_HASH;
 	cfg->hflags = HASH_SHA256;
 	cfg->codesign = true;
+	cfg->codesign_threads = 2;
+	cfg->codesign_timeout = 1000;
+	cfg->prehashrate = 4*1024*1024;
 	cfg->envlevel = ENVLEVEL_DYLD;
 	cfg->resolve_users_groups = true;
 	cfg->omit_apple_hashes = true;
 	cfg->ancestors = SIZE_MAX;
 	cfg->logoneline = -1; /* any */
+	cfg->logspillsize = 64*1024*1024;
 	cfg->suppress_image_exec_at_start = true;
 	cfg->suppress_socket_op_localhost = true;
 	if (logfmt_parse(cfg, "json") == -1) {
@@ -437,9 +652,19 @@ config_new(const char *cfgpath) {
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_format");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_destination");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_mode");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_rotate_size");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_rotate_interval");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_framing");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_spill_file");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "log_spill_size");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "kextlevel");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "hashes");
 	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "codesign");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "codesign_threads");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "codesign_timeout");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "prehash_dirs");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "prehash_history");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "prehash_rate");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "envlevel");
 	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "resolve_users_groups");
 	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "omit_mode");
@@ -452,11 +677,19 @@ config_new(const char *cfgpath) {
 	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "omit_apple_hashes");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "ancestors");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "events");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "priority_high");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "priority_low");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "stats_interval");
+	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "adaptive_degradation");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "memory_budget");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "cache_size_min");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "cache_size_max");
 	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "rlimit_nofile");
 	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "debug");
 	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "suppress_image_exec_at_start");
 	CONFIG_BOOL_FROM_PLIST(rv, cfg, plist, "suppress_socket_op_localhost");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "socket_aggregate_window");
+	CONFIG_STR_FROM_PLIST(rv, cfg, plist, "exec_summary_window");
 
 	/* The setstr initializations must be called even if we were to allow
 	 * xnumon to run without a config file; they handle plist==NULL. */
@@ -504,8 +737,18 @@ config_free(config_t *cfg) {
 		free(cfg->path);
 	if (cfg->id)
 		free(cfg->id);
+	if (cfg->trail)
+		free(cfg->trail);
 	if (cfg->logfile)
 		free(cfg->logfile);
+	if (cfg->logaddr)
+		free(cfg->logaddr);
+	if (cfg->logspillfile)
+		free(cfg->logspillfile);
+	if (cfg->prehashdirs)
+		free(cfg->prehashdirs);
+	if (cfg->prehashhistory)
+		free(cfg->prehashhistory);
 	free(cfg);
 }
 
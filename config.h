@@ -22,11 +22,19 @@ typedef struct {
 	char *id;
 
 	bool launchd_mode;      /* only settable via command line */
+	char *trail;            /* read audit trail instead of auditpipe,
+	                         * only settable via command line */
 	bool debug;
 
 	size_t stats_interval;  /* generate xnumon-stats every n seconds */
+	bool adaptive_degradation; /* shed work under high load */
+	size_t memory_budget;   /* memory ceiling in bytes, 0 off */
+	size_t cache_size_min;  /* adaptive cache size bounds, percent */
+	size_t cache_size_max;
 	size_t limit_nofile;
 	int events;             /* bit mask of enabled events */
+	int prio_high;          /* bit mask of high priority events */
+	int prio_low;           /* bit mask of low priority events */
 
 	int kextlevel;
 #define KEXTLEVEL_NONE 0
@@ -40,7 +48,12 @@ typedef struct {
 #define ENVLEVEL_DYLD 1
 #define ENVLEVEL_FULL 2
 	bool codesign;
+	size_t codesign_threads; /* codesign pool threads, 0 synchronous */
+	size_t codesign_timeout; /* codesign deadline in ms, 0 synchronous */
 	bool resolve_users_groups;
+	char *prehashdirs;      /* comma-separated directories to pre-hash */
+	char *prehashhistory;   /* exec history file for pre-hashing */
+	size_t prehashrate;     /* pre-hashing rate limit in bytes/s, 0 off */
 
 	bool omit_mode;
 	bool omit_size;
@@ -56,6 +69,14 @@ typedef struct {
 	int logfmt;
 	int logoneline;         /* compact one-line log format */
 	char *logfile;
+	size_t logrotatesize;   /* rotate compressed log at n bytes, 0 off */
+	size_t logrotateinterval; /* rotate compressed log after n secs, 0 off */
+	char *logaddr;          /* network log destination address */
+	int logframing;         /* network log framing */
+#define LOGFRAMING_RFC5424 0
+#define LOGFRAMING_NDJSON  1
+	char *logspillfile;     /* network log spill file, NULL off */
+	size_t logspillsize;    /* network log spill file size limit */
 
 	bool suppress_image_exec_at_start;
 	setstr_t suppress_image_exec_by_ident;
@@ -67,6 +88,8 @@ typedef struct {
 	bool suppress_socket_op_localhost;
 	setstr_t suppress_socket_op_by_subject_ident;
 	setstr_t suppress_socket_op_by_subject_path;
+	size_t socket_aggregate_window; /* seconds, 0 off */
+	size_t exec_summary_window; /* seconds, 0 off */
 } config_t;
 
 config_t * config_new(const char *) MALLOC;
@@ -80,6 +103,8 @@ int config_envlevel(config_t *, const char *) NONNULL(1,2);
 const char * config_envlevel_s(config_t *) NONNULL(1);
 
 char * config_events_s(config_t *) NONNULL(1);
+char * config_prio_s(config_t *, int) NONNULL(1);
+int config_prio(config_t *, int) NONNULL(1);
 
 #endif
 
@@ -0,0 +1,310 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Bounded thread pool for code signature verification.
+ *
+ * Code signature verification can stall for seconds on notarization or
+ * OCSP lookups, which must not hold up the worker thread.  Callers submit
+ * a path and wait for the verdict until the configured deadline.  If the
+ * deadline passes, or if all pool threads are busy and verification would
+ * not even start right away, the caller gets a pending or timeout result
+ * immediately and the final verdict is handed to the late callback from a
+ * pool thread once verification completes.
+ */
+
+#include "csigpool.h"
+
+#include "time.h"
+#include "tommylist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <assert.h>
+
+#define CSIGPOOL_THREADS_MAX    16
+#define CSIGPOOL_QUEUE_MAX      256
+
+typedef struct {
+	char *path;
+	csigpool_late_func_t late;
+	void *arg;
+
+	int state;
+#define JOB_QUEUED      0
+#define JOB_RUNNING     1
+#define JOB_DONE        2
+	bool abandoned;         /* caller gave up waiting, deliver late */
+	codesign_t *codesign;
+	int err;
+
+	tommy_node node;
+} csigpool_job_t;
+
+static pthread_t threads[CSIGPOOL_THREADS_MAX];
+static size_t nthreads = 0;
+static uint64_t timeout_ms;
+static bool stopping;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static tommy_list jobs;
+static uint32_t qsize;
+static uint32_t busy;
+
+static uint64_t submitted;
+static uint64_t ontime;
+static uint64_t pending;
+static uint64_t timeouts;
+static uint64_t late;
+static uint64_t overflows;
+static uint64_t discards;
+
+static void
+csigpool_job_free(csigpool_job_t *job) {
+	free(job->path);
+	free(job);
+}
+
+static void *
+csigpool_thread(UNUSED void *arg) {
+	csigpool_job_t *job;
+	codesign_t *cs;
+	int err;
+
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (!stopping && tommy_list_empty(&jobs))
+			pthread_cond_wait(&notempty, &mutex);
+		if (stopping)
+			break;
+		job = tommy_list_remove_existing(&jobs, tommy_list_head(&jobs));
+		qsize--;
+		busy++;
+		job->state = JOB_RUNNING;
+		pthread_mutex_unlock(&mutex);
+
+		/* can be very slow! */
+		cs = codesign_new(job->path, -1);
+		err = errno;
+
+		pthread_mutex_lock(&mutex);
+		busy--;
+		if (job->abandoned) {
+			late++;
+			pthread_mutex_unlock(&mutex);
+			job->late(job->arg, cs);
+			csigpool_job_free(job);
+			pthread_mutex_lock(&mutex);
+		} else {
+			job->codesign = cs;
+			job->err = err;
+			job->state = JOB_DONE;
+			pthread_cond_broadcast(&done);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	return NULL;
+}
+
+/*
+ * Verify the code signature of path.  Returns the verdict like
+ * codesign_new() if it was available before the deadline.  Otherwise
+ * returns NULL with errno set to:
+ *
+ * EINPROGRESS  Verification has not started yet, verdict is pending.
+ * ETIMEDOUT    Verification has not finished before the deadline.
+ * EAGAIN       Queue is full, path will not be verified.
+ * ENOTSUP      Defer is set but there is no pool to defer to.
+ *
+ * For EINPROGRESS and ETIMEDOUT, late(arg, cs) will be called exactly once
+ * from a pool thread with the final verdict, or with cs == NULL if
+ * verification failed or was discarded at shutdown.  The late callback
+ * takes ownership of cs.  For all other return values, late is never
+ * called.  If defer is set, the caller does not wait for the verdict at all
+ * and always gets EINPROGRESS unless the job cannot be queued.
+ */
+codesign_t *
+csigpool_verify(const char *path, bool defer,
+                csigpool_late_func_t late_func, void *arg) {
+	csigpool_job_t *job;
+	struct timespec deadline;
+	codesign_t *cs;
+	int rv;
+
+	if (nthreads == 0) {
+		if (defer) {
+			errno = ENOTSUP;
+			return NULL;
+		}
+		return codesign_new(path, -1);
+	}
+
+	job = malloc(sizeof(csigpool_job_t));
+	if (!job)
+		return NULL;
+	bzero(job, sizeof(csigpool_job_t));
+	job->path = strdup(path);
+	if (!job->path) {
+		free(job);
+		return NULL;
+	}
+	job->late = late_func;
+	job->arg = arg;
+	job->state = JOB_QUEUED;
+
+	if (timespec_nanotime(&deadline) == -1) {
+		csigpool_job_free(job);
+		return NULL;
+	}
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&mutex);
+	submitted++;
+	if (qsize >= CSIGPOOL_QUEUE_MAX) {
+		overflows++;
+		pthread_mutex_unlock(&mutex);
+		csigpool_job_free(job);
+		errno = EAGAIN;
+		return NULL;
+	}
+	tommy_list_insert_tail(&jobs, &job->node, job);
+	qsize++;
+	pthread_cond_signal(&notempty);
+
+	/* deferred, or all threads busy and verification would not start */
+	if (defer || busy + qsize > nthreads) {
+		job->abandoned = true;
+		pending++;
+		pthread_mutex_unlock(&mutex);
+		errno = EINPROGRESS;
+		return NULL;
+	}
+
+	while (job->state != JOB_DONE) {
+		rv = pthread_cond_timedwait(&done, &mutex, &deadline);
+		if (rv == ETIMEDOUT && job->state != JOB_DONE) {
+			job->abandoned = true;
+			if (job->state == JOB_QUEUED) {
+				pending++;
+				errno = EINPROGRESS;
+			} else {
+				timeouts++;
+				errno = ETIMEDOUT;
+			}
+			pthread_mutex_unlock(&mutex);
+			return NULL;
+		}
+	}
+	ontime++;
+	pthread_mutex_unlock(&mutex);
+
+	cs = job->codesign;
+	rv = job->err;
+	csigpool_job_free(job);
+	if (!cs)
+		errno = rv;
+	return cs;
+}
+
+int
+csigpool_init(config_t *cfg) {
+	size_t n;
+
+	assert(nthreads == 0);
+	tommy_list_init(&jobs);
+	qsize = 0;
+	busy = 0;
+	stopping = false;
+	submitted = 0;
+	ontime = 0;
+	pending = 0;
+	timeouts = 0;
+	late = 0;
+	overflows = 0;
+	discards = 0;
+
+	if (!cfg->codesign || cfg->codesign_timeout == 0)
+		return 0;
+	timeout_ms = cfg->codesign_timeout;
+	n = cfg->codesign_threads;
+	if (n > CSIGPOOL_THREADS_MAX)
+		n = CSIGPOOL_THREADS_MAX;
+	for (size_t i = 0; i < n; i++) {
+		if (pthread_create(&threads[i], NULL,
+		                   csigpool_thread, NULL) != 0) {
+			csigpool_fini();
+			return -1;
+		}
+		nthreads++;
+	}
+	return 0;
+}
+
+/*
+ * Waits for verifications in progress to finish and discards all queued
+ * jobs.  Must be called after the last caller of csigpool_verify() has
+ * returned, so only abandoned jobs can be left in the queue.
+ */
+void
+csigpool_fini(void) {
+	csigpool_job_t *job;
+
+	pthread_mutex_lock(&mutex);
+	stopping = true;
+	pthread_cond_broadcast(&notempty);
+	pthread_mutex_unlock(&mutex);
+	for (size_t i = 0; i < nthreads; i++) {
+		if (pthread_join(threads[i], NULL) != 0) {
+			fprintf(stderr, "Failed to join codesign thread - "
+			                "exiting\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	nthreads = 0;
+
+	while (!tommy_list_empty(&jobs)) {
+		job = tommy_list_remove_existing(&jobs, tommy_list_head(&jobs));
+		assert(job->abandoned);
+		qsize--;
+		discards++;
+		job->late(job->arg, NULL);
+		csigpool_job_free(job);
+	}
+	assert(qsize == 0);
+}
+
+void
+csigpool_stats(csigpool_stat_t *st) {
+	assert(st);
+
+	pthread_mutex_lock(&mutex);
+	st->threads = nthreads;
+	st->busy = busy;
+	st->qsize = qsize;
+	st->submitted = submitted;
+	st->ontime = ontime;
+	st->pending = pending;
+	st->timeouts = timeouts;
+	st->late = late;
+	st->overflows = overflows;
+	st->discards = discards;
+	pthread_mutex_unlock(&mutex);
+}
+
@@ -0,0 +1,43 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef CSIGPOOL_H
+#define CSIGPOOL_H
+
+#include "codesign.h"
+#include "config.h"
+#include "attrib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*csigpool_late_func_t)(void *, codesign_t *);
+
+typedef struct {
+	uint32_t threads;
+	uint32_t busy;
+	uint32_t qsize;
+	uint64_t submitted;
+	uint64_t ontime;        /* verdict returned within the deadline */
+	uint64_t pending;       /* deferred, verification not yet started */
+	uint64_t timeouts;      /* deferred, verification did not finish */
+	uint64_t late;          /* deferred verdicts delivered */
+	uint64_t overflows;     /* queue full, not verified */
+	uint64_t discards;      /* deferred jobs discarded at shutdown */
+} csigpool_stat_t;
+
+int csigpool_init(config_t *) WUNRES NONNULL(1);
+void csigpool_fini(void);
+codesign_t * csigpool_verify(const char *, bool, csigpool_late_func_t, void *)
+             MALLOC NONNULL(1,3);
+void csigpool_stats(csigpool_stat_t *) NONNULL(1);
+
+#endif
+
@@ -0,0 +1,95 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Adaptive degradation controller.
+ *
+ * Driven by a timer on the event loop thread, the controller looks at the
+ * audit pipe backlog, kernel-side audit record drops, the work and log queue
+ * sizes and the end-to-end lag of logged events.  Under high pressure, it
+ * raises the degradation level by one step per update, shedding expensive
+ * work in order to keep up with the kernel and avoid losing audit records.
+ * Once the load has subsided for RECOVER_TICKS consecutive updates, it lowers
+ * the level by one step at a time.  The level is read lock-free by the
+ * monitoring cores.
+ */
+
+#include "degrade.h"
+
+#include "hysteresis.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <assert.h>
+
+#define HIGH_QSIZE      4096    /* work or log queue */
+#define LOW_QSIZE       256
+#define HIGH_LAG        10000000 /* usec */
+#define LOW_LAG         2000000  /* usec */
+#define RECOVER_TICKS   30
+
+static hysteresis_t ctl;
+static unsigned int lastdrops;
+
+void
+degrade_init(UNUSED config_t *cfg) {
+	hysteresis_init(&ctl, DEGRADE_MAX, RECOVER_TICKS);
+	lastdrops = 0;
+}
+
+/*
+ * Returns the new level if the level was changed, -1 otherwise.
+ */
+int
+degrade_update(const degrade_input_t *in) {
+	bool high, low;
+
+	high = (in->aupqlimit > 0 && in->aupqlen * 2 >= in->aupqlimit) ||
+	       (in->aupdrops != lastdrops) ||
+	       (in->wqsize >= HIGH_QSIZE) ||
+	       (in->lqsize >= HIGH_QSIZE) ||
+	       (in->lag >= HIGH_LAG);
+	low = (in->aupqlen * 8 < in->aupqlimit || in->aupqlimit == 0) &&
+	      (in->wqsize < LOW_QSIZE) &&
+	      (in->lqsize < LOW_QSIZE) &&
+	      (in->lag < LOW_LAG);
+	lastdrops = in->aupdrops;
+	return hysteresis_update(&ctl, high, low);
+}
+
+int
+degrade_level(void) {
+	return atomic_load_explicit(&ctl.level, memory_order_relaxed);
+}
+
+/*
+ * Paths protected by System Integrity Protection.  Executables at these
+ * paths cannot be modified without disabling SIP, which makes their hashes
+ * the least valuable to compute under load.
+ */
+bool
+degrade_system_path(const char *path) {
+	if (!strncmp(path, "/usr/local/", 11))
+		return false;
+	return !strncmp(path, "/System/", 8) ||
+	       !strncmp(path, "/usr/", 5) ||
+	       !strncmp(path, "/bin/", 5) ||
+	       !strncmp(path, "/sbin/", 6);
+}
+
+void
+degrade_stats(degrade_stat_t *st) {
+	assert(st);
+
+	st->level = (uint32_t)degrade_level();
+	st->maxlevel = (uint32_t)ctl.maxlevel;
+	st->changes = ctl.changes;
+}
+
@@ -0,0 +1,53 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef DEGRADE_H
+#define DEGRADE_H
+
+#include "config.h"
+#include "attrib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Degradation levels are cumulative; every level includes the measures of
+ * all lower levels.
+ */
+#define DEGRADE_NONE            0
+#define DEGRADE_CODESIGN        1       /* defer codesign on cache miss */
+#define DEGRADE_SYSHASH         2       /* skip hashing SIP-protected paths */
+#define DEGRADE_ENV             3       /* truncate exec env capture */
+#define DEGRADE_SOCKET          4       /* aggregate repeated socket events */
+#define DEGRADE_MAX             4
+
+typedef struct {
+	unsigned int aupqlen;
+	unsigned int aupqlimit;
+	unsigned int aupdrops;
+	uint32_t wqsize;
+	uint32_t lqsize;
+	uint64_t lag;           /* max end-to-end lag in usec since last input */
+} degrade_input_t;
+
+typedef struct {
+	uint32_t level;
+	uint32_t maxlevel;
+	uint64_t changes;
+} degrade_stat_t;
+
+void degrade_init(config_t *) NONNULL(1);
+int degrade_update(const degrade_input_t *) NONNULL(1) WUNRES;
+int degrade_level(void) WUNRES;
+bool degrade_system_path(const char *) NONNULL(1) WUNRES;
+void degrade_stats(degrade_stat_t *) NONNULL(1);
+
+#endif
+
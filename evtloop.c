@@ -18,10 +18,12 @@
 #include "time.h"
 #include "os.h"
 #include "policy.h"
+#include "queue.h"
 #include "debug.h"
 #include "attrib.h"
 
 #include <sys/ptrace.h>
+#include <sys/stat.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <limits.h>
@@ -36,6 +38,7 @@
 static bool running = true;     /* shared */
 static int kefd = -1;           /* shared */
 static FILE *auef = NULL;
+static bool auef_isreg = false;  /* trail is a regular file */
 static pid_t xnumon_pid;
 static uint64_t aupclobbers = 0;
 static uint64_t aueunknowns = 0;
@@ -56,6 +59,7 @@ static uint64_t radar42946744_fatal = 0;
 static uint64_t radar43151662_fatal = 0;        /* always fatal */
 static uint64_t missingtoken = 0;
 static uint64_t ooms = 0;
+static bool drained = false;
 
 static bool kextloop_running = true;
 static pthread_t kextloop_thr;
@@ -157,6 +161,22 @@ errout:
 	return -1;
 }
 
+/*
+ * Returns true if all attribute tokens of ev describe regular files.  Renames
+ * and unlinks of regular files cannot change how directories resolve and do
+ * not need to invalidate cached directories.
+ */
+static bool
+attrs_regular(audit_event_t *ev) {
+	if (ev->attr_count == 0)
+		return false;
+	for (size_t i = 0; i < ev->attr_count; i++) {
+		if (!S_ISREG(ev->attr[i].mode))
+			return false;
+	}
+	return true;
+}
+
 /*
  * Construct an absolute path from a possibly relative path and fully resolve
  * all symlinks.
@@ -178,7 +198,7 @@ path_resolve(char **path, const char **cwd, const char *unrpath,
 		*cwd = NULL;
 	}
 
-	*path = sys_realpath(unrpath, *cwd);
+	*path = cachedir_realpath(unrpath, *cwd);
 	if (!*path && (errno == ENOMEM))
 		ooms++;
 }
@@ -198,7 +218,7 @@ path_resolve_symlink(char **path, const char **cwd, const char *unrpath,
 		*cwd = NULL;
 	}
 
-	*path = sys_realdir(unrpath, *cwd);
+	*path = cachedir_realdir(unrpath, *cwd);
 	if (!*path && (errno == ENOMEM))
 		ooms++;
 }
@@ -242,6 +262,23 @@ path_resolve_symlink(char **path, const char **cwd, const char *unrpath,
 			auevent_fprint(stderr, &ev); \
 		break; \
 	}
+/*
+ * Returns true and stops the main loop if the trail has been read entirely.
+ */
+static bool
+auef_trail_eof(void) {
+	int c;
+
+	c = getc(auef);
+	if (c == EOF) {
+		fprintf(stderr, "End of trail\n");
+		running = false;
+		return true;
+	}
+	ungetc(c, auef);
+	return false;
+}
+
 static int
 auef_readable(UNUSED int fd, void *udata) {
 	config_t *cfg = (config_t *)udata;
@@ -251,15 +288,27 @@ auef_readable(UNUSED int fd, void *udata) {
 	const char *cpath;
 	bool flag;
 	int rv;
-
+	int envlevel;
+	uint64_t t0, t1;
+
+	envlevel = cfg->envlevel;
+	/* while degraded, only capture a bounded part of the environment */
+	if (envlevel > 0 && degrade_level() >= DEGRADE_ENV)
+		envlevel |= AUEVENT_FLAG_ENV_TRUNC;
+	/* stop once the writer of a FIFO trail is done */
+	if (cfg->trail && auef_trail_eof())
+		return 0;
 	auevent_create(&ev);
-	rv = auevent_fread(&ev, NULL, cfg->envlevel /* HACK */, auef);
+	t0 = aueprof_now();
+	rv = auevent_fread(&ev, NULL, envlevel /* HACK */, auef);
+	t1 = aueprof_now();
 	if (rv == -1 || rv == 0) {
 		if (ev.flags & AEFLAG_ENOMEM)
 			ooms++;
 		auevent_destroy(&ev);
 		return rv;
 	}
+	latency_aurd(&ev.tv);
 
 #ifdef DEBUG_AUDITPIPE
 	auevent_fprint(stderr, &ev);
@@ -374,7 +423,8 @@ auef_readable(UNUSED int fd, void *udata) {
 			             path,
 			             ev.attr_count > 0 ? &ev.attr[0] : NULL,
 			             ev.execarg,
-			             ev.execenv);
+			             ev.execenv,
+			             ev.flags & AEFLAG_ENVTRUNC);
 			ev.execarg = NULL; /* pass ownership to procmon */
 			ev.execenv = NULL; /* pass ownership to procmon */
 			break;
@@ -386,7 +436,8 @@ auef_readable(UNUSED int fd, void *udata) {
 		              path,
 		              ev.attr_count > 0 ? &ev.attr[0] : NULL,
 		              ev.execarg,
-		              ev.execenv);
+		              ev.execenv,
+		              ev.flags & AEFLAG_ENVTRUNC);
 		ev.execarg = NULL; /* pass ownership to procmon */
 		ev.execenv = NULL; /* pass ownership to procmon */
 		break;
@@ -420,7 +471,7 @@ auef_readable(UNUSED int fd, void *udata) {
 			break;
 		}
 		if (ev.type == AUE_MAC_EXECVE && (
-		    !ev.execarg || ((cfg->envlevel > 0) && !ev.execenv))) {
+		    !ev.execarg || ((envlevel > 0) && !ev.execenv))) {
 			/*
 			 * On at least 10.11.6, audit records for __mac_execve
 			 * are missing their exec arg and exec env tokens.
@@ -445,7 +496,8 @@ auef_readable(UNUSED int fd, void *udata) {
 		             path,
 		             ev.attr_count > 0 ? &ev.attr[0] : NULL,
 		             ev.execarg,
-		             ev.execenv);
+		             ev.execenv,
+		             ev.flags & AEFLAG_ENVTRUNC);
 		ev.execarg = NULL; /* pass ownership to procmon */
 		ev.execenv = NULL; /* pass ownership to procmon */
 		break;
@@ -604,11 +656,6 @@ auef_readable(UNUSED int fd, void *udata) {
 		}
 		path = (char *)(ev.path[1] ? ev.path[1] : ev.path[0]);
 		assert(path);
-		path = strdup(path);
-		if (!path) {
-			ooms++;
-			break;
-		}
 		filemon_touched(&ev.tv, &ev.subject, path);
 		break;
 
@@ -663,6 +710,7 @@ auef_readable(UNUSED int fd, void *udata) {
 			/* counted above */
 			break;
 		filemon_touched(&ev.tv, &ev.subject, path);
+		free(path);
 		break;
 
 	case AUE_RENAMEAT:
@@ -686,6 +734,9 @@ rename_et_al:
 		}
 		TOKEN_ASSERT("rename|link|clonefile|copyfile",
 		             "subject", ev.subject_present);
+		if ((ev.type == AUE_RENAME || ev.type == AUE_RENAMEAT) &&
+		    !attrs_regular(&ev))
+			cachedir_flush();
 		/*
 		 * On at least 10.11.6, AUE_RENAME and AUE_LINK records
 		 * include only an unresolved target path.
@@ -774,6 +825,7 @@ rename_et_al:
 			/* counted above */
 			break;
 		filemon_touched(&ev.tv, &ev.subject, path);
+		free(path);
 		break;
 
 	case AUE_SYMLINK:
@@ -834,6 +886,8 @@ rename_et_al:
 			break;
 		}
 		TOKEN_ASSERT("unlink", "subject", ev.subject_present);
+		if (!attrs_regular(&ev))
+			cachedir_flush();
 		if (ev.path[1]) {
 			/* two path tokens */
 			cpath = ev.path[1];
@@ -873,6 +927,20 @@ rename_et_al:
 		filemon_unlink(cpath, ev.attr_count > 0 ? &ev.attr[0] : NULL);
 		break;
 
+	case AUE_RMDIR:
+	case AUE_MOUNT:
+	case AUE_UNMOUNT:
+		/* only of interest for invalidating cached directories */
+		if (!LOGEVT_WANT(cfg->events, LOGEVT_FILEMON))
+			break;
+		TOKEN_ASSERT("rmdir|mount|unmount", "return", ev.return_present);
+		if (ev.return_value) {
+			failedsyscalls++;
+			break;
+		}
+		cachedir_flush();
+		break;
+
 	/*
 	 * Events for socket tracking.
 	 */
@@ -983,7 +1051,12 @@ rename_et_al:
 	}
 
 out:
+	aueprof_record(ev.type, ev.reclen, t1 - t0, aueprof_now() - t1);
 	auevent_destroy(&ev); /* free all allocated members not NULLed above */
+	/* kqueue does not signal EOF on regular files, check after each
+	 * record instead */
+	if (auef_isreg)
+		(void)auef_trail_eof();
 	return 0;
 }
 #undef TOKEN_ASSERT
@@ -1007,6 +1080,49 @@ sigtstp_arrived(UNUSED int sig, UNUSED void *udata) {
 	return 0;
 }
 
+/*
+ * Account memory per subsystem for the memory budget governor.  Objects of
+ * fixed size are accounted exactly, cache entries and queued events are
+ * estimated.
+ */
+static void
+budget_account(void) {
+	membudget_input_t in;
+	lrucache_stat_t lru;
+	cacheid_stat_t ci;
+	cachedir_stat_t cd;
+	procmon_stat_t pm;
+	filemon_stat_t fm;
+	strpool_stat_t sp;
+	aev_stat_t av;
+	work_stat_t wq;
+	log_stat_t lq;
+
+	cachehash_stats(&lru);
+	in.bytes[MEMBUDGET_CACHES] = lru.bytes;
+	cachecsig_stats(&lru);
+	in.bytes[MEMBUDGET_CACHES] += lru.bytes;
+	cacheldpl_stats(&lru);
+	in.bytes[MEMBUDGET_CACHES] += lru.bytes;
+	cacheid_stats(&ci);
+	in.bytes[MEMBUDGET_CACHES] += ci.lru.bytes;
+	cachedir_stats(&cd);
+	in.bytes[MEMBUDGET_CACHES] += cd.lru.bytes;
+	procmon_stats(&pm);
+	in.bytes[MEMBUDGET_IMAGES] = pm.imagebytes;
+	in.bytes[MEMBUDGET_PROCS] = pm.procbytes;
+	strpool_stats(&sp);
+	aev_stats(&av);
+	in.bytes[MEMBUDGET_STRINGS] = sp.bytes + av.bytes;
+	work_stats(&wq);
+	log_stats(&lq);
+	in.bytes[MEMBUDGET_QUEUES] = ((uint64_t)wq.qsize + lq.qsize) *
+	                             MEMBUDGET_EVENTSZ;
+	filemon_stats(&fm);
+	in.bytes[MEMBUDGET_SYMLINKS] = fm.slbytes;
+	membudget_account(&in);
+}
+
 void
 evtloop_stats(evtloop_stat_t *st) {
 	if (kefd != -1) {
@@ -1016,6 +1132,7 @@ evtloop_stats(evtloop_stat_t *st) {
 	hackmon_stats(&st->hm);
 	filemon_stats(&st->fm);
 	sockmon_stats(&st->sm);
+	execsum_stats(&st->es);
 	st->el_aupclobbers = aupclobbers;
 	st->el_aueunknowns = aueunknowns;
 	st->el_failedsyscalls = failedsyscalls;
@@ -1044,6 +1161,52 @@ evtloop_stats(evtloop_stat_t *st) {
 	cachehash_stats(&st->ch);
 	cachecsig_stats(&st->cc);
 	cacheldpl_stats(&st->cl);
+	cacheid_stats(&st->ci);
+	cachedir_stats(&st->cd);
+	strpool_stats(&st->sp);
+	aev_stats(&st->av);
+	latency_stats(&st->lt);
+	aueprof_stats(&st->ep);
+	degrade_stats(&st->dg);
+	budget_account();
+	membudget_stats(&st->mb);
+	csigpool_stats(&st->cp);
+	prehash_stats(&st->ph);
+}
+
+/*
+ * Print per-lane queue statistics as a continuation of the current line.
+ */
+static void
+siginfo_lanes(const queue_lane_stat_t *lanes) {
+	for (int i = 0; i < QUEUE_PRIOS; i++) {
+		fprintf(stderr, " %s:%"PRIu32"/%"PRIu64" "
+		                "wait:%"PRIu64"/%"PRIu64"us",
+		                queue_prio_s(i),
+		                lanes[i].qsize,
+		                lanes[i].dequeued,
+		                lanes[i].dequeued ?
+		                lanes[i].waittime / lanes[i].dequeued : 0,
+		                lanes[i].waitmax);
+	}
+	fprintf(stderr, "\n");
+}
+
+/*
+ * Print adaptive sizing statistics of a cache as an indented line; the
+ * estimated miss ratios are in permille at 1/4 to 8/4 of the current size.
+ */
+static void
+siginfo_lrucache(const lrucache_stat_t *lru) {
+	fprintf(stderr, "           "
+	                "ghosts:%"PRIu32" "
+	                "ghosthit:%"PRIu64" "   /* would hit if larger */
+	                "resize:%"PRIu64" "
+	                "mrc:",
+	                lru->ghosts, lru->ghosthits, lru->resizes);
+	for (int i = 0; i < LRUCACHE_MRC_POINTS; i++)
+		fprintf(stderr, "%s%"PRIu32, i ? "/" : "", lru->mrc[i]);
+	fprintf(stderr, "\n");
 }
 
 /*
@@ -1103,6 +1266,10 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                "ei:%"PRIu64" "
 	                "cs:%"PRIu64" "
 	                "gc:%"PRIu64" "
+	                "reap chk:%"PRIu64" "
+	                "prc:%"PRIu64" "
+	                "img:%"PRIu64" "
+	                "bytes:%"PRIu64" "
 	                "oom:%"PRIu64"\n",
 	                st.pm.procs,
 	                st.pm.images,
@@ -1113,14 +1280,20 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                st.pm.miss_execinterp,
 	                st.pm.miss_chdirsubj,
 	                st.pm.miss_getcwd,
+	                st.pm.reap_checks,
+	                st.pm.reap_procs,
+	                st.pm.reap_images,
+	                st.pm.reap_bytes,
 	                st.pm.ooms);
 
 	fprintf(stderr, "hackmon "
 	                "recvd:%"PRIu64" "
 	                "procd:%"PRIu64" "
+	                "suppressed:%"PRIu64" "
 	                "oom:%"PRIu64"\n",
 	                st.hm.recvd,
 	                st.hm.procd,
+	                st.hm.suppressed,
 	                st.hm.ooms);
 
 	fprintf(stderr, "filemon "
@@ -1136,11 +1309,29 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	fprintf(stderr, "sockmon "
 	                "recvd:%"PRIu64" "
 	                "procd:%"PRIu64" "
+	                "coalesced:%"PRIu64" "
+	                "aggregated:%"PRIu64"/%"PRIu64"/%"PRIu32" "
+	                "suppressed:%"PRIu64" "
 	                "oom:%"PRIu64"\n",
 	                st.sm.recvd,
 	                st.sm.procd,
+	                st.sm.coalesced,
+	                st.sm.aggregated,
+	                st.sm.summaries,
+	                st.sm.aggregates,
+	                st.sm.suppressed,
 	                st.sm.ooms);
 
+	fprintf(stderr, "execsum "
+	                "groups:%"PRIu32" "
+	                "folded:%"PRIu64" "
+	                "summaries:%"PRIu64" "
+	                "oom:%"PRIu64"\n",
+	                st.es.groups,
+	                st.es.folded,
+	                st.es.summaries,
+	                st.es.ooms);
+
 	if (kefd != -1) {
 		fprintf(stderr, "kext cdevq "
 		                "buckets:%"PRIu32"/~ "
@@ -1161,11 +1352,13 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 		                "lookup:%"PRIu64" "
 		                "miss:%"PRIu64" "       /* normal at startup */
 		                "drop:%"PRIu64" "       /* too many ooo */
+		                "expire:%"PRIu64" "     /* never claimed */
 		                "bktskip:%"PRIu64"\n",  /* ooo arrival search */
 		                st.pm.pqsize,
 		                st.pm.pqlookup,
 		                st.pm.pqmiss,
 		                st.pm.pqdrop,
+		                st.pm.pqexpired,
 		                st.pm.pqskip);
 	}
 
@@ -1181,8 +1374,9 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                st.ap.drops);
 
 	fprintf(stderr, "work queue "
-	                "buckets:%"PRIu32"/~\n",
+	                "buckets:%"PRIu32"/~",
 	                st.wq.qsize);
+	siginfo_lanes(st.wq.lanes);
 
 	fprintf(stderr, "log  queue "
 	                "buckets:%"PRIu32"/~ "
@@ -1194,6 +1388,8 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                "[5]:%"PRIu64" "
 	                "[6]:%"PRIu64" "
 	                "[7]:%"PRIu64" "
+	                "[8]:%"PRIu64" "
+	                "[9]:%"PRIu64" "
 	                "err:%"PRIu64"\n",
 	                st.lq.qsize,
 	                st.lq.counts[LOGEVT_XNUMON_OPS],
@@ -1204,8 +1400,111 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                st.lq.counts[LOGEVT_SOCKET_LISTEN],
 	                st.lq.counts[LOGEVT_SOCKET_ACCEPT],
 	                st.lq.counts[LOGEVT_SOCKET_CONNECT],
+	                st.lq.counts[LOGEVT_IMAGE_CODESIGN],
+	                st.lq.counts[LOGEVT_IMAGE_EXEC_SUMMARY],
 	                st.lq.errors);
-	_Static_assert(LOGEVT_SIZE == 8, "number of handled event types here");
+	_Static_assert(LOGEVT_SIZE == 10, "number of handled event types here");
+
+	fprintf(stderr, "log  lanes");
+	siginfo_lanes(st.lq.lanes);
+
+	fprintf(stderr, "log  dst   "
+	                "raw:%"PRIu64" "
+	                "out:%"PRIu64" "
+	                "blk:%"PRIu64" "
+	                "rot:%"PRIu64" "
+	                "cpu:%"PRIu64"us "
+	                "drop:%"PRIu64" "
+	                "spill:%"PRIu64" "
+	                "conn:%"PRIu64"\n",
+	                st.lq.dst.rawbytes,
+	                st.lq.dst.outbytes,
+	                st.lq.dst.blocks,
+	                st.lq.dst.rotations,
+	                st.lq.dst.cputime,
+	                st.lq.dst.drops,
+	                st.lq.dst.spills,
+	                st.lq.dst.connects);
+
+	fprintf(stderr, "latency    "
+	                "aurd:%"PRIu64"/%"PRIu64"/%"PRIu64"/%"PRIu64"us",
+	                st.lt.aurd.p50, st.lt.aurd.p99,
+	                st.lt.aurd.p999, st.lt.aurd.max);
+	for (int i = 0; i < LATENCY_STAGES; i++) {
+		fprintf(stderr, " %s:%"PRIu64"/%"PRIu64"/%"PRIu64"/%"PRIu64"us",
+		                latency_stage_s(i),
+		                st.lt.stage[i].p50, st.lt.stage[i].p99,
+		                st.lt.stage[i].p999, st.lt.stage[i].max);
+	}
+	fprintf(stderr, "\n");
+
+	fprintf(stderr, "degrade    "
+	                "level:%"PRIu32" "
+	                "max:%"PRIu32" "
+	                "changes:%"PRIu64"\n",
+	                st.dg.level,
+	                st.dg.maxlevel,
+	                st.dg.changes);
+
+	fprintf(stderr, "csig pool  "
+	                "threads:%"PRIu32"/%"PRIu32" "
+	                "buckets:%"PRIu32" "
+	                "submit:%"PRIu64" "
+	                "ontime:%"PRIu64" "
+	                "pending:%"PRIu64" "
+	                "timeout:%"PRIu64" "
+	                "late:%"PRIu64" "
+	                "overflow:%"PRIu64" "
+	                "discard:%"PRIu64"\n",
+	                st.cp.busy,
+	                st.cp.threads,
+	                st.cp.qsize,
+	                st.cp.submitted,
+	                st.cp.ontime,
+	                st.cp.pending,
+	                st.cp.timeouts,
+	                st.cp.late,
+	                st.cp.overflows,
+	                st.cp.discards);
+
+	fprintf(stderr, "prehash    "
+	                "active:%"PRIu32" "
+	                "history:%"PRIu32" "
+	                "passes:%"PRIu64" "
+	                "files:%"PRIu64" "
+	                "hashed:%"PRIu64"/%"PRIu64" "
+	                "csig:%"PRIu64"/%"PRIu64" "
+	                "bytes:%"PRIu64" "
+	                "err:%"PRIu64" "
+	                "defer:%"PRIu64" "
+	                "throttle:%"PRIu64"ms\n",
+	                st.ph.active,
+	                st.ph.history,
+	                st.ph.passes,
+	                st.ph.files,
+	                st.ph.hashed,
+	                st.ph.hashhits,
+	                st.ph.csigs,
+	                st.ph.csighits,
+	                st.ph.bytes,
+	                st.ph.errors,
+	                st.ph.deferrals,
+	                st.ph.throttled / 1000);
+
+	fprintf(stderr, "aue  prof  types:%zu\n", st.ep.types);
+	for (size_t i = 0; i < st.ep.top_count && i < 10; i++) {
+		fprintf(stderr, "           "
+		                "aue:%"PRIu16" "
+		                "n:%"PRIu64" "
+		                "parse:%"PRIu64"us "
+		                "handle:%"PRIu64"us "
+		                "bytes:%"PRIu64"\n",
+		                st.ep.top[i].type,
+		                st.ep.top[i].count,
+		                st.ep.top[i].parsetime / 1000,
+		                st.ep.top[i].handletime / 1000,
+		                st.ep.top[i].bytes);
+	}
 
 	fprintf(stderr, "hash cache "
 	                "buckets:%"PRIu32"/%"PRIu32" "
@@ -1218,6 +1517,7 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                st.ch.puts, st.ch.gets,
 	                st.ch.hits, st.ch.misses,
 	                st.ch.invalids);
+	siginfo_lrucache(&st.ch);
 
 	fprintf(stderr, "csig cache "
 	                "buckets:%"PRIu32"/%"PRIu32" "
@@ -1230,6 +1530,7 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                st.cc.puts, st.cc.gets,
 	                st.cc.hits, st.cc.misses,
 	                st.cc.invalids);
+	siginfo_lrucache(&st.cc);
 
 	fprintf(stderr, "ldpl cache "
 	                "buckets:%"PRIu32"/%"PRIu32" "
@@ -1242,6 +1543,78 @@ siginfo_arrived(UNUSED int sig, UNUSED void *udata) {
 	                st.cl.puts, st.cl.gets,
 	                st.cl.hits, st.cl.misses,
 	                st.cl.invalids);
+	siginfo_lrucache(&st.cl);
+
+	fprintf(stderr, "id cache   "
+	                "buckets:%"PRIu32"/%"PRIu32" "
+	                "put:%"PRIu64" "
+	                "get:%"PRIu64" "
+	                "hit:%"PRIu64" "
+	                "miss:%"PRIu64" "       /* once per uid/gid */
+	                "inv:%"PRIu64" "
+	                "neg:%"PRIu64" "        /* uid/gid without name */
+	                "stale:%"PRIu64" "
+	                "refresh:%"PRIu64" "
+	                "flush:%"PRIu64"\n",
+	                st.ci.lru.used, st.ci.lru.size,
+	                st.ci.lru.puts, st.ci.lru.gets,
+	                st.ci.lru.hits, st.ci.lru.misses,
+	                st.ci.lru.invalids,
+	                st.ci.negative, st.ci.stale,
+	                st.ci.refreshes, st.ci.flushes);
+	siginfo_lrucache(&st.ci.lru);
+
+	fprintf(stderr, "dir cache  "
+	                "buckets:%"PRIu32"/%"PRIu32" "
+	                "put:%"PRIu64" "
+	                "get:%"PRIu64" "
+	                "hit:%"PRIu64" "
+	                "miss:%"PRIu64" "       /* once per unresolved dir */
+	                "inv:%"PRIu64" "
+	                "exp:%"PRIu64" "
+	                "fast:%"PRIu64" "       /* resolved with one lstat */
+	                "flush:%"PRIu64"\n",   /* namespace changes */
+	                st.cd.lru.used, st.cd.lru.size,
+	                st.cd.lru.puts, st.cd.lru.gets,
+	                st.cd.lru.hits, st.cd.lru.misses,
+	                st.cd.lru.invalids,
+	                st.cd.expired, st.cd.fastpaths, st.cd.flushes);
+	siginfo_lrucache(&st.cd.lru);
+
+	fprintf(stderr, "strpool    "
+	                "strings:%"PRIu32" "
+	                "refs:%"PRIu64" "
+	                "bytes:%"PRIu64" "
+	                "saved:%"PRIu64" "      /* vs. private copies */
+	                "alloc:%"PRIu64" "
+	                "hit:%"PRIu64"\n",
+	                st.sp.strings, st.sp.refs,
+	                st.sp.bytes, st.sp.refbytes - st.sp.bytes,
+	                st.sp.allocs, st.sp.hits);
+
+	fprintf(stderr, "aev pool   "
+	                "blocks:%"PRIu32" "
+	                "deltas:%"PRIu32" "
+	                "bytes:%"PRIu64" "
+	                "saved:%"PRIu64" "      /* vs. private copies */
+	                "hit:%"PRIu64" "
+	                "render:%"PRIu64"\n",   /* serializations reused */
+	                st.av.blocks, st.av.deltas, st.av.bytes,
+	                st.av.refbytes > st.av.bytes ?
+	                st.av.refbytes - st.av.bytes : 0,
+	                st.av.hits, st.av.renders);
+
+	fprintf(stderr, "memory     "
+	                "level:%"PRIu32"/%"PRIu32" "
+	                "total:%"PRIu64"/%"PRIu64" "
+	                "peak:%"PRIu64,
+	                st.mb.level, st.mb.maxlevel,
+	                st.mb.total, st.mb.budget, st.mb.peak);
+	for (int i = 0; i < MEMBUDGET_SIZE; i++) {
+		fprintf(stderr, " %s:%"PRIu64,
+		                membudget_subsystem_s(i), st.mb.bytes[i]);
+	}
+	fprintf(stderr, " shed:%"PRIu64"\n", st.mb.shed);
 
 	return 0;
 }
@@ -1255,6 +1628,7 @@ sighup_arrived(UNUSED int sig, UNUSED void *udata) {
 		fprintf(stderr, "Failed to reopen the log\n");
 		return -1;
 	}
+	cacheid_flush();        /* pick up directory changes */
 	return 0;
 }
 
@@ -1268,6 +1642,101 @@ stats_timer_fired(UNUSED int ident, UNUSED void *udata) {
 	return 0;
 }
 
+/*
+ * Called by reaper timer, every second.
+ */
+static int
+reap_timer_fired(UNUSED int ident, UNUSED void *udata) {
+	procmon_reap();
+	return 0;
+}
+
+/*
+ * Called by memory budget timer, every second.
+ */
+static int
+budget_timer_fired(UNUSED int ident, void *udata) {
+	config_t *cfg = (config_t *)udata;
+	unsigned int pct;
+	int lvl;
+
+	budget_account();
+	lvl = membudget_update();
+	if (lvl == -1)
+		return 0;
+	pct = membudget_cache_pct(lvl);
+	cachehash_scale(pct);
+	cachecsig_scale(pct);
+	cacheldpl_scale(pct);
+	cacheid_scale(pct);
+	cachedir_scale(pct);
+	DEBUG(cfg->debug, "membudget",
+	      "level=%i caches=%u%%", lvl, pct);
+	return 0;
+}
+
+/*
+ * Called by socket aggregation timer, every second.
+ */
+static int
+sockagg_timer_fired(UNUSED int ident, UNUSED void *udata) {
+	sockmon_expire();
+	return 0;
+}
+
+/*
+ * Called by exec summary timer, every second.
+ */
+static int
+execsum_timer_fired(UNUSED int ident, UNUSED void *udata) {
+	execsum_expire();
+	return 0;
+}
+
+/*
+ * Called by cache sizing timer, every minute.
+ */
+static int
+cache_timer_fired(UNUSED int ident, void *udata) {
+	config_t *cfg = (config_t *)udata;
+	unsigned int minpct, maxpct;
+
+	minpct = (unsigned int)cfg->cache_size_min;
+	maxpct = (unsigned int)cfg->cache_size_max;
+	cachehash_adapt(minpct, maxpct);
+	cachecsig_adapt(minpct, maxpct);
+	cacheldpl_adapt(minpct, maxpct);
+	cacheid_adapt(minpct, maxpct);
+	cachedir_adapt(minpct, maxpct);
+	return 0;
+}
+
+/*
+ * Called by degradation timer, every second.
+ */
+static int
+degrade_timer_fired(UNUSED int ident, UNUSED void *udata) {
+	degrade_input_t in;
+	aupipe_stat_t ap;
+	work_stat_t wq;
+	log_stat_t lq;
+
+	aupipe_stats(fileno(auef), &ap);
+	work_stats(&wq);
+	log_stats(&lq);
+	in.aupqlen = ap.qlen;
+	in.aupqlimit = ap.qlimit;
+	in.aupdrops = ap.drops;
+	in.wqsize = wq.qsize;
+	in.lqsize = lq.qsize;
+	in.lag = latency_window_max();
+	if (degrade_update(&in) == -1)
+		return 0;
+	if ((log_event_xnumon_degrade() == -1) && (errno == ENOMEM))
+		ooms++;
+	return 0;
+}
+
 /*
  * Called by audit policy watchdog timer, every five minutes.
  */
@@ -1339,9 +1808,32 @@ sigusr1_arrived(UNUSED int sig, UNUSED void *udata) {
 	return 0;
 }
 
+/*
+ * Stop the producers of deferred events and have their pending events
+ * logged, such that they precede the xnumon-ops stop event.  Safe to call
+ * more than once.
+ */
+static void
+evtloop_drain(void) {
+	if (drained)
+		return;
+	drained = true;
+	prehash_fini();         /* stop crawler, save exec history */
+	sockmon_flush();        /* submit pending socket aggregates */
+	work_fini();            /* drain work queue */
+	csigpool_fini();        /* wait for pending codesign verdicts */
+	execsum_fini();         /* log pending exec summaries */
+}
+
 #define TIMER_AUPOL     1
 #define TIMER_STATS     2
 #define TIMER_CONFIG    3
+#define TIMER_DEGRADE   4
+#define TIMER_REAP      5
+#define TIMER_BUDGET    6
+#define TIMER_CACHE     7
+#define TIMER_SOCKAGG   8
+#define TIMER_EXECSUM   9
 
 int
 evtloop_run(config_t *cfg) {
@@ -1355,12 +1847,20 @@ evtloop_run(config_t *cfg) {
 	kevent_ctx_t aptm_ctx    = KEVENT_CTX_TIMER(aupol_timer_fired, cfg);
 	kevent_ctx_t sttm_ctx    = KEVENT_CTX_TIMER(stats_timer_fired, cfg);
 	kevent_ctx_t cftm_ctx    = KEVENT_CTX_TIMER(config_timer_fired, cfg);
+	kevent_ctx_t dgtm_ctx    = KEVENT_CTX_TIMER(degrade_timer_fired, cfg);
+	kevent_ctx_t rptm_ctx    = KEVENT_CTX_TIMER(reap_timer_fired, cfg);
+	kevent_ctx_t mbtm_ctx    = KEVENT_CTX_TIMER(budget_timer_fired, cfg);
+	kevent_ctx_t cstm_ctx    = KEVENT_CTX_TIMER(cache_timer_fired, cfg);
+	kevent_ctx_t satm_ctx    = KEVENT_CTX_TIMER(sockagg_timer_fired, cfg);
+	kevent_ctx_t estm_ctx    = KEVENT_CTX_TIMER(execsum_timer_fired, cfg);
 	kqueue_t *kq = NULL;
+	struct stat st;
 	int pidc;
 	pid_t *pidv;
 	int rv;
 
 	auef = NULL;
+	auef_isreg = false;
 	aupclobbers = 0;
 	aueunknowns = 0;
 	failedsyscalls = 0;
@@ -1380,34 +1880,49 @@ evtloop_run(config_t *cfg) {
 	radar43151662_fatal = 0;
 	missingtoken = 0;
 	ooms = 0;
+	drained = false;
 	xnumon_pid = getpid();
 
-	/* system-global audit(4) setup: audit policy */
-	aupol_wanted = AUDIT_ARGV;
-	if (cfg->envlevel > 0)
-		aupol_wanted |= AUDIT_ARGE;
-	if (aupol_timer_fired(TIMER_AUPOL, NULL) == -1)
-		goto errout;
+	/* replaying a trail must not reconfigure or monitor the live system */
+	if (cfg->trail)
+		cfg->kextlevel = 0;
 
-	/* system-global audit(4) setup: audit class */
-	if (auclass_addmask(AC_XNUMON, auclass_xnumon_events_procmon) == -1) {
-		fprintf(stderr, "Failed to configure AC_XNUMON class mask\n");
-		goto errout;
-	}
-	if (LOGEVT_WANT(cfg->events, LOGEVT_HACKMON) &&
-	    auclass_addmask(AC_XNUMON, auclass_xnumon_events_hackmon) == -1) {
-		fprintf(stderr, "Failed to configure AC_XNUMON class mask\n");
-		goto errout;
-	}
-	if (LOGEVT_WANT(cfg->events, LOGEVT_FILEMON) &&
-	    auclass_addmask(AC_XNUMON, auclass_xnumon_events_filemon) == -1) {
-		fprintf(stderr, "Failed to configure AC_XNUMON class mask\n");
-		goto errout;
-	}
-	if (LOGEVT_WANT(cfg->events, LOGEVT_SOCKMON) &&
-	    auclass_addmask(AC_XNUMON, auclass_xnumon_events_sockmon) == -1) {
-		fprintf(stderr, "Failed to configure AC_XNUMON class mask\n");
-		goto errout;
+	if (!cfg->trail) {
+		/* system-global audit(4) setup: audit policy */
+		aupol_wanted = AUDIT_ARGV;
+		if (cfg->envlevel > 0)
+			aupol_wanted |= AUDIT_ARGE;
+		if (aupol_timer_fired(TIMER_AUPOL, NULL) == -1)
+			goto errout;
+
+		/* system-global audit(4) setup: audit class */
+		if (auclass_addmask(AC_XNUMON,
+		                    auclass_xnumon_events_procmon) == -1) {
+			fprintf(stderr, "Failed to configure AC_XNUMON "
+			                "class mask\n");
+			goto errout;
+		}
+		if (LOGEVT_WANT(cfg->events, LOGEVT_HACKMON) &&
+		    auclass_addmask(AC_XNUMON,
+		                    auclass_xnumon_events_hackmon) == -1) {
+			fprintf(stderr, "Failed to configure AC_XNUMON "
+			                "class mask\n");
+			goto errout;
+		}
+		if (LOGEVT_WANT(cfg->events, LOGEVT_FILEMON) &&
+		    auclass_addmask(AC_XNUMON,
+		                    auclass_xnumon_events_filemon) == -1) {
+			fprintf(stderr, "Failed to configure AC_XNUMON "
+			                "class mask\n");
+			goto errout;
+		}
+		if (LOGEVT_WANT(cfg->events, LOGEVT_SOCKMON) &&
+		    auclass_addmask(AC_XNUMON,
+		                    auclass_xnumon_events_sockmon) == -1) {
+			fprintf(stderr, "Failed to configure AC_XNUMON "
+			                "class mask\n");
+			goto errout;
+		}
 	}
 
 	/* load kext */
@@ -1420,8 +1935,14 @@ evtloop_run(config_t *cfg) {
 		config_timer_init(cfg, TIMER_CONFIG);
 	}
 	cachehash_init();
-	cachecsig_init();
+	cachecsig_init(cfg->hflags);
 	cacheldpl_init();
+	cachedir_init();
+	if (cacheid_init() == -1) {
+		fprintf(stderr, "Failed to initialize id cache\n");
+		rv = -1;
+		goto errout_silent;
+	}
 	if (auevent_init() == -1) {
 		fprintf(stderr, "Failed to initialize auevent\n");
 		rv = -1;
@@ -1437,11 +1958,17 @@ evtloop_run(config_t *cfg) {
 		rv = -1;
 		goto errout_silent;
 	}
+	if (csigpool_init(cfg) == -1) {
+		fprintf(stderr, "Failed to initialize codesign pool\n");
+		rv = -1;
+		goto errout_silent;
+	}
 	if (log_init(cfg) == -1) {
 		fprintf(stderr, "Failed to initialize logging\n");
 		rv = -1;
 		goto errout_silent;
 	}
+	execsum_init(cfg);
 	if (work_init(cfg) == -1) {
 		fprintf(stderr, "Failed to initialize work queue\n");
 		rv = -1;
@@ -1459,6 +1986,13 @@ evtloop_run(config_t *cfg) {
 	}
 	hackmon_init(cfg);
 	sockmon_init(cfg);
+	degrade_init(cfg);
+	membudget_init(cfg);
+	if (prehash_init(cfg) == -1) {
+		fprintf(stderr, "Failed to initialize prehash\n");
+		rv = -1;
+		goto errout_silent;
+	}
 
 	/* try to spawn kextloop thread */
 	if (cfg->kextlevel > 0 && kextloop_spawn(&kefd_ctx) == -1) {
@@ -1530,26 +2064,46 @@ evtloop_run(config_t *cfg) {
 	}
 
 	/* open auditpipe to start queueing audit events */
-	if ((auef = aupipe_fopen(AC_XNUMON)) == NULL) {
+	if (cfg->trail) {
+		/* opening a FIFO blocks until the writer opens it */
+		if ((auef = fopen(cfg->trail, "r")) == NULL) {
+			fprintf(stderr, "fopen(%s): %s (%i)\n", cfg->trail,
+			                strerror(errno), errno);
+			rv = -1;
+			goto errout_silent;
+		}
+		/* unbuffered, so that kqueue readability reflects all
+		 * unread records */
+		setvbuf(auef, NULL, _IONBF, 0);
+		if (fstat(fileno(auef), &st) == -1) {
+			fprintf(stderr, "fstat(%s): %s (%i)\n", cfg->trail,
+			                strerror(errno), errno);
+			rv = -1;
+			goto errout_silent;
+		}
+		auef_isreg = S_ISREG(st.st_mode);
+	} else if ((auef = aupipe_fopen(AC_XNUMON)) == NULL) {
 		fprintf(stderr, "aupipe_fopen(AC_XNUMON) failed\n");
 		rv = -1;
 		goto errout_silent;
 	}
 
 	/* walk already running processes */
-	pidv = sys_pidlist(&pidc);
-	if (!pidv) {
-		fprintf(stderr, "sys_pidlist() failed\n");
-		rv = -1;
-		goto errout_silent;
-	}
-	fprintf(stderr, "Preloading pid");
-	for (int i = pidc - 1; i >= 0; i--) {
-		fprintf(stderr, " %i", pidv[i]);
-		procmon_preloadpid(pidv[i]);
+	if (!cfg->trail) {
+		pidv = sys_pidlist(&pidc);
+		if (!pidv) {
+			fprintf(stderr, "sys_pidlist() failed\n");
+			rv = -1;
+			goto errout_silent;
+		}
+		fprintf(stderr, "Preloading pid");
+		for (int i = pidc - 1; i >= 0; i--) {
+			fprintf(stderr, " %i", pidv[i]);
+			procmon_preloadpid(pidv[i]);
+		}
+		free(pidv);
+		fprintf(stderr, "\n");
 	}
-	free(pidv);
-	fprintf(stderr, "\n");
 
 	/* log xnumon start */
 	if (log_event_xnumon_start() == -1) {
@@ -1568,23 +2122,87 @@ evtloop_run(config_t *cfg) {
 	}
 
 	/* start audit(4) policy watchdog timer */
-	rv = kqueue_add_timer(kq, TIMER_AUPOL, 300, &aptm_ctx);
+	if (!cfg->trail) {
+		rv = kqueue_add_timer(kq, TIMER_AUPOL, 300, &aptm_ctx);
+		if (rv == -1) {
+			fprintf(stderr, "kqueue_add_timer(TIMER_AUPOL) failed: "
+			                "%s (%i)\n", strerror(errno), errno);
+			rv = -1;
+			goto errout;
+		}
+	}
+
+	/* start stats timer */
+	rv = kqueue_add_timer(kq, TIMER_STATS, cfg->stats_interval, &sttm_ctx);
+	if (rv == -1) {
+		fprintf(stderr, "kqueue_add_timer(TIMER_STATS) failed: "
+		                "%s (%i)\n", strerror(errno), errno);
+		rv = -1;
+		goto errout;
+	}
+
+	/* start reaper timer */
+	rv = kqueue_add_timer(kq, TIMER_REAP, 1, &rptm_ctx);
 	if (rv == -1) {
-		fprintf(stderr, "kqueue_add_timer(TIMER_AUPOL) failed: "
+		fprintf(stderr, "kqueue_add_timer(TIMER_REAP) failed: "
 		                "%s (%i)\n", strerror(errno), errno);
 		rv = -1;
 		goto errout;
 	}
 
-	/* start stats timer */
-	rv = kqueue_add_timer(kq, TIMER_STATS, cfg->stats_interval, &sttm_ctx);
+	/* start cache sizing timer */
+	rv = kqueue_add_timer(kq, TIMER_CACHE, 60, &cstm_ctx);
 	if (rv == -1) {
-		fprintf(stderr, "kqueue_add_timer(TIMER_STATS) failed: "
+		fprintf(stderr, "kqueue_add_timer(TIMER_CACHE) failed: "
 		                "%s (%i)\n", strerror(errno), errno);
 		rv = -1;
 		goto errout;
 	}
 
+	if (cfg->socket_aggregate_window > 0 || cfg->adaptive_degradation) {
+		/* start socket aggregation timer */
+		rv = kqueue_add_timer(kq, TIMER_SOCKAGG, 1, &satm_ctx);
+		if (rv == -1) {
+			fprintf(stderr, "kqueue_add_timer(TIMER_SOCKAGG) failed"
+			                ": %s (%i)\n", strerror(errno), errno);
+			rv = -1;
+			goto errout;
+		}
+	}
+
+	if (cfg->exec_summary_window > 0) {
+		/* start exec summary timer */
+		rv = kqueue_add_timer(kq, TIMER_EXECSUM, 1, &estm_ctx);
+		if (rv == -1) {
+			fprintf(stderr, "kqueue_add_timer(TIMER_EXECSUM) failed"
+			                ": %s (%i)\n", strerror(errno), errno);
+			rv = -1;
+			goto errout;
+		}
+	}
+
+	if (cfg->memory_budget > 0) {
+		/* start memory budget governor timer */
+		rv = kqueue_add_timer(kq, TIMER_BUDGET, 1, &mbtm_ctx);
+		if (rv == -1) {
+			fprintf(stderr, "kqueue_add_timer(TIMER_BUDGET) failed"
+			                ": %s (%i)\n", strerror(errno), errno);
+			rv = -1;
+			goto errout;
+		}
+	}
+
+	if (cfg->adaptive_degradation) {
+		/* start degradation controller timer */
+		rv = kqueue_add_timer(kq, TIMER_DEGRADE, 1, &dgtm_ctx);
+		if (rv == -1) {
+			fprintf(stderr, "kqueue_add_timer(TIMER_DEGRADE) failed"
+			                ": %s (%i)\n", strerror(errno), errno);
+			rv = -1;
+			goto errout;
+		}
+	}
+
 	if (cfg->launchd_mode) {
 		/* start config file timer */
 		rv = kqueue_add_timer(kq, TIMER_CONFIG, 300, &cftm_ctx);
@@ -1617,8 +2235,9 @@ evtloop_run(config_t *cfg) {
 
 	rv = 0;
 errout:
-	/* log xnumon stats and stop */
+	/* log deferred events, xnumon stats and stop */
 	DEBUG(cfg->debug, "xnumon_stop", "shutting down");
+	evtloop_drain();
 	(void)log_event_xnumon_stats();
 	if (log_event_xnumon_stop() == -1) {
 		fprintf(stderr, "log_event_xnumon_stop() failed\n");
@@ -1628,12 +2247,13 @@ errout:
 
 errout_silent:
 	/* system-global audit(4) cleanup */
-	if (auclass_removemask(AC_XNUMON,
-	                       auclass_xnumon_events_procmon) == -1 ||
-	    auclass_removemask(AC_XNUMON,
-	                       auclass_xnumon_events_hackmon) == -1 ||
-	    auclass_removemask(AC_XNUMON,
-	                       auclass_xnumon_events_filemon) == -1) {
+	if (!cfg->trail &&
+	    (auclass_removemask(AC_XNUMON,
+	                        auclass_xnumon_events_procmon) == -1 ||
+	     auclass_removemask(AC_XNUMON,
+	                        auclass_xnumon_events_hackmon) == -1 ||
+	     auclass_removemask(AC_XNUMON,
+	                        auclass_xnumon_events_filemon) == -1)) {
 		fprintf(stderr, "Failed to configure AC_XNUMON class mask\n");
 	}
 
@@ -1643,7 +2263,7 @@ errout_silent:
 		fclose(auef);
 		auef = NULL;
 	}
-	work_fini();            /* drain work queue */
+	evtloop_drain();        /* if not done before stop */
 	sockmon_fini();
 	hackmon_fini();
 	filemon_fini();
@@ -1652,9 +2272,13 @@ errout_silent:
 	assert(procmon_images() == 0);
 	codesign_fini();
 	os_fini();
+	cacheid_fini();
+	cachedir_fini();
 	cacheldpl_fini();
 	cachecsig_fini();
 	cachehash_fini();
+	strpool_fini();
+	aev_fini();
 	return rv;
 }
 
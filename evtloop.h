@@ -19,11 +19,22 @@
 #include "hackmon.h"
 #include "filemon.h"
 #include "sockmon.h"
+#include "execsum.h"
 #include "log.h"
 #include "work.h"
 #include "cachehash.h"
 #include "cachecsig.h"
 #include "cacheldpl.h"
+#include "cacheid.h"
+#include "cachedir.h"
+#include "strpool.h"
+#include "aev.h"
+#include "latency.h"
+#include "aueprof.h"
+#include "degrade.h"
+#include "membudget.h"
+#include "csigpool.h"
+#include "prehash.h"
 #include "logevt.h"
 #include "attrib.h"
 
@@ -34,6 +45,7 @@ typedef struct {
 	hackmon_stat_t hm;
 	filemon_stat_t fm;
 	sockmon_stat_t sm;
+	execsum_stat_t es;
 	xnumon_stat_t ke;
 	uint64_t el_aueunknowns;
 	uint64_t el_aupclobbers;
@@ -63,6 +75,16 @@ typedef struct {
 	lrucache_stat_t ch;
 	lrucache_stat_t cc;
 	lrucache_stat_t cl;
+	cacheid_stat_t ci;
+	cachedir_stat_t cd;
+	strpool_stat_t sp;
+	aev_stat_t av;
+	latency_stat_t lt;
+	aueprof_stat_t ep;
+	degrade_stat_t dg;
+	membudget_stat_t mb;
+	csigpool_stat_t cp;
+	prehash_stat_t ph;
 } evtloop_stat_t;
 
 int evtloop_run(config_t *) NONNULL(1);
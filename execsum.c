@@ -0,0 +1,323 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Exec storm summarization.
+ *
+ * With exec_summary_window set, execs are grouped by image hashes, code
+ * signing identity, script path and parent image path.  The first exec of a
+ * group is logged individually as image-exec[2] and opens a window of
+ * exec_summary_window seconds; further execs of the same group within the
+ * window are not logged individually, but folded into a single
+ * image-exec-summary[9] event, which carries the first folded exec in full
+ * along with the count, the times of the first and last folded exec and up
+ * to EXECSUM_SAMPLES distinct argv vectors.  The summary is logged once the
+ * window has passed.
+ *
+ * Only execs with hashes and a final code signature verdict are grouped;
+ * reconstructed execs and execs with pending verdicts are always logged
+ * individually.
+ *
+ * Folding is done by the worker thread, expiry by a timer on the event loop
+ * thread.
+ */
+
+#include "execsum.h"
+
+#include "log.h"
+#include "strpool.h"
+#include "aev.h"
+#include "time.h"
+#include "latency.h"
+#include "atomic.h"
+#include "tommyhash.h"
+#include "tommyhashdyn.h"
+#include "tommylist.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define EXECSUM_MAX     4096    /* max number of groups */
+
+typedef struct {
+	hashes_t hashes;
+	const char *path;       /* strpool */
+	const char *script;     /* strpool */
+	const char *parent;     /* strpool */
+	const char *ident;      /* strpool */
+	const char *teamid;     /* strpool */
+	int csresult;
+} execsum_key_t;
+
+typedef struct {
+	tommy_hashdyn_node h_node;
+	tommy_node l_node;
+	execsum_key_t key;
+	time_t expiry;
+	image_exec_summary_t *sum; /* NULL until first folded exec */
+} execsum_group_t;
+
+static config_t *config;
+static bool enabled;
+static tommy_hashdyn groups;
+static tommy_list grouplist;    /* in order of creation and expiry */
+static pthread_mutex_t mutex;
+
+static uint64_t folded;
+static uint64_t summaries;
+static atomic64_t ooms;
+
+static void
+image_exec_summary_free(image_exec_summary_t *sum) {
+	assert(sum);
+	image_exec_free(sum->image);
+	for (size_t i = 0; i < sum->samples; i++)
+		aev_unref(sum->sample_argv[i]);
+	free(sum);
+}
+
+static image_exec_summary_t *
+image_exec_summary_new(image_exec_t *ie) {
+	image_exec_summary_t *sum;
+
+	sum = malloc(sizeof(image_exec_summary_t));
+	if (!sum)
+		return NULL;
+	bzero(sum, sizeof(image_exec_summary_t));
+	sum->hdr.code = LOGEVT_IMAGE_EXEC_SUMMARY;
+	sum->hdr.le_free = (__typeof__(sum->hdr.le_free))
+	                   image_exec_summary_free;
+	image_exec_ref(ie);
+	sum->image = ie;
+	sum->first_tv = ie->hdr.tv;
+	return sum;
+}
+
+/*
+ * Account an exec in the summary.  Interned argv vectors are shared between
+ * execs with identical arguments, so distinct samples can be told apart by
+ * pointer.
+ */
+static void
+image_exec_summary_add(image_exec_summary_t *sum, image_exec_t *ie) {
+	sum->count++;
+	sum->last_tv = ie->hdr.tv;
+	if (!ie->argv || sum->samples == EXECSUM_SAMPLES)
+		return;
+	for (size_t i = 0; i < sum->samples; i++) {
+		if (sum->sample_argv[i] == ie->argv)
+			return;
+	}
+	sum->sample_pid[sum->samples] = ie->pid;
+	sum->sample_argv[sum->samples] = aev_ref(ie->argv);
+	sum->samples++;
+}
+
+/*
+ * Compare field by field, since padding is not preserved by assignment.
+ * Interned strings are compared by pointer.
+ */
+static int
+execsum_cmp(const void *arg, const void *obj) {
+	const execsum_key_t *key = arg;
+	const execsum_key_t *gkey = &((const execsum_group_t *)obj)->key;
+
+	if (key->path != gkey->path || key->script != gkey->script ||
+	    key->parent != gkey->parent || key->ident != gkey->ident ||
+	    key->teamid != gkey->teamid || key->csresult != gkey->csresult)
+		return 1;
+	return memcmp(&key->hashes, &gkey->hashes, sizeof(hashes_t));
+}
+
+static void
+execsum_key_ref(execsum_key_t *key) {
+	const char *strs[] = {key->path, key->script, key->parent,
+	                      key->ident, key->teamid};
+	for (size_t i = 0; i < sizeof(strs)/sizeof(strs[0]); i++) {
+		if (strs[i])
+			strpool_ref(strs[i]);
+	}
+}
+
+static void
+execsum_key_unref(execsum_key_t *key) {
+	const char *strs[] = {key->path, key->script, key->parent,
+	                      key->ident, key->teamid};
+	for (size_t i = 0; i < sizeof(strs)/sizeof(strs[0]); i++) {
+		if (strs[i])
+			strpool_unref(strs[i]);
+	}
+}
+
+/*
+ * Remove a group and log its summary, if any.  Caller must hold the mutex.
+ */
+static void
+execsum_remove(execsum_group_t *grp) {
+	tommy_hashdyn_remove_existing(&groups, &grp->h_node);
+	tommy_list_remove_existing(&grouplist, &grp->l_node);
+	if (grp->sum) {
+		grp->sum->hdr.tv = grp->sum->last_tv;
+		grp->sum->hdr.ts = latency_now();
+		summaries++;
+		log_submit(grp->sum);
+	}
+	execsum_key_unref(&grp->key);
+	free(grp);
+}
+
+/*
+ * Returns false if the exec is not eligible for grouping; fills in key
+ * otherwise.
+ */
+static bool
+execsum_key(execsum_key_t *key, image_exec_t *ie) {
+	if (!(ie->flags & EIFLAG_HASHES) || !ie->path)
+		return false;
+	if (ie->flags & (EIFLAG_PIDLOOKUP|EIFLAG_NOPATH|
+	                 EIFLAG_CSPENDING|EIFLAG_CSTIMEOUT))
+		return false;
+	if (config->codesign && !ie->codesign)
+		return false;
+
+	bzero(key, sizeof(execsum_key_t));
+	key->hashes = ie->hashes;
+	key->path = ie->path;
+	if (ie->script)
+		key->script = ie->script->path;
+	if (ie->prev)
+		key->parent = ie->prev->path;
+	if (ie->codesign) {
+		key->csresult = ie->codesign->result;
+		if (codesign_is_good(ie->codesign)) {
+			key->ident = ie->codesign->ident;
+			key->teamid = ie->codesign->teamid;
+		}
+	}
+	return true;
+}
+
+/*
+ * Returns true if the exec was folded into a summary and must not be logged
+ * individually.  Called by the worker thread after suppressions were applied.
+ */
+bool
+execsum_fold(image_exec_t *ie) {
+	execsum_key_t key;
+	execsum_group_t *grp;
+	tommy_hash_t h;
+	bool rv = false;
+
+	if (!enabled || !execsum_key(&key, ie))
+		return false;
+	h = tommy_hash_u32(0, &key, sizeof(key));
+
+	pthread_mutex_lock(&mutex);
+	grp = tommy_hashdyn_search(&groups, execsum_cmp, &key, h);
+	if (grp && grp->expiry <= ie->hdr.tv.tv_sec) {
+		execsum_remove(grp);
+		grp = NULL;
+	}
+	if (!grp) {
+		/* novel within the window, log individually */
+		if (tommy_hashdyn_count(&groups) >= EXECSUM_MAX)
+			execsum_remove(tommy_list_head(&grouplist)->data);
+		grp = malloc(sizeof(execsum_group_t));
+		if (!grp) {
+			atomic64_inc(&ooms);
+			goto out;
+		}
+		grp->key = key;
+		execsum_key_ref(&grp->key);
+		grp->expiry = ie->hdr.tv.tv_sec + config->exec_summary_window;
+		grp->sum = NULL;
+		tommy_hashdyn_insert(&groups, &grp->h_node, grp, h);
+		tommy_list_insert_tail(&grouplist, &grp->l_node, grp);
+		goto out;
+	}
+	if (!grp->sum) {
+		grp->sum = image_exec_summary_new(ie);
+		if (!grp->sum) {
+			atomic64_inc(&ooms);
+			goto out;
+		}
+	}
+	image_exec_summary_add(grp->sum, ie);
+	folded++;
+	rv = true;
+out:
+	pthread_mutex_unlock(&mutex);
+	return rv;
+}
+
+/*
+ * Log the summaries whose window has passed.  Called once per second while
+ * summarization is enabled.
+ */
+void
+execsum_expire(void) {
+	struct timespec now;
+	execsum_group_t *grp;
+
+	if (timespec_nanotime(&now) == -1)
+		return;
+	pthread_mutex_lock(&mutex);
+	while (!tommy_list_empty(&grouplist)) {
+		grp = tommy_list_head(&grouplist)->data;
+		if (grp->expiry > now.tv_sec)
+			break;
+		execsum_remove(grp);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+execsum_init(config_t *cfg) {
+	config = cfg;
+	enabled = cfg->exec_summary_window > 0 &&
+	          LOGEVT_WANT(cfg->events,
+	                      LOGEVT_FLAG(LOGEVT_IMAGE_EXEC_SUMMARY));
+	folded = 0;
+	summaries = 0;
+	ooms = 0;
+	pthread_mutex_init(&mutex, NULL);
+	tommy_hashdyn_init(&groups);
+	tommy_list_init(&grouplist);
+}
+
+/*
+ * Must be called after the work queue was drained and before the log queue
+ * is; pending summaries are logged.
+ */
+void
+execsum_fini(void) {
+	if (!config)
+		return;
+	while (!tommy_list_empty(&grouplist))
+		execsum_remove(tommy_list_head(&grouplist)->data);
+	tommy_hashdyn_done(&groups);
+	pthread_mutex_destroy(&mutex);
+	config = NULL;
+}
+
+void
+execsum_stats(execsum_stat_t *st) {
+	assert(st);
+
+	pthread_mutex_lock(&mutex);
+	st->groups = tommy_hashdyn_count(&groups);
+	st->folded = folded;
+	st->summaries = summaries;
+	pthread_mutex_unlock(&mutex);
+	st->ooms = (uint64_t)ooms;
+}
+
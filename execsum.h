@@ -0,0 +1,55 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef EXECSUM_H
+#define EXECSUM_H
+
+#include "procmon.h"
+#include "logevt.h"
+#include "config.h"
+#include "attrib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define EXECSUM_SAMPLES 4       /* distinct argv samples per summary */
+
+typedef struct {
+	uint32_t groups;
+	uint64_t folded;        /* execs folded into summaries */
+	uint64_t summaries;     /* summary events logged */
+	uint64_t ooms;
+} execsum_stat_t;
+
+/*
+ * Summary of execs of the same image by the same parent image within the
+ * exec_summary_window, logged as image-exec-summary[9].
+ */
+typedef struct {
+	logevt_header_t hdr;
+
+	image_exec_t *image;    /* first summarized exec */
+	uint64_t count;
+	struct timespec first_tv;
+	struct timespec last_tv;
+	size_t samples;
+	pid_t sample_pid[EXECSUM_SAMPLES];
+	char **sample_argv[EXECSUM_SAMPLES]; /* aev */
+} image_exec_summary_t;
+
+void execsum_init(config_t *) NONNULL(1);
+void execsum_fini(void);
+bool execsum_fold(image_exec_t *) NONNULL(1) WUNRES;
+void execsum_expire(void);
+void execsum_stats(execsum_stat_t *) NONNULL(1);
+
+#endif
+
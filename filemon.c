@@ -30,9 +30,7 @@
 #include "cf.h"
 #include "cacheldpl.h"
 #include "atomic.h"
-#include "tommyhashdyn.h"
-#include "tommylist.h"
-#include "minmax.h"
+#include "symlinks.h"
 
 #include <sys/stat.h>
 #include <stdlib.h>
@@ -57,200 +55,21 @@ static bool filemon_is_launchd_path(const char *);
  * Symlinks tracking for launchd add
  */
 
-static tommy_hashdyn symlinks;
-static tommy_list symlinks_dangling; /* subset of symlinks */
-
-typedef struct symlinks_obj {
-	tommy_hashdyn_node h_node;
-	tommy_node l_node;
-	char *path;
-
-	/*
-	 * Object is in one of three states at all times:
-	 * a) is_regular_file == false, target == NULL, in symlinks_dangling
-	 * b) is_regular_file == false, target != NULL, in target->origins
-	 * c) is_regular_file == true, target == NULL, not in any list
-	 */
-	bool is_regular_file;
-	tommy_list origins;
-	struct symlinks_obj *target;
-} symlinks_obj_t;
-
-static symlinks_obj_t *
-symlinks_obj_new(char *path) {
-	symlinks_obj_t *obj;
-
-	obj = malloc(sizeof(symlinks_obj_t));
-	if (!obj)
-		return NULL;
-	bzero(obj, sizeof(symlinks_obj_t));
-	obj->path = path;
-	tommy_list_init(&obj->origins);
-	return obj;
-}
-
 static void
-symlinks_obj_free(void *arg) {
-	symlinks_obj_t *obj = arg;
-	free(obj->path);
-	free(obj);
-}
-
-static int
-symlinks_obj_cmp(const void *path, const void* obj) {
-	return strcmp(((const symlinks_obj_t*)obj)->path, path);
-}
+filemon_symlinks_walk(const char *path,
+                      struct timespec *tv, audit_proc_t *subject) {
+	char *root;
 
-static void
-symlinks_init(void) {
-	tommy_hashdyn_init(&symlinks);
-	tommy_list_init(&symlinks_dangling);
-}
-
-static void
-symlinks_fini(void) {
-	tommy_hashdyn_foreach(&symlinks, symlinks_obj_free);
-	tommy_hashdyn_done(&symlinks);
-}
-
-static symlinks_obj_t *
-symlinks_path_find(const char *path) {
-	return tommy_hashdyn_search(&symlinks, symlinks_obj_cmp, path,
-	                            tommy_strhash_u32(0, path));
-}
-
-#define symlinks_path_is_relevant(P) ((bool)symlinks_path_find(P))
-
-/*
- * If origin != NULL, indicates the origin that is being removed and therefore
- * wants to unreference obj.  If origin == NULL, this is a direct unlink from
- * an event.
- */
-static void
-symlinks_obj_unref(symlinks_obj_t *obj, symlinks_obj_t *origin) {
-	if (origin) {
-		origin->target = NULL;
-		tommy_list_remove_existing(&obj->origins, &origin->l_node);
-		tommy_list_insert_head(&symlinks_dangling,
-		                       &origin->l_node, origin);
-	}
-	if (!tommy_list_empty(&obj->origins))
-		return;
-
-	/* this node needs to be removed, no origins point to this anymore */
-	if (obj->target) {
-		symlinks_obj_unref(obj->target, obj);
-	}
-	tommy_hashdyn_remove_existing(&symlinks, &obj->h_node);
-	if (!obj->is_regular_file) {
-		tommy_list_remove_existing(&symlinks_dangling, &obj->l_node);
-	}
-	symlinks_obj_free(obj);
-}
-
-/*
- * Copies path.
- */
-static symlinks_obj_t *
-symlinks_path_add(const char *path, symlinks_obj_t *origin) {
-	symlinks_obj_t *obj;
-
-	tommy_hash_t h;
-	h = tommy_strhash_u32(0, path);
-	obj = tommy_hashdyn_search(&symlinks, symlinks_obj_cmp, path, h);
-	if (!obj) {
-		obj = symlinks_obj_new(strdup(path));
-		if (!obj)
-			return NULL;
-		tommy_hashdyn_insert(&symlinks, &obj->h_node, obj, h);
-		tommy_list_insert_head(&symlinks_dangling, &obj->l_node, obj);
-	}
-	assert(obj);
-	if (origin && (origin->target == NULL)) {
-		origin->target = obj;
-		if (origin->is_regular_file) {
-			origin->is_regular_file = false;
-		} else {
-			tommy_list_remove_existing(&symlinks_dangling,
-			                           &origin->l_node);
-		}
-		tommy_list_insert_head(&obj->origins, &origin->l_node, origin);
-	}
-	return obj;
-}
-
-static void
-symlinks_path_walk(const char *path,
-                   struct timespec *tv, audit_proc_t *subject) {
-	symlinks_obj_t *obj, *root;
-	char *target, *rtarget;
-
-	root = obj = symlinks_path_add(path, NULL);
-	assert(obj);
-	rtarget = strdup(path);
-	if (!rtarget) {
-		ooms++;
-		return;
-	}
-	while (rtarget) {
-		target = sys_readlink(rtarget);
-		free(rtarget);
-		if (!target)
-			break;
-		rtarget = sys_realdir(target, "/");
-		if (!rtarget) {
-			/* directory part may not exist, add unresolved */
-			obj = symlinks_path_add(target, obj);
-			free(target);
-			break;
-		}
-		free(target);
-		obj = symlinks_path_add(rtarget, obj);
-	}
-
-	if (!obj->is_regular_file && sys_islnk(obj->path) != 1) {
-		if (obj->target)
-			symlinks_obj_unref(obj->target, obj);
-		tommy_list_remove_existing(&symlinks_dangling, &obj->l_node);
-		obj->is_regular_file = true;
-	}
-
-	if (!tv)
+	root = symlinks_walk(path);
+	if (!root) {
+		atomic64_inc(&ooms);
 		return;
-
-	assert(root);
-	/* walk up to the actual root for logging */
-	while (!tommy_list_empty(&root->origins)) {
-		root = tommy_list_head(&root->origins)->data;
 	}
-	if (!filemon_is_launchd_path(root->path) &&
-	    !tommy_list_empty(&symlinks_dangling)) {
+	if (!filemon_is_launchd_path(root)) {
 		/* limit aggressively */
-		size_t n = min(tommy_list_count(&symlinks_dangling),
-		               (size_t)16);
-		char *paths[n];
-		char **pp = paths;
-		tommy_node *dsl = tommy_list_head(&symlinks_dangling);
-		while (dsl) {
-			symlinks_obj_t *dslobj = dsl->data;
-			*(pp++) = dslobj->path;
-			dsl = dsl->next;
-		}
-		for (size_t i = 0; i < n; i++) {
-			symlinks_path_walk(paths[i], NULL, NULL);
-		}
+		symlinks_walk_dangling(16);
 	}
-	filemon_launchd_touched(tv, subject, strdup(root->path));
-}
-
-static void
-symlinks_path_remove(const char *path) {
-	symlinks_obj_t * obj;
-
-	obj = symlinks_path_find(path);
-	if (!obj)
-		return;
-	symlinks_obj_unref(obj, NULL);
+	filemon_launchd_touched(tv, subject, root);
 }
 
 static bool
@@ -458,20 +277,26 @@ filemon_launchd_touched(struct timespec *tv, audit_proc_t *subject,
 
 /*
  * Called for all file close, rename etc events with path to the potentially
- * changed file.  Guarantees path to be freed regardless of outcome.
+ * changed file.  Path is not freed; it is only copied if it is relevant.
  *
  * Assumes that path is an absolute and fully resolved path to a real file, not
  * a symlink.  However, path may or may not be a hard link.
  */
 void
-filemon_touched(struct timespec *tv, audit_proc_t *subject, char *path) {
+filemon_touched(struct timespec *tv, audit_proc_t *subject,
+                const char *path) {
+	char *cp;
+
 	events_recvd++;
-	if (symlinks_path_is_relevant(path) || filemon_is_launchd_path(path)) {
+	if (symlinks_is_relevant(path) || filemon_is_launchd_path(path)) {
 		events_procd++;
-		filemon_launchd_touched(tv, subject, path);
-		return;
+		cp = strdup(path);
+		if (!cp) {
+			atomic64_inc(&ooms);
+			return;
+		}
+		filemon_launchd_touched(tv, subject, cp);
 	}
-	free(path);
 }
 
 /*
@@ -490,9 +315,9 @@ filemon_unlink(const char *path, audit_attr_t *attr) {
 			return;
 	}
 
-	if (symlinks_path_is_relevant(path)) {
+	if (symlinks_is_relevant(path)) {
 		events_procd++;
-		symlinks_path_remove(path);
+		symlinks_remove(path);
 	}
 }
 
@@ -506,9 +331,9 @@ filemon_unlink(const char *path, audit_attr_t *attr) {
 void
 filemon_symlink(struct timespec *tv, audit_proc_t *subject, char *path) {
 	events_recvd++;
-	if (symlinks_path_is_relevant(path) || filemon_is_launchd_path(path)) {
+	if (symlinks_is_relevant(path) || filemon_is_launchd_path(path)) {
 		events_procd++;
-		symlinks_path_walk(path, tv, subject);
+		filemon_symlinks_walk(path, tv, subject);
 	}
 	free(path);
 }
@@ -530,8 +355,8 @@ filemon_init_add_plist(const char *path, UNUSED void *udata) {
 	              st.mtime.tv_sec,
 	              st.ctime.tv_sec,
 	              st.btime.tv_sec);
-	if (sys_islnk(path) == 1)
-		symlinks_path_walk(path, NULL, NULL);
+	if ((sys_islnk(path) == 1) && (symlinks_add(path) == -1))
+		atomic64_inc(&ooms);
 	return 0;
 }
 
@@ -587,5 +412,12 @@ filemon_stats(filemon_stat_t *st) {
 	st->procd = events_procd;
 	st->lpmiss = (uint64_t)lpmiss;
 	st->ooms = (uint64_t)ooms;
+	if (config) {
+		symlinks_stat_t sl;
+		symlinks_stats(&sl);
+		st->slbytes = sl.bytes;
+	} else {
+		st->slbytes = 0;
+	}
 }
 
@@ -25,6 +25,7 @@ typedef struct {
 	uint64_t procd;
 	uint64_t lpmiss;
 	uint64_t ooms;
+	uint64_t slbytes;       /* memory held by the symlink graph */
 } filemon_stat_t;
 
 typedef struct {
@@ -46,7 +47,7 @@ typedef struct {
 	char *program_rpath; /* resolved absolute path or argv[0] */
 } launchd_add_t;
 
-void filemon_touched(struct timespec *, audit_proc_t *, char *)
+void filemon_touched(struct timespec *, audit_proc_t *, const char *)
      NONNULL(1,2,3);
 void filemon_symlink(struct timespec *, audit_proc_t *, char *)
      NONNULL(1,2,3);
@@ -24,6 +24,7 @@ static config_t *config;
 
 static uint64_t events_recvd;       /* number of events received */
 static uint64_t events_procd;       /* number of events processed */
+static uint64_t events_suppressed;  /* number of events dropped early */
 static atomic64_t ooms;             /* counts events impaired due to OOM */
 
 setstr_t *suppress_process_access_by_subject_ident;
@@ -62,8 +63,9 @@ process_access_free(process_access_t *pa) {
  */
 static int
 process_access_work(process_access_t *pa) {
-	if (pa->subject_image_exec && image_exec_match_suppressions(
+	if (pa->subject_image_exec && image_exec_suppressed(
 	                              pa->subject_image_exec,
+	                              EISUPPRESS_PROCESS_ACCESS,
 	                              suppress_process_access_by_subject_ident,
 	                              suppress_process_access_by_subject_path))
 		return -1;
@@ -77,13 +79,25 @@ log_event_process_access(struct timespec *tv,
                          pid_t objectpid,
                          const char *method) {
 	process_access_t *pa;
+	image_exec_t *image;
+
+	image = image_exec_by_pid(subject->pid, tv);
+	if (image && image_exec_suppressed_cached(image,
+	                                          EISUPPRESS_PROCESS_ACCESS)) {
+		/* known to be suppressed, skip allocation and queueing */
+		image_exec_free(image);
+		events_suppressed++;
+		return;
+	}
 
 	pa = process_access_new();
 	if (!pa) {
+		if (image)
+			image_exec_free(image);
 		atomic64_inc(&ooms);
 		return;
 	}
-	pa->subject_image_exec = image_exec_by_pid(subject->pid, tv);
+	pa->subject_image_exec = image;
 	pa->object_image_exec = image_exec_by_pid(objectpid, tv);
 	pa->subject = *subject;
 	if (object) {
@@ -141,6 +155,7 @@ hackmon_init(config_t *cfg) {
 	ooms = 0;
 	events_recvd = 0;
 	events_procd = 0;
+	events_suppressed = 0;
 	suppress_process_access_by_subject_ident =
 		&cfg->suppress_process_access_by_subject_ident;
 	suppress_process_access_by_subject_path =
@@ -160,6 +175,7 @@ hackmon_stats(hackmon_stat_t *st) {
 
 	st->recvd = events_recvd;
 	st->procd = events_procd;
+	st->suppressed = events_suppressed;
 	st->ooms = (uint64_t)ooms;
 }
 
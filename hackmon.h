@@ -23,6 +23,7 @@
 typedef struct {
 	uint64_t recvd;
 	uint64_t procd;
+	uint64_t suppressed;
 	uint64_t ooms;
 } hackmon_stat_t;
 
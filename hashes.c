@@ -9,9 +9,14 @@
  */
 
 #include "hashes.h"
-#include "map.h"
+#include "hashio.h"
+#include "blake3.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
 
 #include <sys/types.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <assert.h>
@@ -48,65 +53,108 @@
 #define sha256_final    CC_SHA256_Final
 #endif /* !USE_OPENSSL */
 
-#define RDBUFSZ 1024*32
-
-#define CTX(H)          H##_ctx_t H##ctx;
-#define INIT(H)         H##_init(&H##ctx);
-#define UPDATE(H)       H##_update(&H##ctx, buf, n);
-#define FINAL(H)        H##_final(hashes->H, &H##ctx);
-
-#define HASHES_FD(N,...)                                        \
-static int                                                      \
-hashes_fd_##N(off_t *sz, hashes_t *hashes, int fd) {            \
-	unsigned char buf[RDBUFSZ];                             \
-	ssize_t n;                                              \
-	off_t count;                                            \
-	MAP(CTX, __VA_ARGS__)                                   \
-	count = 0;                                              \
-	MAP(INIT, __VA_ARGS__)                                  \
-	for (;;) {                                              \
-		n = read(fd, buf, sizeof(buf));                 \
-		if (n == 0)                                     \
-			break;                                  \
-		else if (n == -1) {                             \
-			bzero(hashes, sizeof(hashes_t));        \
-			return -1;                              \
-		}                                               \
-		count += n;                                     \
-		MAP(UPDATE, __VA_ARGS__)                        \
-	}                                                       \
-	*sz = count;                                            \
-	MAP(FINAL, __VA_ARGS__)                                 \
-	return 0;                                               \
+struct hashes_ctx {
+	int flags;
+	md5_ctx_t md5ctx;
+	sha1_ctx_t sha1ctx;
+	sha256_ctx_t sha256ctx;
+	blake3_ctx_t blake3ctx;
+	XXH3_state_t *xxh128state;      /* needs 64 byte alignment */
+};
+
+/*
+ * Streaming interface for callers that do their own I/O, such as hashio.
+ */
+hashes_ctx_t *
+hashes_ctx_new(int flags) {
+	hashes_ctx_t *ctx;
+
+	assert(flags & HASH_ALL);
+
+	ctx = malloc(sizeof(hashes_ctx_t));
+	if (!ctx)
+		return NULL;
+	ctx->flags = flags;
+	if (flags & HASH_XXH128) {
+		ctx->xxh128state = XXH3_createState();
+		if (!ctx->xxh128state) {
+			free(ctx);
+			return NULL;
+		}
+		XXH3_128bits_reset(ctx->xxh128state);
+	}
+	if (flags & HASH_MD5)
+		md5_init(&ctx->md5ctx);
+	if (flags & HASH_SHA1)
+		sha1_init(&ctx->sha1ctx);
+	if (flags & HASH_SHA256)
+		sha256_init(&ctx->sha256ctx);
+	if (flags & HASH_BLAKE3)
+		blake3_init(&ctx->blake3ctx);
+	return ctx;
+}
+
+void
+hashes_ctx_update(hashes_ctx_t *ctx, const void *buf, size_t n) {
+	if (ctx->flags & HASH_MD5)
+		md5_update(&ctx->md5ctx, buf, n);
+	if (ctx->flags & HASH_SHA1)
+		sha1_update(&ctx->sha1ctx, buf, n);
+	if (ctx->flags & HASH_SHA256)
+		sha256_update(&ctx->sha256ctx, buf, n);
+	if (ctx->flags & HASH_BLAKE3)
+		blake3_update(&ctx->blake3ctx, buf, n);
+	if (ctx->flags & HASH_XXH128)
+		XXH3_128bits_update(ctx->xxh128state, buf, n);
 }
 
-HASHES_FD(md5, md5)
-HASHES_FD(sha1, sha1)
-HASHES_FD(sha256, sha256)
-HASHES_FD(md5_sha1, md5, sha1)
-HASHES_FD(sha1_sha256, sha1, sha256)
-HASHES_FD(md5_sha256, md5, sha256)
-HASHES_FD(md5_sha1_sha256, md5, sha1, sha256)
+/*
+ * Finalize hashes and free ctx.  If hashes is NULL, only free ctx.
+ */
+void
+hashes_ctx_final(hashes_ctx_t *ctx, hashes_t *hashes) {
+	XXH128_canonical_t xxh128;
 
+	if (hashes) {
+		if (ctx->flags & HASH_MD5)
+			md5_final(hashes->md5, &ctx->md5ctx);
+		if (ctx->flags & HASH_SHA1)
+			sha1_final(hashes->sha1, &ctx->sha1ctx);
+		if (ctx->flags & HASH_SHA256)
+			sha256_final(hashes->sha256, &ctx->sha256ctx);
+		if (ctx->flags & HASH_BLAKE3)
+			blake3_final(hashes->blake3, &ctx->blake3ctx);
+		if (ctx->flags & HASH_XXH128) {
+			XXH128_canonicalFromHash(&xxh128, XXH3_128bits_digest(
+			                         ctx->xxh128state));
+			memcpy(hashes->xxh128, xxh128.digest, XXH128SZ);
+		}
+	}
+	if (ctx->flags & HASH_XXH128)
+		XXH3_freeState(ctx->xxh128state);
+	free(ctx);
+}
+
+/*
+ * Hash the file open at fd from offset 0 to EOF, keeping reads in flight
+ * while digesting completed blocks.
+ */
 int
 hashes_fd(off_t *sz, hashes_t *hashes, int flags, int fd) {
-	switch (flags) {
-	case HASH_MD5:
-		return hashes_fd_md5(sz, hashes, fd);
-	case HASH_SHA1:
-		return hashes_fd_sha1(sz, hashes, fd);
-	case HASH_SHA256:
-		return hashes_fd_sha256(sz, hashes, fd);
-	case HASH_MD5_SHA1:
-		return hashes_fd_md5_sha1(sz, hashes, fd);
-	case HASH_SHA1_SHA256:
-		return hashes_fd_sha1_sha256(sz, hashes, fd);
-	case HASH_MD5_SHA256:
-		return hashes_fd_md5_sha256(sz, hashes, fd);
-	case HASH_MD5_SHA1_SHA256:
-		return hashes_fd_md5_sha1_sha256(sz, hashes, fd);
+	hashio_file_t file;
+
+	if (!(flags & HASH_ALL))
+		return -1;
+
+	file.fd = fd;
+	if (hashio_hash(&file, 1, flags, HASHIO_DEPTH_FD) == -1 ||
+	    file.rv == -1) {
+		bzero(hashes, sizeof(hashes_t));
+		return -1;
 	}
-	return -1;
+	*sz = file.size;
+	memcpy(hashes, &file.hashes, sizeof(hashes_t));
+	return 0;
 }
 
 int
@@ -142,17 +190,52 @@ hashes_parse(const char *hashspec) {
 			flags |= HASH_SHA1;
 		if (sz == 6 && !memcmp(p, "sha256", sz))
 			flags |= HASH_SHA256;
+		if (sz == 6 && !memcmp(p, "blake3", sz))
+			flags |= HASH_BLAKE3;
+		if (sz == 6 && !memcmp(p, "xxh128", sz))
+			flags |= HASH_XXH128;
 		if (!p[sz])
 			break;
 		p += sz + 1;
 		while ((p[sz] != '\0') && (p[sz] == ' '))
 			sz++;
 	}
-	if (flags == 0)
+	/* xxh128 is fast but not collision-resistant, never use it alone */
+	if (!(flags & HASH_CRYPTO))
 		return -1;
 	return flags;
 }
 
+/*
+ * Return the strongest of the digests in flags as a cache key for content
+ * identity; hashes_keysz() returns its size.  The order is from strongest to
+ * weakest; xxh128 is never used as a key because it is trivial to construct
+ * collisions for it.
+ */
+unsigned char *
+hashes_key(hashes_t *hashes, int flags) {
+	if (flags & HASH_BLAKE3)
+		return hashes->blake3;
+	if (flags & HASH_SHA256)
+		return hashes->sha256;
+	if (flags & HASH_SHA1)
+		return hashes->sha1;
+	assert(flags & HASH_MD5);
+	return hashes->md5;
+}
+
+size_t
+hashes_keysz(int flags) {
+	if (flags & HASH_BLAKE3)
+		return BLAKE3SZ;
+	if (flags & HASH_SHA256)
+		return SHA256SZ;
+	if (flags & HASH_SHA1)
+		return SHA1SZ;
+	assert(flags & HASH_MD5);
+	return MD5SZ;
+}
+
 static const char *hflags[] = {
 	"none",
 	"md5",
@@ -161,7 +244,31 @@ static const char *hflags[] = {
 	"sha256",
 	"md5,sha256",
 	"sha1,sha256",
-	"md5,sha1,sha256"
+	"md5,sha1,sha256",
+	"blake3",
+	"md5,blake3",
+	"sha1,blake3",
+	"md5,sha1,blake3",
+	"sha256,blake3",
+	"md5,sha256,blake3",
+	"sha1,sha256,blake3",
+	"md5,sha1,sha256,blake3",
+	"xxh128",
+	"md5,xxh128",
+	"sha1,xxh128",
+	"md5,sha1,xxh128",
+	"sha256,xxh128",
+	"md5,sha256,xxh128",
+	"sha1,sha256,xxh128",
+	"md5,sha1,sha256,xxh128",
+	"blake3,xxh128",
+	"md5,blake3,xxh128",
+	"sha1,blake3,xxh128",
+	"md5,sha1,blake3,xxh128",
+	"sha256,blake3,xxh128",
+	"md5,sha256,blake3,xxh128",
+	"sha1,sha256,blake3,xxh128",
+	"md5,sha1,sha256,blake3,xxh128"
 };
 
 const char *
@@ -11,6 +11,7 @@
 #ifndef HASHES_H
 #define HASHES_H
 
+#include "blake3.h"
 #include "attrib.h"
 
 #include <sys/types.h>
@@ -18,26 +19,42 @@
 #define MD5SZ    16
 #define SHA1SZ   20
 #define SHA256SZ 32
+#define XXH128SZ 16
+
+#define HASHES_KEYSZ BLAKE3SZ    /* largest key returned by hashes_key */
 
 typedef struct __attribute__((packed)) {
 	unsigned char md5[MD5SZ];
 	unsigned char sha1[SHA1SZ];
 	unsigned char sha256[SHA256SZ];
+	unsigned char blake3[BLAKE3SZ];
+	unsigned char xxh128[XXH128SZ];
 } hashes_t;
 
+typedef struct hashes_ctx hashes_ctx_t;
+
+hashes_ctx_t * hashes_ctx_new(int) MALLOC;
+void hashes_ctx_update(hashes_ctx_t *, const void *, size_t) NONNULL(1,2);
+void hashes_ctx_final(hashes_ctx_t *, hashes_t *) NONNULL(1);
+
 int hashes_fd(off_t *, hashes_t *, int, int) NONNULL(1,2);
 int hashes_path(off_t *, hashes_t *, int, const char *) NONNULL(1,2,4);
 int hashes_parse(const char *) NONNULL(1);
+unsigned char * hashes_key(hashes_t *, int) NONNULL(1);
+size_t hashes_keysz(int);
 const char * hashes_flags_s(int);
 
 #define HASH_MD5                1
 #define HASH_SHA1               2
 #define HASH_SHA256             4
+#define HASH_BLAKE3             8
+#define HASH_XXH128             16
 #define HASH_MD5_SHA1           (HASH_MD5|HASH_SHA1)
 #define HASH_MD5_SHA256         (HASH_MD5|HASH_SHA256)
 #define HASH_SHA1_SHA256        (HASH_SHA1|HASH_SHA256)
 #define HASH_MD5_SHA1_SHA256    (HASH_MD5|HASH_SHA1|HASH_SHA256)
-#define HASH_ALL                HASH_MD5_SHA1_SHA256
+#define HASH_ALL                (HASH_MD5_SHA1_SHA256|HASH_BLAKE3|HASH_XXH128)
+#define HASH_CRYPTO             (HASH_MD5_SHA1_SHA256|HASH_BLAKE3)
 
 #endif
 
@@ -0,0 +1,317 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Overlapped file I/O engine for hashing executable images.
+ *
+ * Hashes a batch of files while keeping up to depth block reads in flight
+ * across all files using POSIX asynchronous I/O, feeding completed blocks
+ * to the digest routines in file order.  Each file has at most
+ * HASHIO_SLOTS reads in flight, so that the next block is being read while
+ * the current one is being digested.  If the system refuses to queue more
+ * asynchronous reads (EAGAIN, e.g. due to kern.aioprocmax) or does not
+ * support them, the affected block is read synchronously instead.  Short
+ * reads are not taken as EOF; the remainder is read again.
+ *
+ * Images are hashed one at a time by hashes_fd() in exec order, so batches
+ * of more than one file are only used by the timeops benchmark.  Buffers are
+ * allocated once per thread and reused across calls.
+ */
+
+#include "hashio.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <aio.h>
+
+#define HASHIO_BLKSZ            (1024*128)
+#define HASHIO_SLOTS            2
+
+typedef struct {
+	struct aiocb cb;
+	bool sync;              /* read completed synchronously */
+	ssize_t n;              /* result of synchronous read */
+	int err;                /* errno of synchronous read */
+} hashio_slot_t;
+
+typedef struct {
+	hashio_file_t *file;
+	hashes_ctx_t *ctx;
+	off_t issued;           /* offset of next read to issue */
+	off_t next;             /* offset of next byte to digest */
+	hashio_slot_t slot[HASHIO_SLOTS];
+	size_t head;            /* oldest read in flight */
+	size_t count;           /* number of reads in flight */
+	bool eof;               /* EOF seen, issue no more reads */
+	bool failed;            /* read failed, issue no more reads */
+} hashio_state_t;
+
+typedef struct {
+	unsigned char **free;   /* stack of unused buffers */
+	size_t nfree;
+	size_t inflight;
+	size_t depth;
+} hashio_engine_t;
+
+/* per-thread workspace for up to depth reads in flight */
+static _Thread_local struct {
+	hashio_state_t *states;
+	unsigned char **free;
+	unsigned char *bufs;
+	size_t depth;
+} ws;
+
+/*
+ * Make sure the workspace of the calling thread supports depth reads in
+ * flight.  Returns -1 with errno set on failure, 0 otherwise.
+ */
+static int
+hashio_ws_reserve(size_t depth) {
+	hashio_state_t *states;
+	unsigned char **stack;
+	unsigned char *bufs;
+
+	if (depth <= ws.depth)
+		return 0;
+	states = malloc(depth * sizeof(hashio_state_t));
+	if (!states)
+		return -1;
+	stack = malloc(depth * sizeof(unsigned char *));
+	if (!stack) {
+		free(states);
+		return -1;
+	}
+	bufs = malloc(depth * HASHIO_BLKSZ);
+	if (!bufs) {
+		free(stack);
+		free(states);
+		return -1;
+	}
+	hashio_thread_fini();
+	ws.states = states;
+	ws.free = stack;
+	ws.bufs = bufs;
+	ws.depth = depth;
+	return 0;
+}
+
+/*
+ * Release the workspace of the calling thread.  Must be called by threads
+ * using hashio before they exit.
+ */
+void
+hashio_thread_fini(void) {
+	free(ws.states);
+	free(ws.free);
+	free(ws.bufs);
+	bzero(&ws, sizeof(ws));
+}
+
+static void
+hashio_issue(hashio_engine_t *e, hashio_state_t *s) {
+	hashio_slot_t *slot;
+
+	assert(e->nfree > 0);
+	assert(s->count < HASHIO_SLOTS);
+
+	slot = &s->slot[(s->head + s->count) % HASHIO_SLOTS];
+	bzero(slot, sizeof(hashio_slot_t));
+	slot->cb.aio_fildes = s->file->fd;
+	slot->cb.aio_offset = s->issued;
+	slot->cb.aio_buf = e->free[--e->nfree];
+	slot->cb.aio_nbytes = HASHIO_BLKSZ;
+	slot->cb.aio_sigevent.sigev_notify = SIGEV_NONE;
+	if (aio_read(&slot->cb) == -1) {
+		slot->sync = true;
+		slot->n = pread(slot->cb.aio_fildes, (void *)slot->cb.aio_buf,
+		                HASHIO_BLKSZ, s->issued);
+		slot->err = errno;
+	}
+	s->issued += HASHIO_BLKSZ;
+	s->count++;
+	e->inflight++;
+}
+
+/*
+ * Reap the oldest read in flight of s if it has completed.  Returns true if
+ * a read was reaped.
+ */
+static bool
+hashio_reap(hashio_engine_t *e, hashio_state_t *s) {
+	hashio_slot_t *slot;
+	ssize_t n;
+	int err;
+
+	if (s->count == 0)
+		return false;
+	slot = &s->slot[s->head];
+	if (slot->sync) {
+		n = slot->n;
+		err = slot->err;
+	} else {
+		err = aio_error(&slot->cb);
+		if (err == EINPROGRESS)
+			return false;
+		n = aio_return(&slot->cb);
+	}
+
+	/* reads beyond a short read do not start at next and are dropped */
+	if (!s->eof && !s->failed && slot->cb.aio_offset == s->next) {
+		if (n == -1) {
+			s->failed = true;
+			s->file->err = err;
+		} else if (n == 0) {
+			s->eof = true;
+		} else {
+			hashes_ctx_update(s->ctx,
+			                  (const void *)slot->cb.aio_buf,
+			                  (size_t)n);
+			s->file->size += n;
+			s->next += n;
+			/* short read, read the remainder again */
+			if ((size_t)n < slot->cb.aio_nbytes)
+				s->issued = s->next;
+		}
+	}
+
+	e->free[e->nfree++] = (unsigned char *)slot->cb.aio_buf;
+	s->head = (s->head + 1) % HASHIO_SLOTS;
+	s->count--;
+	e->inflight--;
+	return true;
+}
+
+static void
+hashio_finish(hashio_state_t *s) {
+	if (s->failed) {
+		hashes_ctx_final(s->ctx, NULL);
+		bzero(&s->file->hashes, sizeof(hashes_t));
+		s->file->rv = -1;
+	} else {
+		hashes_ctx_final(s->ctx, &s->file->hashes);
+		s->file->rv = 0;
+	}
+	s->ctx = NULL;
+}
+
+/*
+ * Wait for at least one asynchronous read of the active files to complete.
+ */
+static void
+hashio_wait(hashio_state_t *states, size_t nactive) {
+	const struct aiocb *list[HASHIO_DEPTH_MAX];
+	size_t n = 0;
+
+	for (size_t i = 0; i < nactive; i++) {
+		hashio_state_t *s = &states[i];
+		for (size_t j = 0; j < s->count; j++) {
+			hashio_slot_t *slot =
+				&s->slot[(s->head + j) % HASHIO_SLOTS];
+			if (!slot->sync && n < HASHIO_DEPTH_MAX)
+				list[n++] = &slot->cb;
+		}
+	}
+	if (n > 0)
+		(void)aio_suspend(list, n, NULL);
+}
+
+/*
+ * Hash n files using up to depth reads in flight.  Per-file results are
+ * returned in the hashio_file_t elements.  Returns -1 with errno set if
+ * the engine itself could not be set up, 0 otherwise.
+ */
+int
+hashio_hash(hashio_file_t *files, size_t n, int flags, size_t depth) {
+	hashio_engine_t e;
+	hashio_state_t *states;
+	size_t next, nactive;
+	bool progress;
+
+	assert(files);
+
+	if (depth < 1)
+		depth = 1;
+	if (depth > HASHIO_DEPTH_MAX)
+		depth = HASHIO_DEPTH_MAX;
+	for (size_t i = 0; i < n; i++) {
+		files[i].size = 0;
+		files[i].rv = -1;
+		files[i].err = 0;
+	}
+
+	/* at most depth files are active at a time, compacted to the front */
+	if (hashio_ws_reserve(depth) == -1)
+		return -1;
+	states = ws.states;
+	e.free = ws.free;
+	for (size_t i = 0; i < depth; i++)
+		e.free[i] = ws.bufs + i * HASHIO_BLKSZ;
+	e.nfree = depth;
+	e.inflight = 0;
+	e.depth = depth;
+
+	next = 0;
+	nactive = 0;
+	for (;;) {
+		/* activate files */
+		while (nactive < depth && next < n) {
+			hashio_state_t *s = &states[nactive];
+			bzero(s, sizeof(hashio_state_t));
+			s->file = &files[next++];
+			s->ctx = hashes_ctx_new(flags);
+			if (!s->ctx) {
+				s->file->err = errno;
+				continue;
+			}
+			nactive++;
+		}
+		if (nactive == 0)
+			break;
+
+		/* issue reads, one per file per round for fairness */
+		do {
+			progress = false;
+			for (size_t i = 0; i < nactive; i++) {
+				hashio_state_t *s = &states[i];
+				if (e.inflight == e.depth)
+					break;
+				if (s->eof || s->failed ||
+				    s->count == HASHIO_SLOTS)
+					continue;
+				hashio_issue(&e, s);
+				progress = true;
+			}
+		} while (progress && e.inflight < e.depth);
+
+		/* reap completed reads and finish files */
+		progress = false;
+		for (size_t i = 0; i < nactive;) {
+			hashio_state_t *s = &states[i];
+			while (hashio_reap(&e, s))
+				progress = true;
+			if ((s->eof || s->failed) && s->count == 0) {
+				hashio_finish(s);
+				states[i] = states[--nactive];
+				progress = true;
+				continue;
+			}
+			i++;
+		}
+		if (!progress)
+			hashio_wait(states, nactive);
+	}
+	assert(e.inflight == 0);
+	return 0;
+}
+
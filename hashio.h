@@ -0,0 +1,34 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef HASHIO_H
+#define HASHIO_H
+
+#include "hashes.h"
+#include "attrib.h"
+
+#include <sys/types.h>
+
+#define HASHIO_DEPTH_FD         2       /* reads in flight for hashes_fd */
+#define HASHIO_DEPTH_MAX        64
+
+typedef struct {
+	int fd;                 /* in: file to hash from offset 0 */
+	off_t size;             /* out: number of bytes hashed */
+	hashes_t hashes;        /* out: hashes if rv == 0, zeroes otherwise */
+	int rv;                 /* out: 0 on success, -1 on error */
+	int err;                /* out: errno if rv == -1 */
+} hashio_file_t;
+
+int hashio_hash(hashio_file_t *, size_t, int, size_t) NONNULL(1) WUNRES;
+void hashio_thread_fini(void);
+
+#endif
+
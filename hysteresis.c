@@ -0,0 +1,61 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Level stepping with hysteresis, shared by the adaptive degradation
+ * controller and the memory budget governor.
+ */
+
+#include "hysteresis.h"
+
+#include <assert.h>
+
+void
+hysteresis_init(hysteresis_t *h, int max, unsigned int recover) {
+	assert(h);
+
+	atomic_store(&h->level, 0);
+	h->max = max;
+	h->maxlevel = 0;
+	h->recover = recover;
+	h->lowticks = 0;
+	h->changes = 0;
+}
+
+/*
+ * Raise the level by one if high is set, or lower it by one if low has been
+ * set for recover consecutive updates.  Returns the new level if the level
+ * was changed, -1 otherwise.
+ */
+int
+hysteresis_update(hysteresis_t *h, bool high, bool low) {
+	int cur = atomic_load_explicit(&h->level, memory_order_relaxed);
+
+	if (high) {
+		h->lowticks = 0;
+		if (cur == h->max)
+			return -1;
+		cur++;
+	} else if (low && cur > 0) {
+		if (++h->lowticks < h->recover)
+			return -1;
+		h->lowticks = 0;
+		cur--;
+	} else {
+		h->lowticks = 0;
+		return -1;
+	}
+	atomic_store_explicit(&h->level, cur, memory_order_relaxed);
+	if (cur > h->maxlevel)
+		h->maxlevel = cur;
+	h->changes++;
+	return cur;
+}
+
@@ -0,0 +1,38 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef HYSTERESIS_H
+#define HYSTERESIS_H
+
+#include "attrib.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Level in 0..max, stepped up by one under high load and down by one after
+ * recover consecutive updates under low load.  Updated by a single thread;
+ * level may be read lock-free with a relaxed atomic load.
+ */
+typedef struct {
+	_Atomic int level;
+	int max;
+	int maxlevel;
+	unsigned int recover;
+	unsigned int lowticks;
+	uint64_t changes;
+} hysteresis_t;
+
+void hysteresis_init(hysteresis_t *, int, unsigned int) NONNULL(1);
+int hysteresis_update(hysteresis_t *, bool, bool) NONNULL(1) WUNRES;
+
+#endif
+
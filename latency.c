@@ -0,0 +1,242 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#include "latency.h"
+
+#include "time.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Lock-free latency histograms with log-linear buckets in the style of HDR
+ * histograms:  values below 2^SUBBITS usec get a bucket each, every power of
+ * two above is split into 2^SUBBITS linear sub-buckets, which bounds the
+ * relative error of reported percentiles to 1/2^SUBBITS.  Values are clamped
+ * to 2^MAXBITS usec for bucketing; the maximum is tracked exactly.
+ *
+ * Recording is a relaxed atomic increment and does not block; stats readers
+ * may see a histogram that is slightly inconsistent with its count, which is
+ * acceptable for monitoring purposes.
+ */
+
+#define SUBBITS         4
+#define SUBBUCKETS      (1 << SUBBITS)
+#define MAXBITS         32
+#define BUCKETS         ((MAXBITS - SUBBITS + 1) * SUBBUCKETS)
+
+typedef struct {
+	_Atomic uint64_t buckets[BUCKETS];
+	_Atomic uint64_t count;
+	_Atomic uint64_t max;
+} hist_t;
+
+static hist_t hist_aurd;
+static hist_t hist[LATENCY_STAGES][LOGEVT_SIZE];
+static _Atomic uint64_t window_max;     /* total lag since last read */
+
+static const char *stage_names[] = {
+	"dispatch",
+	"work",
+	"logq",
+	"format",
+	"write",
+	"total"
+};
+_Static_assert(sizeof(stage_names)/sizeof(stage_names[0]) == LATENCY_STAGES,
+               "number of stage names initialized above");
+
+static size_t
+hist_bucket(uint64_t v) {
+	int msb, shift;
+
+	if (v >= (UINT64_C(1) << MAXBITS))
+		v = (UINT64_C(1) << MAXBITS) - 1;
+	if (v < SUBBUCKETS)
+		return (size_t)v;
+	msb = 63 - __builtin_clzll(v);
+	shift = msb - SUBBITS;
+	return (size_t)((shift + 1) * SUBBUCKETS + (v >> shift) - SUBBUCKETS);
+}
+
+/*
+ * Highest value that maps to bucket i.
+ */
+static uint64_t
+hist_value(size_t i) {
+	int shift;
+
+	if (i < SUBBUCKETS)
+		return i;
+	shift = (int)(i / SUBBUCKETS) - 1;
+	return ((uint64_t)(SUBBUCKETS + i % SUBBUCKETS) << shift) +
+	       ((UINT64_C(1) << shift) - 1);
+}
+
+static void
+hist_record(hist_t *h, uint64_t v) {
+	uint64_t max;
+
+	atomic_fetch_add_explicit(&h->buckets[hist_bucket(v)], 1,
+	                          memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+	max = atomic_load_explicit(&h->max, memory_order_relaxed);
+	while (v > max && !atomic_compare_exchange_weak_explicit(&h->max,
+	                  &max, v, memory_order_relaxed, memory_order_relaxed));
+}
+
+/*
+ * Compute a summary from nh histograms, merging them on the fly.
+ */
+static void
+hist_summarize(latency_summary_t *sum, hist_t *hs[], size_t nh) {
+	uint64_t buckets[BUCKETS];
+	uint64_t count = 0, max = 0, seen = 0, m;
+	uint64_t rank50, rank99, rank999;
+	bool have50 = false, have99 = false;
+
+	bzero(sum, sizeof(*sum));
+	bzero(buckets, sizeof(buckets));
+	for (size_t j = 0; j < nh; j++) {
+		for (size_t i = 0; i < BUCKETS; i++) {
+			m = atomic_load_explicit(&hs[j]->buckets[i],
+			                         memory_order_relaxed);
+			buckets[i] += m;
+			count += m;
+		}
+		m = atomic_load_explicit(&hs[j]->max, memory_order_relaxed);
+		if (m > max)
+			max = m;
+	}
+	if (count == 0)
+		return;
+
+	rank50 = (count * 500 + 999) / 1000;
+	rank99 = (count * 990 + 999) / 1000;
+	rank999 = (count * 999 + 999) / 1000;
+	for (size_t i = 0; i < BUCKETS; i++) {
+		if (buckets[i] == 0)
+			continue;
+		seen += buckets[i];
+		if (!have50 && seen >= rank50) {
+			sum->p50 = hist_value(i);
+			have50 = true;
+		}
+		if (!have99 && seen >= rank99) {
+			sum->p99 = hist_value(i);
+			have99 = true;
+		}
+		if (seen >= rank999) {
+			sum->p999 = hist_value(i);
+			break;
+		}
+	}
+	sum->count = count;
+	sum->max = max;
+	if (sum->p50 > max)
+		sum->p50 = max;
+	if (sum->p99 > max)
+		sum->p99 = max;
+	if (sum->p999 > max)
+		sum->p999 = max;
+}
+
+/*
+ * Current wall clock time in usec, comparable to kernel event timestamps.
+ */
+uint64_t
+latency_now(void) {
+	struct timespec tv;
+
+	if (timespec_nanotime(&tv) == -1)
+		return 0;
+	return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_nsec / 1000;
+}
+
+static uint64_t
+latency_usec(const struct timespec *tv) {
+	return (uint64_t)tv->tv_sec * 1000000 + (uint64_t)tv->tv_nsec / 1000;
+}
+
+/*
+ * Record the time from the kernel timestamp of an audit event until it has
+ * been read from the audit pipe.
+ */
+void
+latency_aurd(const struct timespec *tv) {
+	uint64_t now = latency_now(), then = latency_usec(tv);
+
+	hist_record(&hist_aurd, now > then ? now - then : 0);
+}
+
+/*
+ * Record the time spent in stage by an event with code since start (usec
+ * as returned by latency_now) until now.  Returns now, for use as start of
+ * the next stage.  Clock adjustments can make time appear to go backwards;
+ * such samples are recorded as 0.
+ */
+uint64_t
+latency_record(int stage, uint64_t code, uint64_t start) {
+	uint64_t now = latency_now();
+
+	assert(stage >= 0 && stage < LATENCY_STAGES);
+	assert(code < LOGEVT_SIZE);
+	hist_record(&hist[stage][code], now > start ? now - start : 0);
+	if (stage == LATENCY_TOTAL && now > start) {
+		uint64_t max = atomic_load_explicit(&window_max,
+		                                    memory_order_relaxed);
+		while (now - start > max &&
+		       !atomic_compare_exchange_weak_explicit(&window_max,
+		       &max, now - start, memory_order_relaxed,
+		       memory_order_relaxed));
+	}
+	return now;
+}
+
+uint64_t
+latency_record_since(int stage, uint64_t code, const struct timespec *tv) {
+	return latency_record(stage, code, latency_usec(tv));
+}
+
+/*
+ * Returns the maximum end-to-end lag recorded since the last call.
+ */
+uint64_t
+latency_window_max(void) {
+	return atomic_exchange_explicit(&window_max, 0, memory_order_relaxed);
+}
+
+const char *
+latency_stage_s(int stage) {
+	assert(stage >= 0 && stage < LATENCY_STAGES);
+	return stage_names[stage];
+}
+
+void
+latency_stats(latency_stat_t *st) {
+	hist_t *hs[LOGEVT_SIZE];
+
+	assert(st);
+
+	hs[0] = &hist_aurd;
+	hist_summarize(&st->aurd, hs, 1);
+	for (int s = 0; s < LATENCY_STAGES; s++) {
+		for (int c = 0; c < LOGEVT_SIZE; c++)
+			hs[c] = &hist[s][c];
+		hist_summarize(&st->stage[s], hs, LOGEVT_SIZE);
+	}
+	for (int c = 0; c < LOGEVT_SIZE; c++) {
+		hs[0] = &hist[LATENCY_TOTAL][c];
+		hist_summarize(&st->total[c], hs, 1);
+	}
+}
+
@@ -0,0 +1,60 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "logevt.h"
+#include "attrib.h"
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Pipeline stages an event passes through, timed in usec.  The dispatch
+ * stage starts at the kernel timestamp of the event and ends when the event
+ * is submitted to the work queue; it includes audit pipe latency, parsing and
+ * correlation in procmon and the other monitors.  The total stage is the
+ * end-to-end lag from the kernel timestamp until the event has been handed
+ * to the log destination.
+ */
+#define LATENCY_DISPATCH        0       /* kernel to work_submit */
+#define LATENCY_WORK            1       /* work queue, hashing, codesign */
+#define LATENCY_LOGQ            2       /* log queue */
+#define LATENCY_FORMAT          3       /* log formatting */
+#define LATENCY_WRITE           4       /* log destination */
+#define LATENCY_TOTAL           5       /* kernel to log destination */
+#define LATENCY_STAGES          6
+
+typedef struct {
+	uint64_t count;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+} latency_summary_t;
+
+typedef struct {
+	latency_summary_t aurd;                 /* kernel to audit event read */
+	latency_summary_t stage[LATENCY_STAGES];/* all event codes */
+	latency_summary_t total[LOGEVT_SIZE];   /* end-to-end by event code */
+} latency_stat_t;
+
+uint64_t latency_now(void);
+void latency_aurd(const struct timespec *) NONNULL(1);
+uint64_t latency_record(int, uint64_t, uint64_t);
+uint64_t latency_record_since(int, uint64_t, const struct timespec *)
+         NONNULL(3);
+uint64_t latency_window_max(void);
+const char * latency_stage_s(int);
+void latency_stats(latency_stat_t *) NONNULL(1);
+
+#endif
+
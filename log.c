@@ -14,6 +14,9 @@
 #include "logfmtyaml.h"
 #include "logfmtxml.h"
 #include "logdstfile.h"
+#include "logdstgzip.h"
+#include "logdstspool.h"
+#include "logdstnet.h"
 #include "logdststdout.h"
 #include "logdstsyslog.h"
 
@@ -23,6 +26,9 @@
 #include "time.h"
 #include "work.h"
 #include "evtloop.h"
+#include "latency.h"
+#include "degrade.h"
+#include "membudget.h"
 
 #include <string.h>
 #include <assert.h>
@@ -39,9 +45,11 @@ logevt_func_t le_logevt[LOGEVT_SIZE] = {
 	logevt_launchd_add,
 	logevt_socket_listen,
 	logevt_socket_accept,
-	logevt_socket_connect
+	logevt_socket_connect,
+	logevt_image_codesign,
+	logevt_image_exec_summary
 };
-_Static_assert(LOGEVT_SIZE == 8, "number of logevt types initialized above");
+_Static_assert(LOGEVT_SIZE == 10, "number of logevt types initialized above");
 
 /*
  * Log formats.
@@ -55,31 +63,58 @@ static logfmt_t *logfmttab[] = {
 #define LOGFMTS (sizeof(logfmttab)/sizeof(logfmttab[0]))
 
 /*
- * Log destinations.
+ * Log destinations.  File and network destinations come first; they are
+ * selected by the path or address given as destination instead of by name.
  */
 static logdst_t *logdsttab[] = {
 	&logdstfile,
+	&logdstgzip,
+	&logdstspool,
+	&logdstnet,
 	&logdststdout,
 	&logdstsyslog
 };
 #define LOGDSTS (sizeof(logdsttab)/sizeof(logdsttab[0]))
+#define LOGDST_FILE     0
+#define LOGDST_GZIP     1       /* file path ending in .gz */
+#define LOGDST_SPOOL    2       /* file path ending in .spool */
+#define LOGDST_NET      3       /* tcp://, udp:// or unix:// address */
+#define LOGDST_NAMED    4       /* first destination selected by name */
 
 int
 logdst_parse(config_t *cfg, const char *name) {
+	size_t sz;
+
 	assert(cfg);
 	assert(name);
-	for (size_t i = 1; i < LOGDSTS; i++) {
+	for (size_t i = LOGDST_NAMED; i < LOGDSTS; i++) {
 		if (!strcmp(logdsttab[i]->ld_name, name)) {
 			cfg->logdst = i;
 			return 0;
 		}
 	}
+	if (!strncmp(name, "tcp://", 6) || !strncmp(name, "udp://", 6) ||
+	    !strncmp(name, "unix://", 7)) {
+		if (cfg->logaddr)
+			free(cfg->logaddr);
+		cfg->logaddr = strdup(name);
+		if (!cfg->logaddr)
+			return -1;
+		cfg->logdst = LOGDST_NET;
+		return 0;
+	}
 	if (cfg->logfile)
 		free(cfg->logfile);
 	cfg->logfile = strdup(name);
 	if (!cfg->logfile)
 		return -1;
-	cfg->logdst = 0;
+	sz = strlen(name);
+	if (sz > 3 && !strcmp(name + sz - 3, ".gz"))
+		cfg->logdst = LOGDST_GZIP;
+	else if (sz > 6 && !strcmp(name + sz - 6, ".spool"))
+		cfg->logdst = LOGDST_SPOOL;
+	else
+		cfg->logdst = LOGDST_FILE;
 	return 0;
 }
 
@@ -112,12 +147,15 @@ static int logdst = -1;
 static queue_t log_queue;
 static pthread_t log_thr;
 static logevt_header_t log_sentinel;
+static config_t *config = NULL;
 
 static uint64_t counts[LOGEVT_SIZE];
 static uint64_t errors;
 
 static int
-log_log(logevt_header_t *hdr) {
+log_log(logevt_header_t *hdr, int prio) {
+	uint64_t code = hdr->code;
+	uint64_t ts;
 	FILE *f;
 	int rv;
 
@@ -125,18 +163,23 @@ log_log(logevt_header_t *hdr) {
 	assert(logdsttab[logdst]->ld_raw || logfmt != -1);
 	assert(hdr->code >= 0 && hdr->code < LOGEVT_SIZE);
 
+	ts = latency_record(LATENCY_LOGQ, code, hdr->ts);
+	queue_account_wait(&log_queue, prio, ts > hdr->ts ? ts - hdr->ts : 0);
 	if (logdsttab[logdst]->ld_raw) {
 		rv = logdsttab[logdst]->ld_event(hdr);
 	} else {
 		f = logdsttab[logdst]->ld_open();
 		if (!f)
 			return -1;
-		rv = le_logevt[hdr->code](logfmttab[logfmt], f, hdr);
+		rv = le_logevt[code](logfmttab[logfmt], f, hdr);
+		ts = latency_record(LATENCY_FORMAT, code, ts);
 		if (logdsttab[logdst]->ld_close(f) == -1)
 			errors++;
 	}
+	(void)latency_record(LATENCY_WRITE, code, ts);
+	(void)latency_record_since(LATENCY_TOTAL, code, &hdr->tv);
 	if (rv == 0)
-		counts[hdr->code]++;
+		counts[code]++;
 	else
 		errors++;
 	assert(hdr->le_free);
@@ -147,6 +190,7 @@ log_log(logevt_header_t *hdr) {
 static void *
 log_thread(UNUSED void *arg) {
 	logevt_header_t *hdr;
+	int prio;
 
 #if 0	/* terra pericolosa */
 	(void)policy_thread_sched_standard();
@@ -154,10 +198,13 @@ log_thread(UNUSED void *arg) {
 	(void)policy_thread_diskio_utility();
 
 	for (;;) {
-		hdr = queue_dequeue(&log_queue);
+		/* unlocked read is fine, only used as an idle heuristic */
+		if (queue_size(&log_queue) == 0 && logdsttab[logdst]->ld_flush)
+			logdsttab[logdst]->ld_flush();
+		hdr = queue_dequeue_prio(&log_queue, &prio);
 		if (hdr == &log_sentinel)
 			break;
-		(void)log_log(hdr);
+		(void)log_log(hdr, prio);
 	}
 
 	return NULL;
@@ -197,6 +244,7 @@ log_init(config_t *cfg) {
 		fprintf(stderr, "Failed to initialize logdst %i\n", logdst);
 		return -1;
 	}
+	config = cfg;
 	queue_init(&log_queue);
 	if (pthread_create(&log_thr, NULL, log_thread, NULL) != 0) {
 		queue_destroy(&log_queue);
@@ -229,7 +277,7 @@ log_fini(void) {
 		return;
 
 	bzero(&log_sentinel, sizeof(log_sentinel));
-	queue_enqueue(&log_queue, &log_sentinel.node, &log_sentinel);
+	queue_enqueue_last(&log_queue, &log_sentinel.node, &log_sentinel);
 	if (pthread_join(log_thr, NULL) != 0) {
 		fprintf(stderr, "Failed to join logger thread - exiting\n");
 		exit(EXIT_FAILURE);
@@ -239,19 +287,27 @@ log_fini(void) {
 	logdsttab[logdst]->ld_fini();
 	logfmt = -1;
 	logdst = -1;
+	config = NULL;
 	log_initialized = false;
 }
 
 void
 log_submit(void *data) {
 	logevt_header_t *hdr = data;
+	int prio;
 
 	assert(hdr);
 	assert(hdr->code >= 0);
 	assert(hdr->code <= LOGEVT_SIZE);
 	assert(hdr->tv.tv_sec > 0);
 	assert(hdr->le_free);
-	queue_enqueue(&log_queue, &hdr->node, hdr);
+	hdr->ts = latency_record(LATENCY_WORK, hdr->code, hdr->ts);
+	prio = config_prio(config, hdr->code);
+	if (membudget_shed(prio)) {
+		hdr->le_free(hdr);
+		return;
+	}
+	queue_enqueue_prio(&log_queue, prio, &hdr->node, hdr);
 }
 
 void
@@ -259,9 +315,14 @@ log_stats(log_stat_t *st) {
 	assert(st);
 
 	st->qsize = queue_size(&log_queue);
+	queue_lane_stats(&log_queue, st->lanes);
 	st->errors = errors;
 	for (size_t i = 0; i < LOGEVT_SIZE; i++)
 		st->counts[i] = counts[i];
+	if (logdst != -1 && logdsttab[logdst]->ld_stats)
+		logdsttab[logdst]->ld_stats(&st->dst);
+	else
+		bzero(&st->dst, sizeof(logdst_stat_t));
 }
 
 void
@@ -299,6 +360,7 @@ log_event_xnumon_ops(const char *subtype) {
 	}
 	evt->hdr.le_free = free;
 	evt->subtype = subtype;
+	evt->degradation = (uint64_t)degrade_level();
 	work_submit(evt);
 	return 0;
 }
@@ -319,6 +381,14 @@ log_event_xnumon_stop(void) {
 	return log_event_xnumon_ops("stop");
 }
 
+/*
+ * Convenience function to generate and submit a xnumon-ops(degrade) event.
+ */
+int
+log_event_xnumon_degrade(void) {
+	return log_event_xnumon_ops("degrade");
+}
+
 /*
  * Convenience function to generate and submit a xnumon stats event.
  */
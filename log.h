@@ -12,7 +12,9 @@
 #define LOG_H
 
 #include "logevt.h"
+#include "logdst.h"
 #include "config.h"
+#include "queue.h"
 #include "attrib.h"
 
 #include <stdint.h>
@@ -29,8 +31,10 @@ void log_fini(void);
 
 typedef struct {
 	uint32_t qsize;
+	queue_lane_stat_t lanes[QUEUE_PRIOS];
 	uint64_t errors;
 	uint64_t counts[LOGEVT_SIZE];
+	logdst_stat_t dst;
 } log_stat_t;
 
 void log_submit(void *) NONNULL(1);
@@ -39,6 +43,7 @@ void log_version(FILE *) NONNULL(1);
 
 int log_event_xnumon_start(void) WUNRES;
 int log_event_xnumon_stop(void) WUNRES;
+int log_event_xnumon_degrade(void) WUNRES;
 int log_event_xnumon_stats(void) WUNRES;
 
 #endif
@@ -0,0 +1,104 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#include "logbuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#define INITIAL_CAPACITY 4096
+
+static int
+logbuf_writefn(void *cookie, const char *buf, int len) {
+	logbuf_t *lb = cookie;
+	size_t capacity;
+	char *p;
+
+	if (lb->failed) {
+		errno = ENOMEM;
+		return -1;
+	}
+	/* keep room for the terminating NUL */
+	if (lb->size + len + 1 > lb->capacity) {
+		capacity = lb->capacity * 2;
+		while (lb->size + len + 1 > capacity)
+			capacity *= 2;
+		p = realloc(lb->buf, capacity);
+		if (!p) {
+			lb->failed = true;
+			errno = ENOMEM;
+			return -1;
+		}
+		lb->buf = p;
+		lb->capacity = capacity;
+	}
+	memcpy(lb->buf + lb->size, buf, len);
+	lb->size += len;
+	return len;
+}
+
+int
+logbuf_init(logbuf_t *lb) {
+	lb->buf = malloc(INITIAL_CAPACITY);
+	if (!lb->buf)
+		return -1;
+	lb->buf[0] = '\0';
+	lb->size = 0;
+	lb->capacity = INITIAL_CAPACITY;
+	lb->failed = false;
+	lb->f = funopen(lb, NULL, logbuf_writefn, NULL, NULL);
+	if (!lb->f) {
+		free(lb->buf);
+		lb->buf = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void
+logbuf_fini(logbuf_t *lb) {
+	if (lb->f) {
+		fclose(lb->f);
+		lb->f = NULL;
+	}
+	if (lb->buf) {
+		free(lb->buf);
+		lb->buf = NULL;
+	}
+}
+
+/*
+ * Reset the buffer and return the stream to format a record into.
+ */
+FILE *
+logbuf_open(logbuf_t *lb) {
+	assert(lb->f);
+	lb->size = 0;
+	lb->failed = false;
+	return lb->f;
+}
+
+/*
+ * Flush the stream into the buffer and NUL-terminate it.  On success, the
+ * record is available in buf and size until the next logbuf_open.
+ */
+int
+logbuf_close(logbuf_t *lb) {
+	if (fflush(lb->f) == EOF || lb->failed) {
+		(void)fpurge(lb->f);
+		clearerr(lb->f);
+		return -1;
+	}
+	lb->buf[lb->size] = '\0';
+	return 0;
+}
+
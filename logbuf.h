@@ -0,0 +1,41 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef LOGBUF_H
+#define LOGBUF_H
+
+#include "attrib.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+ * Long-lived, growable output buffer with a FILE * interface for the log
+ * format drivers to write into.  Unlike open_memstream, the buffer and the
+ * stream are allocated once and reset for every record, so that there is no
+ * allocation and no zeroing on the log path once the buffer has grown to the
+ * size of the largest record.  A logbuf_t is not thread-safe; every thread
+ * formatting records needs its own.
+ */
+typedef struct {
+	FILE *f;
+	char *buf;
+	size_t size;            /* bytes in buf, excluding terminating NUL */
+	size_t capacity;
+	bool failed;
+} logbuf_t;
+
+int logbuf_init(logbuf_t *) NONNULL(1) WUNRES;
+void logbuf_fini(logbuf_t *) NONNULL(1);
+FILE * logbuf_open(logbuf_t *) NONNULL(1);
+int logbuf_close(logbuf_t *) NONNULL(1) WUNRES;
+
+#endif
+
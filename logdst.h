@@ -16,8 +16,20 @@
 #include "logevt.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+typedef struct {
+	uint64_t rawbytes;          /* bytes produced by the formatter */
+	uint64_t outbytes;          /* bytes written to the destination */
+	uint64_t blocks;            /* completed compression blocks */
+	uint64_t rotations;         /* files rotated by the destination */
+	uint64_t cputime;           /* usec of compression CPU time */
+	uint64_t drops;             /* events dropped by the destination */
+	uint64_t spills;            /* events spilled to disk */
+	uint64_t connects;          /* connections established */
+} logdst_stat_t;
+
 /*
  * There are two different kinds of log destination drivers.  Raw drivers
  * implement ld_event and receive the raw event struct for fully custom
@@ -25,6 +37,10 @@
  * formatted logging.  The FILE * produced by ld_open will be passed to the
  * event formatter, which will use the log format driver to write a formatted
  * log record to the FILE *.
+ *
+ * Drivers that buffer internally can implement ld_flush, which is called by
+ * the log thread whenever the log queue runs empty, in order to commit all
+ * buffered events to the destination before going idle.
  */
 typedef int    (*logdst_init_func_t)(config_t *);
 typedef int    (*logdst_reinit_func_t)(void);
@@ -32,6 +48,8 @@ typedef void   (*logdst_fini_func_t)(void);
 typedef FILE * (*logdst_open_func_t)(void);
 typedef int    (*logdst_close_func_t)(FILE *);
 typedef int    (*logdst_event_func_t)(const logevt_header_t *);
+typedef void   (*logdst_flush_func_t)(void);
+typedef void   (*logdst_stats_func_t)(logdst_stat_t *);
 typedef struct {
 	const char *ld_name;
 	bool ld_raw;                /* wants raw event, not formatted buffer */
@@ -44,6 +62,8 @@ typedef struct {
 	logdst_event_func_t  ld_event;  /* raw mode only */
 	logdst_open_func_t   ld_open;   /* normal mode only */
 	logdst_close_func_t  ld_close;  /* normal mode only */
+	logdst_flush_func_t  ld_flush;  /* optional */
+	logdst_stats_func_t  ld_stats;  /* optional */
 } logdst_t;
 
 
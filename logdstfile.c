@@ -96,6 +96,8 @@ logdst_t logdstfile = {
 	logdstfile_fini,
 	NULL,
 	logdstfile_open,
-	logdstfile_close
+	logdstfile_close,
+	NULL,
+	NULL
 };
 
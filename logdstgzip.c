@@ -0,0 +1,367 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#include "logdstgzip.h"
+
+#include "logutl.h"
+#include "sys.h"
+#include "minmax.h"
+#include "attrib.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+#include <mach/mach.h>
+#include <zlib.h>
+
+/*
+ * Compressed file log destination.
+ *
+ * Events are compressed in a streaming fashion into a sequence of gzip
+ * members; concatenated gzip members are a valid gzip file as per RFC 1952
+ * and can be read using gzcat or zless.  Every member is independently
+ * decompressible.  A member is completed whenever BLOCKSZ bytes of
+ * uncompressed event data have been written to it, and before the file is
+ * closed or rotated.  Whenever the log queue runs empty, a sync flush is
+ * performed, so that all events are committed to disk in decompressible form
+ * without resetting the compression dictionary.  Event data is batched in an
+ * input buffer and compressed in chunks of up to INBUFSZ bytes, which keeps
+ * the cost of sampling compression CPU time off the per-event path.
+ *
+ * If configured, the destination rotates the file itself by compressed size
+ * or by age.  The log thread is the only writer, so rotating between events
+ * does not lose or delay any events.  A file found at startup is rotated out
+ * of the way, since it may end with an incomplete member.  If reopening the
+ * file fails after rotation, opening is retried on the next compressed chunk.
+ */
+
+#define BLOCKSZ  (256*1024)     /* uncompressed bytes per gzip member */
+#define INBUFSZ  (64*1024)      /* uncompressed input buffer */
+#define OUTBUFSZ (64*1024)      /* compressed output buffer */
+
+static config_t *config = NULL;
+static FILE *f = NULL;
+static int fd = -1;
+static gid_t gid;
+static z_stream zs;
+static bool zsinit = false;
+static bool zsactive = false;   /* member started but not finished */
+static unsigned char inbuf[INBUFSZ];
+static size_t inlen;            /* uncompressed bytes in inbuf */
+static unsigned char outbuf[OUTBUFSZ];
+static size_t blockraw;         /* uncompressed bytes in current member */
+static off_t filesize;          /* compressed bytes in current file */
+static time_t fileopened;
+static logdst_stat_t stats;
+
+/*
+ * Returns user CPU time of the calling thread in usec.  Compression runs
+ * entirely in user space, while writes add to system time, so user time is
+ * a reasonable approximation of the CPU cost of compression.
+ */
+static uint64_t
+logdstgzip_utime(void) {
+	thread_basic_info_data_t tbi;
+	mach_msg_type_number_t cnt = THREAD_BASIC_INFO_COUNT;
+	mach_port_t thr;
+	kern_return_t krv;
+
+	thr = mach_thread_self();
+	krv = thread_info(thr, THREAD_BASIC_INFO, (thread_info_t)&tbi, &cnt);
+	(void)mach_port_deallocate(mach_task_self(), thr);
+	if (krv != KERN_SUCCESS)
+		return 0;
+	return (uint64_t)tbi.user_time.seconds * 1000000 +
+	       (uint64_t)tbi.user_time.microseconds;
+}
+
+static int
+logdstgzip_write_out(void) {
+	unsigned char *p = outbuf;
+	size_t sz = sizeof(outbuf) - zs.avail_out;
+	ssize_t n;
+
+	while (sz > 0) {
+		n = write(fd, p, sz);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		sz -= n;
+		stats.outbytes += n;
+		filesize += n;
+	}
+	zs.next_out = outbuf;
+	zs.avail_out = sizeof(outbuf);
+	return 0;
+}
+
+static int logdstgzip_fdopen(void);
+
+/*
+ * Compress the content of the input buffer into the current member, starting
+ * a new member if needed.  For mode Z_NO_FLUSH, output is only written to the
+ * file when the output buffer is full.  For Z_SYNC_FLUSH and Z_FINISH, all
+ * pending output is written to the file.  Input that cannot be compressed
+ * and written is dropped.
+ */
+static int
+logdstgzip_deflate(int mode) {
+	uint64_t t0;
+	int rv;
+
+	if (!zsactive && inlen == 0)
+		return 0;
+	if (fd == -1 && logdstgzip_fdopen() == -1) {
+		inlen = 0;
+		return -1;
+	}
+	if (!zsactive) {
+		if (deflateReset(&zs) != Z_OK) {
+			inlen = 0;
+			return -1;
+		}
+		zsactive = true;
+	}
+
+	t0 = logdstgzip_utime();
+	zs.next_in = inbuf;
+	zs.avail_in = (uInt)inlen;
+	inlen = 0;
+	for (;;) {
+		rv = deflate(&zs, mode);
+		if (rv == Z_STREAM_ERROR)
+			goto errout;
+		if (zs.avail_out > 0)
+			break;
+		if (logdstgzip_write_out() == -1)
+			goto errout;
+	}
+	assert(zs.avail_in == 0);
+	stats.cputime += logdstgzip_utime() - t0;
+
+	if (mode == Z_FINISH) {
+		assert(rv == Z_STREAM_END);
+		zsactive = false;
+		blockraw = 0;
+		stats.blocks++;
+	}
+	if (mode != Z_NO_FLUSH)
+		return logdstgzip_write_out();
+	return 0;
+
+errout:
+	stats.cputime += logdstgzip_utime() - t0;
+	return -1;
+}
+
+static int
+logdstgzip_writefn(UNUSED void *cookie, const char *buf, int len) {
+	size_t n;
+
+	for (int i = 0; i < len; i += n) {
+		if (inlen == sizeof(inbuf) &&
+		    logdstgzip_deflate(Z_NO_FLUSH) == -1) {
+			errno = EIO;
+			return -1;
+		}
+		n = min(sizeof(inbuf) - inlen, (size_t)(len - i));
+		memcpy(inbuf + inlen, buf + i, n);
+		inlen += n;
+	}
+	stats.rawbytes += len;
+	blockraw += len;
+	return len;
+}
+
+static int
+logdstgzip_fdopen(void) {
+	struct stat ss;
+
+	assert(fd == -1);
+	fd = open(config->logfile, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0644);
+	if (fd == -1)
+		return -1;
+	(void)fchown(fd, 0, gid);
+	(void)fcntl(fd, F_NOCACHE, 1);
+	(void)fcntl(fd, F_SINGLE_WRITER, 1);
+	filesize = (fstat(fd, &ss) == 0) ? ss.st_size : 0;
+	fileopened = time(NULL);
+	return 0;
+}
+
+static void
+logdstgzip_fdclose(void) {
+	if (fd == -1)
+		return;
+	(void)logdstgzip_deflate(Z_FINISH);
+	zsactive = false;
+	close(fd);
+	fd = -1;
+}
+
+static int
+logdstgzip_rotate(void) {
+	char *rpath;
+	int rv = 0;
+
+	logdstgzip_fdclose();
+	rpath = logutl_rotated_path(config->logfile, ".gz");
+	if (!rpath || rename(config->logfile, rpath) == -1) {
+		fprintf(stderr, "Failed to rotate '%s': %s (%i)\n",
+		                config->logfile, strerror(errno), errno);
+		rv = -1;
+	} else {
+		stats.rotations++;
+	}
+	if (rpath)
+		free(rpath);
+	if (logdstgzip_fdopen() == -1)
+		return -1;
+	return rv;
+}
+
+static bool
+logdstgzip_rotate_due(void) {
+	if (fd == -1)
+		return false;
+	if (config->logrotatesize > 0 &&
+	    (size_t)filesize >= config->logrotatesize)
+		return true;
+	if (config->logrotateinterval > 0 &&
+	    (size_t)(time(NULL) - fileopened) >= config->logrotateinterval)
+		return true;
+	return false;
+}
+
+static FILE *
+logdstgzip_open(void) {
+	return f;
+}
+
+static int
+logdstgzip_close(FILE *f) {
+	int rv = 0;
+
+	if (fflush(f) == EOF)
+		rv = -1;
+	if (blockraw >= BLOCKSZ &&
+	    logdstgzip_deflate(Z_FINISH) == -1)
+		rv = -1;
+	if (logdstgzip_rotate_due() && logdstgzip_rotate() == -1)
+		rv = -1;
+	return rv;
+}
+
+static void
+logdstgzip_flush(void) {
+	(void)logdstgzip_deflate(Z_SYNC_FLUSH);
+	if (logdstgzip_rotate_due())
+		(void)logdstgzip_rotate();
+}
+
+static int
+logdstgzip_init(config_t *cfg) {
+	struct stat ss;
+	char *rpath;
+
+	config = cfg;
+	gid = sys_gidbyname("admin");
+	bzero(&stats, sizeof(stats));
+	bzero(&zs, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+	                 15 + 16 /* gzip */, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+	zsinit = true;
+	zs.next_out = outbuf;
+	zs.avail_out = sizeof(outbuf);
+
+	/* rotate away existing file, may end in an incomplete member */
+	if (stat(config->logfile, &ss) == 0 && ss.st_size > 0) {
+		rpath = logutl_rotated_path(config->logfile, ".gz");
+		if (!rpath || rename(config->logfile, rpath) == -1) {
+			fprintf(stderr, "Failed to rotate '%s': %s (%i)\n",
+			                config->logfile, strerror(errno), errno);
+			if (rpath)
+				free(rpath);
+			goto errout;
+		}
+		free(rpath);
+	}
+
+	if (logdstgzip_fdopen() == -1)
+		goto errout;
+	f = funopen(NULL, NULL, logdstgzip_writefn, NULL, NULL);
+	if (!f)
+		goto errout;
+	return 0;
+
+errout:
+	if (fd != -1) {
+		close(fd);
+		fd = -1;
+	}
+	deflateEnd(&zs);
+	zsinit = false;
+	return -1;
+}
+
+/*
+ * Reopen the file after external rotation, e.g. by newsyslog.
+ */
+static int
+logdstgzip_reinit(void) {
+	assert(config);
+	logdstgzip_fdclose();
+	return logdstgzip_fdopen();
+}
+
+static void
+logdstgzip_fini(void) {
+	if (f) {
+		fflush(f);
+		fclose(f);
+		f = NULL;
+	}
+	logdstgzip_fdclose();
+	if (zsinit) {
+		deflateEnd(&zs);
+		zsinit = false;
+	}
+	config = NULL;
+}
+
+static void
+logdstgzip_stats(logdst_stat_t *st) {
+	*st = stats;
+}
+
+logdst_t logdstgzip = {
+	"gzip", false, true, true, true,
+	logdstgzip_init,
+	logdstgzip_reinit,
+	logdstgzip_fini,
+	NULL,
+	logdstgzip_open,
+	logdstgzip_close,
+	logdstgzip_flush,
+	logdstgzip_stats
+};
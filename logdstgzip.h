@@ -0,0 +1,19 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef LOGDSTGZIP_H
+#define LOGDSTGZIP_H
+
+#include "logdst.h"
+
+logdst_t logdstgzip;
+
+#endif
+
@@ -0,0 +1,814 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#include "logdstnet.h"
+
+#include "logbuf.h"
+#include "minmax.h"
+#include "attrib.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+/*
+ * Network log destination.
+ *
+ * The log thread formats events into a staging buffer, frames them and
+ * appends the frames to an in-memory ring buffer.  A separate sender thread
+ * owns the socket, (re)connects asynchronously with exponential backoff and
+ * sends frames in batches.  The log thread never touches the network.
+ *
+ * When the ring buffer is full, frames are spilled to a bounded spill file,
+ * if configured, and dropped otherwise.  As long as the spill file is not
+ * empty, all new frames are appended to it in order to preserve ordering; the
+ * sender drains the ring buffer before the spill file.  On shutdown, the
+ * sender keeps draining for up to DRAIN_TIMEOUT seconds; frames still in the
+ * ring buffer are then moved to the spill file together with its unsent
+ * content, and an existing spill file is sent first after startup.
+ *
+ * Delivery over stream sockets is at-least-once: after a send error, the
+ * whole unacknowledged batch is resent on the new connection.  A datagram
+ * that cannot be sent is dropped and the socket reconnected before sending
+ * the remaining datagrams of the batch.
+ */
+
+#define RINGSZ          (4*1024*1024)   /* in-memory ring buffer */
+#define BATCHSZ         (64*1024)       /* bytes per batch */
+#define BATCHFRAMES     1024            /* frames per batch */
+#define BACKOFF_MIN     1               /* seconds */
+#define BACKOFF_MAX     60              /* seconds */
+#define CONNECT_TIMEOUT 5               /* seconds */
+#define SEND_TIMEOUT    10              /* seconds */
+#define DRAIN_TIMEOUT   5               /* seconds */
+#define SYSLOG_PRI      141             /* LOG_LOCAL1|LOG_NOTICE */
+
+#define PROTO_TCP       0
+#define PROTO_UDP       1
+#define PROTO_UNIX      2
+
+static config_t *config = NULL;
+static char hostname[256];
+static pid_t pid;
+
+/* target, parsed from config->logaddr */
+static int proto;
+static char *host = NULL;
+static char *port = NULL;
+static char *path = NULL;
+
+/* staging buffer for the event being formatted, log thread only */
+static logbuf_t lb;
+
+/* sender thread state */
+static pthread_t thr;
+static bool thr_running = false;
+static int sock = -1;
+static bool dgram;
+static unsigned char *batch = NULL;
+static size_t batchcap;
+static uint32_t batchlens[BATCHFRAMES];
+
+/* shared state, protected by mutex */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static unsigned char *ring = NULL;
+static uint64_t rhead;          /* ring write position, monotonic */
+static uint64_t rtail;          /* ring read position, monotonic */
+static int spillfd = -1;
+static off_t spillwr;
+static off_t spillrd;
+static bool stopping;
+static logdst_stat_t stats;
+
+/*
+ * Parse tcp://host:port, udp://host:port, unix:///path into the target.
+ * IPv6 addresses can be given in square brackets.
+ */
+static int
+logdstnet_parse(const char *addr) {
+	const char *p, *sep;
+
+	if (!strncmp(addr, "unix://", 7)) {
+		proto = PROTO_UNIX;
+		path = strdup(addr + 7);
+		return path ? 0 : -1;
+	}
+	if (!strncmp(addr, "tcp://", 6))
+		proto = PROTO_TCP;
+	else if (!strncmp(addr, "udp://", 6))
+		proto = PROTO_UDP;
+	else
+		return -1;
+	p = addr + 6;
+	if (*p == '[') {
+		p++;
+		sep = strchr(p, ']');
+		if (!sep || sep[1] != ':')
+			return -1;
+		host = strndup(p, sep - p);
+		sep++;
+	} else {
+		sep = strrchr(p, ':');
+		if (!sep)
+			return -1;
+		host = strndup(p, sep - p);
+	}
+	if (!host)
+		return -1;
+	port = strdup(sep + 1);
+	if (!port)
+		return -1;
+	return 0;
+}
+
+static void
+logdstnet_ring_copyin(const void *buf, size_t sz) {
+	size_t off = rhead % RINGSZ;
+	size_t n = min(sz, RINGSZ - off);
+
+	memcpy(ring + off, buf, n);
+	memcpy(ring, (const unsigned char *)buf + n, sz - n);
+	rhead += sz;
+}
+
+static void
+logdstnet_ring_copyout(uint64_t pos, void *buf, size_t sz) {
+	size_t off = pos % RINGSZ;
+	size_t n = min(sz, RINGSZ - off);
+
+	memcpy(buf, ring + off, n);
+	memcpy((unsigned char *)buf + n, ring, sz - n);
+}
+
+static int
+logdstnet_spill_write(const struct iovec *iov, int iovcnt, uint32_t len) {
+	off_t off = spillwr;
+	ssize_t n;
+
+	n = pwrite(spillfd, &len, sizeof(len), off);
+	if (n != sizeof(len))
+		return -1;
+	off += n;
+	for (int i = 0; i < iovcnt; i++) {
+		n = pwrite(spillfd, iov[i].iov_base, iov[i].iov_len, off);
+		if (n != (ssize_t)iov[i].iov_len)
+			return -1;
+		off += n;
+	}
+	spillwr = off;
+	return 0;
+}
+
+/*
+ * Append a frame made up of iovcnt pieces.  Called on the log thread.
+ */
+static int
+logdstnet_enqueue(const struct iovec *iov, int iovcnt, size_t rawsz) {
+	uint32_t len = 0;
+	int rv = 0;
+
+	for (int i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	pthread_mutex_lock(&mutex);
+	stats.rawbytes += rawsz;
+	if (spillwr == spillrd &&
+	    rhead - rtail + sizeof(len) + len <= RINGSZ) {
+		logdstnet_ring_copyin(&len, sizeof(len));
+		for (int i = 0; i < iovcnt; i++)
+			logdstnet_ring_copyin(iov[i].iov_base,
+			                      iov[i].iov_len);
+	} else if (spillfd != -1 && (size_t)spillwr + sizeof(len) + len <=
+	                            config->logspillsize &&
+	           logdstnet_spill_write(iov, iovcnt, len) == 0) {
+		stats.spills++;
+	} else {
+		stats.drops++;
+		rv = -1;
+	}
+	pthread_mutex_unlock(&mutex);
+	pthread_cond_signal(&cond);
+	return rv;
+}
+
+/*
+ * Copy whole frames into the batch buffer, from the ring buffer if not empty,
+ * otherwise from the spill file.  RFC 5424 messages are prefixed with their
+ * length as per RFC 6587 octet counting when sending over a stream socket.
+ * Must be called with the mutex held.  The mutex is released while reading
+ * from the spill file; this is safe because only the sender thread consumes
+ * or truncates it, and the log thread only appends beyond spillwr.  Returns
+ * the number of frames and sets *consumed to the number of bytes consumed
+ * from the source.
+ */
+static size_t
+logdstnet_batch_fetch(size_t *consumed, bool *fromspill) {
+	size_t frames = 0, used = 0, need;
+	uint64_t pos = rtail;
+	off_t spos = spillrd;
+	off_t spend = spillwr;
+	char prefix[16];
+	int prefixsz;
+	uint32_t len;
+	void *p;
+
+	*fromspill = (rtail == rhead);
+	if (*fromspill)
+		pthread_mutex_unlock(&mutex);
+	while (frames < BATCHFRAMES) {
+		if (!*fromspill) {
+			if (pos == rhead)
+				break;
+			logdstnet_ring_copyout(pos, &len, sizeof(len));
+		} else {
+			if (spos == spend)
+				break;
+			if (pread(spillfd, &len, sizeof(len), spos) !=
+			    sizeof(len))
+				goto spillerr;
+		}
+		prefixsz = 0;
+		if (!dgram && config->logframing == LOGFRAMING_RFC5424)
+			prefixsz = snprintf(prefix, sizeof(prefix), "%u ",
+			                    len);
+		need = used + prefixsz + len;
+		if (frames > 0 && need > BATCHSZ)
+			break;
+		if (need > batchcap) {
+			p = realloc(batch, need);
+			if (!p) {
+				if (frames > 0)
+					break;
+				/* frame too large for memory, skip it */
+				if (*fromspill)
+					pthread_mutex_lock(&mutex);
+				stats.drops++;
+				if (!*fromspill)
+					rtail = pos + sizeof(len) + len;
+				else
+					spillrd = spos + sizeof(len) + len;
+				*consumed = 0;
+				return 0;
+			}
+			batch = p;
+			batchcap = need;
+		}
+		memcpy(batch + used, prefix, prefixsz);
+		if (!*fromspill) {
+			logdstnet_ring_copyout(pos + sizeof(len),
+			                       batch + used + prefixsz, len);
+			pos += sizeof(len) + len;
+		} else {
+			if (pread(spillfd, batch + used + prefixsz, len,
+			          spos + sizeof(len)) != (ssize_t)len)
+				goto spillerr;
+			spos += sizeof(len) + len;
+		}
+		batchlens[frames++] = prefixsz + len;
+		used = need;
+	}
+	if (*fromspill)
+		pthread_mutex_lock(&mutex);
+	*consumed = *fromspill ? (size_t)(spos - spillrd)
+	                       : (size_t)(pos - rtail);
+	return frames;
+
+spillerr:
+	/* unreadable spill file, discard its content */
+	pthread_mutex_lock(&mutex);
+	stats.drops++;
+	(void)ftruncate(spillfd, 0);
+	spillrd = spillwr = 0;
+	*consumed = 0;
+	return 0;
+}
+
+static void
+logdstnet_batch_commit(size_t consumed, bool fromspill, size_t sent) {
+	pthread_mutex_lock(&mutex);
+	stats.outbytes += sent;
+	if (!fromspill) {
+		rtail += consumed;
+	} else {
+		spillrd += consumed;
+		if (spillrd == spillwr) {
+			(void)ftruncate(spillfd, 0);
+			spillrd = spillwr = 0;
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Send the batch.  Datagrams are sent one frame per datagram; stream sockets
+ * send the batch as a whole.  Returns -1 if the connection needs to be
+ * reestablished and the frames from *done onwards resent.  The datagram that
+ * failed to send is dropped and counted in *done.
+ */
+static int
+logdstnet_batch_send(size_t frames, size_t *sent, size_t *done) {
+	unsigned char *p = batch;
+	size_t sz = 0;
+	ssize_t n;
+
+	*sent = 0;
+	*done = 0;
+	if (dgram) {
+		for (size_t i = 0; i < frames; i++) {
+			do {
+				n = send(sock, p, batchlens[i], 0);
+			} while (n == -1 && errno == EINTR);
+			(*done)++;
+			if (n == -1) {
+				pthread_mutex_lock(&mutex);
+				stats.drops++;
+				pthread_mutex_unlock(&mutex);
+				return -1;
+			}
+			*sent += batchlens[i];
+			p += batchlens[i];
+		}
+		return 0;
+	}
+
+	for (size_t i = 0; i < frames; i++)
+		sz += batchlens[i];
+	while (sz > 0) {
+		n = send(sock, p, sz, 0);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		sz -= n;
+		*sent += n;
+	}
+	*done = frames;
+	return 0;
+}
+
+static int
+logdstnet_socket_setup(int fd) {
+	struct timeval tv;
+	int one = 1;
+
+	tv.tv_sec = SEND_TIMEOUT;
+	tv.tv_usec = 0;
+	if (setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one)) == -1)
+		return -1;
+	if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1)
+		return -1;
+	(void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return 0;
+}
+
+static int
+logdstnet_connect_unix(void) {
+	struct sockaddr_un sun;
+	int fd;
+
+	if (strlen(path) >= sizeof(sun.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	bzero(&sun, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strlcpy(sun.sun_path, path, sizeof(sun.sun_path));
+
+	/* try stream first, fall back to datagram (e.g. /var/run/syslog) */
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0) {
+		dgram = false;
+		goto out;
+	}
+	close(fd);
+	if (errno != EPROTOTYPE)
+		return -1;
+	fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+		close(fd);
+		return -1;
+	}
+	dgram = true;
+out:
+	if (logdstnet_socket_setup(fd) == -1) {
+		close(fd);
+		return -1;
+	}
+	sock = fd;
+	return 0;
+}
+
+static int
+logdstnet_connect_inet(void) {
+	struct addrinfo hints, *ai, *res;
+	struct pollfd pfd;
+	socklen_t len;
+	int fd = -1, err, flags, rv;
+
+	bzero(&hints, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = (proto == PROTO_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+	rv = getaddrinfo(host, port, &hints, &res);
+	if (rv != 0) {
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd == -1)
+			continue;
+		flags = fcntl(fd, F_GETFL);
+		(void)fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+			if (errno != EINPROGRESS)
+				goto next;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			if (poll(&pfd, 1, CONNECT_TIMEOUT * 1000) != 1)
+				goto next;
+			len = sizeof(err);
+			if (getsockopt(fd, SOL_SOCKET, SO_ERROR,
+			               &err, &len) == -1 || err != 0)
+				goto next;
+		}
+		(void)fcntl(fd, F_SETFL, flags);
+		if (logdstnet_socket_setup(fd) == -1)
+			goto next;
+		break;
+next:
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd == -1)
+		return -1;
+	dgram = (proto == PROTO_UDP);
+	sock = fd;
+	return 0;
+}
+
+static int
+logdstnet_connect(void) {
+	if (proto == PROTO_UNIX)
+		return logdstnet_connect_unix();
+	return logdstnet_connect_inet();
+}
+
+static void
+logdstnet_disconnect(void) {
+	if (sock != -1) {
+		close(sock);
+		sock = -1;
+	}
+}
+
+/*
+ * Wait for up to secs seconds or until stopping.  Mutex must be held.
+ */
+static void
+logdstnet_backoff(int secs) {
+	struct timespec ts;
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	ts.tv_sec = now.tv_sec + secs;
+	ts.tv_nsec = now.tv_usec * 1000;
+	while (!stopping) {
+		if (pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
+			break;
+	}
+}
+
+static void *
+logdstnet_thread(UNUSED void *arg) {
+	int backoff = BACKOFF_MIN;
+	size_t frames, consumed, sent, done;
+	time_t deadline = 0;
+	bool fromspill;
+
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (!stopping && rhead == rtail && spillwr == spillrd)
+			pthread_cond_wait(&cond, &mutex);
+		if (rhead == rtail && spillwr == spillrd)
+			break;
+		if (stopping) {
+			/* leave the rest to logdstnet_spill_ring */
+			if (!deadline)
+				deadline = time(NULL) + DRAIN_TIMEOUT;
+			else if (time(NULL) >= deadline)
+				break;
+		}
+		if (sock == -1) {
+			pthread_mutex_unlock(&mutex);
+			if (logdstnet_connect() == -1) {
+				pthread_mutex_lock(&mutex);
+				if (stopping)
+					break;
+				logdstnet_backoff(backoff);
+				backoff = min(backoff * 2, BACKOFF_MAX);
+				continue;
+			}
+			backoff = BACKOFF_MIN;
+			pthread_mutex_lock(&mutex);
+			stats.connects++;
+		}
+		frames = logdstnet_batch_fetch(&consumed, &fromspill);
+		if (frames == 0)
+			continue;
+		pthread_mutex_unlock(&mutex);
+		if (logdstnet_batch_send(frames, &sent, &done) == -1) {
+			logdstnet_disconnect();
+			/* datagrams sent or dropped are not resent */
+			consumed = 0;
+			for (size_t i = 0; i < done; i++)
+				consumed += sizeof(uint32_t) + batchlens[i];
+			logdstnet_batch_commit(consumed, fromspill, sent);
+			pthread_mutex_lock(&mutex);
+			continue;
+		}
+		logdstnet_batch_commit(consumed, fromspill, sent);
+		pthread_mutex_lock(&mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+	logdstnet_disconnect();
+	return NULL;
+}
+
+static FILE *
+logdstnet_open(void) {
+	return logbuf_open(&lb);
+}
+
+/*
+ * Frame the staged event and hand it over to the sender thread.
+ */
+static int
+logdstnet_close(UNUSED FILE *f) {
+	struct iovec iov[2];
+	char header[384];
+	char stamp[32];
+	struct timeval now;
+	struct tm stm;
+	size_t sz;
+	int n;
+
+	if (logbuf_close(&lb) == -1)
+		return -1;
+	sz = lb.size;
+	while (sz > 0 && lb.buf[sz - 1] == '\n')
+		sz--;
+
+	if (config->logframing == LOGFRAMING_NDJSON) {
+		iov[0].iov_base = lb.buf;
+		iov[0].iov_len = sz;
+		iov[1].iov_base = (void *)"\n";
+		iov[1].iov_len = 1;
+		return logdstnet_enqueue(iov, 2, sz);
+	}
+
+	assert(config->logframing == LOGFRAMING_RFC5424);
+	gettimeofday(&now, NULL);
+	gmtime_r(&now.tv_sec, &stm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &stm);
+	n = snprintf(header, sizeof(header), "<%i>1 %s.%06iZ %s xnumon %i - - ",
+	             SYSLOG_PRI, stamp, (int)now.tv_usec, hostname, pid);
+	if (n < 0 || (size_t)n >= sizeof(header))
+		return -1;
+	iov[0].iov_base = header;
+	iov[0].iov_len = n;
+	iov[1].iov_base = lb.buf;
+	iov[1].iov_len = sz;
+	return logdstnet_enqueue(iov, 2, sz);
+}
+
+static void logdstnet_fini(void);
+
+static int
+logdstnet_init(config_t *cfg) {
+	struct stat ss;
+
+	config = cfg;
+	assert(cfg->logoneline);
+	bzero(&stats, sizeof(stats));
+	rhead = rtail = 0;
+	spillwr = spillrd = 0;
+	stopping = false;
+	pid = getpid();
+	if (gethostname(hostname, sizeof(hostname)) == -1)
+		strlcpy(hostname, "-", sizeof(hostname));
+
+	if (!cfg->logaddr || logdstnet_parse(cfg->logaddr) == -1) {
+		fprintf(stderr, "Invalid network log destination\n");
+		goto errout;
+	}
+	ring = malloc(RINGSZ);
+	if (!ring)
+		goto errout;
+	if (cfg->logspillfile) {
+		spillfd = open(cfg->logspillfile,
+		               O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+		if (spillfd == -1) {
+			fprintf(stderr, "Failed to open '%s': %s (%i)\n",
+			                cfg->logspillfile,
+			                strerror(errno), errno);
+			goto errout;
+		}
+		/* resend frames spilled before the last shutdown */
+		if (fstat(spillfd, &ss) == 0)
+			spillwr = ss.st_size;
+	}
+	if (logbuf_init(&lb) == -1)
+		goto errout;
+	if (pthread_create(&thr, NULL, logdstnet_thread, NULL) != 0)
+		goto errout;
+	thr_running = true;
+	return 0;
+
+errout:
+	logdstnet_fini();
+	return -1;
+}
+
+/*
+ * Move frames remaining in the ring buffer to the spill file.  Frames in the
+ * ring buffer are older than frames in the spill file, so unless the spill
+ * file is empty, a new spill file is written with the ring buffer frames
+ * first, followed by the unsent content of the old spill file.  The same
+ * applies if the spill file was only partially sent before the drain timed
+ * out, in order not to resend its head after startup.
+ */
+static void
+logdstnet_spill_ring(void) {
+	struct iovec iov;
+	char *tmppath = NULL;
+	int oldfd = -1;
+	uint64_t rstart = rtail;
+	off_t oldrd = 0, oldwr = 0;
+	uint32_t len;
+	ssize_t n;
+
+	if (spillfd == -1 || (rtail == rhead && spillrd == 0))
+		return;
+	if (spillrd != spillwr) {
+		if (asprintf(&tmppath, "%s.tmp", config->logspillfile) == -1)
+			goto out;
+		oldfd = spillfd;
+		oldrd = spillrd;
+		oldwr = spillwr;
+		spillfd = open(tmppath, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0600);
+		if (spillfd == -1) {
+			spillfd = oldfd;
+			oldfd = -1;
+			goto out;
+		}
+		spillrd = spillwr = 0;
+	}
+	while (rtail != rhead) {
+		logdstnet_ring_copyout(rtail, &len, sizeof(len));
+		if (len > batchcap) {
+			void *p = realloc(batch, len);
+			if (!p)
+				break;
+			batch = p;
+			batchcap = len;
+		}
+		logdstnet_ring_copyout(rtail + sizeof(len), batch, len);
+		iov.iov_base = batch;
+		iov.iov_len = len;
+		if ((size_t)(spillwr + oldwr - oldrd) + sizeof(len) + len >
+		    config->logspillsize ||
+		    logdstnet_spill_write(&iov, 1, len) == -1)
+			break;
+		rtail += sizeof(len) + len;
+	}
+	if (oldfd != -1) {
+		/* append unsent content of the old spill file */
+		if (!batch) {
+			batch = malloc(BATCHSZ);
+			if (batch)
+				batchcap = BATCHSZ;
+		}
+		while (oldrd < oldwr) {
+			n = pread(oldfd, batch, min(batchcap,
+			          (size_t)(oldwr - oldrd)), oldrd);
+			if (n <= 0 ||
+			    pwrite(spillfd, batch, n, spillwr) != n)
+				break;
+			oldrd += n;
+			spillwr += n;
+		}
+		if (oldrd == oldwr &&
+		    rename(tmppath, config->logspillfile) == 0) {
+			close(oldfd);
+		} else {
+			/* keep the old spill file, losing the ring buffer */
+			(void)unlink(tmppath);
+			close(spillfd);
+			spillfd = oldfd;
+			rtail = rstart;
+		}
+	}
+out:
+	if (tmppath)
+		free(tmppath);
+	if (rhead != rtail)
+		fprintf(stderr, "Failed to spill queued events\n");
+	while (rtail != rhead) {
+		logdstnet_ring_copyout(rtail, &len, sizeof(len));
+		rtail += sizeof(len) + len;
+		stats.drops++;
+	}
+}
+
+static void
+logdstnet_fini(void) {
+	if (thr_running) {
+		pthread_mutex_lock(&mutex);
+		stopping = true;
+		pthread_mutex_unlock(&mutex);
+		pthread_cond_broadcast(&cond);
+		if (pthread_join(thr, NULL) != 0) {
+			fprintf(stderr, "Failed to join sender thread\n");
+		}
+		thr_running = false;
+		logdstnet_spill_ring();
+	}
+	logbuf_fini(&lb);
+	if (spillfd != -1) {
+		close(spillfd);
+		spillfd = -1;
+	}
+	if (ring) {
+		free(ring);
+		ring = NULL;
+	}
+	if (batch) {
+		free(batch);
+		batch = NULL;
+		batchcap = 0;
+	}
+	if (host) {
+		free(host);
+		host = NULL;
+	}
+	if (port) {
+		free(port);
+		port = NULL;
+	}
+	if (path) {
+		free(path);
+		path = NULL;
+	}
+	config = NULL;
+}
+
+static void
+logdstnet_stats(logdst_stat_t *st) {
+	pthread_mutex_lock(&mutex);
+	*st = stats;
+	pthread_mutex_unlock(&mutex);
+}
+
+logdst_t logdstnet = {
+	"net", false, true, false, true,
+	logdstnet_init,
+	NULL,
+	logdstnet_fini,
+	NULL,
+	logdstnet_open,
+	logdstnet_close,
+	NULL,
+	logdstnet_stats
+};
@@ -0,0 +1,403 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#include "logdstspool.h"
+
+#include "logutl.h"
+#include "sys.h"
+#include "attrib.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <zlib.h>
+
+/*
+ * Memory-mapped spool log destination.
+ *
+ * Events are formatted directly into a preallocated, memory-mapped segment
+ * file (see logdstspool.h for the format) without any write syscalls on the
+ * hot path.  A frame is committed by advancing the commit offset in the
+ * segment header after the frame has been written completely.  This makes
+ * recovery after a crash of xnumon a constant-time operation: on startup,
+ * writing simply resumes at the commit offset of the existing segment.
+ * After a system crash, the last frames before commit may not have made it
+ * to disk; readers should verify the CRC.
+ *
+ * When a segment is full or older than the rotation interval, it is renamed
+ * out of the way, a new segment is created at the configured path, and the
+ * old segment is sealed and truncated to its committed size.  The segment
+ * size is taken from the rotation size, defaulting to SEGSZ_DEFAULT.
+ */
+
+#define SEGSZ_DEFAULT   (64*1024*1024)
+#define SEGSZ_MIN       (1024*1024)
+#define ALIGN(X)        (((X) + SPOOL_ALIGN - 1) & ~((size_t)SPOOL_ALIGN - 1))
+
+static config_t *config = NULL;
+static FILE *f = NULL;
+static int fd = -1;
+static gid_t gid;
+static unsigned char *base = NULL;      /* mapped segment */
+static spool_hdr_t *hdr = NULL;         /* header of mapped segment */
+static size_t segsz;                    /* size of mapped segment */
+static size_t pending;                  /* payload bytes of current frame */
+static bool failed;                     /* current frame failed */
+static time_t segopened;
+static logdst_stat_t stats;
+
+static size_t
+logdstspool_segsz(void) {
+	size_t sz;
+
+	sz = config->logrotatesize ? config->logrotatesize : SEGSZ_DEFAULT;
+	if (sz < SEGSZ_MIN)
+		sz = SEGSZ_MIN;
+	return (sz + SPOOL_HDRSZ - 1) & ~((size_t)SPOOL_HDRSZ - 1);
+}
+
+static int
+logdstspool_map(size_t sz) {
+	void *p;
+
+	p = mmap(NULL, sz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	base = p;
+	hdr = p;
+	segsz = sz;
+	return 0;
+}
+
+static void
+logdstspool_unmap(void) {
+	if (!base)
+		return;
+	(void)msync(base, segsz, MS_SYNC);
+	(void)munmap(base, segsz);
+	base = NULL;
+	hdr = NULL;
+}
+
+/*
+ * Create and map a new, empty segment at the configured path.
+ */
+static int
+logdstspool_create(void) {
+	fstore_t fst;
+	size_t sz;
+
+	assert(fd == -1);
+	sz = logdstspool_segsz();
+	fd = open(config->logfile, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+	if (fd == -1)
+		return -1;
+	(void)fchown(fd, 0, gid);
+
+	/* preallocate, contiguous if possible */
+	bzero(&fst, sizeof(fst));
+	fst.fst_flags = F_ALLOCATECONTIG|F_ALLOCATEALL;
+	fst.fst_posmode = F_PEOFPOSMODE;
+	fst.fst_length = sz;
+	if (fcntl(fd, F_PREALLOCATE, &fst) == -1) {
+		fst.fst_flags = F_ALLOCATEALL;
+		(void)fcntl(fd, F_PREALLOCATE, &fst);
+	}
+	if (ftruncate(fd, sz) == -1 || logdstspool_map(sz) == -1) {
+		close(fd);
+		fd = -1;
+		(void)unlink(config->logfile);
+		return -1;
+	}
+
+	hdr->version = SPOOL_VERSION;
+	hdr->flags = 0;
+	hdr->size = sz;
+	hdr->commit = SPOOL_HDRSZ;
+	hdr->records = 0;
+	atomic_thread_fence(memory_order_release);
+	memcpy(hdr->magic, SPOOL_MAGIC, sizeof(hdr->magic));
+	segopened = time(NULL);
+	return 0;
+}
+
+/*
+ * Resume writing to an existing segment at the configured path.  Only the
+ * header is inspected, hence recovery takes constant time independent of
+ * segment size and content.
+ *
+ * Returns 0 on success, 1 if there is no resumable segment, -1 on errors.
+ */
+static int
+logdstspool_recover(void) {
+	struct stat ss;
+
+	assert(fd == -1);
+	fd = open(config->logfile, O_RDWR|O_CLOEXEC);
+	if (fd == -1)
+		return (errno == ENOENT) ? 1 : -1;
+	if (fstat(fd, &ss) == -1)
+		goto errout;
+	if ((size_t)ss.st_size < SPOOL_HDRSZ)
+		goto skip;
+	if (logdstspool_map(ss.st_size) == -1)
+		goto errout;
+	if (memcmp(hdr->magic, SPOOL_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != SPOOL_VERSION ||
+	    (hdr->flags & SPOOL_FLAG_SEALED) ||
+	    hdr->size != (uint64_t)ss.st_size ||
+	    hdr->commit < SPOOL_HDRSZ ||
+	    hdr->commit > hdr->size) {
+		(void)munmap(base, segsz);
+		base = NULL;
+		hdr = NULL;
+		goto skip;
+	}
+	segopened = ss.st_birthtimespec.tv_sec;
+	return 0;
+skip:
+	close(fd);
+	fd = -1;
+	return 1;
+errout:
+	close(fd);
+	fd = -1;
+	return -1;
+}
+
+/*
+ * Resume the segment at the configured path or, if it is not resumable,
+ * rotate it out of the way and create a new one.
+ */
+static int
+logdstspool_open_segment(void) {
+	char *rpath;
+	int rv;
+
+	rv = logdstspool_recover();
+	if (rv != 1)
+		return rv;
+	rpath = logutl_rotated_path(config->logfile, ".spool");
+	if (!rpath)
+		return -1;
+	if (rename(config->logfile, rpath) == -1 && errno != ENOENT) {
+		fprintf(stderr, "Failed to rotate '%s': %s (%i)\n",
+		                config->logfile, strerror(errno), errno);
+		free(rpath);
+		return -1;
+	}
+	free(rpath);
+	return logdstspool_create();
+}
+
+static void
+logdstspool_close_segment(void) {
+	logdstspool_unmap();
+	if (fd != -1) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+/*
+ * Replace the current segment with a new one.  The payload of a partially
+ * written frame is carried over to the new segment.
+ */
+static int
+logdstspool_rotate(void) {
+	unsigned char *oldbase = base;
+	size_t oldsz = segsz;
+	int oldfd = fd;
+	uint64_t oldcommit;
+	char *rpath;
+
+	if (!base)
+		return -1;
+	oldcommit = hdr->commit;
+	rpath = logutl_rotated_path(config->logfile, ".spool");
+	if (!rpath)
+		return -1;
+	if (rename(config->logfile, rpath) == -1) {
+		fprintf(stderr, "Failed to rotate '%s': %s (%i)\n",
+		                config->logfile, strerror(errno), errno);
+		free(rpath);
+		return -1;
+	}
+	base = NULL;
+	hdr = NULL;
+	fd = -1;
+	if (logdstspool_create() == -1) {
+		(void)rename(rpath, config->logfile);
+		free(rpath);
+		base = oldbase;
+		hdr = (spool_hdr_t *)oldbase;
+		segsz = oldsz;
+		fd = oldfd;
+		return -1;
+	}
+	free(rpath);
+	if (pending > 0) {
+		if (SPOOL_HDRSZ + sizeof(spool_frame_t) + pending > segsz) {
+			failed = true;
+			pending = 0;
+		} else {
+			memcpy(base + SPOOL_HDRSZ + sizeof(spool_frame_t),
+			       oldbase + oldcommit + sizeof(spool_frame_t),
+			       pending);
+		}
+	}
+
+	/* seal old segment only after the new segment is in place */
+	((spool_hdr_t *)oldbase)->flags |= SPOOL_FLAG_SEALED;
+	(void)msync(oldbase, oldsz, MS_SYNC);
+	(void)munmap(oldbase, oldsz);
+	(void)ftruncate(oldfd, oldcommit);
+	close(oldfd);
+	stats.rotations++;
+	return 0;
+}
+
+static int
+logdstspool_writefn(UNUSED void *cookie, const char *buf, int len) {
+	size_t off;
+
+	if (failed || !base)
+		goto errout;
+	off = hdr->commit + sizeof(spool_frame_t) + pending;
+	if (off + len > segsz) {
+		if (logdstspool_rotate() == -1 || failed)
+			goto errout;
+		off = hdr->commit + sizeof(spool_frame_t) + pending;
+		if (off + len > segsz)
+			goto errout;
+	}
+	memcpy(base + off, buf, len);
+	pending += len;
+	return len;
+
+errout:
+	failed = true;
+	errno = ENOSPC;
+	return -1;
+}
+
+static FILE *
+logdstspool_open(void) {
+	return f;
+}
+
+static int
+logdstspool_close(FILE *f) {
+	spool_frame_t *frame;
+	uint64_t next;
+	int rv = 0;
+
+	if (fflush(f) == EOF || failed || !base) {
+		(void)fpurge(f);
+		clearerr(f);
+		rv = -1;
+		goto out;
+	}
+
+	frame = (spool_frame_t *)(base + hdr->commit);
+	frame->len = (uint32_t)pending;
+	frame->crc = (uint32_t)crc32(0, (Bytef *)(frame + 1), (uInt)pending);
+	next = ALIGN(hdr->commit + sizeof(spool_frame_t) + pending);
+	assert(next <= segsz);
+	stats.rawbytes += pending;
+	stats.outbytes += next - hdr->commit;
+	atomic_thread_fence(memory_order_release);
+	hdr->records++;
+	hdr->commit = next;
+
+out:
+	pending = 0;
+	failed = false;
+	if (config->logrotateinterval > 0 &&
+	    (size_t)(time(NULL) - segopened) >= config->logrotateinterval &&
+	    logdstspool_rotate() == -1)
+		rv = -1;
+	return rv;
+}
+
+/*
+ * Initiate writeback of committed frames while idle.
+ */
+static void
+logdstspool_flush(void) {
+	if (!base)
+		return;
+	(void)msync(base, hdr->commit, MS_ASYNC);
+}
+
+static int
+logdstspool_init(config_t *cfg) {
+	config = cfg;
+	gid = sys_gidbyname("admin");
+	bzero(&stats, sizeof(stats));
+	pending = 0;
+	failed = false;
+	if (logdstspool_open_segment() == -1) {
+		fprintf(stderr, "Failed to open spool '%s': %s (%i)\n",
+		                config->logfile, strerror(errno), errno);
+		return -1;
+	}
+	f = funopen(NULL, NULL, logdstspool_writefn, NULL, NULL);
+	if (!f) {
+		logdstspool_close_segment();
+		return -1;
+	}
+	return 0;
+}
+
+static int
+logdstspool_reinit(void) {
+	assert(config);
+	logdstspool_close_segment();
+	return logdstspool_open_segment();
+}
+
+static void
+logdstspool_fini(void) {
+	if (f) {
+		fclose(f);
+		f = NULL;
+	}
+	logdstspool_close_segment();
+	config = NULL;
+}
+
+static void
+logdstspool_stats(logdst_stat_t *st) {
+	*st = stats;
+}
+
+logdst_t logdstspool = {
+	"spool", false, true, true, true,
+	logdstspool_init,
+	logdstspool_reinit,
+	logdstspool_fini,
+	NULL,
+	logdstspool_open,
+	logdstspool_close,
+	logdstspool_flush,
+	logdstspool_stats
+};
@@ -0,0 +1,57 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef LOGDSTSPOOL_H
+#define LOGDSTSPOOL_H
+
+#include "logdst.h"
+
+#include <stdint.h>
+
+/*
+ * Spool segment file format, in host byte order.
+ *
+ * A segment file is preallocated to its full size and starts with a header
+ * page, followed by framed records starting at offset SPOOL_HDRSZ.  Each
+ * frame consists of a spool_frame_t followed by len bytes of formatted event,
+ * padded to SPOOL_ALIGN bytes.  The commit field in the header is the offset
+ * past the last completely written frame; it is only updated after the frame
+ * has been written in full.  Bytes beyond commit are undefined.
+ *
+ * Readers may map the segment concurrently and consume frames up to commit.
+ * Once a reader has consumed all frames of a segment with SPOOL_FLAG_SEALED
+ * set, the next segment can be found at the configured path; the sealed
+ * segment has been renamed with a timestamp inserted before the .spool suffix
+ * and truncated to commit bytes.
+ */
+#define SPOOL_MAGIC     "XNUSPOOL"
+#define SPOOL_VERSION   1
+#define SPOOL_HDRSZ     4096
+#define SPOOL_ALIGN     8
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t flags;
+#define SPOOL_FLAG_SEALED 1
+	uint64_t size;          /* segment size including header */
+	uint64_t commit;        /* offset past last committed frame */
+	uint64_t records;       /* number of committed frames */
+} spool_hdr_t;
+
+typedef struct {
+	uint32_t len;           /* payload length, excluding frame and padding */
+	uint32_t crc;           /* CRC-32 of payload */
+} spool_frame_t;
+
+logdst_t logdstspool;
+
+#endif
+
@@ -57,6 +57,8 @@ logdst_t logdststdout = {
 	logdststdout_fini,
 	NULL,
 	logdststdout_open,
-	logdststdout_close
+	logdststdout_close,
+	NULL,
+	NULL
 };
 
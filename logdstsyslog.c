@@ -12,8 +12,7 @@
 
 #include "config.h"
 #include "attrib.h"
-
-#include "memstream.h"
+#include "logbuf.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,24 +21,18 @@
 
 static config_t *config;
 
-static char *msg;
-static size_t sz;
+static logbuf_t lb;
 
 static FILE *
 logdstsyslog_open(void) {
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunguarded-availability"
-	return open_memstream(&msg, &sz);
-#pragma clang diagnostic pop
+	return logbuf_open(&lb);
 }
 
 static int
-logdstsyslog_close(FILE *f) {
-	fclose(f);
-	if (!msg)
+logdstsyslog_close(UNUSED FILE *f) {
+	if (logbuf_close(&lb) == -1)
 		return -1;
-	syslog(LOG_NOTICE, "%s", msg);
-	free(msg);
+	syslog(LOG_NOTICE, "%s", lb.buf);
 	return 0;
 }
 
@@ -47,6 +40,8 @@ static int
 logdstsyslog_init(config_t *cfg) {
 	config = cfg;
 	assert(cfg->logoneline);
+	if (logbuf_init(&lb) == -1)
+		return -1;
 	setlogmask(LOG_UPTO(LOG_NOTICE));
 	openlog("xnumon", LOG_CONS|LOG_PID|LOG_NDELAY, LOG_LOCAL1);
 	return 0;
@@ -55,6 +50,7 @@ logdstsyslog_init(config_t *cfg) {
 static void
 logdstsyslog_fini(void) {
 	closelog();
+	logbuf_fini(&lb);
 	config = NULL;
 }
 
@@ -65,6 +61,8 @@ logdst_t logdstsyslog = {
 	logdstsyslog_fini,
 	NULL,
 	logdstsyslog_open,
-	logdstsyslog_close
+	logdstsyslog_close,
+	NULL,
+	NULL
 };
 
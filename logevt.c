@@ -16,9 +16,8 @@
  * Currently, this code also does runtime translation of user, group etc IDs
  * into names.  The reason for this is that we do not want to block the worker
  * thread with such lookups, because they are not as time-critical as the
- * acquisition of hashes and code signatures.  As a side benefit, we do not
- * need to malloc space for the strings as we can print them to the log record
- * right away.
+ * acquisition of hashes and code signatures.  Names are served from cacheid,
+ * which keeps slow directory lookups off the log thread for known IDs.
  *
  * General design decisions:
  * - only use null values for configuration, not for data
@@ -33,13 +32,17 @@
 #include "filemon.h"
 #include "hackmon.h"
 #include "sockmon.h"
+#include "execsum.h"
+#include "queue.h"
 #include "str.h"
 #include "sys.h"
+#include "cacheid.h"
+#include "aev.h"
+#include "memstream.h"
 
+#include <stdlib.h>
 #include <assert.h>
 #include <sys/types.h>
-#include <pwd.h>
-#include <grp.h>
 
 static config_t *config;
 
@@ -51,7 +54,7 @@ logevt_init(config_t *cfg) {
 static void
 logevt_uid(logfmt_t *fmt, FILE *f,
            uid_t uid, const char *idlabel, const char *namelabel) {
-	struct passwd *pw;
+	char name[CACHEID_NAMESZ];
 
 	fmt->dict_item(f, idlabel);
 	if (uid == (uid_t)-1) {
@@ -61,10 +64,9 @@ logevt_uid(logfmt_t *fmt, FILE *f,
 	fmt->value_uint(f, uid);
 
 	if (config->resolve_users_groups) {
-		pw = getpwuid(uid);
-		if (pw) {
+		if (cacheid_user(name, sizeof(name), uid) == 0) {
 			fmt->dict_item(f, namelabel);
-			fmt->value_string(f, pw->pw_name);
+			fmt->value_string(f, name);
 		}
 	}
 }
@@ -72,7 +74,7 @@ logevt_uid(logfmt_t *fmt, FILE *f,
 static void
 logevt_gid(logfmt_t *fmt, FILE *f,
            gid_t gid, const char *idlabel, const char *namelabel) {
-	struct group *gr;
+	char name[CACHEID_NAMESZ];
 
 	fmt->dict_item(f, idlabel);
 	if (gid == (gid_t)-1) {
@@ -82,10 +84,9 @@ logevt_gid(logfmt_t *fmt, FILE *f,
 	fmt->value_uint(f, gid);
 
 	if (config->resolve_users_groups) {
-		gr = getgrgid(gid);
-		if (gr) {
+		if (cacheid_group(name, sizeof(name), gid) == 0) {
 			fmt->dict_item(f, namelabel);
-			fmt->value_string(f, gr->gr_name);
+			fmt->value_string(f, name);
 		}
 	}
 }
@@ -117,6 +118,8 @@ logevt_xnumon_ops(logfmt_t *fmt, FILE *f, void *arg0) {
 
 	fmt->dict_item(f, "op");
 	fmt->value_string(f, ops->subtype);
+	fmt->dict_item(f, "degradation");
+	fmt->value_uint(f, ops->degradation);
 
 	fmt->dict_item(f, "build");
 	fmt->dict_begin(f);
@@ -139,20 +142,57 @@ logevt_xnumon_ops(logfmt_t *fmt, FILE *f, void *arg0) {
 		fmt->value_null(f);
 	fmt->dict_item(f, "launchd_mode");
 	fmt->value_bool(f, config->launchd_mode);
+	fmt->dict_item(f, "trail");
+	if (config->trail)
+		fmt->value_string(f, config->trail);
+	else
+		fmt->value_null(f);
 	fmt->dict_item(f, "debug");
 	fmt->value_bool(f, config->debug);
 	fmt->dict_item(f, "events");
 	char *evts = config_events_s(config);
 	fmt->value_string(f, evts);
 	free(evts);
+	fmt->dict_item(f, "priority_high");
+	char *prio = config_prio_s(config, QUEUE_PRIO_HIGH);
+	fmt->value_string(f, prio);
+	free(prio);
+	fmt->dict_item(f, "priority_low");
+	prio = config_prio_s(config, QUEUE_PRIO_LOW);
+	fmt->value_string(f, prio);
+	free(prio);
 	fmt->dict_item(f, "stats_interval");
 	fmt->value_uint(f, config->stats_interval);
+	fmt->dict_item(f, "adaptive_degradation");
+	fmt->value_bool(f, config->adaptive_degradation);
+	fmt->dict_item(f, "memory_budget");
+	fmt->value_uint(f, config->memory_budget);
+	fmt->dict_item(f, "cache_size_min");
+	fmt->value_uint(f, config->cache_size_min);
+	fmt->dict_item(f, "cache_size_max");
+	fmt->value_uint(f, config->cache_size_max);
 	fmt->dict_item(f, "kextlevel");
 	fmt->value_string(f, config_kextlevel_s(config));
 	fmt->dict_item(f, "hashes");
 	fmt->value_string(f, hashes_flags_s(config->hflags));
 	fmt->dict_item(f, "codesign");
 	fmt->value_bool(f, config->codesign);
+	fmt->dict_item(f, "codesign_threads");
+	fmt->value_uint(f, config->codesign_threads);
+	fmt->dict_item(f, "codesign_timeout");
+	fmt->value_uint(f, config->codesign_timeout);
+	fmt->dict_item(f, "prehash_dirs");
+	if (config->prehashdirs)
+		fmt->value_string(f, config->prehashdirs);
+	else
+		fmt->value_null(f);
+	fmt->dict_item(f, "prehash_history");
+	if (config->prehashhistory)
+		fmt->value_string(f, config->prehashhistory);
+	else
+		fmt->value_null(f);
+	fmt->dict_item(f, "prehash_rate");
+	fmt->value_uint(f, config->prehashrate);
 	fmt->dict_item(f, "envlevel");
 	fmt->value_string(f, config_envlevel_s(config));
 	fmt->dict_item(f, "resolve_users_groups");
@@ -192,6 +232,25 @@ logevt_xnumon_ops(logfmt_t *fmt, FILE *f, void *arg0) {
 		fmt->value_string(f, config->logfile);
 	else
 		fmt->value_null(f);
+	fmt->dict_item(f, "logrotatesize");
+	fmt->value_uint(f, config->logrotatesize);
+	fmt->dict_item(f, "logrotateinterval");
+	fmt->value_uint(f, config->logrotateinterval);
+	fmt->dict_item(f, "logaddr");
+	if (config->logaddr)
+		fmt->value_string(f, config->logaddr);
+	else
+		fmt->value_null(f);
+	fmt->dict_item(f, "logframing");
+	fmt->value_string(f, config->logframing == LOGFRAMING_NDJSON ?
+	                     "ndjson" : "rfc5424");
+	fmt->dict_item(f, "logspillfile");
+	if (config->logspillfile)
+		fmt->value_string(f, config->logspillfile);
+	else
+		fmt->value_null(f);
+	fmt->dict_item(f, "logspillsize");
+	fmt->value_uint(f, config->logspillsize);
 	fmt->dict_item(f, "limit_nofile");
 	fmt->value_uint(f, config->limit_nofile);
 	fmt->dict_item(f, "suppress_image_exec_at_start");
@@ -220,6 +279,10 @@ logevt_xnumon_ops(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->dict_item(f, "suppress_socket_op_by_subject_path");
 	fmt->value_uint(f,
 		setstr_size(&config->suppress_socket_op_by_subject_path));
+	fmt->dict_item(f, "socket_aggregate_window");
+	fmt->value_uint(f, config->socket_aggregate_window);
+	fmt->dict_item(f, "exec_summary_window");
+	fmt->value_uint(f, config->exec_summary_window);
 	fmt->dict_end(f); /* config */
 
 	fmt->dict_item(f, "system");
@@ -236,6 +299,62 @@ logevt_xnumon_ops(logfmt_t *fmt, FILE *f, void *arg0) {
 	return 0;
 }
 
+static void
+logevt_latency(logfmt_t *fmt, FILE *f, const latency_summary_t *sum) {
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "count");
+	fmt->value_uint(f, sum->count);
+	fmt->dict_item(f, "p50");
+	fmt->value_uint(f, sum->p50);
+	fmt->dict_item(f, "p99");
+	fmt->value_uint(f, sum->p99);
+	fmt->dict_item(f, "p999");
+	fmt->value_uint(f, sum->p999);
+	fmt->dict_item(f, "max");
+	fmt->value_uint(f, sum->max);
+	fmt->dict_end(f);
+}
+
+static void
+logevt_lanes(logfmt_t *fmt, FILE *f, const queue_lane_stat_t *lanes) {
+	fmt->dict_begin(f);
+	for (int i = 0; i < QUEUE_PRIOS; i++) {
+		fmt->dict_item(f, queue_prio_s(i));
+		fmt->dict_begin(f);
+		fmt->dict_item(f, "buckets");
+		fmt->value_uint(f, lanes[i].qsize);
+		fmt->dict_item(f, "dequeued");
+		fmt->value_uint(f, lanes[i].dequeued);
+		fmt->dict_item(f, "waittime");
+		fmt->value_uint(f, lanes[i].waittime);
+		fmt->dict_item(f, "waitmax");
+		fmt->value_uint(f, lanes[i].waitmax);
+		fmt->dict_end(f);
+	}
+	fmt->dict_end(f);
+}
+
+/*
+ * Emits the adaptive sizing items of a cache into the current dict; the
+ * estimated miss ratios are in permille at 1/4 to 8/4 of the current size.
+ */
+static void
+logevt_lrucache(logfmt_t *fmt, FILE *f, const lrucache_stat_t *lru) {
+	fmt->dict_item(f, "ghosts");
+	fmt->value_uint(f, lru->ghosts);
+	fmt->dict_item(f, "ghosthit");
+	fmt->value_uint(f, lru->ghosthits);
+	fmt->dict_item(f, "resizes");
+	fmt->value_uint(f, lru->resizes);
+	fmt->dict_item(f, "mrc");
+	fmt->list_begin(f);
+	for (int i = 0; i < LRUCACHE_MRC_POINTS; i++) {
+		fmt->list_item(f, "permille");
+		fmt->value_uint(f, lru->mrc[i]);
+	}
+	fmt->list_end(f);
+}
+
 int
 logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	evtloop_stat_t *st = (evtloop_stat_t *)arg0;
@@ -313,6 +432,17 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->dict_item(f, "getcwd");
 	fmt->value_uint(f, st->pm.miss_getcwd);
 	fmt->dict_end(f); /* miss */
+	fmt->dict_item(f, "reaped");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "checks");
+	fmt->value_uint(f, st->pm.reap_checks);
+	fmt->dict_item(f, "procs");
+	fmt->value_uint(f, st->pm.reap_procs);
+	fmt->dict_item(f, "images");
+	fmt->value_uint(f, st->pm.reap_images);
+	fmt->dict_item(f, "bytes");
+	fmt->value_uint(f, st->pm.reap_bytes);
+	fmt->dict_end(f); /* reaped */
 	fmt->dict_item(f, "oom");
 	fmt->value_uint(f, st->pm.ooms);
 	fmt->dict_end(f); /* procmon */
@@ -323,6 +453,8 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->value_uint(f, st->hm.recvd);
 	fmt->dict_item(f, "procd");
 	fmt->value_uint(f, st->hm.procd);
+	fmt->dict_item(f, "suppressed");
+	fmt->value_uint(f, st->hm.suppressed);
 	fmt->dict_item(f, "oom");
 	fmt->value_uint(f, st->hm.ooms);
 	fmt->dict_end(f); /* hackmon */
@@ -345,10 +477,32 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->value_uint(f, st->sm.recvd);
 	fmt->dict_item(f, "procd");
 	fmt->value_uint(f, st->sm.procd);
+	fmt->dict_item(f, "coalesced");
+	fmt->value_uint(f, st->sm.coalesced);
+	fmt->dict_item(f, "aggregated");
+	fmt->value_uint(f, st->sm.aggregated);
+	fmt->dict_item(f, "summaries");
+	fmt->value_uint(f, st->sm.summaries);
+	fmt->dict_item(f, "aggregates");
+	fmt->value_uint(f, st->sm.aggregates);
+	fmt->dict_item(f, "suppressed");
+	fmt->value_uint(f, st->sm.suppressed);
 	fmt->dict_item(f, "oom");
 	fmt->value_uint(f, st->sm.ooms);
 	fmt->dict_end(f); /* sockmon */
 
+	fmt->dict_item(f, "execsum");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "groups");
+	fmt->value_uint(f, st->es.groups);
+	fmt->dict_item(f, "folded");
+	fmt->value_uint(f, st->es.folded);
+	fmt->dict_item(f, "summaries");
+	fmt->value_uint(f, st->es.summaries);
+	fmt->dict_item(f, "oom");
+	fmt->value_uint(f, st->es.ooms);
+	fmt->dict_end(f); /* execsum */
+
 	fmt->dict_item(f, "kext_cdevq");
 	fmt->dict_begin(f);
 	fmt->dict_item(f, "buckets");
@@ -375,6 +529,8 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->value_uint(f, st->pm.pqmiss);
 	fmt->dict_item(f, "drop");
 	fmt->value_uint(f, st->pm.pqdrop);
+	fmt->dict_item(f, "expire");
+	fmt->value_uint(f, st->pm.pqexpired);
 	fmt->dict_item(f, "bktskip");
 	fmt->value_uint(f, st->pm.pqskip);
 	fmt->dict_end(f); /* prep-queue */
@@ -397,12 +553,16 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->dict_begin(f);
 	fmt->dict_item(f, "buckets");
 	fmt->value_uint(f, st->wq.qsize);
+	fmt->dict_item(f, "lanes");
+	logevt_lanes(fmt, f, st->wq.lanes);
 	fmt->dict_end(f); /* work-queue */
 
 	fmt->dict_item(f, "log_queue");
 	fmt->dict_begin(f);
 	fmt->dict_item(f, "buckets");
 	fmt->value_uint(f, st->lq.qsize);
+	fmt->dict_item(f, "lanes");
+	logevt_lanes(fmt, f, st->lq.lanes);
 	fmt->dict_item(f, "events");
 	fmt->list_begin(f);
 	for (int i = 0; i < LOGEVT_SIZE; i++) {
@@ -414,6 +574,129 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->value_uint(f, st->lq.errors);
 	fmt->dict_end(f); /* log-queue */
 
+	fmt->dict_item(f, "log_dst");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "rawbytes");
+	fmt->value_uint(f, st->lq.dst.rawbytes);
+	fmt->dict_item(f, "outbytes");
+	fmt->value_uint(f, st->lq.dst.outbytes);
+	fmt->dict_item(f, "blocks");
+	fmt->value_uint(f, st->lq.dst.blocks);
+	fmt->dict_item(f, "rotations");
+	fmt->value_uint(f, st->lq.dst.rotations);
+	fmt->dict_item(f, "cputime");
+	fmt->value_uint(f, st->lq.dst.cputime);
+	fmt->dict_item(f, "drops");
+	fmt->value_uint(f, st->lq.dst.drops);
+	fmt->dict_item(f, "spills");
+	fmt->value_uint(f, st->lq.dst.spills);
+	fmt->dict_item(f, "connects");
+	fmt->value_uint(f, st->lq.dst.connects);
+	fmt->dict_end(f); /* log-dst */
+
+	fmt->dict_item(f, "latency");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "aurd");
+	logevt_latency(fmt, f, &st->lt.aurd);
+	for (int i = 0; i < LATENCY_STAGES; i++) {
+		fmt->dict_item(f, latency_stage_s(i));
+		logevt_latency(fmt, f, &st->lt.stage[i]);
+	}
+	fmt->dict_item(f, "events");
+	fmt->list_begin(f);
+	for (int i = 0; i < LOGEVT_SIZE; i++) {
+		fmt->list_item(f, "event");
+		logevt_latency(fmt, f, &st->lt.total[i]);
+	}
+	fmt->list_end(f);
+	fmt->dict_end(f); /* latency */
+
+	fmt->dict_item(f, "aue_profile");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "types");
+	fmt->value_uint(f, st->ep.types);
+	fmt->dict_item(f, "top");
+	fmt->list_begin(f);
+	for (size_t i = 0; i < st->ep.top_count; i++) {
+		fmt->list_item(f, "aue");
+		fmt->dict_begin(f);
+		fmt->dict_item(f, "type");
+		fmt->value_uint(f, st->ep.top[i].type);
+		fmt->dict_item(f, "count");
+		fmt->value_uint(f, st->ep.top[i].count);
+		fmt->dict_item(f, "parsetime");
+		fmt->value_uint(f, st->ep.top[i].parsetime / 1000);
+		fmt->dict_item(f, "handletime");
+		fmt->value_uint(f, st->ep.top[i].handletime / 1000);
+		fmt->dict_item(f, "bytes");
+		fmt->value_uint(f, st->ep.top[i].bytes);
+		fmt->dict_end(f);
+	}
+	fmt->list_end(f);
+	fmt->dict_end(f); /* aue-profile */
+
+	fmt->dict_item(f, "degradation");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "level");
+	fmt->value_uint(f, st->dg.level);
+	fmt->dict_item(f, "maxlevel");
+	fmt->value_uint(f, st->dg.maxlevel);
+	fmt->dict_item(f, "changes");
+	fmt->value_uint(f, st->dg.changes);
+	fmt->dict_end(f); /* degradation */
+
+	fmt->dict_item(f, "codesign_pool");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "threads");
+	fmt->value_uint(f, st->cp.threads);
+	fmt->dict_item(f, "busy");
+	fmt->value_uint(f, st->cp.busy);
+	fmt->dict_item(f, "buckets");
+	fmt->value_uint(f, st->cp.qsize);
+	fmt->dict_item(f, "submitted");
+	fmt->value_uint(f, st->cp.submitted);
+	fmt->dict_item(f, "ontime");
+	fmt->value_uint(f, st->cp.ontime);
+	fmt->dict_item(f, "pending");
+	fmt->value_uint(f, st->cp.pending);
+	fmt->dict_item(f, "timeouts");
+	fmt->value_uint(f, st->cp.timeouts);
+	fmt->dict_item(f, "late");
+	fmt->value_uint(f, st->cp.late);
+	fmt->dict_item(f, "overflows");
+	fmt->value_uint(f, st->cp.overflows);
+	fmt->dict_item(f, "discards");
+	fmt->value_uint(f, st->cp.discards);
+	fmt->dict_end(f); /* codesign-pool */
+
+	fmt->dict_item(f, "prehash");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "active");
+	fmt->value_uint(f, st->ph.active);
+	fmt->dict_item(f, "history");
+	fmt->value_uint(f, st->ph.history);
+	fmt->dict_item(f, "passes");
+	fmt->value_uint(f, st->ph.passes);
+	fmt->dict_item(f, "files");
+	fmt->value_uint(f, st->ph.files);
+	fmt->dict_item(f, "hashed");
+	fmt->value_uint(f, st->ph.hashed);
+	fmt->dict_item(f, "hashhits");
+	fmt->value_uint(f, st->ph.hashhits);
+	fmt->dict_item(f, "csigs");
+	fmt->value_uint(f, st->ph.csigs);
+	fmt->dict_item(f, "csighits");
+	fmt->value_uint(f, st->ph.csighits);
+	fmt->dict_item(f, "bytes");
+	fmt->value_uint(f, st->ph.bytes);
+	fmt->dict_item(f, "errors");
+	fmt->value_uint(f, st->ph.errors);
+	fmt->dict_item(f, "deferrals");
+	fmt->value_uint(f, st->ph.deferrals);
+	fmt->dict_item(f, "throttled");
+	fmt->value_uint(f, st->ph.throttled);
+	fmt->dict_end(f); /* prehash */
+
 	fmt->dict_item(f, "hash_cache");
 	fmt->dict_begin(f);
 	fmt->dict_item(f, "buckets");
@@ -430,6 +713,7 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->value_uint(f, st->ch.misses);
 	fmt->dict_item(f, "inv");
 	fmt->value_uint(f, st->ch.invalids);
+	logevt_lrucache(fmt, f, &st->ch);
 	fmt->dict_end(f); /* hash-cache */
 
 	fmt->dict_item(f, "csig_cache");
@@ -448,6 +732,7 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->value_uint(f, st->cc.misses);
 	fmt->dict_item(f, "inv");
 	fmt->value_uint(f, st->cc.invalids);
+	logevt_lrucache(fmt, f, &st->cc);
 	fmt->dict_end(f); /* csig-cache */
 
 	fmt->dict_item(f, "ldpl_cache");
@@ -466,14 +751,130 @@ logevt_xnumon_stats(logfmt_t *fmt, FILE *f, void *arg0) {
 	fmt->value_uint(f, st->cl.misses);
 	fmt->dict_item(f, "inv");
 	fmt->value_uint(f, st->cl.invalids);
+	logevt_lrucache(fmt, f, &st->cl);
 	fmt->dict_end(f); /* ldpl-cache */
 
+	fmt->dict_item(f, "id_cache");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "buckets");
+	fmt->value_uint(f, st->ci.lru.used);
+	fmt->dict_item(f, "bucketmax");
+	fmt->value_uint(f, st->ci.lru.size);
+	fmt->dict_item(f, "put");
+	fmt->value_uint(f, st->ci.lru.puts);
+	fmt->dict_item(f, "get");
+	fmt->value_uint(f, st->ci.lru.gets);
+	fmt->dict_item(f, "hit");
+	fmt->value_uint(f, st->ci.lru.hits);
+	fmt->dict_item(f, "miss");
+	fmt->value_uint(f, st->ci.lru.misses);
+	fmt->dict_item(f, "inv");
+	fmt->value_uint(f, st->ci.lru.invalids);
+	logevt_lrucache(fmt, f, &st->ci.lru);
+	fmt->dict_item(f, "neg");
+	fmt->value_uint(f, st->ci.negative);
+	fmt->dict_item(f, "stale");
+	fmt->value_uint(f, st->ci.stale);
+	fmt->dict_item(f, "refresh");
+	fmt->value_uint(f, st->ci.refreshes);
+	fmt->dict_item(f, "flush");
+	fmt->value_uint(f, st->ci.flushes);
+	fmt->dict_end(f); /* id-cache */
+
+	fmt->dict_item(f, "dir_cache");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "buckets");
+	fmt->value_uint(f, st->cd.lru.used);
+	fmt->dict_item(f, "bucketmax");
+	fmt->value_uint(f, st->cd.lru.size);
+	fmt->dict_item(f, "put");
+	fmt->value_uint(f, st->cd.lru.puts);
+	fmt->dict_item(f, "get");
+	fmt->value_uint(f, st->cd.lru.gets);
+	fmt->dict_item(f, "hit");
+	fmt->value_uint(f, st->cd.lru.hits);
+	fmt->dict_item(f, "miss");
+	fmt->value_uint(f, st->cd.lru.misses);
+	fmt->dict_item(f, "inv");
+	fmt->value_uint(f, st->cd.lru.invalids);
+	logevt_lrucache(fmt, f, &st->cd.lru);
+	fmt->dict_item(f, "exp");
+	fmt->value_uint(f, st->cd.expired);
+	fmt->dict_item(f, "fast");
+	fmt->value_uint(f, st->cd.fastpaths);
+	fmt->dict_item(f, "flush");
+	fmt->value_uint(f, st->cd.flushes);
+	fmt->dict_end(f); /* dir-cache */
+
+	fmt->dict_item(f, "strpool");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "strings");
+	fmt->value_uint(f, st->sp.strings);
+	fmt->dict_item(f, "refs");
+	fmt->value_uint(f, st->sp.refs);
+	fmt->dict_item(f, "bytes");
+	fmt->value_uint(f, st->sp.bytes);
+	fmt->dict_item(f, "saved");
+	fmt->value_uint(f, st->sp.refbytes - st->sp.bytes);
+	fmt->dict_item(f, "alloc");
+	fmt->value_uint(f, st->sp.allocs);
+	fmt->dict_item(f, "hit");
+	fmt->value_uint(f, st->sp.hits);
+	fmt->dict_end(f); /* strpool */
+
+	fmt->dict_item(f, "aev_pool");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "blocks");
+	fmt->value_uint(f, st->av.blocks);
+	fmt->dict_item(f, "deltas");
+	fmt->value_uint(f, st->av.deltas);
+	fmt->dict_item(f, "bytes");
+	fmt->value_uint(f, st->av.bytes);
+	fmt->dict_item(f, "saved");
+	fmt->value_uint(f, st->av.refbytes > st->av.bytes ?
+	                   st->av.refbytes - st->av.bytes : 0);
+	fmt->dict_item(f, "hit");
+	fmt->value_uint(f, st->av.hits);
+	fmt->dict_item(f, "render");
+	fmt->value_uint(f, st->av.renders);
+	fmt->dict_end(f); /* aev-pool */
+
+	fmt->dict_item(f, "memory");
+	fmt->dict_begin(f);
+	fmt->dict_item(f, "budget");
+	fmt->value_uint(f, st->mb.budget);
+	fmt->dict_item(f, "total");
+	fmt->value_uint(f, st->mb.total);
+	fmt->dict_item(f, "peak");
+	fmt->value_uint(f, st->mb.peak);
+	fmt->dict_item(f, "level");
+	fmt->value_uint(f, st->mb.level);
+	fmt->dict_item(f, "maxlevel");
+	fmt->value_uint(f, st->mb.maxlevel);
+	fmt->dict_item(f, "changes");
+	fmt->value_uint(f, st->mb.changes);
+	fmt->dict_item(f, "shed");
+	fmt->value_uint(f, st->mb.shed);
+	fmt->dict_item(f, "subsystems");
+	fmt->dict_begin(f);
+	for (int i = 0; i < MEMBUDGET_SIZE; i++) {
+		fmt->dict_item(f, membudget_subsystem_s(i));
+		fmt->value_uint(f, st->mb.bytes[i]);
+	}
+	fmt->dict_end(f); /* subsystems */
+	fmt->dict_end(f); /* memory */
+
 	logevt_footer(fmt, f);
 	return 0;
 }
 
+/*
+ * Log image ie with code signature cs, which is ie->codesign except for
+ * late code signature verdicts.
+ */
 static void
-logevt_image_exec_image(logfmt_t *fmt, FILE *f, image_exec_t *ie) {
+logevt_image_exec_image_cs(logfmt_t *fmt, FILE *f,
+                           image_exec_t *ie, codesign_t *cs) {
 	fmt->dict_begin(f);
 	fmt->dict_item(f, "path");
 	fmt->value_string(f, ie->path);
@@ -507,8 +908,8 @@ logevt_image_exec_image(logfmt_t *fmt, FILE *f, image_exec_t *ie) {
 	}
 	if ((ie->flags & EIFLAG_HASHES) &&
 	    (!config->omit_apple_hashes ||
-	     !ie->codesign ||
-	     !codesign_is_apple_system(ie->codesign))) {
+	     !cs ||
+	     !codesign_is_apple_system(cs))) {
 		if (config->hflags & HASH_MD5) {
 			fmt->dict_item(f, "md5");
 			fmt->value_buf_hex(f, ie->hashes.md5, MD5SZ);
@@ -521,36 +922,57 @@ logevt_image_exec_image(logfmt_t *fmt, FILE *f, image_exec_t *ie) {
 			fmt->dict_item(f, "sha256");
 			fmt->value_buf_hex(f, ie->hashes.sha256, SHA256SZ);
 		}
+		if (config->hflags & HASH_BLAKE3) {
+			fmt->dict_item(f, "blake3");
+			fmt->value_buf_hex(f, ie->hashes.blake3, BLAKE3SZ);
+		}
+		if (config->hflags & HASH_XXH128) {
+			fmt->dict_item(f, "xxh128");
+			fmt->value_buf_hex(f, ie->hashes.xxh128, XXH128SZ);
+		}
 	}
 
-	if (ie->codesign) {
+	if (!cs && (ie->flags & EIFLAG_CSPENDING)) {
+		fmt->dict_item(f, "signature");
+		fmt->value_string(f, "pending");
+	} else if (!cs && (ie->flags & EIFLAG_CSTIMEOUT)) {
+		fmt->dict_item(f, "signature");
+		fmt->value_string(f, "timeout");
+	} else if (!cs && (ie->flags & EIFLAG_CSOVERFLOW)) {
 		fmt->dict_item(f, "signature");
-		fmt->value_string(f, codesign_result_s(ie->codesign));
-		if (ie->codesign->origin) {
+		fmt->value_string(f, "overflow");
+	} else if (cs) {
+		fmt->dict_item(f, "signature");
+		fmt->value_string(f, codesign_result_s(cs));
+		if (cs->origin) {
 			fmt->dict_item(f, "origin");
-			fmt->value_string(f, codesign_origin_s(ie->codesign));
+			fmt->value_string(f, codesign_origin_s(cs));
 		}
-		if (ie->codesign->cdhash) {
+		if (cs->cdhash) {
 			fmt->dict_item(f, "cdhash");
-			fmt->value_buf_hex(f, ie->codesign->cdhash,
-			                      ie->codesign->cdhashsz);
+			fmt->value_buf_hex(f, cs->cdhash, cs->cdhashsz);
 		}
-		if (ie->codesign->ident) {
+		if (cs->ident) {
 			fmt->dict_item(f, "ident");
-			fmt->value_string(f, ie->codesign->ident);
+			fmt->value_string(f, cs->ident);
 		}
-		if (ie->codesign->teamid) {
+		if (cs->teamid) {
 			fmt->dict_item(f, "teamid");
-			fmt->value_string(f, ie->codesign->teamid);
+			fmt->value_string(f, cs->teamid);
 		}
-		if (ie->codesign->certcn) {
+		if (cs->certcn) {
 			fmt->dict_item(f, "certcn");
-			fmt->value_string(f, ie->codesign->certcn);
+			fmt->value_string(f, cs->certcn);
 		}
 	}
 	fmt->dict_end(f); /* image */
 }
 
+static void
+logevt_image_exec_image(logfmt_t *fmt, FILE *f, image_exec_t *ie) {
+	logevt_image_exec_image_cs(fmt, f, ie, ie->codesign);
+}
+
 static void
 logevt_process_image_exec(logfmt_t *fmt, FILE *f, image_exec_t *ie) {
 	fmt->dict_begin(f);
@@ -578,6 +1000,14 @@ logevt_process_image_exec(logfmt_t *fmt, FILE *f, image_exec_t *ie) {
 			fmt->dict_item(f, "sha256");
 			fmt->value_buf_hex(f, ie->hashes.sha256, SHA256SZ);
 		}
+		if (config->hflags & HASH_BLAKE3) {
+			fmt->dict_item(f, "blake3");
+			fmt->value_buf_hex(f, ie->hashes.blake3, BLAKE3SZ);
+		}
+		if (config->hflags & HASH_XXH128) {
+			fmt->dict_item(f, "xxh128");
+			fmt->value_buf_hex(f, ie->hashes.xxh128, XXH128SZ);
+		}
 	}
 	if (ie->codesign && codesign_is_good(ie->codesign)) {
 		if (ie->codesign->ident) {
@@ -611,6 +1041,16 @@ logevt_process_image_exec(logfmt_t *fmt, FILE *f, image_exec_t *ie) {
 				fmt->value_buf_hex(f,
 				        ie->script->hashes.sha256, SHA256SZ);
 			}
+			if (config->hflags & HASH_BLAKE3) {
+				fmt->dict_item(f, "blake3");
+				fmt->value_buf_hex(f,
+				        ie->script->hashes.blake3, BLAKE3SZ);
+			}
+			if (config->hflags & HASH_XXH128) {
+				fmt->dict_item(f, "xxh128");
+				fmt->value_buf_hex(f,
+				        ie->script->hashes.xxh128, XXH128SZ);
+			}
 		}
 		fmt->dict_end(f); /* script */
 	}
@@ -688,6 +1128,59 @@ logevt_process(logfmt_t *fmt, FILE *f,
 	fmt->dict_end(f); /* process */
 }
 
+static void
+logevt_aev_list(logfmt_t *fmt, FILE *f,
+                const char *label, const char *item, char **aev) {
+	fmt->dict_item(f, label);
+	fmt->list_begin(f);
+	for (int i = 0; aev[i]; i++) {
+		fmt->list_item(f, item);
+		fmt->value_string(f, aev[i]);
+	}
+	fmt->list_end(f);
+}
+
+/*
+ * Log interned argv/env vector aev.  Vectors shared between images are
+ * rendered once and the serialization reused.  This relies on the item
+ * never being the first in its dict and always being at the same nesting
+ * level, in which case rendering it leaves the format state unchanged.
+ */
+static void
+logevt_aev(logfmt_t *fmt, FILE *f,
+           const char *label, const char *item, char **aev) {
+	const char *cbuf;
+	char *buf;
+	size_t sz;
+	FILE *mf;
+
+	if (aev_render_get(aev, fmt, label, &cbuf, &sz)) {
+		fwrite(cbuf, sz, 1, f);
+		return;
+	}
+	if (!aev_shared(aev)) {
+		logevt_aev_list(fmt, f, label, item, aev);
+		return;
+	}
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunguarded-availability"
+	mf = open_memstream(&buf, &sz);
+#pragma clang diagnostic pop
+	if (!mf) {
+		logevt_aev_list(fmt, f, label, item, aev);
+		return;
+	}
+	logevt_aev_list(fmt, mf, label, item, aev);
+	if (fclose(mf) == EOF || !buf) {
+		if (buf)
+			free(buf);
+		logevt_aev_list(fmt, f, label, item, aev);
+		return;
+	}
+	fwrite(buf, sz, 1, f);
+	aev_render_put(aev, fmt, label, buf, sz);
+}
+
 int
 logevt_image_exec(logfmt_t *fmt, FILE *f, void *arg0) {
 	image_exec_t *ie = (image_exec_t *)arg0;
@@ -699,24 +1192,14 @@ logevt_image_exec(logfmt_t *fmt, FILE *f, void *arg0) {
 		fmt->value_bool(f, true);
 	}
 
-	if (ie->argv) {
-		fmt->dict_item(f, "argv");
-		fmt->list_begin(f);
-		for (int i = 0; ie->argv[i]; i++) {
-			fmt->list_item(f, "arg");
-			fmt->value_string(f, ie->argv[i]);
-		}
-		fmt->list_end(f); /* argv */
-	}
+	if (ie->argv)
+		logevt_aev(fmt, f, "argv", "arg", ie->argv);
 
-	if (ie->envv) {
-		fmt->dict_item(f, "env");
-		fmt->list_begin(f);
-		for (int i = 0; ie->envv[i]; i++) {
-			fmt->list_item(f, "var");
-			fmt->value_string(f, ie->envv[i]);
-		}
-		fmt->list_end(f); /* env */
+	if (ie->envv)
+		logevt_aev(fmt, f, "env", "var", ie->envv);
+	if (ie->flags & EIFLAG_ENVTRUNC) {
+		fmt->dict_item(f, "env_truncated");
+		fmt->value_bool(f, true);
 	}
 
 	if (ie->cwd) {
@@ -741,6 +1224,68 @@ logevt_image_exec(logfmt_t *fmt, FILE *f, void *arg0) {
 	return 0;
 }
 
+int
+logevt_image_codesign(logfmt_t *fmt, FILE *f, void *arg0) {
+	image_codesign_t *ic = (image_codesign_t *)arg0;
+	image_exec_t *ie = ic->image;
+
+	logevt_header(fmt, f, (logevt_header_t *)arg0);
+
+	if (!(ie->flags & EIFLAG_PIDLOOKUP)) {
+		fmt->dict_item(f, "exec_time");
+		fmt->value_timespec(f, &ie->hdr.tv);
+	}
+	fmt->dict_item(f, "exec_pid");
+	fmt->value_int(f, ie->pid);
+
+	fmt->dict_item(f, "image");
+	logevt_image_exec_image_cs(fmt, f, ie, ic->codesign);
+
+	logevt_footer(fmt, f);
+	return 0;
+}
+
+int
+logevt_image_exec_summary(logfmt_t *fmt, FILE *f, void *arg0) {
+	image_exec_summary_t *sum = (image_exec_summary_t *)arg0;
+	image_exec_t *ie = sum->image;
+
+	logevt_header(fmt, f, (logevt_header_t *)arg0);
+
+	fmt->dict_item(f, "count");
+	fmt->value_uint(f, sum->count);
+	fmt->dict_item(f, "first");
+	fmt->value_timespec(f, &sum->first_tv);
+	fmt->dict_item(f, "last");
+	fmt->value_timespec(f, &sum->last_tv);
+
+	fmt->dict_item(f, "samples");
+	fmt->list_begin(f);
+	for (size_t i = 0; i < sum->samples; i++) {
+		fmt->list_item(f, "sample");
+		fmt->dict_begin(f);
+		fmt->dict_item(f, "pid");
+		fmt->value_int(f, sum->sample_pid[i]);
+		logevt_aev_list(fmt, f, "argv", "arg", sum->sample_argv[i]);
+		fmt->dict_end(f); /* sample */
+	}
+	fmt->list_end(f); /* samples */
+
+	fmt->dict_item(f, "image");
+	logevt_image_exec_image(fmt, f, ie);
+
+	if (ie->script) {
+		fmt->dict_item(f, "script");
+		logevt_image_exec_image(fmt, f, ie->script);
+	}
+
+	fmt->dict_item(f, "subject");
+	logevt_process(fmt, f, &ie->subject, 0, ie->prev);
+
+	logevt_footer(fmt, f);
+	return 0;
+}
+
 int
 logevt_process_access(logfmt_t *fmt, FILE *f, void *arg0) {
 	process_access_t *pa = (process_access_t *)arg0;
@@ -860,6 +1405,18 @@ logevt_socket_accept(logfmt_t *fmt, FILE *f, void *arg0) {
 		fmt->value_uint(f, so->peer_port);
 	}
 
+	if (so->count > 0) {
+		fmt->dict_item(f, "aggregate");
+		fmt->dict_begin(f);
+		fmt->dict_item(f, "count");
+		fmt->value_uint(f, so->count);
+		fmt->dict_item(f, "first");
+		fmt->value_timespec(f, &so->first_tv);
+		fmt->dict_item(f, "last");
+		fmt->value_timespec(f, &so->last_tv);
+		fmt->dict_end(f); /* aggregate */
+	}
+
 	fmt->dict_item(f, "subject");
 	logevt_process(fmt, f,
 	               &so->subject, 0,
@@ -894,6 +1451,18 @@ logevt_socket_connect(logfmt_t *fmt, FILE *f, void *arg0) {
 		fmt->value_uint(f, so->peer_port);
 	}
 
+	if (so->count > 0) {
+		fmt->dict_item(f, "aggregate");
+		fmt->dict_begin(f);
+		fmt->dict_item(f, "count");
+		fmt->value_uint(f, so->count);
+		fmt->dict_item(f, "first");
+		fmt->value_timespec(f, &so->first_tv);
+		fmt->dict_item(f, "last");
+		fmt->value_timespec(f, &so->last_tv);
+		fmt->dict_end(f); /* aggregate */
+	}
+
 	fmt->dict_item(f, "subject");
 	logevt_process(fmt, f,
 	               &so->subject, 0,
@@ -51,8 +51,11 @@ typedef struct {
 #define LOGEVT_SOCKET_LISTEN    5       /* socket_listen_t */
 #define LOGEVT_SOCKET_ACCEPT    6       /* socket_accept_t */
 #define LOGEVT_SOCKET_CONNECT   7       /* socket_connect_t */
-#define LOGEVT_SIZE             8
+#define LOGEVT_IMAGE_CODESIGN   8       /* image_codesign_t */
+#define LOGEVT_IMAGE_EXEC_SUMMARY 9     /* image_exec_summary_t */
+#define LOGEVT_SIZE             10
 	struct timespec tv;
+	uint64_t ts;            /* start of current stage, see latency.h */
 	logevt_work_func_t le_work;
 	logevt_free_func_t le_free;
 	tommy_node node;
@@ -70,6 +73,7 @@ typedef struct {
 	logevt_header_t hdr;
 
 	const char *subtype;
+	uint64_t degradation;   /* DEGRADE_* level, see degrade.h */
 } xnumon_ops_t;
 
 int logevt_xnumon_ops(logfmt_t *, FILE *, void *) NONNULL(1,2,3) WUNRES;
@@ -80,6 +84,9 @@ int logevt_launchd_add(logfmt_t *, FILE *, void *) NONNULL(1,2,3) WUNRES;
 int logevt_socket_listen(logfmt_t *, FILE *, void *) NONNULL(1,2,3) WUNRES;
 int logevt_socket_accept(logfmt_t *, FILE *, void *) NONNULL(1,2,3) WUNRES;
 int logevt_socket_connect(logfmt_t *, FILE *, void *) NONNULL(1,2,3) WUNRES;
+int logevt_image_codesign(logfmt_t *, FILE *, void *) NONNULL(1,2,3) WUNRES;
+int logevt_image_exec_summary(logfmt_t *, FILE *, void *)
+    NONNULL(1,2,3) WUNRES;
 
 void logevt_init(config_t *);
 
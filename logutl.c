@@ -10,7 +10,11 @@
 
 #include "logutl.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
 
 void
 logutl_fwrite_hex(FILE *f, const unsigned char *buf, size_t sz) {
@@ -30,3 +34,39 @@ logutl_fwrite_timespec(FILE *f, struct timespec *tv) {
 }
 
 
+
+/*
+ * Returns a newly allocated, currently unused path to rotate the log file at
+ * path to, composed of path with a UTC timestamp inserted before suffix.
+ * Path must end in suffix.
+ */
+char *
+logutl_rotated_path(const char *path, const char *suffix) {
+	char stamp[20];
+	struct tm stm;
+	time_t now;
+	int baselen;
+	char *p;
+	int rv;
+
+	baselen = (int)(strlen(path) - strlen(suffix));
+	assert(baselen >= 0 && !strcmp(path + baselen, suffix));
+	now = time(NULL);
+	gmtime_r(&now, &stm);
+	strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &stm);
+	for (int i = 0; i < 100; i++) {
+		if (i == 0)
+			rv = asprintf(&p, "%.*s.%s%s",
+			              baselen, path, stamp, suffix);
+		else
+			rv = asprintf(&p, "%.*s.%s-%i%s",
+			              baselen, path, stamp, i, suffix);
+		if (rv == -1)
+			return NULL;
+		if (access(p, F_OK) == -1 && errno == ENOENT)
+			return p;
+		free(p);
+	}
+	errno = EEXIST;
+	return NULL;
+}
@@ -18,6 +18,7 @@
 
 void logutl_fwrite_hex(FILE *, const unsigned char *, size_t) NONNULL(1,2);
 void logutl_fwrite_timespec(FILE *, struct timespec *) NONNULL(1,2);
+char * logutl_rotated_path(const char *, const char *) MALLOC NONNULL(1,2);
 
 #endif
 
@@ -9,17 +9,39 @@
  */
 
 /*
- * Generic, fixed-size least-recently-used cache based on tommy_hashtable and
- * tommy_list.  The implementation is not thread-safe.
+ * Generic least-recently-used cache based on tommy_hashtable and tommy_list.
+ * The implementation is not thread-safe.
+ *
+ * The cache keeps the hashes of as many recently evicted objects as it holds
+ * objects, as ghosts.  A miss on a ghost means that a cache larger by the
+ * number of evictions since would have hit.  Hits are classified by the number
+ * of gets and puts since the previous access to the object, an upper bound of
+ * its distance from the LRU head, which tells which hits a smaller cache would
+ * still have had.  Together, these yield an estimate of the miss ratio curve
+ * from a quarter up to twice the current size, which lrucache_adapt uses to
+ * grow or shrink the cache within bounds.
  */
 
 #include "lrucache.h"
 
 #include "tommy_ext.h"
+#include "minmax.h"
 
+#include <stdbool.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 
+#define ADAPT_GETS      256     /* min gets per adaptation */
+#define GROW_PERMILLE   5       /* grow if 25% more saves 0.5% of gets */
+#define SHRINK_PERMILLE 1       /* shrink if 25% less costs < 0.1% of gets */
+
+typedef struct {
+	tommy_hashdyn_node h_node;
+	tommy_node l_node;
+	uint64_t seq;           /* evictions at time of eviction */
+} lrucache_ghost_t;
+
 typedef struct {
 	void *key;
 	size_t sz;
@@ -32,6 +54,127 @@ compfunc(const void *arg, const void *obj) {
 	return memcmp(lrunode->data, ctx->key, ctx->sz);
 }
 
+/*
+ * Ghosts only keep the hash of the evicted object; hash collisions are rare
+ * enough not to matter for the estimate.
+ */
+static int
+ghostcompfunc(UNUSED const void *arg, UNUSED const void *obj) {
+	return 0;
+}
+
+/*
+ * Remember the hash of an object evicted to make room.
+ */
+static void
+lrucache_ghost_add(lrucache_t *this, tommy_hash_t h) {
+	lrucache_ghost_t *ghost = NULL;
+
+	this->evictions++;
+	while (tommy_hashdyn_count(&this->ghosts) >= this->limit) {
+		if (ghost)
+			free(ghost);
+		ghost = tommy_list_remove_existing(&this->ghostlist,
+		                tommy_list_head(&this->ghostlist));
+		tommy_hashdyn_remove_existing(&this->ghosts, &ghost->h_node);
+	}
+	if (!ghost) {
+		ghost = malloc(sizeof(lrucache_ghost_t));
+		if (!ghost)
+			return;
+	}
+	ghost->seq = this->evictions;
+	tommy_hashdyn_insert(&this->ghosts, &ghost->h_node, ghost, h);
+	tommy_list_insert_tail(&this->ghostlist, &ghost->l_node, ghost);
+}
+
+/*
+ * On a miss, account a ghost for hash h as a hit for a larger cache.
+ */
+static void
+lrucache_ghost_hit(lrucache_t *this, tommy_hash_t h) {
+	lrucache_ghost_t *ghost;
+	uint64_t q;
+
+	ghost = tommy_hashdyn_search(&this->ghosts, ghostcompfunc, NULL, h);
+	if (!ghost)
+		return;
+	q = ((this->evictions - ghost->seq + 1) * 4 + this->limit - 1) /
+	    this->limit;
+	if (q >= 1 && q <= 4)
+		this->wghosts[q - 1]++;
+	this->stat.ghosthits++;
+	tommy_list_remove_existing(&this->ghostlist, &ghost->l_node);
+	tommy_hashdyn_remove_existing(&this->ghosts, &ghost->h_node);
+	free(ghost);
+}
+
+static void
+lrucache_ghost_flush(lrucache_t *this) {
+	lrucache_ghost_t *ghost;
+
+	while (!tommy_list_empty(&this->ghostlist)) {
+		ghost = tommy_list_remove_existing(&this->ghostlist,
+		                tommy_list_head(&this->ghostlist));
+		tommy_hashdyn_remove_existing(&this->ghosts, &ghost->h_node);
+		free(ghost);
+	}
+}
+
+/*
+ * Free objects from the end of the LRU queue until at most `n' remain.
+ * Objects evicted to make room for new ones leave a ghost behind.
+ */
+static void
+lrucache_evict(lrucache_t *this, tommy_count_t n, bool ghosts) {
+	tommy_node *lnode;
+	lrucache_node_t *lrunode;
+
+	while (tommy_hashtable_count(&this->hashtable) > n) {
+		lnode = tommy_list_tail(&this->list);
+		lrunode = lnode->data;
+		tommy_list_remove_existing(&this->list, lnode);
+		tommy_hashtable_remove_existing(&this->hashtable,
+		                                &lrunode->h_node);
+		if (ghosts)
+			lrucache_ghost_add(this, lrunode->h_node.key);
+		this->freefunc(lrunode->data);
+	}
+}
+
+/*
+ * Rebuild the hashtable for a new number of buckets.
+ */
+static void
+lrucache_rehash(lrucache_t *this, tommy_count_t bucket_max) {
+	lrucache_node_t *lrunode;
+
+	tommy_hashtable_done(&this->hashtable);
+	this->bucket_max = bucket_max;
+	tommy_hashtable_init(&this->hashtable, this->bucket_max);
+	for (tommy_node *lnode = tommy_list_head(&this->list);
+	     lnode; lnode = lnode->next) {
+		lrunode = lnode->data;
+		tommy_hashtable_insert(&this->hashtable, &lrunode->h_node,
+		                       lrunode, lrunode->h_node.key);
+	}
+}
+
+/*
+ * Apply the current target size and memory pressure scale.
+ */
+static void
+lrucache_resize(lrucache_t *this) {
+	this->limit = (tommy_count_t)((uint64_t)this->target * this->pct / 100);
+	if (this->limit == 0)
+		this->limit = 1;
+	this->stat.size = this->limit;
+	lrucache_evict(this, this->limit, false);
+	if (this->target > this->bucket_max ||
+	    this->target * 4 < this->bucket_max)
+		lrucache_rehash(this, bucket_max_for_buckets(this->target));
+}
+
 static void
 freeargfunc(void *arg, void *obj) {
 	lrucache_node_t *node = obj;
@@ -41,7 +184,8 @@ freeargfunc(void *arg, void *obj) {
 
 /*
  * Initialize an already allocated tommy_lrucache struct with the given
- * number of effectively usable cache buckets.  The initial `hashsz', `compsz'
+ * number of effectively usable cache buckets.  Stored objects are accounted
+ * as `objsz' bytes each in the statistics.  The initial `hashsz', `compsz'
  * and `condsz' bytes of stored objects are used as input to the hash function,
  * as key for key comparison in get and put operations, and as object validity
  * criteria as part of get operations.  If `hashsz' and `compsz' are equal, the
@@ -50,13 +194,18 @@ freeargfunc(void *arg, void *obj) {
  * The cache uses `freefunc' to free objects for cache eviction.
  */
 void
-lrucache_init(lrucache_t *this, tommy_count_t buckets,
+lrucache_init(lrucache_t *this, tommy_count_t buckets, size_t objsz,
               size_t hashsz, size_t compsz, size_t condsz,
               lrucache_free_func_t *freefunc) {
 	assert(this);
 	assert(freefunc);
 
 	this->bucket_max = bucket_max_for_buckets(buckets);
+	this->base = this->bucket_max;
+	this->target = this->bucket_max;
+	this->pct = 100;
+	this->limit = this->bucket_max;
+	this->objsz = objsz;
 	this->hashsz = hashsz;
 	this->compsz = compsz;
 	this->condsz = condsz;
@@ -65,6 +214,14 @@ lrucache_init(lrucache_t *this, tommy_count_t buckets,
 	this->stat.size = this->bucket_max;
 	tommy_hashtable_init(&this->hashtable, this->bucket_max);
 	tommy_list_init(&this->list);
+	tommy_hashdyn_init(&this->ghosts);
+	tommy_list_init(&this->ghostlist);
+	this->clock = 0;
+	this->evictions = 0;
+	this->wgets = 0;
+	this->wmisses = 0;
+	bzero(this->whits, sizeof(this->whits));
+	bzero(this->wghosts, sizeof(this->wghosts));
 }
 
 /*
@@ -80,7 +237,6 @@ lrucache_init(lrucache_t *this, tommy_count_t buckets,
 void
 lrucache_put(lrucache_t *this, lrucache_node_t *node, void *data) {
 	compfunc_ctx_t ctx;
-	tommy_node *lnode;
 	lrucache_node_t *lrunode;
 	tommy_hash_t h;
 
@@ -89,14 +245,9 @@ lrucache_put(lrucache_t *this, lrucache_node_t *node, void *data) {
 	assert(data);
 
 	this->stat.puts++;
-	if (tommy_hashtable_count(&this->hashtable) == this->bucket_max) {
-		lnode = tommy_list_tail(&this->list);
-		lrunode = lnode->data;
-		tommy_list_remove_existing(&this->list, lnode);
-		tommy_hashtable_remove_existing(&this->hashtable,
-		                                &lrunode->h_node);
-		this->freefunc(lrunode->data);
-	}
+	this->clock++;
+	if (tommy_hashtable_count(&this->hashtable) >= this->limit)
+		lrucache_evict(this, this->limit - 1, true);
 	ctx.key = data;
 	ctx.sz = this->compsz;
 	h = tommy_hash_u32(0, data, this->hashsz);
@@ -106,6 +257,7 @@ lrucache_put(lrucache_t *this, lrucache_node_t *node, void *data) {
 		return;
 	}
 	node->data = data;
+	node->stamp = this->clock;
 	tommy_hashtable_insert(&this->hashtable, &node->h_node, node, h);
 	tommy_list_insert_head(&this->list, &node->l_node, node);
 }
@@ -125,17 +277,23 @@ void *
 lrucache_get(lrucache_t *this, void *key) {
 	compfunc_ctx_t ctx;
 	lrucache_node_t *lrunode;
+	tommy_hash_t h;
+	uint64_t q;
 
 	assert(this);
 	assert(key);
 
 	this->stat.gets++;
+	this->clock++;
+	this->wgets++;
 	ctx.key = key;
 	ctx.sz = this->compsz;
-	lrunode = tommy_hashtable_search(&this->hashtable, compfunc, &ctx,
-	                                 tommy_hash_u32(0, key, this->hashsz));
+	h = tommy_hash_u32(0, key, this->hashsz);
+	lrunode = tommy_hashtable_search(&this->hashtable, compfunc, &ctx, h);
 	if (!lrunode) {
 		this->stat.misses++;
+		this->wmisses++;
+		lrucache_ghost_hit(this, h);
 		return NULL;
 	}
 	if ((this->condsz > this->compsz) &&
@@ -147,16 +305,49 @@ lrucache_get(lrucache_t *this, void *key) {
 		tommy_list_remove_existing(&this->list, &lrunode->l_node);
 		this->freefunc(lrunode->data);
 		this->stat.invalids++;
+		this->wmisses++;
 		return NULL;
 	}
 	if (&lrunode->l_node != tommy_list_head(&this->list)) {
 		tommy_list_remove_existing(&this->list, &lrunode->l_node);
 		tommy_list_insert_head(&this->list, &lrunode->l_node, lrunode);
 	}
+	q = (this->clock - lrunode->stamp) * 4 / this->limit;
+	this->whits[q < 3 ? q : 3]++;
+	lrunode->stamp = this->clock;
 	this->stat.hits++;
 	return lrunode->data;
 }
 
+/*
+ * Look up an object like lrucache_get, but without updating the recency of
+ * the object or the statistics, and without invalidating objects failing
+ * the validity condition; these are not returned.  For maintenance tasks
+ * that must not influence eviction.
+ */
+void *
+lrucache_peek(lrucache_t *this, void *key) {
+	compfunc_ctx_t ctx;
+	lrucache_node_t *lrunode;
+	tommy_hash_t h;
+
+	assert(this);
+	assert(key);
+
+	ctx.key = key;
+	ctx.sz = this->compsz;
+	h = tommy_hash_u32(0, key, this->hashsz);
+	lrunode = tommy_hashtable_search(&this->hashtable, compfunc, &ctx, h);
+	if (!lrunode)
+		return NULL;
+	if ((this->condsz > this->compsz) &&
+	    !!memcmp(((unsigned char *)lrunode->data) + this->compsz,
+	             ((unsigned char *)key) + this->compsz,
+	             this->condsz - this->compsz))
+		return NULL;
+	return lrunode->data;
+}
+
 /*
  * Return statistics.
  */
@@ -166,9 +357,89 @@ lrucache_stats(lrucache_t *this, lrucache_stat_t *st) {
 	assert(st);
 
 	this->stat.used = tommy_hashtable_count(&this->hashtable);
+	this->stat.ghosts = tommy_hashdyn_count(&this->ghosts);
+	this->stat.bytes = (uint64_t)this->stat.used * this->objsz +
+	                   (uint64_t)this->hashtable.bucket_max *
+	                   sizeof(tommy_hashtable_node *) +
+	                   tommy_hashdyn_memory_usage(&this->ghosts) +
+	                   (uint64_t)this->stat.ghosts *
+	                   (sizeof(lrucache_ghost_t) -
+	                    sizeof(tommy_hashdyn_node));
 	*st = this->stat;
 }
 
+/*
+ * Limit the cache to `pct' percent of its target size, evicting least
+ * recently used objects as needed.  Under memory pressure, caches give up
+ * their least valuable entries first.
+ */
+void
+lrucache_scale(lrucache_t *this, unsigned int pct) {
+	assert(this);
+	assert(pct <= 100);
+
+	this->pct = pct;
+	lrucache_resize(this);
+}
+
+/*
+ * Update the estimated miss ratio curve from the observations since the last
+ * call, then grow the cache by a quarter if that would have saved a relevant
+ * share of misses, or shrink it by a quarter if that would have cost next to
+ * no hits, within `minpct' and `maxpct' percent of the initial size.  Growing
+ * is suspended while the cache is scaled down under memory pressure.
+ */
+void
+lrucache_adapt(lrucache_t *this, unsigned int minpct, unsigned int maxpct) {
+	uint64_t misses[LRUCACHE_MRC_POINTS];
+	tommy_count_t min, max, target;
+
+	assert(this);
+
+	if (this->wgets < ADAPT_GETS)
+		return;
+
+	/* point 3 is the current size; below, hits of the outer quarters
+	 * would have been misses, above, ghost hits would have been hits */
+	misses[3] = this->wmisses;
+	for (int i = 2; i >= 0; i--)
+		misses[i] = misses[i + 1] + this->whits[i + 1];
+	for (int i = 4; i < LRUCACHE_MRC_POINTS; i++)
+		misses[i] = misses[i - 1] - min(misses[i - 1],
+		                                this->wghosts[i - 4]);
+	for (int i = 0; i < LRUCACHE_MRC_POINTS; i++)
+		this->stat.mrc[i] = (uint32_t)(min(misses[i], this->wgets) *
+		                               1000 / this->wgets);
+
+	min = (tommy_count_t)((uint64_t)this->base * minpct / 100);
+	max = (tommy_count_t)((uint64_t)this->base * maxpct / 100);
+	if (min < 16)
+		min = 16;
+	if (max < min)
+		max = min;
+	target = this->target;
+	if ((misses[3] - misses[4]) * 1000 >= this->wgets * GROW_PERMILLE &&
+	    this->pct == 100)
+		target += target / 4;
+	else if ((misses[2] - misses[3]) * 1000 <
+	         this->wgets * SHRINK_PERMILLE)
+		target -= target / 4;
+	if (target > max)
+		target = max;
+	if (target < min)
+		target = min;
+
+	this->wgets = 0;
+	this->wmisses = 0;
+	bzero(this->whits, sizeof(this->whits));
+	bzero(this->wghosts, sizeof(this->wghosts));
+	if (target != this->target) {
+		this->target = target;
+		this->stat.resizes++;
+		lrucache_resize(this);
+	}
+}
+
 /*
  * Flush the cache, resulting in an empty initialized cache.
  * Objects stored in the cache will be freed using `freefunc'.
@@ -177,7 +448,10 @@ void
 lrucache_flush(lrucache_t *this) {
 	assert(this);
 
-	lrucache_destroy(this);
+	tommy_hashtable_done(&this->hashtable);
+	tommy_list_foreach_arg(&this->list, freeargfunc,
+	                       (void *)this->freefunc);
+	lrucache_ghost_flush(this);
 	tommy_hashtable_init(&this->hashtable, this->bucket_max);
 	tommy_list_init(&this->list);
 }
@@ -193,5 +467,7 @@ lrucache_destroy(lrucache_t *this) {
 	tommy_hashtable_done(&this->hashtable);
 	tommy_list_foreach_arg(&this->list, freeargfunc,
 	                       (void *)this->freefunc);
+	lrucache_ghost_flush(this);
+	tommy_hashdyn_done(&this->ghosts);
 }
 
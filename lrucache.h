@@ -15,22 +15,33 @@
 
 #include "tommylist.h"
 #include "tommyhashtbl.h"
+#include "tommyhashdyn.h"
+
+#include <stdint.h>
 
 /*
  * Trade-off between the number of binaries actively used on a system, the
  * performance curves of the underlying data structures and acceptable memory
  * use.  The number of buckets is the number of cached codesign results and
  * hashes, respectively, not necessarily the effective number of buckets in
- * underlying data structures.
+ * underlying data structures.  This is the initial size; caches adapt their
+ * size at runtime within the configured cache_size_min and cache_size_max.
  */
 #define LRUCACHE_BUCKETS           12288
 
+/*
+ * The estimated miss ratio curve has points at 1/4, 2/4, .. 8/4 of the
+ * current cache size; point 3 is the current size.
+ */
+#define LRUCACHE_MRC_POINTS        8
+
 typedef void lrucache_free_func_t(void *) NONNULL(1);
 
 typedef struct lrucache_node {
 	tommy_hashtable_node h_node;
 	tommy_node l_node;
 	void *data;
+	uint64_t stamp;         /* clock at last access */
 } lrucache_node_t;
 
 typedef struct lrucache_stat {
@@ -41,26 +52,52 @@ typedef struct lrucache_stat {
 	uint64_t hits;
 	uint64_t misses;
 	uint64_t invalids;
+	uint64_t bytes;         /* approximate */
+	uint32_t ghosts;        /* keys of recently evicted objects */
+	uint64_t ghosthits;     /* misses that a larger cache would have hit */
+	uint64_t resizes;
+	uint32_t mrc[LRUCACHE_MRC_POINTS]; /* estimated miss ratio, permille */
 } lrucache_stat_t;
 
 typedef struct lrucache {
 	tommy_hashtable hashtable;
 	tommy_list list;
 	tommy_count_t bucket_max;
+	tommy_count_t base;     /* size the cache was initialized with */
+	tommy_count_t target;   /* adaptive size */
+	unsigned int pct;       /* scale under memory pressure */
+	tommy_count_t limit;    /* effective size */
+	size_t objsz;
 	size_t hashsz;
 	size_t compsz;
 	size_t condsz;
 	lrucache_free_func_t *freefunc;
+
+	/* hashes of recently evicted objects, oldest first */
+	tommy_hashdyn ghosts;
+	tommy_list ghostlist;
+	uint64_t clock;         /* gets and puts */
+	uint64_t evictions;
+
+	/* observations since the last adaptation */
+	uint64_t wgets;
+	uint64_t wmisses;
+	uint64_t whits[4];      /* by quarter of size from the LRU head */
+	uint64_t wghosts[4];    /* by quarter of size beyond the LRU tail */
+
 	lrucache_stat_t stat;
 } lrucache_t;
 
-void lrucache_init(lrucache_t *, tommy_count_t,
+void lrucache_init(lrucache_t *, tommy_count_t, size_t,
                    size_t, size_t, size_t,
                    lrucache_free_func_t *) NONNULL(1);
 void lrucache_put(lrucache_t *, lrucache_node_t *, void *) NONNULL(1,2,3);
 void * lrucache_get(lrucache_t *, void *) NONNULL(1,2) WUNRES;
+void * lrucache_peek(lrucache_t *, void *) NONNULL(1,2) WUNRES;
 void lrucache_stats(lrucache_t *, lrucache_stat_t *) NONNULL(1,2);
 void lrucache_flush(lrucache_t *) NONNULL(1);
+void lrucache_scale(lrucache_t *, unsigned int) NONNULL(1);
+void lrucache_adapt(lrucache_t *, unsigned int, unsigned int) NONNULL(1);
 void lrucache_destroy(lrucache_t *) NONNULL(1);
 
 #endif
@@ -0,0 +1,153 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Memory budget governor.
+ *
+ * Driven by a timer on the event loop thread, memory held by the caches, the
+ * exec image graph, the process table, the string and argv/env pools, the
+ * queues and the symlink graph is accounted per subsystem and compared
+ * against the configured memory_budget.  Above HIGH_PCT percent of the
+ * budget, the pressure level is raised by one step per update:  first the
+ * caches are shrunk, since they can always be refilled, and only then are
+ * events in the low priority lane shed before they are queued for logging.
+ * Once usage has stayed below LOW_PCT percent of the budget for
+ * RECOVER_TICKS consecutive updates, the level is lowered one step at a
+ * time.  Without a budget, memory is still accounted for statistics.
+ *
+ * The level is read lock-free by the worker thread.
+ */
+
+#include "membudget.h"
+
+#include "hysteresis.h"
+#include "queue.h"
+#include "atomic.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <assert.h>
+
+#define HIGH_PCT        90
+#define LOW_PCT         70
+#define RECOVER_TICKS   30
+
+static uint64_t budget;
+static uint64_t bytes[MEMBUDGET_SIZE];
+static uint64_t total;
+static uint64_t peak;
+static hysteresis_t ctl;
+static atomic64_t shed;
+
+void
+membudget_init(config_t *cfg) {
+	budget = cfg->memory_budget;
+	bzero(bytes, sizeof(bytes));
+	total = 0;
+	peak = 0;
+	hysteresis_init(&ctl, MEMBUDGET_MAX, RECOVER_TICKS);
+	shed = 0;
+}
+
+/*
+ * Record the current memory use per subsystem.
+ */
+void
+membudget_account(const membudget_input_t *in) {
+	total = 0;
+	for (size_t i = 0; i < MEMBUDGET_SIZE; i++) {
+		bytes[i] = in->bytes[i];
+		total += bytes[i];
+	}
+	if (total > peak)
+		peak = total;
+}
+
+/*
+ * Returns the new level if the level was changed, -1 otherwise.
+ */
+int
+membudget_update(void) {
+	if (budget == 0)
+		return -1;
+	return hysteresis_update(&ctl,
+	                         total >= budget / 100 * HIGH_PCT,
+	                         total < budget / 100 * LOW_PCT);
+}
+
+int
+membudget_level(void) {
+	return atomic_load_explicit(&ctl.level, memory_order_relaxed);
+}
+
+/*
+ * Percentage of their full size the caches are limited to at level lvl.
+ */
+unsigned int
+membudget_cache_pct(int lvl) {
+	switch (lvl) {
+	case MEMBUDGET_NONE:
+		return 100;
+	case MEMBUDGET_SHRINK1:
+		return 50;
+	case MEMBUDGET_SHRINK2:
+		return 25;
+	default:
+		return 10;
+	}
+}
+
+/*
+ * Returns true iff an event in priority lane prio is to be dropped instead
+ * of being logged.  Thread-safe.
+ */
+bool
+membudget_shed(int prio) {
+	if (prio != QUEUE_PRIO_LOW || membudget_level() < MEMBUDGET_SHED)
+		return false;
+	atomic64_inc(&shed);
+	return true;
+}
+
+const char *
+membudget_subsystem_s(int subsys) {
+	switch (subsys) {
+	case MEMBUDGET_CACHES:
+		return "caches";
+	case MEMBUDGET_IMAGES:
+		return "images";
+	case MEMBUDGET_PROCS:
+		return "procs";
+	case MEMBUDGET_STRINGS:
+		return "strings";
+	case MEMBUDGET_QUEUES:
+		return "queues";
+	case MEMBUDGET_SYMLINKS:
+		return "symlinks";
+	default:
+		return NULL;
+	}
+}
+
+void
+membudget_stats(membudget_stat_t *st) {
+	assert(st);
+
+	st->budget = budget;
+	st->total = total;
+	st->peak = peak;
+	for (size_t i = 0; i < MEMBUDGET_SIZE; i++)
+		st->bytes[i] = bytes[i];
+	st->level = (uint32_t)membudget_level();
+	st->maxlevel = (uint32_t)ctl.maxlevel;
+	st->changes = ctl.changes;
+	st->shed = (uint64_t)shed;
+}
+
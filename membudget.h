@@ -0,0 +1,69 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#include "config.h"
+#include "attrib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Subsystems memory is accounted for.
+ */
+#define MEMBUDGET_CACHES        0       /* lru caches */
+#define MEMBUDGET_IMAGES        1       /* image_exec_t graph */
+#define MEMBUDGET_PROCS         2       /* proctab */
+#define MEMBUDGET_STRINGS       3       /* string and argv/env pools */
+#define MEMBUDGET_QUEUES        4       /* events in work and log queues */
+#define MEMBUDGET_SYMLINKS      5       /* symlink graph */
+#define MEMBUDGET_SIZE          6
+
+#define MEMBUDGET_EVENTSZ       512     /* typical queued event, estimate */
+
+/*
+ * Pressure levels are cumulative; every level includes the measures of all
+ * lower levels.
+ */
+#define MEMBUDGET_NONE          0
+#define MEMBUDGET_SHRINK1       1       /* caches to 50% */
+#define MEMBUDGET_SHRINK2       2       /* caches to 25% */
+#define MEMBUDGET_SHRINK3       3       /* caches to 10% */
+#define MEMBUDGET_SHED          4       /* drop low priority events */
+#define MEMBUDGET_MAX           4
+
+typedef struct {
+	uint64_t bytes[MEMBUDGET_SIZE];
+} membudget_input_t;
+
+typedef struct {
+	uint64_t budget;
+	uint64_t total;
+	uint64_t peak;
+	uint64_t bytes[MEMBUDGET_SIZE];
+	uint32_t level;
+	uint32_t maxlevel;
+	uint64_t changes;
+	uint64_t shed;
+} membudget_stat_t;
+
+void membudget_init(config_t *) NONNULL(1);
+void membudget_account(const membudget_input_t *) NONNULL(1);
+int membudget_update(void) WUNRES;
+int membudget_level(void) WUNRES;
+unsigned int membudget_cache_pct(int) WUNRES;
+bool membudget_shed(int) WUNRES;
+const char * membudget_subsystem_s(int) WUNRES;
+void membudget_stats(membudget_stat_t *) NONNULL(1);
+
+#endif
+
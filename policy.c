@@ -111,3 +111,10 @@ policy_thread_diskio_utility(void) {
 	                      IOPOL_UTILITY);
 }
 
+int
+policy_thread_diskio_throttle(void) {
+	return setiopolicy_np(IOPOL_TYPE_DISK,
+	                      IOPOL_SCOPE_THREAD,
+	                      IOPOL_THROTTLE);
+}
+
@@ -25,6 +25,7 @@ int policy_thread_sched_standard(void);
 int policy_thread_diskio_important(void);
 int policy_thread_diskio_standard(void);
 int policy_thread_diskio_utility(void);
+int policy_thread_diskio_throttle(void);
 
 #endif
 
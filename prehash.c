@@ -0,0 +1,607 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Background pre-hashing crawler.
+ *
+ * The first exec of a binary pays for hashing and code signature
+ * verification inline, and after boot or login hundreds of binaries are
+ * executed for the first time in a burst.  The crawler walks the paths from
+ * the persisted exec history and the configured directories while xnumon
+ * and the system are idle, and populates cachehash and cachecsig ahead of
+ * time.  It runs on a single thread with throttled disk I/O, yields as soon
+ * as there is work queued or degradation is in effect, and limits the
+ * number of files per pass so that it cannot evict the working set from
+ * the caches.
+ */
+
+#include "prehash.h"
+
+#include "hashes.h"
+#include "hashio.h"
+#include "cachehash.h"
+#include "cachecsig.h"
+#include "csigpool.h"
+#include "codesign.h"
+#include "degrade.h"
+#include "latency.h"
+#include "lrucache.h"
+#include "policy.h"
+#include "work.h"
+#include "sys.h"
+#include "time.h"
+#include "tommylist.h"
+#include "tommyhashdyn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fts.h>
+#include <pthread.h>
+#include <assert.h>
+#include <mach-o/loader.h>
+#include <mach-o/fat.h>
+
+#define PREHASH_FILES_MAX       (LRUCACHE_BUCKETS / 2)  /* per pass */
+#define PREHASH_HISTORY_MAX     4096
+#define PREHASH_RESCAN          (6 * 3600)      /* sec between passes */
+#define PREHASH_BACKOFF         1000000         /* usec to wait when busy */
+#define PREHASH_LOADAVG         0.5             /* max load per cpu */
+
+typedef struct {
+	tommy_hashdyn_node h_node;
+	tommy_node l_node;
+	char *path;
+} prehash_hist_t;
+
+static config_t *config;
+static pthread_t thr;
+static bool running = false;
+static bool stopping;
+static long ncpu;
+static size_t passfiles;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stop = PTHREAD_COND_INITIALIZER;
+
+/* exec history, protected by mutex */
+static bool history_enabled = false;
+static tommy_hashdyn history;
+static tommy_list history_list; /* same entries, least recently seen first */
+
+/* stats, protected by mutex */
+static uint32_t active;
+static uint64_t passes;
+static uint64_t files;
+static uint64_t hashed;
+static uint64_t hashhits;
+static uint64_t csigs;
+static uint64_t csighits;
+static uint64_t bytes;
+static uint64_t errors;
+static uint64_t deferrals;
+static uint64_t throttled;
+
+#define STAT_INC(X, N) \
+	do { \
+		pthread_mutex_lock(&mutex); \
+		(X) += (N); \
+		pthread_mutex_unlock(&mutex); \
+	} while (0)
+
+static int
+prehash_hist_cmp(const void *path, const void *obj) {
+	return strcmp(((const prehash_hist_t *)obj)->path, path);
+}
+
+static void
+prehash_hist_free(void *obj) {
+	free(((prehash_hist_t *)obj)->path);
+	free(obj);
+}
+
+/*
+ * Add path to the history as the most recently seen entry, or move it there
+ * if it is already in the history.  If the history is full, the least
+ * recently seen entry is evicted.  Must be called with mutex held.
+ */
+static void
+prehash_hist_add(const char *path) {
+	prehash_hist_t *obj;
+	tommy_hash_t h;
+
+	if (strchr(path, '\n'))
+		return;
+	h = tommy_strhash_u32(0, path);
+	obj = tommy_hashdyn_search(&history, prehash_hist_cmp, path, h);
+	if (obj) {
+		tommy_list_remove_existing(&history_list, &obj->l_node);
+		tommy_list_insert_tail(&history_list, &obj->l_node, obj);
+		return;
+	}
+	if (tommy_hashdyn_count(&history) >= PREHASH_HISTORY_MAX) {
+		obj = tommy_list_head(&history_list)->data;
+		tommy_list_remove_existing(&history_list, &obj->l_node);
+		tommy_hashdyn_remove_existing(&history, &obj->h_node);
+		prehash_hist_free(obj);
+	}
+	obj = malloc(sizeof(prehash_hist_t));
+	if (!obj)
+		return;
+	obj->path = strdup(path);
+	if (!obj->path) {
+		free(obj);
+		return;
+	}
+	tommy_hashdyn_insert(&history, &obj->h_node, obj, h);
+	tommy_list_insert_tail(&history_list, &obj->l_node, obj);
+}
+
+static void
+prehash_hist_load(const char *filename) {
+	FILE *f;
+	char *line = NULL;
+	size_t linesz = 0;
+	ssize_t n;
+
+	f = fopen(filename, "r");
+	if (!f)
+		return;
+	pthread_mutex_lock(&mutex);
+	while ((n = getline(&line, &linesz, f)) != -1) {
+		if (n > 0 && line[n - 1] == '\n')
+			line[--n] = '\0';
+		if (line[0] == '/')
+			prehash_hist_add(line);
+	}
+	pthread_mutex_unlock(&mutex);
+	free(line);
+	fclose(f);
+}
+
+/*
+ * Write the history to a temporary file and rename it into place, so that
+ * a crash while saving never leaves a truncated history behind.
+ */
+static int
+prehash_hist_save(const char *filename) {
+	char *tmpname;
+	FILE *f;
+
+	if (asprintf(&tmpname, "%s.tmp", filename) == -1)
+		return -1;
+	f = fopen(tmpname, "w");
+	if (!f) {
+		free(tmpname);
+		return -1;
+	}
+	pthread_mutex_lock(&mutex);
+	for (tommy_node *node = tommy_list_head(&history_list);
+	     node; node = node->next) {
+		prehash_hist_t *obj = node->data;
+		fprintf(f, "%s\n", obj->path);
+	}
+	pthread_mutex_unlock(&mutex);
+	if (fclose(f) == EOF || rename(tmpname, filename) == -1) {
+		(void)unlink(tmpname);
+		free(tmpname);
+		return -1;
+	}
+	free(tmpname);
+	return 0;
+}
+
+/*
+ * Record path of an executed image for which hashes had to be calculated
+ * inline.  Called from the worker thread.
+ */
+void
+prehash_seen(const char *path) {
+	pthread_mutex_lock(&mutex);
+	if (history_enabled)
+		prehash_hist_add(path);
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Sleep usec or until stopping.  Returns -1 if stopping, 0 otherwise.
+ */
+static int
+prehash_sleep(uint64_t usec) {
+	struct timespec deadline;
+	int rv;
+
+	if (timespec_nanotime(&deadline) == -1)
+		return -1;
+	deadline.tv_sec += usec / 1000000;
+	deadline.tv_nsec += (usec % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&mutex);
+	rv = 0;
+	while (!stopping && rv != ETIMEDOUT)
+		rv = pthread_cond_timedwait(&stop, &mutex, &deadline);
+	rv = stopping ? -1 : 0;
+	pthread_mutex_unlock(&mutex);
+	return rv;
+}
+
+/*
+ * Idle means no work queued for the worker or the codesign pool, no
+ * degradation in effect and a moderate system load average.
+ */
+static bool
+prehash_idle(void) {
+	work_stat_t wst;
+	csigpool_stat_t cst;
+	double load;
+
+	if (degrade_level() != DEGRADE_NONE)
+		return false;
+	work_stats(&wst);
+	if (wst.qsize > 0)
+		return false;
+	csigpool_stats(&cst);
+	if (cst.busy > 0 || cst.qsize > 0)
+		return false;
+	if (getloadavg(&load, 1) == 1 && load > PREHASH_LOADAVG * ncpu)
+		return false;
+	return true;
+}
+
+static int
+prehash_wait_idle(void) {
+	while (!prehash_idle()) {
+		STAT_INC(deferrals, 1);
+		if (prehash_sleep(PREHASH_BACKOFF) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+static bool
+prehash_stat_equal(stat_attr_t *a, stat_attr_t *b) {
+	return (a->size == b->size) &&
+	       (a->dev == b->dev) &&
+	       (a->ino == b->ino) &&
+	       timespec_equal(&a->mtime, &b->mtime) &&
+	       timespec_equal(&a->ctime, &b->ctime) &&
+	       timespec_equal(&a->btime, &b->btime);
+}
+
+/*
+ * Returns 1 for Mach-O and fat binaries, 2 for scripts and 0 for anything
+ * else, which is not worth hashing ahead of time.
+ */
+static int
+prehash_magic(int fd) {
+	uint32_t magic;
+
+	if (pread(fd, &magic, sizeof(magic), 0) != sizeof(magic))
+		return 0;
+	switch (magic) {
+	case MH_MAGIC:
+	case MH_CIGAM:
+	case MH_MAGIC_64:
+	case MH_CIGAM_64:
+	case FAT_MAGIC:
+	case FAT_CIGAM:
+		return 1;
+	}
+	if (((char *)&magic)[0] == '#' && ((char *)&magic)[1] == '!')
+		return 2;
+	return 0;
+}
+
+/*
+ * Warm the caches for the executable at path, following the same stat
+ * checks as image exec acquisition in procmon.  Returns -1 if the pass
+ * should end, 0 otherwise.
+ */
+static int
+prehash_file(const char *path) {
+	stat_attr_t st1, st2;
+	hashes_t hashes;
+	codesign_t *cs;
+	uint64_t t0, elapsed, need;
+	off_t sz;
+	int fd, kind;
+	bool hit;
+
+	if (passfiles >= PREHASH_FILES_MAX)
+		return -1;
+	if (prehash_wait_idle() == -1)
+		return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return 0;
+	if (sys_fdattr(&st1, fd) == -1) {
+		close(fd);
+		STAT_INC(errors, 1);
+		return 0;
+	}
+	kind = prehash_magic(fd);
+	if (kind == 0) {
+		close(fd);
+		return 0;
+	}
+	STAT_INC(files, 1);
+
+	hit = cachehash_get(&hashes, st1.dev, st1.ino,
+	                    &st1.mtime, &st1.ctime, &st1.btime);
+	if (hit) {
+		STAT_INC(hashhits, 1);
+	} else {
+		t0 = latency_now();
+		if (hashes_fd(&sz, &hashes, config->hflags, fd) == -1 ||
+		    sz != st1.size ||
+		    sys_fdattr(&st2, fd) == -1 ||
+		    !prehash_stat_equal(&st1, &st2)) {
+			close(fd);
+			STAT_INC(errors, 1);
+			return 0;
+		}
+		cachehash_put(st1.dev, st1.ino,
+		              &st1.mtime, &st1.ctime, &st1.btime, &hashes);
+		/* only files that were not cached count against the limit */
+		passfiles++;
+		pthread_mutex_lock(&mutex);
+		hashed++;
+		bytes += sz;
+		pthread_mutex_unlock(&mutex);
+
+		/* throttle to the configured rate */
+		if (config->prehashrate > 0) {
+			elapsed = latency_now();
+			elapsed = elapsed > t0 ? elapsed - t0 : 0;
+			need = (uint64_t)sz * 1000000 / config->prehashrate;
+			if (need > elapsed) {
+				STAT_INC(throttled, need - elapsed);
+				if (prehash_sleep(need - elapsed) == -1) {
+					close(fd);
+					return -1;
+				}
+			}
+		}
+	}
+	close(fd);
+
+	/* procmon does not verify code signatures of scripts */
+	if (kind != 1 || !config->codesign)
+		return 0;
+
+	cs = cachecsig_get(&hashes);
+	if (cs) {
+		codesign_free(cs);
+		STAT_INC(csighits, 1);
+		return 0;
+	}
+	if (prehash_wait_idle() == -1)
+		return -1;
+	if (hit)
+		passfiles++;
+	cs = codesign_new(path, -1);
+	if (!cs) {
+		STAT_INC(errors, 1);
+		return 0;
+	}
+	if (sys_pathattr(&st2, path) == 0 && prehash_stat_equal(&st1, &st2)) {
+		cachecsig_put(&hashes, cs);
+		STAT_INC(csigs, 1);
+	}
+	codesign_free(cs);
+	return 0;
+}
+
+static int
+prehash_history(void) {
+	char **paths;
+	size_t n, i;
+	int rv;
+
+	pthread_mutex_lock(&mutex);
+	n = tommy_hashdyn_count(&history);
+	paths = malloc((n ? n : 1) * sizeof(char *));
+	if (!paths) {
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+	i = 0;
+	for (tommy_node *node = tommy_list_head(&history_list);
+	     node && i < n; node = node->next) {
+		prehash_hist_t *obj = node->data;
+		paths[i] = strdup(obj->path);
+		if (paths[i])
+			i++;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	rv = 0;
+	for (size_t j = 0; j < i; j++) {
+		if (rv == 0)
+			rv = prehash_file(paths[j]);
+		free(paths[j]);
+	}
+	free(paths);
+	return rv;
+}
+
+static int
+prehash_dir(char *dir) {
+	char *argv[] = {dir, NULL};
+	FTS *fts;
+	FTSENT *ent;
+	int rv;
+
+	fts = fts_open(argv, FTS_PHYSICAL|FTS_XDEV|FTS_NOCHDIR, NULL);
+	if (!fts)
+		return 0;
+	rv = 0;
+	while (rv == 0 && (ent = fts_read(fts))) {
+		if (ent->fts_info != FTS_F)
+			continue;
+		if (!(ent->fts_statp->st_mode & (S_IXUSR|S_IXGRP|S_IXOTH)))
+			continue;
+		rv = prehash_file(ent->fts_path);
+	}
+	fts_close(fts);
+	return rv;
+}
+
+/*
+ * One pass over the exec history first, then the configured directories,
+ * which are a comma-separated list.
+ */
+static int
+prehash_pass(void) {
+	char *dirs, *p, *dir;
+	int rv;
+
+	passfiles = 0;
+	pthread_mutex_lock(&mutex);
+	active = 1;
+	passes++;
+	pthread_mutex_unlock(&mutex);
+
+	rv = prehash_history();
+	if (rv == 0 && config->prehashdirs) {
+		dirs = strdup(config->prehashdirs);
+		if (dirs) {
+			p = dirs;
+			while (rv == 0 && (dir = strsep(&p, ",")) != NULL) {
+				while (*dir == ' ')
+					dir++;
+				if (*dir)
+					rv = prehash_dir(dir);
+			}
+			free(dirs);
+		}
+	}
+
+	pthread_mutex_lock(&mutex);
+	active = 0;
+	rv = stopping ? -1 : 0;
+	pthread_mutex_unlock(&mutex);
+	return rv;
+}
+
+static void *
+prehash_thread(UNUSED void *arg) {
+	(void)policy_thread_diskio_throttle();
+
+	for (;;) {
+		if (prehash_pass() == -1)
+			break;
+		if (prehash_sleep((uint64_t)PREHASH_RESCAN * 1000000) == -1)
+			break;
+	}
+	hashio_thread_fini();
+	return NULL;
+}
+
+int
+prehash_init(config_t *cfg) {
+	assert(!running);
+	config = cfg;
+	stopping = false;
+	active = 0;
+	passes = 0;
+	files = 0;
+	hashed = 0;
+	hashhits = 0;
+	csigs = 0;
+	csighits = 0;
+	bytes = 0;
+	errors = 0;
+	deferrals = 0;
+	throttled = 0;
+	tommy_hashdyn_init(&history);
+	tommy_list_init(&history_list);
+
+	if (!cfg->prehashdirs && !cfg->prehashhistory)
+		return 0;
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		ncpu = 1;
+	if (cfg->prehashhistory) {
+		prehash_hist_load(cfg->prehashhistory);
+		history_enabled = true;
+	}
+	if (pthread_create(&thr, NULL, prehash_thread, NULL) != 0) {
+		history_enabled = false;
+		return -1;
+	}
+	running = true;
+	return 0;
+}
+
+/*
+ * Stops the crawler and saves the exec history.  Must be called before the
+ * caches, the work queue and the codesign pool are torn down.
+ */
+void
+prehash_fini(void) {
+	bool save;
+
+	if (running) {
+		pthread_mutex_lock(&mutex);
+		stopping = true;
+		pthread_cond_broadcast(&stop);
+		pthread_mutex_unlock(&mutex);
+		if (pthread_join(thr, NULL) != 0) {
+			fprintf(stderr, "Failed to join prehash thread - "
+			                "exiting\n");
+			exit(EXIT_FAILURE);
+		}
+		running = false;
+	}
+	/* the worker thread may still call prehash_seen() */
+	pthread_mutex_lock(&mutex);
+	save = history_enabled;
+	history_enabled = false;
+	pthread_mutex_unlock(&mutex);
+	if (save && prehash_hist_save(config->prehashhistory) == -1)
+		fprintf(stderr, "Failed to save prehash history '%s': "
+		                "%s (%i)\n", config->prehashhistory,
+		                strerror(errno), errno);
+	pthread_mutex_lock(&mutex);
+	tommy_list_foreach(&history_list, prehash_hist_free);
+	tommy_list_init(&history_list);
+	tommy_hashdyn_done(&history);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+prehash_stats(prehash_stat_t *st) {
+	assert(st);
+
+	pthread_mutex_lock(&mutex);
+	st->active = active;
+	st->history = tommy_hashdyn_count(&history);
+	st->passes = passes;
+	st->files = files;
+	st->hashed = hashed;
+	st->hashhits = hashhits;
+	st->csigs = csigs;
+	st->csighits = csighits;
+	st->bytes = bytes;
+	st->errors = errors;
+	st->deferrals = deferrals;
+	st->throttled = throttled;
+	pthread_mutex_unlock(&mutex);
+}
+
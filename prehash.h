@@ -0,0 +1,40 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef PREHASH_H
+#define PREHASH_H
+
+#include "config.h"
+#include "attrib.h"
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t active;        /* 1 while a pass is in progress */
+	uint32_t history;       /* paths in exec history */
+	uint64_t passes;
+	uint64_t files;         /* executables examined */
+	uint64_t hashed;        /* hashes calculated */
+	uint64_t hashhits;      /* hashes already cached */
+	uint64_t csigs;         /* code signatures verified */
+	uint64_t csighits;      /* code signatures already cached */
+	uint64_t bytes;         /* bytes hashed */
+	uint64_t errors;
+	uint64_t deferrals;     /* waits for the system to become idle */
+	uint64_t throttled;     /* usec slept to honour the rate limit */
+} prehash_stat_t;
+
+int prehash_init(config_t *) WUNRES NONNULL(1);
+void prehash_fini(void);
+void prehash_seen(const char *) NONNULL(1);
+void prehash_stats(prehash_stat_t *) NONNULL(1);
+
+#endif
+
@@ -12,13 +12,26 @@
 
 #include "tommyhash.h"
 #include "filemon.h"
+#include "strpool.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
+/*
+ * Every proc is armed on the idle wheel for PROC_IDLE_MIN ticks.  Procs that
+ * were looked up in the meantime are re-armed; procs that were idle are handed
+ * out by proctab_idle for verification that the process still exists, since
+ * audit(4) occasionally fails to deliver the exit of a process.  Procs that
+ * turn out to be alive are re-armed with exponential backoff.
+ */
+#define PROC_IDLE_MIN   120     /* ticks */
+#define PROC_IDLE_MAX   3600    /* ticks */
+
 static proc_t *proctab[UINT16_MAX + 1];
 uint32_t procs; /* external access from procmap.c */
+static timerwheel_t idlewheel;
+static tommy_list idlelist;     /* expired, not yet handed out */
 
 _Static_assert(sizeof(pid_t) == 4, "pid_t is 32bit");
 #define hashpid(P) (uint16_t)tommy_inthash_u32((uint32_t)(P))
@@ -83,6 +96,7 @@ proc_triggerfd(fd_ctx_t *ctx, struct timespec *tv) {
 	if ((ctx->flags & FDFLAG_FILE) && ctx->fi.path) {
 		assert(ctx->fi.path);
 		filemon_touched(tv, &ctx->fi.subject, ctx->fi.path);
+		strpool_unref(ctx->fi.path);
 		ctx->fi.path = NULL;
 	}
 }
@@ -90,7 +104,7 @@ proc_triggerfd(fd_ctx_t *ctx, struct timespec *tv) {
 void
 proc_freefd(fd_ctx_t *ctx) {
 	if ((ctx->flags & FDFLAG_FILE) && ctx->fi.path) {
-		free(ctx->fi.path);
+		strpool_unref(ctx->fi.path);
 		ctx->fi.path = NULL;
 	}
 	free(ctx);
@@ -110,6 +124,10 @@ proc_new(void) {
 	bzero(proc, sizeof(proc_t));
 	tommy_list_init(&proc->fdlolist);
 	tommy_list_init(&proc->fdhilist);
+	proc->seen = idlewheel.now;
+	proc->idle = PROC_IDLE_MIN;
+	timerwheel_add(&idlewheel, &proc->idle_timer, proc,
+	               idlewheel.now + proc->idle);
 	procs++;
 	return proc;
 }
@@ -124,6 +142,7 @@ proc_free(proc_t *proc, struct timespec *tv) {
 	fd_ctx_t *ctx;
 
 	assert(proc);
+	timerwheel_remove(&proc->idle_timer);
 	while (!tommy_list_empty(&proc->fdlolist)) {
 		ctx = tommy_list_remove_existing(&proc->fdlolist,
 				tommy_list_head(&proc->fdlolist));
@@ -141,7 +160,7 @@ proc_free(proc_t *proc, struct timespec *tv) {
 	if (proc->image_exec)
 		image_exec_free(proc->image_exec);
 	if (proc->cwd)
-		free(proc->cwd);
+		strpool_unref(proc->cwd);
 	assert(procs > 0);
 	procs--;
 	free(proc);
@@ -189,13 +208,12 @@ proctab_find(pid_t pid) {
 	proc_t *proc;
 
 	proc = proctab[hashpid(pid)];
-	if (proc) {
-		if (proc->pid == pid)
+	while (proc) {
+		if (proc->pid == pid) {
+			proc->seen = idlewheel.now;
 			return proc;
-		while ((proc = proc->next)) {
-			if (proc->pid == pid)
-				return proc;
 		}
+		proc = proc->next;
 	}
 
 	return NULL;
@@ -248,6 +266,46 @@ proctab_remove(pid_t pid, struct timespec *tv) {
 	}
 }
 
+/*
+ * Advance the idle wheel by one tick and return up to n procs that have not
+ * been looked up for their full idle interval.  The caller must either
+ * remove each returned proc from proctab or pass it to proctab_alive.  Idle
+ * procs in excess of n are handed out on subsequent ticks.
+ */
+size_t
+proctab_idle(proc_t **v, size_t n) {
+	proc_t *proc;
+	size_t i;
+
+	timerwheel_advance(&idlewheel, idlewheel.now + 1, &idlelist);
+	i = 0;
+	while (i < n && !tommy_list_empty(&idlelist)) {
+		proc = tommy_list_head(&idlelist)->data;
+		timerwheel_remove(&proc->idle_timer);
+		if (idlewheel.now - proc->seen < proc->idle) {
+			/* looked up since armed */
+			proc->idle = PROC_IDLE_MIN;
+			timerwheel_add(&idlewheel, &proc->idle_timer, proc,
+			               proc->seen + proc->idle);
+			continue;
+		}
+		v[i++] = proc;
+	}
+	return i;
+}
+
+/*
+ * Re-arm an idle proc that was verified to be alive, backing off up to
+ * PROC_IDLE_MAX ticks.
+ */
+void
+proctab_alive(proc_t *proc) {
+	proc->idle = proc->idle * 2 < PROC_IDLE_MAX ? proc->idle * 2
+	                                            : PROC_IDLE_MAX;
+	timerwheel_add(&idlewheel, &proc->idle_timer, proc,
+	               idlewheel.now + proc->idle);
+}
+
 /*
  * Does not trigger any implicit close filemon events anymore.
  */
@@ -271,6 +329,8 @@ void
 proctab_init(void) {
 	procs = 0;
 	bzero(proctab, sizeof(proctab));
+	timerwheel_init(&idlewheel, 0);
+	tommy_list_init(&idlelist);
 }
 
 void
@@ -13,6 +13,7 @@
 
 #include "procmon.h" /* image_exec_t */
 
+#include "timerwheel.h"
 #include "tommylist.h"
 
 #include <sys/types.h>
@@ -34,7 +35,7 @@ typedef struct {
 		} so;
 		struct {
 			audit_proc_t subject;
-			char *path;
+			const char *path; /* strpool */
 		} fi;
 	};
 } fd_ctx_t;
@@ -48,11 +49,16 @@ typedef struct proc {
 	image_exec_t *image_exec;
 
 	/* current working directory, tracked via chdir/fchdir */
-	char *cwd;
+	const char *cwd; /* strpool */
 
 	/* hashtable bucket linkage */
 	struct proc *next;
 
+	/* liveness verification of idle procs, see proctab_idle */
+	timerwheel_timer_t idle_timer;
+	uint64_t seen;          /* tick of last lookup */
+	uint32_t idle;          /* ticks until next verification */
+
 	/*
 	 * Open file descriptors smaller than default RLIMIT_NOFILE stored in
 	 * pointer array in addition to a list to allow O(1) access time but
@@ -73,6 +79,8 @@ proc_t * proctab_create(pid_t);
 proc_t * proctab_find_or_create(pid_t);
 proc_t * proctab_find(pid_t);
 void proctab_remove(pid_t, struct timespec *);
+size_t proctab_idle(proc_t **, size_t) NONNULL(1) WUNRES;
+void proctab_alive(proc_t *) NONNULL(1);
 
 fd_ctx_t * proc_getfd(proc_t *, int) NONNULL(1) WUNRES;
 fd_ctx_t * proc_closefd(proc_t *, int) NONNULL(1) WUNRES;
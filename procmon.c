@@ -21,10 +21,17 @@
 #include "hashes.h"
 #include "cachehash.h"
 #include "cachecsig.h"
+#include "csigpool.h"
+#include "prehash.h"
 #include "time.h"
 #include "work.h"
 #include "filemon.h"
+#include "degrade.h"
+#include "latency.h"
 #include "atomic.h"
+#include "strpool.h"
+#include "aev.h"
+#include "execsum.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -37,8 +44,18 @@
 #include <signal.h>
 #include <errno.h>
 #include <time.h>
+#include <stddef.h>
 #include <pthread.h>
 
+#define IMAGE_EXEC_ALIGN        64      /* cache line size */
+#define REAP_BATCH              64      /* idle procs verified per tick */
+#define PREPQ_MAXAGE            300     /* sec until unclaimed images expire */
+
+_Static_assert(offsetof(image_exec_t, refs) / IMAGE_EXEC_ALIGN ==
+               (offsetof(image_exec_t, codesign) + sizeof(codesign_t *) - 1) /
+               IMAGE_EXEC_ALIGN,
+               "hot fields of image_exec_t share a single cache line");
+
 static config_t *config;
 
 /* prepq state */
@@ -49,6 +66,7 @@ static uint64_t pqlookup;       /* counts total number of lookups in pq */
 static uint64_t pqmiss;         /* counts no preloaded image found in pq */
 static uint64_t pqdrop;         /* counts preloaded imgs removed due max TTL */
 static uint64_t pqskip;         /* counts non-matching entries skipped in pq */
+static uint64_t pqexpired;      /* counts preloaded imgs removed due max age */
 
 static atomic32_t images;
 static uint64_t liveacq;        /* counts live process acquisitions */
@@ -59,6 +77,10 @@ static uint64_t miss_execinterp;
 static uint64_t miss_chdirsubj;
 static uint64_t miss_getcwd;
 static atomic64_t ooms;         /* counts events impaired due to OOM */
+static uint64_t reap_checks;    /* counts idle procs verified by reaper */
+static uint64_t reap_procs;     /* counts procs reaped, exit was missed */
+static uint64_t reap_images;    /* counts exec images freed by reaping */
+static uint64_t reap_bytes;     /* approx. memory reclaimed by reaping */
 
 setstr_t *suppress_image_exec_by_ident;
 setstr_t *suppress_image_exec_by_path;
@@ -66,32 +88,31 @@ setstr_t *suppress_image_exec_by_ancestor_ident;
 setstr_t *suppress_image_exec_by_ancestor_path;
 
 static int image_exec_work(image_exec_t *);
+static void image_exec_codesign_late(void *, codesign_t *);
 
 /*
- * Ownership of path will be transfered to image_exec; caller must not assume
- * that path still exists after calling this function.  Path is also freed when
- * this function fails and returns NULL.
+ * Ownership of the strpool reference path will be transfered to image_exec;
+ * caller must not assume that path still exists after calling this function.
+ * Path is also released when this function fails and returns NULL.
  *
  * Thread-safe.
  */
 static image_exec_t *
-image_exec_new(char *path) {
+image_exec_new(const char *path) {
 	image_exec_t *image;
 
 	assert(path);
 
-	image = malloc(sizeof(image_exec_t));
-	if (!image) {
-		free(path);
+	if (posix_memalign((void **)&image, IMAGE_EXEC_ALIGN,
+	                   sizeof(image_exec_t)) != 0) {
+		strpool_unref(path);
 		atomic64_inc(&ooms);
 		return NULL;
 	}
 	bzero(image, sizeof(image_exec_t));
-	pthread_mutex_init(&image->refsmutex, NULL);
 	image->refs = 1;
 #ifdef DEBUG_REFS
-	fprintf(stderr, "DEBUG_REFS: image_exec_new(%p) refs=%zu\n",
-	                image, image->refs);
+	fprintf(stderr, "DEBUG_REFS: image_exec_new(%p) refs=1\n", image);
 #endif
 	image->path = path;
 	image->fd = -1;
@@ -109,46 +130,41 @@ image_exec_new(char *path) {
 void
 image_exec_free(image_exec_t *image) {
 	assert(image);
-	pthread_mutex_lock(&image->refsmutex);
-	image->refs--;
 #ifdef DEBUG_REFS
-	fprintf(stderr, "DEBUG_REFS: image_exec_free(%p) refs=%zu (was %zu)\n",
-	                image, image->refs, image->refs + 1);
+	fprintf(stderr, "DEBUG_REFS: image_exec_free(%p) refs=%zu (was)\n",
+	                image, (size_t)atomic32_load(&image->refs));
 #endif
-	if (image->refs > 0) {
-		pthread_mutex_unlock(&image->refsmutex);
+	if (!atomic32_dec_test0(&image->refs))
 		return;
-	}
-	pthread_mutex_unlock(&image->refsmutex);
-	pthread_mutex_destroy(&image->refsmutex);
 	if (image->script)
 		image_exec_free(image->script);
 	if (image->prev)
 		image_exec_free(image->prev);
 	if (image->argv)
-		free(image->argv);
+		aev_unref(image->argv);
 	if (image->envv)
-		free(image->envv);
+		aev_unref(image->envv);
 	if (image->path)
-		free(image->path);
+		strpool_unref(image->path);
 	if (image->cwd)
-		free(image->cwd);
+		strpool_unref(image->cwd);
 	if (image->codesign)
 		codesign_free(image->codesign);
 	atomic32_dec(&images);
 	free(image);
 }
 
-static void
+/*
+ * Thread-safe.
+ */
+void
 image_exec_ref(image_exec_t *image) {
 	assert(image);
-	pthread_mutex_lock(&image->refsmutex);
-	image->refs++;
 #ifdef DEBUG_REFS
-	fprintf(stderr, "DEBUG_REFS: image_exec_ref(%p) refs=%zu (was %zu)\n",
-	                image, image->refs, image->refs - 1);
+	fprintf(stderr, "DEBUG_REFS: image_exec_ref(%p) refs=%zu (was)\n",
+	                image, (size_t)atomic32_load(&image->refs));
 #endif
-	pthread_mutex_unlock(&image->refsmutex);
+	atomic32_inc(&image->refs);
 }
 
 /*
@@ -163,7 +179,8 @@ image_exec_prune_ancestors(image_exec_t *image, size_t level) {
 
 #ifdef DEBUG_REFS
 	fprintf(stderr, "DEBUG_REFS: image_exec_prune_ancestors(%p, level %zu) "
-	                "refs=%zu\n", image, level, image->refs);
+	                "refs=%zu\n", image, level,
+	                (size_t)atomic32_load(&image->refs));
 #endif
 	if (!image->prev)
 		return;
@@ -172,7 +189,7 @@ image_exec_prune_ancestors(image_exec_t *image, size_t level) {
 		image->prev = NULL;
 		return;
 	}
-	if (image->refs == 1)
+	if (atomic32_load(&image->refs) == 1)
 		image_exec_prune_ancestors(image->prev, level + 1);
 }
 
@@ -254,6 +271,32 @@ image_exec_close(image_exec_t *image) {
 	}
 }
 
+/*
+ * Compare a 3rd stat after codesign verification to the 1st.  Returns 0 if
+ * they match, 1 if they do not match and codesign must be invalidated, and
+ * -1 if the 3rd stat failed, in which case codesign must not be cached but
+ * does not need to be invalidated either.  The codesign routines fail
+ * internally if the data is changed during signature verification.
+ */
+static int
+image_exec_codesign_check(image_exec_t *image) {
+	stat_attr_t st;
+
+	if (sys_pathattr(&st, image->path) == -1)
+		return -1;
+	if ((image->stat.size != st.size) ||
+	    (image->stat.dev != st.dev) ||
+	    (image->stat.ino != st.ino) ||
+	    (image->stat.mtime.tv_sec != st.mtime.tv_sec) ||
+	    (image->stat.mtime.tv_nsec != st.mtime.tv_nsec) ||
+	    (image->stat.ctime.tv_sec != st.ctime.tv_sec) ||
+	    (image->stat.ctime.tv_nsec != st.ctime.tv_nsec) ||
+	    (image->stat.btime.tv_sec != st.btime.tv_sec) ||
+	    (image->stat.btime.tv_nsec != st.btime.tv_nsec))
+		return 1;
+	return 0;
+}
+
 /*
  * Kern indicates if we are currently handling a kernel module callback.
  *
@@ -292,6 +335,14 @@ image_exec_acquire(image_exec_t *image, bool kern) {
 		                    &image->stat.mtime,
 		                    &image->stat.ctime,
 		                    &image->stat.btime);
+		if (!hit && degrade_level() >= DEGRADE_SYSHASH &&
+		    image->path && degrade_system_path(image->path)) {
+			/* shed load, skip hashes and codesign */
+			close(image->fd);
+			image->fd = -1;
+			image->flags |= EIFLAG_DONE;
+			return 0;
+		}
 		if (!hit) {
 			/* cache miss, calculate hashes */
 			rv = hashes_fd(&sz, &image->hashes, config->hflags,
@@ -333,6 +384,8 @@ image_exec_acquire(image_exec_t *image, bool kern) {
 			              &image->stat.ctime,
 			              &image->stat.btime,
 			              &image->hashes);
+			if (image->path)
+				prehash_seen(image->path);
 #ifdef DEBUG_EXECIMAGE
 			fprintf(stderr, "DEBUG_EXECIMAGE: hashes from path=%s\n", image->path);
 #endif
@@ -390,35 +443,47 @@ image_exec_acquire(image_exec_t *image, bool kern) {
 		             !strcmp(image->path, "/usr/sbin/ocspd")))
 			return 0;
 
-		/* Check code signature (can be very slow!) */
-		image->codesign = codesign_new(image->path, -1);
+		/* Check code signature (can be very slow!); if the verdict is
+		 * not available before the deadline, log the image with a
+		 * pending or timeout verdict and let the late callback, which
+		 * owns the extra reference, take care of the final verdict.
+		 * While degraded, do not wait for the verdict at all. */
+		image_exec_ref(image);
+		image->codesign = csigpool_verify(image->path,
+		                                  degrade_level() >=
+		                                  DEGRADE_CODESIGN,
+		                                  image_exec_codesign_late,
+		                                  image);
 		if (!image->codesign) {
-			if (errno == ENOMEM)
+			int err = errno;
+			if (err == EINPROGRESS || err == ETIMEDOUT) {
+				image->flags |= (err == ETIMEDOUT) ?
+				                EIFLAG_CSTIMEOUT :
+				                EIFLAG_CSPENDING;
+				image->flags |= EIFLAG_DONE;
+				return 0;
+			}
+			image_exec_free(image);
+			if (err == ENOTSUP) {
+				/* degraded without pool, skip verification */
+				image->flags |= EIFLAG_DONE;
+				return 0;
+			}
+			if (err == EAGAIN)
+				image->flags |= EIFLAG_CSOVERFLOW;
+			else if (err == ENOMEM)
 				image->flags |= EIFLAG_ENOMEM;
 			image->flags |= EIFLAG_DONE;
 			return -1;
 		}
+		image_exec_free(image);
 
-		/*
-		 * If 3rd stat does not match 1st, invalidate codesign.
-		 * If 3rd stat fails, return error but don't invalidate.
-		 * The codesign routines fail internally if the data is changed
-		 * during signature verification.
-		 */
-		rv = sys_pathattr(&st, image->path);
+		rv = image_exec_codesign_check(image);
 		if (rv == -1) {
 			image->flags |= EIFLAG_DONE;
 			return -1;
 		}
-		if ((image->stat.size != st.size) ||
-		    (image->stat.dev != st.dev) ||
-		    (image->stat.ino != st.ino) ||
-		    (image->stat.mtime.tv_sec != st.mtime.tv_sec) ||
-		    (image->stat.mtime.tv_nsec != st.mtime.tv_nsec) ||
-		    (image->stat.ctime.tv_sec != st.ctime.tv_sec) ||
-		    (image->stat.ctime.tv_nsec != st.ctime.tv_nsec) ||
-		    (image->stat.btime.tv_sec != st.btime.tv_sec) ||
-		    (image->stat.btime.tv_nsec != st.btime.tv_nsec)) {
+		if (rv == 1) {
 			codesign_free(image->codesign);
 			image->codesign = NULL;
 			image->flags |= EIFLAG_DONE;
@@ -436,6 +501,72 @@ image_exec_acquire(image_exec_t *image, bool kern) {
 	return 0;
 }
 
+static void
+image_codesign_free(image_codesign_t *ic) {
+	assert(ic);
+	image_exec_free(ic->image);
+	if (ic->codesign)
+		codesign_free(ic->codesign);
+	free(ic);
+}
+
+/*
+ * Late callback for codesign verifications that did not finish before the
+ * deadline; called from a codesign pool thread.  Caches the final verdict
+ * and submits an image-codesign event carrying it, subject to the same
+ * suppressions as the original image-exec event.  Owns a reference to
+ * image and ownership of cs.  The image itself is not modified, since it
+ * has been submitted for logging already; the image flags evaluated here
+ * were set before the image was submitted for work and do not change
+ * anymore.
+ */
+static void
+image_exec_codesign_late(void *arg, codesign_t *cs) {
+	image_exec_t *image = arg;
+	image_codesign_t *ic;
+
+	assert(image);
+	if (!cs)
+		goto out;
+	if (image_exec_codesign_check(image) != 0)
+		goto out;
+	cachecsig_put(&image->hashes, cs);
+
+	if (!LOGEVT_WANT(config->events, LOGEVT_FLAG(LOGEVT_IMAGE_CODESIGN)))
+		goto out;
+	if (image->flags & EIFLAG_NOLOG)
+		goto out;
+	if (image_exec_match_suppressions(image, suppress_image_exec_by_ident,
+	                                         suppress_image_exec_by_path))
+		goto out;
+	if (codesign_is_good(cs) &&
+	    setstr_contains3(suppress_image_exec_by_ident, cs->ident,
+	                                                   cs->teamid))
+		goto out;
+
+	ic = malloc(sizeof(image_codesign_t));
+	if (!ic) {
+		atomic64_inc(&ooms);
+		goto out;
+	}
+	bzero(ic, sizeof(image_codesign_t));
+	ic->hdr.code = LOGEVT_IMAGE_CODESIGN;
+	if (timespec_nanotime(&ic->hdr.tv) == -1) {
+		free(ic);
+		goto out;
+	}
+	ic->hdr.ts = latency_now();
+	ic->hdr.le_free = (__typeof__(ic->hdr.le_free))image_codesign_free;
+	ic->image = image;
+	ic->codesign = cs;
+	log_submit(ic);
+	return;
+out:
+	if (cs)
+		codesign_free(cs);
+	image_exec_free(image);
+}
+
 /*
  * Return true iff exec image matches either one of the idents in by_ident or
  * one of the paths in by_path.
@@ -459,6 +590,47 @@ image_exec_match_suppressions(image_exec_t *ie,
 	return false;
 }
 
+/*
+ * Like image_exec_match_suppressions, but memoizes the verdict for the
+ * suppression lists of subsystem what once the image has been fully acquired,
+ * that is, once its code signature is known or known to be unavailable.
+ * Verdicts are not memoized for images with a pending or timed out code
+ * signature, so that the memoized verdict never depends on the signature
+ * being unavailable.
+ *
+ * Only called by the worker thread, which is also the only thread acquiring
+ * images and thus changing their flags and code signatures.
+ */
+bool
+image_exec_suppressed(image_exec_t *ie, int what,
+                      setstr_t *by_ident, setstr_t *by_path) {
+	uint32_t suppress;
+	bool match;
+
+	suppress = atomic32_load(&ie->suppress);
+	if (suppress & EISUPPRESS_KNOWN(what))
+		return !!(suppress & EISUPPRESS_MATCH(what));
+	match = image_exec_match_suppressions(ie, by_ident, by_path);
+	if ((ie->flags & EIFLAG_DONE) &&
+	    !(ie->flags & (EIFLAG_CSPENDING|EIFLAG_CSTIMEOUT))) {
+		suppress |= EISUPPRESS_KNOWN(what);
+		if (match)
+			suppress |= EISUPPRESS_MATCH(what);
+		ie->suppress = suppress;
+	}
+	return match;
+}
+
+/*
+ * Returns true iff a memoized verdict says that the image matches the
+ * suppression lists of subsystem what.  Thread-safe; intended for dropping
+ * events of suppressed subjects on the main thread before allocating them.
+ */
+bool
+image_exec_suppressed_cached(image_exec_t *ie, int what) {
+	return !!(atomic32_load(&ie->suppress) & EISUPPRESS_MATCH(what));
+}
+
 /*
  * Work function to be executed in the worker thread.
  *
@@ -487,8 +659,11 @@ image_exec_work(image_exec_t *ei) {
 	}
 	if (ei->flags & EIFLAG_NOLOG)
 		return -1;
-	if (image_exec_match_suppressions(ei, suppress_image_exec_by_ident,
-	                                      suppress_image_exec_by_path))
+	if (image_exec_suppressed(ei, EISUPPRESS_IMAGE_EXEC,
+	                          suppress_image_exec_by_ident,
+	                          suppress_image_exec_by_path))
+		return -1;
+	if (execsum_fold(ei))
 		return -1;
 	return 0;
 }
@@ -499,6 +674,7 @@ image_exec_work(image_exec_t *ei) {
 static image_exec_t *
 image_exec_from_pid(pid_t pid) {
 	image_exec_t *ei;
+	const char *ipath;
 	char *path;
 	int nopath = 0;
 	int rv;
@@ -520,7 +696,12 @@ image_exec_from_pid(pid_t pid) {
 		}
 		nopath = 1;
 	}
-	ei = image_exec_new(path);
+	ipath = strpool_adopt(path);
+	if (!ipath) {
+		atomic64_inc(&ooms);
+		return NULL;
+	}
+	ei = image_exec_new(ipath);
 	if (!ei)
 		return NULL;
 	rv = timespec_nanotime(&ei->hdr.tv);
@@ -549,6 +730,7 @@ static proc_t *
 procmon_proc_from_pid(pid_t pid, bool log_event, struct timespec *tv) {
 	proc_t *proc;
 	pid_t ppid;
+	char *cwd;
 
 	proc = proctab_find_or_create(pid);
 	if (!proc) {
@@ -563,11 +745,12 @@ procmon_proc_from_pid(pid_t pid, bool log_event, struct timespec *tv) {
 	}
 
 	if (proc->cwd) {
-		free(proc->cwd);
+		strpool_unref(proc->cwd);
 	}
-	proc->cwd = sys_pidcwd(pid);
+	cwd = sys_pidcwd(pid);
+	proc->cwd = cwd ? strpool_adopt(cwd) : NULL;
 	if (!proc->cwd) {
-		if (errno == ENOMEM)
+		if (cwd || errno == ENOMEM)
 			atomic64_inc(&ooms);
 		/* process not alive anymore unless ENOMEM */
 		proctab_remove(pid, tv);
@@ -689,12 +872,7 @@ procmon_fork(struct timespec *tv,
 	child->fork_tv = *tv;
 
 	assert(parent->cwd);
-	child->cwd = strdup(parent->cwd);
-	if (!child->cwd) {
-		proctab_remove(childpid, tv);
-		atomic64_inc(&ooms);
-		return;
-	}
+	child->cwd = strpool_ref(parent->cwd);
 
 	assert(parent->image_exec);
 	child->image_exec = parent->image_exec;
@@ -713,7 +891,7 @@ procmon_spawn(struct timespec *tv,
               audit_proc_t *subject,
               pid_t childpid,
               char *imagepath, audit_attr_t *attr,
-              char **argv, char **envv) {
+              char **argv, char **envv, bool envtrunc) {
 #ifdef DEBUG_PROCMON
 	DEBUG(config->debug, "procmon_spawn",
 	      "subject->pid=%i childpid=%i imagepath=%s",
@@ -722,7 +900,7 @@ procmon_spawn(struct timespec *tv,
 
 	procmon_fork(tv, subject, childpid);
 	subject->pid = childpid;
-	procmon_exec(tv, subject, imagepath, attr, argv, envv);
+	procmon_exec(tv, subject, imagepath, attr, argv, envv, envtrunc);
 }
 
 /*
@@ -841,10 +1019,10 @@ void
 procmon_exec(struct timespec *tv,
              audit_proc_t *subject,
              char *imagepath, audit_attr_t *attr,
-             char **argv, char **envv) {
+             char **argv, char **envv, bool envtrunc) {
 	proc_t *proc;
 	image_exec_t *prev_image_exec;
-	char *cwd;
+	const char *ipath;
 
 #ifdef DEBUG_PROCMON
 	DEBUG(config->debug, "procmon_exec",
@@ -895,8 +1073,11 @@ procmon_exec(struct timespec *tv,
 		      "looking for %s[%i]: not found (image)",
 		      imagepath, proc->pid);
 		pqmiss++;
-		image = image_exec_new(imagepath);
+		ipath = strpool_adopt(imagepath);
+		image = ipath ? image_exec_new(ipath) : NULL;
 		if (!image) {
+			if (!ipath)
+				atomic64_inc(&ooms);
 			/* no counter, oom is the only reason this can happen */
 			if (argv)
 				free(argv);
@@ -921,14 +1102,14 @@ procmon_exec(struct timespec *tv,
 			      "prepq_miss",
 			      "looking for %s[%i]: not found (interp "
 			      "argv[0]=%s)",
-			      imagepath, proc->pid, argv ? argv[0] : NULL);
+			      image->path, proc->pid, argv ? argv[0] : NULL);
 			pqmiss++;
 			if (!argv) {
 				miss_execinterp++;
 				DEBUG(config->debug, "miss_execinterp",
 				      "subject.pid=%i imagepath=%s "
 				      "argv=NULL attr:%s",
-				      subject->pid, imagepath,
+				      subject->pid, image->path,
 				      attr ? "y" : "n");
 				image_exec_free(image);
 				if (envv)
@@ -946,7 +1127,7 @@ procmon_exec(struct timespec *tv,
 					      "subject.pid=%i imagepath=%s "
 					      "argv[0]=%s argv[1]=%s "
 					      "attr:%s",
-					      subject->pid, imagepath,
+					      subject->pid, image->path,
 					      argv[0], argv[1],
 					      attr ? "y" : "n");
 					image_exec_free(image);
@@ -955,14 +1136,18 @@ procmon_exec(struct timespec *tv,
 						free(envv);
 					return;
 				}
-				interp = image_exec_new(p);
+				ipath = strpool_adopt(p);
+				if (!ipath)
+					atomic64_inc(&ooms);
+				else
+					interp = image_exec_new(ipath);
 			}
 			if (!interp) {
 				miss_execinterp++;
 				DEBUG(config->debug, "miss_execinterp",
 				      "subject.pid=%i imagepath=%s "
 				      "argv[0]=%s argv[1]=%s attr:%s",
-				      subject->pid, imagepath,
+				      subject->pid, image->path,
 				      argv[0], argv[1],
 				      attr ? "y" : "n");
 				image_exec_free(image);
@@ -986,28 +1171,26 @@ procmon_exec(struct timespec *tv,
 	}
 	assert(proc->image_exec);
 	assert(proc->image_exec != prev_image_exec);
-	cwd = strdup(proc->cwd);
-	if (!cwd) {
-		atomic64_inc(&ooms);
-		image_exec_free(proc->image_exec);
-		proc->image_exec = NULL;
-		/* free what would have been transfered to image_exec below */
-		if (prev_image_exec)
-			image_exec_free(prev_image_exec);
-		if (argv)
-			free(argv);
-		if (envv)
-			free(envv);
-		return;
-	}
-	assert(proc->image_exec->refs == 1);
+	assert(atomic32_load(&proc->image_exec->refs) == 1);
 	proc->image_exec->hdr.tv = *tv;
 	proc->image_exec->fork_tv = proc->fork_tv;
 	proc->image_exec->pid = proc->pid;
 	proc->image_exec->subject = *subject;
-	proc->image_exec->argv = argv;
-	proc->image_exec->envv = envv;
-	proc->image_exec->cwd = cwd;
+	if (argv) {
+		proc->image_exec->argv = aev_intern(argv, NULL);
+		if (!proc->image_exec->argv)
+			atomic64_inc(&ooms);
+	}
+	if (envv) {
+		/* most execs inherit the environment of their parent */
+		proc->image_exec->envv = aev_intern(envv,
+		                                    prev_image_exec->envv);
+		if (!proc->image_exec->envv)
+			atomic64_inc(&ooms);
+		if (envtrunc)
+			proc->image_exec->flags |= EIFLAG_ENVTRUNC;
+	}
+	proc->image_exec->cwd = strpool_ref(proc->cwd);
 	proc->image_exec->prev = prev_image_exec;
 
 	if (proc->image_exec->prev->flags & EIFLAG_NOLOG_KIDS)
@@ -1077,6 +1260,7 @@ procmon_wait4(struct timespec *tv, pid_t pid) {
 void
 procmon_chdir(struct timespec *tv, pid_t pid, char *path) {
 	proc_t *proc;
+	const char *cwd;
 
 #ifdef DEBUG_CHDIR
 	DEBUG(config->debug, "procmon_chdir",
@@ -1099,9 +1283,16 @@ procmon_chdir(struct timespec *tv, pid_t pid, char *path) {
 	}
 	assert(proc);
 
+	cwd = strpool_adopt(path);
+	if (!cwd) {
+		atomic64_inc(&ooms);
+		/* reacquired from the live process on next use */
+		proctab_remove(pid, tv);
+		return;
+	}
 	if (proc->cwd)
-		free(proc->cwd);
-	proc->cwd = path;
+		strpool_unref(proc->cwd);
+	proc->cwd = cwd;
 }
 
 /*
@@ -1116,14 +1307,14 @@ procmon_chdir(struct timespec *tv, pid_t pid, char *path) {
 void
 procmon_kern_preexec(struct timespec *tm, pid_t pid, const char *imagepath) {
 	image_exec_t *ei;
-	char *path;
+	const char *path;
 
 #ifdef DEBUG_PROCMON
 	DEBUG(config->debug, "procmon_kern_preexec",
 	      "pid=%i imagepath=%s", pid, imagepath);
 #endif
 
-	path = strdup(imagepath);
+	path = strpool_intern(imagepath);
 	if (!path) {
 		atomic64_inc(&ooms);
 		return;
@@ -1313,7 +1504,7 @@ procmon_file_open(audit_proc_t *subject, int fd, char *path,
 	}
 	ctx->flags = FDFLAG_FILE;
 	ctx->fi.subject = *subject;
-	ctx->fi.path = strdup(path);
+	ctx->fi.path = strpool_intern(path);
 	if (!ctx->fi.path) {
 		atomic64_inc(&ooms);
 	}
@@ -1332,6 +1523,77 @@ procmon_fd_close(pid_t pid, int fd) {
 	}
 }
 
+/*
+ * Returns true iff the process tracked as proc does not exist anymore, or
+ * if its pid was reused by a process started after the one we know of.
+ */
+static bool
+procmon_reap_dead(proc_t *proc) {
+	struct timespec start;
+
+	if (proc->pid <= 0)
+		return false;
+	if (kill(proc->pid, 0) == -1 && errno == ESRCH)
+		return true;
+	if (proc->fork_tv.tv_sec == 0)
+		return false;
+	if (sys_pidbsdinfo(&start, NULL, proc->pid) == -1)
+		return errno == ESRCH;
+	return timespec_greater_plus(&start, &proc->fork_tv, 1);
+}
+
+/*
+ * Reclaim procs for which audit(4) failed to deliver an exit, and exec images
+ * in the prepq that were never claimed by an exec event.
+ * Called by the reaper timer, once per second.
+ *
+ * Not thread-safe - must be called from the main thread, not worker or logger!
+ */
+void
+procmon_reap(void) {
+	proc_t *idle[REAP_BATCH];
+	struct timespec now;
+	image_exec_t *ie;
+	size_t n;
+
+	n = proctab_idle(idle, REAP_BATCH);
+	for (size_t i = 0; i < n; i++) {
+		reap_checks++;
+		if (!procmon_reap_dead(idle[i])) {
+			proctab_alive(idle[i]);
+			continue;
+		}
+#ifdef DEBUG_PROCMON
+		DEBUG(config->debug, "procmon_reap",
+		      "pid=%i", idle[i]->pid);
+#endif
+		/* estimate what is freed along with the proc */
+		for (ie = idle[i]->image_exec;
+		     ie && atomic32_load(&ie->refs) == 1; ie = ie->prev) {
+			reap_images++;
+			reap_bytes += sizeof(image_exec_t);
+		}
+		reap_bytes += sizeof(proc_t);
+		reap_procs++;
+		/* the time of the missed exit is unknown, so do not trigger
+		 * implicit close events for files still open */
+		proctab_remove(idle[i]->pid, NULL);
+	}
+
+	if (timespec_nanotime(&now) == -1)
+		return;
+	while (!tommy_list_empty(&pqlist)) {
+		ie = tommy_list_head(&pqlist)->data;
+		if (!timespec_greater_plus(&now, &ie->hdr.tv, PREPQ_MAXAGE))
+			break;
+		DEBUG(config->debug, "prepq_expire",
+		      "expired %s[%i]", ie->path, ie->pid);
+		prepq_remove_existing(ie);
+		image_exec_free(ie);
+		pqexpired++;
+	}
+}
+
 int
 procmon_init(config_t *cfg) {
 	proctab_init();
@@ -1348,7 +1610,12 @@ procmon_init(config_t *cfg) {
 	pqmiss = 0;
 	pqdrop = 0;
 	pqskip = 0;
+	pqexpired = 0;
 	pqsize = 0;
+	reap_checks = 0;
+	reap_procs = 0;
+	reap_images = 0;
+	reap_bytes = 0;
 	tommy_list_init(&pqlist);
 	pthread_mutex_init(&pqmutex, NULL);
 	suppress_image_exec_by_ident = &cfg->suppress_image_exec_by_ident;
@@ -1385,6 +1652,8 @@ procmon_stats(procmon_stat_t *st) {
 
 	st->procs = procs; /* external */
 	st->images = (uint32_t)images;
+	st->procbytes = (uint64_t)st->procs * sizeof(proc_t);
+	st->imagebytes = (uint64_t)st->images * sizeof(image_exec_t);
 	st->liveacq = liveacq;
 	st->miss_bypid = miss_bypid;
 	st->miss_forksubj = miss_forksubj;
@@ -1397,7 +1666,12 @@ procmon_stats(procmon_stat_t *st) {
 	st->pqmiss = pqmiss;
 	st->pqdrop = pqdrop;
 	st->pqskip = pqskip;
+	st->pqexpired = pqexpired;
 	st->pqsize = pqsize;
+	st->reap_checks = reap_checks;
+	st->reap_procs = reap_procs;
+	st->reap_images = reap_images;
+	st->reap_bytes = reap_bytes;
 }
 
 /*
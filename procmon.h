@@ -21,6 +21,7 @@
 #include "logevt.h"
 #include "debug.h"
 #include "attrib.h"
+#include "atomic.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -29,6 +30,8 @@
 typedef struct {
 	uint32_t procs;
 	uint32_t images;
+	uint64_t procbytes;
+	uint64_t imagebytes;
 	uint64_t liveacq;
 	uint64_t miss_bypid;
 	uint64_t miss_forksubj;
@@ -42,13 +45,20 @@ typedef struct {
 	uint64_t pqmiss;
 	uint64_t pqdrop;
 	uint64_t pqskip;
+	uint64_t pqexpired;
+	uint64_t reap_checks;
+	uint64_t reap_procs;
+	uint64_t reap_images;
+	uint64_t reap_bytes;
 } procmon_stat_t;
 
 void procmon_fork(struct timespec *, audit_proc_t *, pid_t) NONNULL(1,2);
 void procmon_spawn(struct timespec *, audit_proc_t *, pid_t,
-                   char *, audit_attr_t *, char **, char **) NONNULL(1,2);
+                   char *, audit_attr_t *, char **, char **, bool)
+                   NONNULL(1,2);
 void procmon_exec(struct timespec *, audit_proc_t *,
-                  char *, audit_attr_t *, char **, char **) NONNULL(1,2,3);
+                  char *, audit_attr_t *, char **, char **, bool)
+                  NONNULL(1,2,3);
 void procmon_exit(struct timespec *, pid_t) NONNULL(1);
 void procmon_wait4(struct timespec *, pid_t) NONNULL(1);
 void procmon_chdir(struct timespec *tv, pid_t, char *) NONNULL(1,3);
@@ -56,6 +66,7 @@ void procmon_chdir(struct timespec *tv, pid_t, char *) NONNULL(1,3);
 void procmon_kern_preexec(struct timespec *, pid_t, const char *) NONNULL(1,3);
 
 void procmon_preloadpid(pid_t);
+void procmon_reap(void);
 
 int procmon_init(config_t *) WUNRES NONNULL(1);
 void procmon_fini(void);
@@ -78,10 +89,17 @@ void procmon_fd_close(pid_t, int);
  * as an exec log event in order to avoid allocating and copying all this
  * data doubly.  This reuse accounts for at least some of the complexity in
  * its implementation.
+ *
+ * Fields used by reference counting and by walks along the chain of
+ * ancestors are grouped right after the header, so that a walk touches a
+ * single cache line per image instead of pulling in the bulky exec data.
  */
 typedef struct image_exec {
 	logevt_header_t hdr;
 
+	/* hot fields */
+	atomic32_t refs;
+	pid_t pid;
 	unsigned long flags;
 #define EIFLAG_PIDLOOKUP    0x0001UL  /* image created from pid lookup */
 #define EIFLAG_NOPATH       0x0002UL  /* external fetching failed, no path */
@@ -93,17 +111,34 @@ typedef struct image_exec {
 #define EIFLAG_ENOMEM       0x0080UL  /* set if parts missing due to ENOMEM */
 #define EIFLAG_NOLOG        0x0100UL  /* do not submit this for logging */
 #define EIFLAG_NOLOG_KIDS   0x0200UL  /* do not submit children to logging */
+#define EIFLAG_CSPENDING    0x0400UL  /* codesign verdict pending */
+#define EIFLAG_CSTIMEOUT    0x0800UL  /* codesign verdict timed out */
+#define EIFLAG_CSOVERFLOW   0x1000UL  /* codesign skipped, pool queue full */
+#define EIFLAG_ENVTRUNC     0x2000UL  /* envv truncated while degraded */
+	/* origin image */
+	struct image_exec *prev;
+	/* for interpreters, ptr to script file */
+	struct image_exec *script;
+	const char *path; /* strpool */
+	/* codesign results, or NULL */
+	codesign_t *codesign;
 
 	/* open/analysis/close state */
 	int fd;
 
+	/* memoized suppression verdicts, written by the worker thread only */
+	atomic32_t suppress;
+#define EISUPPRESS_IMAGE_EXEC       0 /* suppress_image_exec_by_* */
+#define EISUPPRESS_PROCESS_ACCESS   1 /* suppress_process_access_by_* */
+#define EISUPPRESS_SOCKET_OP        2 /* suppress_socket_op_by_* */
+#define EISUPPRESS_KNOWN(W)         (1U << (2 * (W)))
+#define EISUPPRESS_MATCH(W)         (2U << (2 * (W)))
+
 	/* exec data */
-	pid_t pid;
 	struct timespec fork_tv;
-	char **argv; /* free */
-	char **envv; /* free */
-	char *path; /* free */
-	char *cwd; /* free */
+	char **argv; /* aev */
+	char **envv; /* aev */
+	const char *cwd; /* strpool */
 	audit_proc_t subject;
 
 	/* stat attrs if EIFLAG_STAT or EIFLAG_ATTR is set */
@@ -112,27 +147,31 @@ typedef struct image_exec {
 	/* hashes if EIFLAG_HASHES is set */
 	hashes_t hashes;
 
-	/* codesign results, or NULL */
-	codesign_t *codesign;
-
-	/* for interpreters, ptr to script file */
-	struct image_exec *script;
-	/* origin image */
-	struct image_exec *prev;
-
 	/* kext prep queue ttl */
 	size_t pqttl;
 #define MAXPQTTL 16     /* maximum out-of-order window and water level up to
                            which the kextctl file descriptor will be drained
                            with priority versus the auditpipe descriptor */
-
-	size_t refs;
-	pthread_mutex_t refsmutex;
 } image_exec_t;
 
+/*
+ * Late code signature verdict for an image that was logged with a pending
+ * or timed out code signature verdict.
+ */
+typedef struct {
+	logevt_header_t hdr;
+
+	image_exec_t *image;
+	codesign_t *codesign;
+} image_codesign_t;
+
 image_exec_t * image_exec_by_pid(pid_t, struct timespec *tv) MALLOC NONNULL(2);
+void image_exec_ref(image_exec_t *) NONNULL(1);
 void image_exec_free(image_exec_t *) NONNULL(1);
 bool image_exec_match_suppressions(image_exec_t *, setstr_t *, setstr_t *)
      NONNULL(1,2,3) WUNRES;
+bool image_exec_suppressed(image_exec_t *, int, setstr_t *, setstr_t *)
+     NONNULL(1,3,4) WUNRES;
+bool image_exec_suppressed_cached(image_exec_t *, int) NONNULL(1) WUNRES;
 
 #endif
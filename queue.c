@@ -13,16 +13,37 @@
 #include <assert.h>
 
 /*
- * Single producer, single consumer queue, thread-safe.
- * Draining is handled externally by sending a sentinel down the queue.
+ * Multiple producer, single consumer queue.  Enqueueing and dequeueing take
+ * the queue mutex, so any number of threads can enqueue concurrently, while
+ * items must be dequeued by a single consumer thread, which is also the only
+ * one allowed to account wait times.  Since there is only one waiter,
+ * producers signal rather than broadcast the notempty condition.
+ * Draining is handled externally by sending a sentinel down the queue
+ * using queue_enqueue_last(), which is only dequeued once all priority
+ * lanes are empty.
+ *
+ * Items are queued into one of QUEUE_PRIOS priority lanes and dequeued
+ * from the highest priority non-empty lane, FIFO within each lane.  To
+ * prevent starvation, a non-empty lower priority lane that has been passed
+ * over QUEUE_STARVE_LIMIT times in a row gets to go next.
  */
 
+#define QUEUE_STARVE_LIMIT      16
+
 void
 queue_init(queue_t *queue) {
 	int rv;
 
 	assert(queue);
-	tommy_list_init(&queue->list);
+	for (int i = 0; i < QUEUE_PRIOS; i++) {
+		tommy_list_init(&queue->lane[i]);
+		queue->lanesize[i] = 0;
+		queue->skipped[i] = 0;
+		queue->dequeued[i] = 0;
+		queue->waittime[i] = 0;
+		queue->waitmax[i] = 0;
+	}
+	tommy_list_init(&queue->last);
 	rv = pthread_mutex_init(&queue->mutex, NULL);
 	assert(rv == 0);
 	rv = pthread_cond_init(&queue->notempty, NULL);
@@ -37,35 +58,158 @@ queue_destroy(queue_t *queue) {
 	(void)pthread_mutex_destroy(&queue->mutex);
 }
 
+void
+queue_enqueue_prio(queue_t *queue, int prio, tommy_node *node, void *data) {
+	assert(queue);
+	assert(prio >= 0 && prio < QUEUE_PRIOS);
+	assert(node);
+	assert(data);
+
+	pthread_mutex_lock(&queue->mutex);
+	tommy_list_insert_tail(&queue->lane[prio], node, data);
+	queue->lanesize[prio]++;
+	queue->size++;
+	pthread_mutex_unlock(&queue->mutex);
+	pthread_cond_signal(&queue->notempty);
+}
+
 void
 queue_enqueue(queue_t *queue, tommy_node *node, void *data) {
+	queue_enqueue_prio(queue, QUEUE_PRIO_NORMAL, node, data);
+}
+
+/*
+ * Enqueue an item that will only be dequeued after all priority lanes have
+ * been drained; used for the sentinel.
+ */
+void
+queue_enqueue_last(queue_t *queue, tommy_node *node, void *data) {
 	assert(queue);
 	assert(node);
 	assert(data);
 
 	pthread_mutex_lock(&queue->mutex);
-	tommy_list_insert_tail(&queue->list, node, data);
+	tommy_list_insert_tail(&queue->last, node, data);
 	queue->size++;
 	pthread_mutex_unlock(&queue->mutex);
 	pthread_cond_signal(&queue->notempty);
 }
 
+/*
+ * Select the lane to dequeue from; must be called with the mutex held.
+ * Returns -1 if all lanes are empty.
+ */
+static int
+queue_select(queue_t *queue) {
+	int prio = -1;
+
+	for (int i = 0; i < QUEUE_PRIOS; i++) {
+		if (queue->lanesize[i] > 0) {
+			prio = i;
+			break;
+		}
+	}
+	if (prio == -1)
+		return -1;
+	for (int i = prio + 1; i < QUEUE_PRIOS; i++) {
+		if (queue->lanesize[i] > 0 &&
+		    queue->skipped[i] >= QUEUE_STARVE_LIMIT) {
+			prio = i;
+			break;
+		}
+	}
+	for (int i = prio + 1; i < QUEUE_PRIOS; i++) {
+		if (queue->lanesize[i] > 0)
+			queue->skipped[i]++;
+	}
+	queue->skipped[prio] = 0;
+	return prio;
+}
+
+/*
+ * Dequeue the next item, blocking until one is available.  The lane the
+ * item was dequeued from is returned in *prio, or -1 for items enqueued
+ * using queue_enqueue_last().
+ */
 void *
-queue_dequeue(queue_t *queue) {
+queue_dequeue_prio(queue_t *queue, int *prio) {
+	tommy_list *list;
 	void *data;
+	int lane;
 
 	assert(queue);
+	assert(prio);
 	pthread_mutex_lock(&queue->mutex);
-	while (tommy_list_empty(&queue->list)) {
+	while (queue->size == 0) {
 		pthread_cond_wait(&queue->notempty, &queue->mutex);
 	}
-	assert(!tommy_list_empty(&queue->list));
-	assert(queue->size > 0);
-	data = tommy_list_remove_existing(&queue->list,
-	                                  tommy_list_head(&queue->list));
+	lane = queue_select(queue);
+	if (lane == -1) {
+		list = &queue->last;
+	} else {
+		list = &queue->lane[lane];
+		queue->lanesize[lane]--;
+		queue->dequeued[lane]++;
+	}
+	assert(!tommy_list_empty(list));
+	data = tommy_list_remove_existing(list, tommy_list_head(list));
 	queue->size--;
 	pthread_mutex_unlock(&queue->mutex);
 	assert(data);
+	*prio = lane;
 	return data;
 }
 
+void *
+queue_dequeue(queue_t *queue) {
+	int prio;
+
+	return queue_dequeue_prio(queue, &prio);
+}
+
+/*
+ * Account for the time an item spent waiting in the queue.  Must only be
+ * called from the consumer thread.
+ */
+void
+queue_account_wait(queue_t *queue, int prio, uint64_t usec) {
+	assert(queue);
+
+	if (prio < 0 || prio >= QUEUE_PRIOS)
+		return;
+	queue->waittime[prio] += usec;
+	if (usec > queue->waitmax[prio])
+		queue->waitmax[prio] = usec;
+}
+
+/*
+ * Fill in per-lane statistics; st must point to QUEUE_PRIOS elements.
+ * Unlocked reads are fine here, the values are only used for reporting.
+ */
+void
+queue_lane_stats(queue_t *queue, queue_lane_stat_t *st) {
+	assert(queue);
+	assert(st);
+
+	for (int i = 0; i < QUEUE_PRIOS; i++) {
+		st[i].qsize = queue->lanesize[i];
+		st[i].dequeued = queue->dequeued[i];
+		st[i].waittime = queue->waittime[i];
+		st[i].waitmax = queue->waitmax[i];
+	}
+}
+
+const char *
+queue_prio_s(int prio) {
+	switch (prio) {
+	case QUEUE_PRIO_HIGH:
+		return "high";
+	case QUEUE_PRIO_NORMAL:
+		return "normal";
+	case QUEUE_PRIO_LOW:
+		return "low";
+	default:
+		return NULL;
+	}
+}
+
@@ -15,19 +15,45 @@
 
 #include "tommylist.h"
 
+#include <stdint.h>
 #include <pthread.h>
 
+#define QUEUE_PRIO_HIGH         0
+#define QUEUE_PRIO_NORMAL       1
+#define QUEUE_PRIO_LOW          2
+#define QUEUE_PRIOS             3
+
 typedef struct {
-	tommy_list      list;
+	tommy_list      lane[QUEUE_PRIOS];
+	tommy_list      last;
 	pthread_mutex_t mutex;
 	pthread_cond_t  notempty;
 	size_t          size;
+	size_t          lanesize[QUEUE_PRIOS];
+	unsigned int    skipped[QUEUE_PRIOS];
+	/* consumer-side accounting, written by the consumer thread only */
+	uint64_t        dequeued[QUEUE_PRIOS];
+	uint64_t        waittime[QUEUE_PRIOS];
+	uint64_t        waitmax[QUEUE_PRIOS];
 } queue_t;
 
+typedef struct {
+	uint32_t qsize;
+	uint64_t dequeued;
+	uint64_t waittime;      /* usec, cumulative */
+	uint64_t waitmax;       /* usec */
+} queue_lane_stat_t;
+
 void queue_init(queue_t *) NONNULL(1);
 void queue_destroy(queue_t *) NONNULL(1);
 void queue_enqueue(queue_t *, tommy_node *, void *) NONNULL(1,2,3);
+void queue_enqueue_prio(queue_t *, int, tommy_node *, void *) NONNULL(1,3,4);
+void queue_enqueue_last(queue_t *, tommy_node *, void *) NONNULL(1,2,3);
 void * queue_dequeue(queue_t *) NONNULL(1);
+void * queue_dequeue_prio(queue_t *, int *) NONNULL(1,2);
+void queue_account_wait(queue_t *, int, uint64_t) NONNULL(1);
+void queue_lane_stats(queue_t *, queue_lane_stat_t *) NONNULL(1,2);
+const char * queue_prio_s(int);
 #define queue_size(Q) (Q)->size
 
 #endif
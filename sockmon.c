@@ -10,20 +10,45 @@
 
 /*
  * Monitoring core for network sockets.
+ *
+ * With socket_aggregate_window set, repeated accepts and connects of the same
+ * subject image, protocol, peer address and service port are aggregated:
+ * the first occurrence is logged immediately, the repetitions within the
+ * window starting with it are folded into a single record carrying their
+ * count and the times of the first and last repetition, which is logged
+ * once the window has passed.  For connects, the service port is the peer
+ * port; for accepts, it is the local port, since the peer port of accepted
+ * connections is usually ephemeral.
+ *
+ * While degraded to DEGRADE_SOCKET, the same aggregation applies with a
+ * window of at least DEGRADE_WINDOW seconds, so that repetitions are still
+ * accounted for in the log.
  */
 
 #include "sockmon.h"
 
 #include "work.h"
+#include "degrade.h"
+#include "strpool.h"
+#include "time.h"
+#include "tommyhash.h"
+#include "tommyhashdyn.h"
+#include "tommylist.h"
 #include "atomic.h"
 
 #include <strings.h>
+#include <string.h>
 #include <assert.h>
 
 static config_t *config;
 
 static uint64_t events_recvd;   /* number of events received */
 static uint64_t events_procd;   /* number of events processed */
+static uint64_t events_coalesced; /* number of events aggregated while
+                                     * degraded */
+static uint64_t events_aggregated; /* number of events aggregated */
+static uint64_t summaries;      /* number of aggregate records logged */
+static uint64_t events_suppressed; /* number of events dropped early */
 static atomic64_t ooms;         /* counts events impaired due to OOM */
 
 setstr_t *suppress_socket_op_by_subject_ident;
@@ -60,29 +85,35 @@ socket_op_free(socket_op_t *so) {
  */
 static int
 socket_op_work(socket_op_t *so) {
-	if (so->subject_image_exec && image_exec_match_suppressions(
+	if (so->subject_image_exec && image_exec_suppressed(
 	                              so->subject_image_exec,
+	                              EISUPPRESS_SOCKET_OP,
 	                              suppress_socket_op_by_subject_ident,
 	                              suppress_socket_op_by_subject_path))
 		return -1;
 	return 0;
 }
 
-static void
-log_event_socket_op(struct timespec *tv,
-                    audit_proc_t *subject,
-                    int protocol, /* can be 0 (none) or -1 (raw) */
-                    ipaddr_t *sock_addr, uint16_t sock_port,
-                    ipaddr_t *peer_addr, uint16_t peer_port,
-                    uint64_t eventcode) {
+/*
+ * Build a socket op event, taking ownership of the reference to image.
+ */
+static socket_op_t *
+socket_op_build(struct timespec *tv,
+                audit_proc_t *subject, image_exec_t *image,
+                int protocol, /* can be 0 (none) or -1 (raw) */
+                ipaddr_t *sock_addr, uint16_t sock_port,
+                ipaddr_t *peer_addr, uint16_t peer_port,
+                uint64_t eventcode) {
 	socket_op_t *so;
 
 	so = socket_op_new(eventcode);
 	if (!so) {
 		atomic64_inc(&ooms);
-		return;
+		if (image)
+			image_exec_free(image);
+		return NULL;
 	}
-	so->subject_image_exec = image_exec_by_pid(subject->pid, tv);
+	so->subject_image_exec = image;
 	so->subject = *subject;
 	/* can be 0 if unknown or -1 if raw */
 	so->protocol = protocol;
@@ -97,7 +128,182 @@ log_event_socket_op(struct timespec *tv,
 		so->peer_port = peer_port;
 	}
 	so->hdr.tv = *tv;
-	work_submit(so);
+	return so;
+}
+
+/*
+ * Aggregation table of recent accepts and connects, keyed by subject image
+ * path (interned, compared by pointer), eventcode, protocol, peer address and
+ * service port.  Entries are listed in order of creation, one list per window
+ * length, such that within each list, the windows end in list order.  List 0
+ * is for the configured window, list 1 for the longer DEGRADE_WINDOW.
+ */
+#define AGGREGATE_MAX   4096
+#define DEGRADE_WINDOW  60      /* seconds */
+typedef struct {
+	const char *path; /* strpool */
+	uint64_t eventcode;
+	int protocol;
+	uint16_t port;
+	ipaddr_t addr;
+} aggregate_key_t;
+typedef struct {
+	tommy_hashdyn_node h_node;
+	tommy_node l_node;
+	aggregate_key_t key;
+	time_t expiry;
+	tommy_list *list;
+	socket_op_t *so; /* aggregate record, NULL until first repetition */
+} aggregate_t;
+static tommy_hashdyn aggregates;
+static tommy_list aggregatelists[2];
+
+static int
+aggregate_cmp(const void *arg, const void *obj) {
+	const aggregate_key_t *key = arg;
+	const aggregate_t *agg = obj;
+	return memcmp(key, &agg->key, sizeof(aggregate_key_t));
+}
+
+/*
+ * Remove an aggregate and log its record, if any.  With log unset, the
+ * record is discarded instead.
+ */
+static void
+aggregate_remove(aggregate_t *agg, bool log) {
+	tommy_hashdyn_remove_existing(&aggregates, &agg->h_node);
+	tommy_list_remove_existing(agg->list, &agg->l_node);
+	if (agg->so) {
+		if (log) {
+			agg->so->hdr.tv = agg->so->last_tv;
+			summaries++;
+			work_submit(agg->so);
+		} else {
+			socket_op_free(agg->so);
+		}
+	}
+	strpool_unref(agg->key.path);
+	free(agg);
+}
+
+/*
+ * Returns the aggregate whose window ends first, or NULL if there are none.
+ */
+static aggregate_t *
+aggregate_oldest(void) {
+	aggregate_t *oldest = NULL, *agg;
+
+	for (size_t i = 0; i < 2; i++) {
+		if (tommy_list_empty(&aggregatelists[i]))
+			continue;
+		agg = tommy_list_head(&aggregatelists[i])->data;
+		if (!oldest || agg->expiry < oldest->expiry)
+			oldest = agg;
+	}
+	return oldest;
+}
+
+/*
+ * Returns true if the socket op was folded into an aggregate and must not be
+ * logged on its own; takes ownership of the reference to image in that case.
+ * The window applies to aggregates created by this call.
+ */
+static bool
+sockmon_aggregate(struct timespec *tv,
+                  audit_proc_t *subject, image_exec_t *image,
+                  int protocol,
+                  ipaddr_t *sock_addr, uint16_t sock_port,
+                  ipaddr_t *peer_addr, uint16_t peer_port,
+                  uint64_t eventcode, size_t window) {
+	aggregate_key_t key;
+	aggregate_t *agg;
+	tommy_hash_t h;
+
+	if (!image || !image->path || !peer_addr)
+		return false;
+
+	bzero(&key, sizeof(key));
+	key.path = image->path;
+	key.eventcode = eventcode;
+	key.protocol = protocol;
+	key.port = eventcode == LOGEVT_SOCKET_ACCEPT ? sock_port : peer_port;
+	key.addr = *peer_addr;
+	h = tommy_hash_u32(0, &key, sizeof(key));
+	agg = tommy_hashdyn_search(&aggregates, aggregate_cmp, &key, h);
+	if (agg && agg->expiry <= tv->tv_sec) {
+		aggregate_remove(agg, true);
+		agg = NULL;
+	}
+	if (!agg) {
+		if (tommy_hashdyn_count(&aggregates) >= AGGREGATE_MAX)
+			aggregate_remove(aggregate_oldest(), true);
+		agg = malloc(sizeof(aggregate_t));
+		if (!agg) {
+			atomic64_inc(&ooms);
+			return false;
+		}
+		agg->key = key;
+		strpool_ref(agg->key.path);
+		agg->expiry = tv->tv_sec + window;
+		agg->list = &aggregatelists[window !=
+		                            config->socket_aggregate_window];
+		agg->so = NULL;
+		tommy_hashdyn_insert(&aggregates, &agg->h_node, agg, h);
+		tommy_list_insert_tail(agg->list, &agg->l_node, agg);
+		return false;
+	}
+
+	if (agg->so) {
+		agg->so->count++;
+		agg->so->last_tv = *tv;
+		image_exec_free(image);
+	} else {
+		agg->so = socket_op_build(tv, subject, image,
+		                          protocol, sock_addr, sock_port,
+		                          peer_addr, peer_port, eventcode);
+		if (agg->so) {
+			agg->so->count = 1;
+			agg->so->first_tv = *tv;
+			agg->so->last_tv = *tv;
+		}
+	}
+	events_aggregated++;
+	return true;
+}
+
+/*
+ * Log the aggregate records whose window has passed.  Called once per second
+ * while aggregation is enabled.
+ */
+void
+sockmon_expire(void) {
+	struct timespec now;
+	aggregate_t *agg;
+
+	if (timespec_nanotime(&now) == -1)
+		return;
+	for (size_t i = 0; i < 2; i++) {
+		while (!tommy_list_empty(&aggregatelists[i])) {
+			agg = tommy_list_head(&aggregatelists[i])->data;
+			if (agg->expiry > now.tv_sec)
+				break;
+			aggregate_remove(agg, true);
+		}
+	}
+}
+
+/*
+ * Log all pending aggregate records regardless of their window.  Called at
+ * shutdown while the work queue is still accepting work.
+ */
+void
+sockmon_flush(void) {
+	aggregate_t *agg;
+
+	if (!config)
+		return;
+	while ((agg = aggregate_oldest()))
+		aggregate_remove(agg, true);
 }
 
 static void
@@ -107,6 +313,11 @@ sockmon_socket_op(struct timespec *tv,
                   ipaddr_t *sock_addr /* can be NULL */ , uint16_t sock_port,
                   ipaddr_t *peer_addr /* can be NULL */, uint16_t peer_port,
                   uint64_t eventcode) {
+	image_exec_t *image;
+	socket_op_t *so;
+	size_t window;
+	bool degraded;
+
 	events_recvd++;
 	if (config->suppress_socket_op_localhost) {
 		if (peer_addr) {
@@ -117,9 +328,34 @@ sockmon_socket_op(struct timespec *tv,
 				return;
 		}
 	}
+	image = image_exec_by_pid(subject->pid, tv);
+	if (image && image_exec_suppressed_cached(image,
+	                                          EISUPPRESS_SOCKET_OP)) {
+		/* known to be suppressed, skip allocation and queueing */
+		image_exec_free(image);
+		events_suppressed++;
+		return;
+	}
+	/* while degraded, aggregate for at least DEGRADE_WINDOW seconds */
+	window = config->socket_aggregate_window;
+	degraded = degrade_level() >= DEGRADE_SOCKET;
+	if (degraded && window < DEGRADE_WINDOW)
+		window = DEGRADE_WINDOW;
+	if (window > 0 &&
+	    eventcode != LOGEVT_SOCKET_LISTEN &&
+	    sockmon_aggregate(tv, subject, image, protocol,
+	                      sock_addr, sock_port, peer_addr, peer_port,
+	                      eventcode, window)) {
+		if (degraded)
+			events_coalesced++;
+		return;
+	}
 	events_procd++;
-	log_event_socket_op(tv, subject, protocol, sock_addr, sock_port,
-	                    peer_addr, peer_port, eventcode);
+	so = socket_op_build(tv, subject, image, protocol,
+	                     sock_addr, sock_port, peer_addr, peer_port,
+	                     eventcode);
+	if (so)
+		work_submit(so);
 }
 
 /*
@@ -240,6 +476,13 @@ sockmon_init(config_t *cfg) {
 	ooms = 0;
 	events_recvd = 0;
 	events_procd = 0;
+	events_coalesced = 0;
+	events_aggregated = 0;
+	summaries = 0;
+	events_suppressed = 0;
+	tommy_hashdyn_init(&aggregates);
+	tommy_list_init(&aggregatelists[0]);
+	tommy_list_init(&aggregatelists[1]);
 	suppress_socket_op_by_subject_ident =
 		&cfg->suppress_socket_op_by_subject_ident;
 	suppress_socket_op_by_subject_path =
@@ -248,8 +491,14 @@ sockmon_init(config_t *cfg) {
 
 void
 sockmon_fini(void) {
+	aggregate_t *agg;
+
 	if (!config)
 		return;
+	/* sockmon_flush() has logged pending records, discard leftovers */
+	while ((agg = aggregate_oldest()))
+		aggregate_remove(agg, false);
+	tommy_hashdyn_done(&aggregates);
 	config = NULL;
 }
 
@@ -259,6 +508,11 @@ sockmon_stats(sockmon_stat_t *st) {
 
 	st->recvd = events_recvd;
 	st->procd = events_procd;
+	st->coalesced = events_coalesced;
+	st->aggregated = events_aggregated;
+	st->summaries = summaries;
+	st->suppressed = events_suppressed;
+	st->aggregates = tommy_hashdyn_count(&aggregates);
 	st->ooms = (uint64_t)ooms;
 }
 
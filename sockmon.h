@@ -25,6 +25,11 @@
 typedef struct {
 	uint64_t recvd;
 	uint64_t procd;
+	uint64_t coalesced;
+	uint64_t aggregated;
+	uint64_t summaries;
+	uint64_t suppressed;
+	uint32_t aggregates;
 	uint64_t ooms;
 } sockmon_stat_t;
 
@@ -37,6 +42,10 @@ typedef struct {
 	uint16_t sock_port;
 	ipaddr_t peer_addr; /* unused for listen */
 	uint16_t peer_port; /* unused for listen */
+	/* aggregated repetitions, 0 for regular socket ops */
+	uint64_t count;
+	struct timespec first_tv;
+	struct timespec last_tv;
 } socket_op_t;
 #define socket_listen_t     socket_op_t
 #define socket_accept_t     socket_op_t
@@ -57,6 +66,9 @@ void sockmon_connect(struct timespec *, audit_proc_t *, int,
                      ipaddr_t *, uint16_t)
      NONNULL(1,2,4);
 
+void sockmon_expire(void);
+void sockmon_flush(void);
+
 void sockmon_init(config_t *) NONNULL(1);
 void sockmon_fini(void);
 void sockmon_stats(sockmon_stat_t *) NONNULL(1);
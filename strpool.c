@@ -0,0 +1,187 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Pool of interned, immutable, reference counted strings.
+ *
+ * The same paths, working directories and code signing identities are held
+ * by many processes, file descriptors and images at the same time.  Instead
+ * of each owning a private copy, they share a single instance from the pool
+ * and release it with strpool_unref() instead of free().
+ *
+ * The pool is initialized on first use, so that it is available to the
+ * auxiliary tools without setup.  Thread-safe.
+ */
+
+#include "strpool.h"
+
+#include "tommyhashdyn.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+typedef struct {
+	tommy_hashdyn_node node;
+	size_t refs;
+	size_t len;
+	char str[];
+} strpool_obj_t;
+
+#define STRPOOL_OBJ(S) \
+	((strpool_obj_t *)((uintptr_t)(S) - offsetof(strpool_obj_t, str)))
+
+static tommy_hashdyn pool;
+static bool initialized = false;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t refs;
+static uint64_t bytes;
+static uint64_t refbytes;
+static uint64_t allocs;
+static uint64_t hits;
+
+static int
+strpool_obj_cmp(const void *str, const void *obj) {
+	return strcmp(((const strpool_obj_t *)obj)->str, str);
+}
+
+/*
+ * Returns a reference to the pooled instance of str, or NULL if out of memory.
+ * Must be called with mutex held.
+ */
+static const char *
+strpool_get(const char *str) {
+	strpool_obj_t *obj;
+	tommy_hash_t h;
+	size_t len;
+
+	if (!initialized) {
+		tommy_hashdyn_init(&pool);
+		initialized = true;
+	}
+
+	len = strlen(str);
+	h = tommy_hash_u32(0, str, len);
+	obj = tommy_hashdyn_search(&pool, strpool_obj_cmp, str, h);
+	if (obj) {
+		hits++;
+	} else {
+		obj = malloc(sizeof(strpool_obj_t) + len + 1);
+		if (!obj)
+			return NULL;
+		obj->refs = 0;
+		obj->len = len;
+		memcpy(obj->str, str, len + 1);
+		tommy_hashdyn_insert(&pool, &obj->node, obj, h);
+		allocs++;
+		bytes += len + 1;
+	}
+	obj->refs++;
+	refs++;
+	refbytes += len + 1;
+	return obj->str;
+}
+
+/*
+ * Intern a copy of str.  Returns NULL if out of memory.
+ */
+const char *
+strpool_intern(const char *str) {
+	const char *s;
+
+	pthread_mutex_lock(&mutex);
+	s = strpool_get(str);
+	pthread_mutex_unlock(&mutex);
+	return s;
+}
+
+/*
+ * Intern str and free it.  Returns NULL if out of memory; str is freed in
+ * any case.
+ */
+const char *
+strpool_adopt(char *str) {
+	const char *s;
+
+	s = strpool_intern(str);
+	free(str);
+	return s;
+}
+
+/*
+ * Take another reference to a string obtained from the pool.
+ */
+const char *
+strpool_ref(const char *str) {
+	strpool_obj_t *obj = STRPOOL_OBJ(str);
+
+	pthread_mutex_lock(&mutex);
+	assert(obj->refs > 0);
+	obj->refs++;
+	refs++;
+	refbytes += obj->len + 1;
+	hits++;
+	pthread_mutex_unlock(&mutex);
+	return str;
+}
+
+/*
+ * Release a reference to a string obtained from the pool.
+ */
+void
+strpool_unref(const char *str) {
+	strpool_obj_t *obj = STRPOOL_OBJ(str);
+
+	pthread_mutex_lock(&mutex);
+	assert(obj->refs > 0);
+	refs--;
+	refbytes -= obj->len + 1;
+	if (--obj->refs == 0) {
+		tommy_hashdyn_remove_existing(&pool, &obj->node);
+		bytes -= obj->len + 1;
+		free(obj);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Free all strings still in the pool.
+ */
+void
+strpool_fini(void) {
+	pthread_mutex_lock(&mutex);
+	if (initialized) {
+		tommy_hashdyn_foreach(&pool, free);
+		tommy_hashdyn_done(&pool);
+		initialized = false;
+	}
+	refs = 0;
+	bytes = 0;
+	refbytes = 0;
+	allocs = 0;
+	hits = 0;
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+strpool_stats(strpool_stat_t *st) {
+	pthread_mutex_lock(&mutex);
+	st->strings = initialized ? tommy_hashdyn_count(&pool) : 0;
+	st->refs = refs;
+	st->bytes = bytes;
+	st->refbytes = refbytes;
+	st->allocs = allocs;
+	st->hits = hits;
+	pthread_mutex_unlock(&mutex);
+}
+
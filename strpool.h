@@ -0,0 +1,35 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef STRPOOL_H
+#define STRPOOL_H
+
+#include "attrib.h"
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t strings;       /* unique strings in pool */
+	uint64_t refs;          /* references to strings in pool */
+	uint64_t bytes;         /* bytes held by strings in pool */
+	uint64_t refbytes;      /* bytes that private copies would hold */
+	uint64_t allocs;        /* strings allocated */
+	uint64_t hits;          /* allocations avoided */
+} strpool_stat_t;
+
+const char * strpool_intern(const char *) NONNULL(1) WUNRES;
+const char * strpool_adopt(char *) NONNULL(1) WUNRES;
+const char * strpool_ref(const char *) NONNULL(1);
+void strpool_unref(const char *) NONNULL(1);
+void strpool_fini(void);
+void strpool_stats(strpool_stat_t *) NONNULL(1);
+
+#endif
+
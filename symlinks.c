@@ -0,0 +1,357 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Graph of symlinks relevant to file monitoring.
+ *
+ * Every path is interned as a single node in a hash table, and symlinks point
+ * to the node of their target.  Chains are resolved incrementally:  when a
+ * symlink is added, only its own target is read, and resolution stops at the
+ * first node whose chain is already known.  Link and unlink events keep the
+ * known chains up to date, so that symlink farms sharing intermediate links
+ * do not cause the same symlinks to be read over and over again.
+ *
+ * Not thread-safe; only used from the event loop thread.
+ */
+
+#include "symlinks.h"
+
+#include "cachedir.h"
+#include "sys.h"
+#include "tommyhashdyn.h"
+#include "tommylist.h"
+#include "minmax.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define SYMLINKS_CHAIN_MAX      32      /* as MAXSYMLINKS */
+
+typedef struct symlinks_obj {
+	tommy_hashdyn_node h_node;
+	tommy_node l_node;
+
+	/*
+	 * Object is in one of three states at all times:
+	 * a) is_regular_file == false, target == NULL, in symlinks_dangling
+	 * b) is_regular_file == false, target != NULL, in target->origins
+	 * c) is_regular_file == true, target == NULL, not in any list
+	 */
+	bool is_regular_file;
+	tommy_list origins;
+	struct symlinks_obj *target;
+
+	char path[];
+} symlinks_obj_t;
+
+static tommy_hashdyn symlinks;
+static tommy_list symlinks_dangling; /* subset of symlinks */
+static uint64_t readlinks;
+static uint64_t bytes;
+
+static symlinks_obj_t *
+symlinks_obj_new(const char *path) {
+	symlinks_obj_t *obj;
+	size_t sz;
+
+	sz = strlen(path) + 1;
+	obj = malloc(sizeof(symlinks_obj_t) + sz);
+	if (!obj)
+		return NULL;
+	bzero(obj, sizeof(symlinks_obj_t));
+	memcpy(obj->path, path, sz);
+	tommy_list_init(&obj->origins);
+	bytes += sizeof(symlinks_obj_t) + sz;
+	return obj;
+}
+
+static void
+symlinks_obj_free(void *arg) {
+	symlinks_obj_t *obj = arg;
+
+	bytes -= sizeof(symlinks_obj_t) + strlen(obj->path) + 1;
+	free(obj);
+}
+
+static int
+symlinks_obj_cmp(const void *path, const void* obj) {
+	return strcmp(((const symlinks_obj_t*)obj)->path, path);
+}
+
+void
+symlinks_init(void) {
+	tommy_hashdyn_init(&symlinks);
+	tommy_list_init(&symlinks_dangling);
+	readlinks = 0;
+	bytes = 0;
+}
+
+void
+symlinks_fini(void) {
+	tommy_hashdyn_foreach(&symlinks, symlinks_obj_free);
+	tommy_hashdyn_done(&symlinks);
+}
+
+static symlinks_obj_t *
+symlinks_path_find(const char *path) {
+	return tommy_hashdyn_search(&symlinks, symlinks_obj_cmp, path,
+	                            tommy_strhash_u32(0, path));
+}
+
+bool
+symlinks_is_relevant(const char *path) {
+	return (bool)symlinks_path_find(path);
+}
+
+/*
+ * If origin != NULL, indicates the origin that is being removed and therefore
+ * wants to unreference obj.  If origin == NULL, this is a direct unlink from
+ * an event.
+ */
+static void
+symlinks_obj_unref(symlinks_obj_t *obj, symlinks_obj_t *origin) {
+	if (origin) {
+		origin->target = NULL;
+		tommy_list_remove_existing(&obj->origins, &origin->l_node);
+		tommy_list_insert_head(&symlinks_dangling,
+		                       &origin->l_node, origin);
+	}
+	if (!tommy_list_empty(&obj->origins))
+		return;
+
+	/* this node needs to be removed, no origins point to this anymore */
+	if (obj->target) {
+		symlinks_obj_unref(obj->target, obj);
+	}
+	tommy_hashdyn_remove_existing(&symlinks, &obj->h_node);
+	if (!obj->is_regular_file) {
+		tommy_list_remove_existing(&symlinks_dangling, &obj->l_node);
+	}
+	symlinks_obj_free(obj);
+}
+
+/*
+ * Forget what obj points to and return it to the dangling state.  Frees obj
+ * if it was only kept alive by a cycle back to itself.
+ */
+static void
+symlinks_obj_detach(symlinks_obj_t *obj) {
+	if (obj->target) {
+		symlinks_obj_unref(obj->target, obj);
+	} else if (obj->is_regular_file) {
+		obj->is_regular_file = false;
+		tommy_list_insert_head(&symlinks_dangling, &obj->l_node, obj);
+	}
+}
+
+/*
+ * Copies path.  Returns NULL if out of memory.
+ */
+static symlinks_obj_t *
+symlinks_path_add(const char *path, symlinks_obj_t *origin) {
+	symlinks_obj_t *obj;
+
+	tommy_hash_t h;
+	h = tommy_strhash_u32(0, path);
+	obj = tommy_hashdyn_search(&symlinks, symlinks_obj_cmp, path, h);
+	if (!obj) {
+		obj = symlinks_obj_new(path);
+		if (!obj)
+			return NULL;
+		tommy_hashdyn_insert(&symlinks, &obj->h_node, obj, h);
+		tommy_list_insert_head(&symlinks_dangling, &obj->l_node, obj);
+	}
+	assert(obj);
+	if (origin && (origin->target == NULL)) {
+		origin->target = obj;
+		if (origin->is_regular_file) {
+			origin->is_regular_file = false;
+		} else {
+			tommy_list_remove_existing(&symlinks_dangling,
+			                           &origin->l_node);
+		}
+		tommy_list_insert_head(&obj->origins, &origin->l_node, origin);
+	}
+	return obj;
+}
+
+/*
+ * Read the target of symlink path into buf, made absolute relative to the
+ * directory of path, without allocating.  Returns -1 if path is not a symlink
+ * or cannot be read.
+ */
+static int
+symlinks_readlink(char *buf, size_t sz, const char *path) {
+	char tmp[PATH_MAX];
+	const char *sep;
+	ssize_t n;
+	int rv;
+
+	assert(path[0] == '/');
+
+	/* readlink does not append a NUL character, PATH_MAX includes NUL */
+	n = readlink(path, tmp, sizeof(tmp) - 1);
+	if (n == -1)
+		return -1;
+	readlinks++;
+	tmp[n] = '\0';
+	sys_strip_path_noop(tmp);
+
+	if (tmp[0] == '/') {
+		rv = snprintf(buf, sz, "%s", tmp);
+	} else {
+		sep = strrchr(path, '/');
+		assert(sep);
+		rv = snprintf(buf, sz, "%.*s/%s", (int)(sep - path), path, tmp);
+	}
+	if (rv < 0 || (size_t)rv >= sz) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Add the symlink at path and resolve the chain of its targets, stopping at
+ * the first node whose chain is already known.  Returns the node for path or
+ * NULL if out of memory.
+ */
+static symlinks_obj_t *
+symlinks_walk_obj(const char *path) {
+	char target[PATH_MAX];
+	symlinks_obj_t *obj, *root, *next;
+	char *rtarget;
+	bool known, resolved;
+
+	/* a new symlink at path supersedes what was known about path */
+	obj = symlinks_path_find(path);
+	if (obj)
+		symlinks_obj_detach(obj);
+	root = obj = symlinks_path_add(path, NULL);
+	if (!root)
+		return NULL;
+
+	for (size_t i = 0; i < SYMLINKS_CHAIN_MAX; i++) {
+		if (symlinks_readlink(target, sizeof(target), obj->path) == -1)
+			break;
+		rtarget = cachedir_realdir(target, "/");
+		resolved = !!rtarget;
+		next = symlinks_path_find(resolved ? rtarget : target);
+		known = next && (next->target || next->is_regular_file);
+		/* if the directory part does not exist, add unresolved */
+		next = symlinks_path_add(resolved ? rtarget : target, obj);
+		if (resolved)
+			free(rtarget);
+		if (!next)
+			return root;
+		obj = next;
+		if (known || !resolved)
+			break;
+	}
+
+	if (!obj->is_regular_file && !obj->target &&
+	    sys_islnk(obj->path) != 1) {
+		tommy_list_remove_existing(&symlinks_dangling, &obj->l_node);
+		obj->is_regular_file = true;
+	}
+	return root;
+}
+
+/*
+ * Add the symlink at path to the graph.  Returns -1 if out of memory.
+ */
+int
+symlinks_add(const char *path) {
+	return symlinks_walk_obj(path) ? 0 : -1;
+}
+
+/*
+ * Add the symlink at path to the graph and return a newly allocated copy of
+ * the path of the outermost symlink pointing to it, for logging.  Returns NULL
+ * if out of memory.
+ */
+char *
+symlinks_walk(const char *path) {
+	symlinks_obj_t *root;
+
+	root = symlinks_walk_obj(path);
+	if (!root)
+		return NULL;
+	for (size_t i = 0; i < SYMLINKS_CHAIN_MAX &&
+	                   !tommy_list_empty(&root->origins); i++) {
+		root = tommy_list_head(&root->origins)->data;
+	}
+	return strdup(root->path);
+}
+
+/*
+ * Retry resolving up to n dangling symlinks, the targets of which may have
+ * come into existence in the meantime.
+ */
+void
+symlinks_walk_dangling(size_t n) {
+	symlinks_obj_t *obj;
+	tommy_node *dsl;
+	size_t i;
+
+	n = min(tommy_list_count(&symlinks_dangling), n);
+	if (n == 0)
+		return;
+	/* walking one node can attach targets to other collected nodes and
+	 * then free nodes on detach, so collect paths instead of nodes */
+	char *paths[n];
+	dsl = tommy_list_head(&symlinks_dangling);
+	for (i = 0; dsl && i < n; i++) {
+		obj = dsl->data;
+		paths[i] = strdup(obj->path);
+		if (!paths[i])
+			break;
+		dsl = dsl->next;
+	}
+	n = i;
+	for (i = 0; i < n; i++) {
+		obj = symlinks_path_find(paths[i]);
+		if (obj && !obj->target && !obj->is_regular_file)
+			(void)symlinks_walk_obj(paths[i]);
+		free(paths[i]);
+	}
+}
+
+/*
+ * Called when the symlink at path was unlinked.  Nodes still pointed to by
+ * other symlinks stay in the graph as dangling.
+ */
+void
+symlinks_remove(const char *path) {
+	symlinks_obj_t *obj;
+
+	obj = symlinks_path_find(path);
+	if (!obj)
+		return;
+	if (tommy_list_empty(&obj->origins)) {
+		symlinks_obj_unref(obj, NULL);
+		return;
+	}
+	symlinks_obj_detach(obj);
+}
+
+void
+symlinks_stats(symlinks_stat_t *st) {
+	st->nodes = tommy_hashdyn_count(&symlinks);
+	st->dangling = tommy_list_count(&symlinks_dangling);
+	st->readlinks = readlinks;
+	st->bytes = bytes;
+}
+
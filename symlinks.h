@@ -0,0 +1,37 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef SYMLINKS_H
+#define SYMLINKS_H
+
+#include "attrib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	uint32_t nodes;         /* paths in the graph */
+	uint32_t dangling;      /* symlinks with unresolved target */
+	uint64_t readlinks;     /* symlinks read */
+	uint64_t bytes;         /* memory held by nodes */
+} symlinks_stat_t;
+
+void symlinks_init(void);
+void symlinks_fini(void);
+bool symlinks_is_relevant(const char *) NONNULL(1) WUNRES;
+int symlinks_add(const char *) NONNULL(1) WUNRES;
+char * symlinks_walk(const char *) NONNULL(1) MALLOC;
+void symlinks_walk_dangling(size_t);
+void symlinks_remove(const char *) NONNULL(1);
+void symlinks_stats(symlinks_stat_t *) NONNULL(1);
+
+#endif
+
@@ -0,0 +1,97 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Flood xnumon with execs right before a process access, so that the
+ * process-access event is queued behind the image-exec work of its object.
+ * The object image must nevertheless be fully acquired when logged.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+
+#include "path.h"
+
+#define PATH TESTDIR"/true.dep"
+#define ARGV0 "true.dep"
+#define FLOOD_PATH "/usr/bin/true"
+#define FLOOD_COUNT 256
+
+int
+main(int argc, char *argv[]) {
+	int rv;
+	pid_t pid, fpid;
+	char *av[] = {ARGV0, NULL};
+	char *fav[] = {"true", NULL};
+	char *ev[] = {NULL};
+	posix_spawnattr_t attr;
+	int i, n;
+
+	printf("spec:testcase returncode=0\n");
+	fflush(stdout);
+
+	n = 0;
+	for (i = 0; i < FLOOD_COUNT; i++) {
+		rv = posix_spawn(&fpid, FLOOD_PATH, NULL, NULL, fav, ev);
+		if (rv != 0) {
+			errno = rv;
+			perror("spawn(flood)");
+			break;
+		}
+		n++;
+	}
+
+	rv = posix_spawnattr_init(&attr);
+	if (rv != 0) {
+		errno = rv;
+		perror("posix_spawnattr_init");
+	}
+	rv = posix_spawnattr_setflags(&attr, POSIX_SPAWN_START_SUSPENDED);
+	if (rv != 0) {
+		errno = rv;
+		perror("posix_spawnattr_setflags");
+	}
+	rv = posix_spawn(&pid, PATH, NULL, &attr, av, ev);
+	if (rv != 0) {
+		errno = rv;
+		perror("spawn");
+		return 1;
+	}
+
+	printf("spec:process-access "
+	       "subject.pid=%i "
+	       "subject.image.path=%s "
+	       "subject.image.sha256=* "
+	       "object.pid=%i "
+	       "object.image.path="PATH" "
+	       "method=ptrace "
+	       "\n",
+	       getpid(), getpath(), pid);
+
+	if (ptrace(PT_ATTACHEXC, pid, NULL, 0) == -1) {
+		perror("ptrace(PT_ATTACHEXC)");
+		kill(pid, SIGCONT);
+		return 1;
+	}
+	sleep(1);
+	/* see ptrace.c for why we do not detach properly */
+	kill(pid, SIGCONT);
+	kill(pid, SIGKILL);
+	while (n > 0 && wait(NULL) != -1)
+		n--;
+	return 0;
+}
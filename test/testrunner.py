@@ -179,6 +179,8 @@ class Specs:
             'socket-listen':  5,
             'socket-accept':  6,
             'socket-connect': 7,
+            'image-codesign': 8,
+            'image-exec-summary': 9,
         }
         def __init__(self, spec):
             parts = spec.strip().split(' ')
@@ -14,16 +14,26 @@
  */
 
 #include "hashes.h"
+#include "hashio.h"
 #include "codesign.h"
 #include "cachehash.h"
 #include "cachecsig.h"
+#include "cachedir.h"
+#include "symlinks.h"
+#include "procmon.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <time.h>
+#include <pthread.h>
 
 #ifndef __BSD__
 #include <getopt.h>
@@ -119,7 +129,7 @@ timeit_cachecsig_get(void) {
 
 	cs = codesign_new("/usr/bin/iotop", -1);
 	memset(&h, 0x7F, sizeof(hashes_t));
-	cachecsig_init();
+	cachecsig_init(HASH_SHA256);
 	cachecsig_put(&h, cs);
 	codesign_free(cs);
 	TIMEIT_START;
@@ -138,7 +148,7 @@ timeit_cachecsig_put(void) {
 
 	cs = codesign_new("/usr/bin/iotop", -1);
 	memset(&h, 0x7F, sizeof(hashes_t));
-	cachecsig_init();
+	cachecsig_init(HASH_SHA256);
 	TIMEIT_START;
 	cachecsig_put(&h, cs);
 	TIMEIT_STOP;
@@ -159,11 +169,278 @@ timeit_average(size_t n, timeit_func func) {
 	return total / n;
 }
 
+#define BENCH_FILES_MAX 256
+
+/*
+ * Hashing throughput against the number of reads in flight, on cold page
+ * cache, for up to BENCH_FILES_MAX regular files in dir.
+ */
+static void
+bench_hashio(const char *dir) {
+	static char *paths[BENCH_FILES_MAX];
+	static hashio_file_t files[BENCH_FILES_MAX];
+	struct timespec t0, t1;
+	struct dirent *de;
+	size_t n = 0;
+	off_t bytes;
+	double secs;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d) {
+		fprintf(stderr, "opendir(%s): %s (%i)\n",
+		        dir, strerror(errno), errno);
+		exit(EXIT_FAILURE);
+	}
+	while ((de = readdir(d)) && n < BENCH_FILES_MAX) {
+		if (de->d_type != DT_REG)
+			continue;
+		if (asprintf(&paths[n], "%s/%s", dir, de->d_name) == -1) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		n++;
+	}
+	closedir(d);
+
+	printf("depth    files        bytes      secs       MB/s\n");
+	for (size_t depth = 1; depth <= HASHIO_DEPTH_MAX; depth *= 2) {
+		purge();
+		for (size_t i = 0; i < n; i++)
+			files[i].fd = open(paths[i], O_RDONLY);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (hashio_hash(files, n, HASH_SHA256, depth) == -1) {
+			fprintf(stderr, "hashio_hash(): %s (%i)\n",
+			        strerror(errno), errno);
+			exit(EXIT_FAILURE);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		bytes = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (files[i].fd != -1)
+				close(files[i].fd);
+			if (files[i].rv == 0)
+				bytes += files[i].size;
+		}
+		secs = (double)(t1.tv_sec - t0.tv_sec) +
+		       (double)(t1.tv_nsec - t0.tv_nsec) / 1000000000;
+		printf("%5zu %8zu %12lld %9f %10f\n", depth, n,
+		       (long long)bytes, secs, (double)bytes / secs / 1000000);
+	}
+
+	for (size_t i = 0; i < n; i++)
+		free(paths[i]);
+	hashio_thread_fini();
+}
+
+#define BENCH_FARM_TARGETS       1000
+#define BENCH_FARM_LINKS         100000
+#define BENCH_FARM_RELINKS       10000
+
+static double
+bench_elapsed(struct timespec *t0, struct timespec *t1) {
+	return (double)(t1->tv_sec - t0->tv_sec) +
+	       (double)(t1->tv_nsec - t0->tv_nsec) / 1000000000;
+}
+
+static void
+bench_symlinks_pass(const char *label, const char *dir,
+                    size_t first, size_t count) {
+	char path[PATH_MAX];
+	struct timespec t0, t1;
+	symlinks_stat_t st0, st1;
+
+	symlinks_stats(&st0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t i = first; i < first + count; i++) {
+		snprintf(path, sizeof(path), "%s/bin/l%zu", dir, i);
+		if (symlinks_add(path) == -1) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	symlinks_stats(&st1);
+	printf("%-10s %8zu %9f %10"PRIu64" %8"PRIu32" %8"PRIu32"\n",
+	       label, count, bench_elapsed(&t0, &t1),
+	       st1.readlinks - st0.readlinks, st1.nodes, st1.dangling);
+}
+
+/*
+ * Symlink graph maintenance on a synthetic symlink farm in the empty or
+ * nonexistent directory dir: BENCH_FARM_LINKS symlinks in bin/ point to
+ * BENCH_FARM_TARGETS symlinks in opt/, which point to regular files in
+ * store/, as in package manager prefixes.
+ */
+static void
+bench_symlinks(const char *dir) {
+	char path[PATH_MAX], target[PATH_MAX];
+	int fd;
+
+	if ((mkdir(dir, 0755) == -1 && errno != EEXIST) ||
+	    snprintf(path, sizeof(path), "%s/store", dir) < 0 ||
+	    mkdir(path, 0755) == -1 ||
+	    snprintf(path, sizeof(path), "%s/opt", dir) < 0 ||
+	    mkdir(path, 0755) == -1 ||
+	    snprintf(path, sizeof(path), "%s/bin", dir) < 0 ||
+	    mkdir(path, 0755) == -1) {
+		fprintf(stderr, "mkdir(%s): %s (%i)\n",
+		        path, strerror(errno), errno);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < BENCH_FARM_TARGETS; i++) {
+		snprintf(path, sizeof(path), "%s/store/f%zu", dir, i);
+		fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		if (fd == -1) {
+			fprintf(stderr, "open(%s): %s (%i)\n",
+			        path, strerror(errno), errno);
+			exit(EXIT_FAILURE);
+		}
+		close(fd);
+		snprintf(path, sizeof(path), "%s/opt/p%zu", dir, i);
+		snprintf(target, sizeof(target), "../store/f%zu", i);
+		if (symlink(target, path) == -1)
+			goto errout;
+	}
+	for (size_t i = 0; i < BENCH_FARM_LINKS; i++) {
+		snprintf(path, sizeof(path), "%s/bin/l%zu", dir, i);
+		snprintf(target, sizeof(target), "../opt/p%zu",
+		         i % BENCH_FARM_TARGETS);
+		if (symlink(target, path) == -1)
+			goto errout;
+	}
+
+	cachedir_init();
+	symlinks_init();
+	printf("pass          links      secs  readlinks    nodes dangling\n");
+	bench_symlinks_pass("add", dir, 0, BENCH_FARM_LINKS);
+	bench_symlinks_pass("re-add", dir, 0, BENCH_FARM_LINKS);
+	for (size_t i = 0; i < BENCH_FARM_RELINKS; i++) {
+		snprintf(path, sizeof(path), "%s/bin/l%zu", dir, i);
+		symlinks_remove(path);
+	}
+	bench_symlinks_pass("relink", dir, 0, BENCH_FARM_RELINKS);
+	symlinks_fini();
+	cachedir_fini();
+	return;
+errout:
+	fprintf(stderr, "symlink(%s): %s (%i)\n",
+	        path, strerror(errno), errno);
+	exit(EXIT_FAILURE);
+}
+
+#define BENCH_REFS_OPS          10000000
+#define BENCH_REFS_THREADS      8
+#define BENCH_WALK_CHAINS       10000
+#define BENCH_WALK_DEPTH        64
+#define BENCH_WALK_PASSES       10
+
+static image_exec_t *bench_image;
+
+static void *
+bench_refs_thread(void *arg) {
+	size_t n = *(size_t *)arg;
+
+	for (size_t i = 0; i < n; i++) {
+		image_exec_ref(bench_image);
+		image_exec_free(bench_image);
+	}
+	return NULL;
+}
+
+static image_exec_t *
+bench_image_new(void) {
+	image_exec_t *image;
+
+	if (posix_memalign((void **)&image, 64, sizeof(image_exec_t)) != 0) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	bzero(image, sizeof(image_exec_t));
+	image->refs = 1;
+	return image;
+}
+
+/*
+ * Reference counting throughput on a single image shared between threads,
+ * as ancestors are between the event loop, worker and logger threads, and
+ * walks along chains of ancestors allocated interleaved with each other, as
+ * in a long-running process table.
+ */
+static void
+bench_refs(void) {
+	pthread_t thr[BENCH_REFS_THREADS];
+	image_exec_t *leaves[BENCH_WALK_CHAINS];
+	image_exec_t *image, *pie;
+	struct timespec t0, t1;
+	volatile uint64_t sink = 0;
+	size_t n;
+	double secs;
+
+	/* the benchmark holds a reference, refs never drop to zero */
+	bench_image = bench_image_new();
+	printf("threads  ref+unref      secs    ns/op\n");
+	for (size_t nthr = 1; nthr <= BENCH_REFS_THREADS; nthr *= 2) {
+		n = BENCH_REFS_OPS / nthr;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (size_t i = 0; i < nthr; i++) {
+			if (pthread_create(&thr[i], NULL,
+			                   bench_refs_thread, &n) != 0) {
+				fprintf(stderr, "Failed to create thread\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		for (size_t i = 0; i < nthr; i++)
+			pthread_join(thr[i], NULL);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		secs = bench_elapsed(&t0, &t1);
+		printf("%7zu %10zu %9f %8.2f\n", nthr, n * nthr, secs,
+		       secs * 1000000000 / (double)(n * nthr));
+	}
+	free(bench_image);
+
+	for (size_t i = 0; i < BENCH_WALK_CHAINS; i++)
+		leaves[i] = NULL;
+	for (size_t d = 0; d < BENCH_WALK_DEPTH; d++) {
+		for (size_t i = 0; i < BENCH_WALK_CHAINS; i++) {
+			image = bench_image_new();
+			image->pid = (pid_t)(d + 1);
+			image->prev = leaves[i];
+			leaves[i] = image;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t p = 0; p < BENCH_WALK_PASSES; p++) {
+		for (size_t i = 0; i < BENCH_WALK_CHAINS; i++) {
+			for (pie = leaves[i]; pie && pie->pid > 0;
+			     pie = pie->prev)
+				sink += (uint64_t)pie->pid + pie->flags;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = bench_elapsed(&t0, &t1);
+	n = BENCH_WALK_PASSES * BENCH_WALK_CHAINS * BENCH_WALK_DEPTH;
+	printf("walked %zu ancestors in %f secs, %.2f ns/ancestor, "
+	       "%zu bytes/image\n",
+	       n, secs, secs * 1000000000 / (double)n, sizeof(image_exec_t));
+	for (size_t i = 0; i < BENCH_WALK_CHAINS; i++) {
+		while (leaves[i]) {
+			image = leaves[i]->prev;
+			free(leaves[i]);
+			leaves[i] = image;
+		}
+	}
+	(void)sink;
+}
+
 static void
 fusage(FILE *f, const char *argv0) {
 	fprintf(f,
-"Usage: %s [-h]\n"
+"Usage: %s [-h] [-c dir] [-s dir] [-r]\n"
 " -h             print usage\n"
+" -c dir         benchmark hashing throughput against concurrency\n"
+" -s dir         benchmark symlink graph on a farm created in dir\n"
+" -r             benchmark image refcounting and ancestry walks\n"
 , argv0);
 }
 
@@ -172,11 +449,20 @@ main(int argc, char *argv[]) {
 	int ch;
 	const char *argv0 = argv[0];
 
-	while ((ch = getopt(argc, argv, "h")) != -1) {
+	while ((ch = getopt(argc, argv, "hc:s:r")) != -1) {
 		switch (ch) {
 			case 'h':
 				fusage(stdout, argv0);
 				exit(EXIT_SUCCESS);
+			case 'c':
+				bench_hashio(optarg);
+				exit(EXIT_SUCCESS);
+			case 's':
+				bench_symlinks(optarg);
+				exit(EXIT_SUCCESS);
+			case 'r':
+				bench_refs();
+				exit(EXIT_SUCCESS);
 			case '?':
 				exit(EXIT_FAILURE);
 			default:
@@ -236,6 +522,26 @@ main(int argc, char *argv[]) {
 	}
 	printf("\n");
 
+	printf("blake3          ");
+	for (int i = 0; i < 4; i++) {
+		path = paths[i];
+
+		hashes_flags = HASH_BLAKE3;
+		avg = timeit_average(10, timeit_hashes);
+		printf(" %f", avg);
+	}
+	printf("\n");
+
+	printf("xxh128          ");
+	for (int i = 0; i < 4; i++) {
+		path = paths[i];
+
+		hashes_flags = HASH_XXH128;
+		avg = timeit_average(10, timeit_hashes);
+		printf(" %f", avg);
+	}
+	printf("\n");
+
 	printf("md5+sha1        ");
 	for (int i = 0; i < 4; i++) {
 		path = paths[i];
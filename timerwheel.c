@@ -0,0 +1,137 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+/*
+ * Hierarchical timer wheel with TIMERWHEEL_LEVELS levels of TIMERWHEEL_SLOTS
+ * slots each, counting in abstract ticks.  Adding and removing timers is O(1);
+ * advancing by one tick touches a single slot on the lowest level, and once
+ * every TIMERWHEEL_SLOTS ticks redistributes a single slot of a higher level
+ * to the levels below.  Expiries further out than TIMERWHEEL_RANGE ticks are
+ * clamped.  Intended for large numbers of long-running timers which are
+ * mostly re-armed or removed before they expire.
+ *
+ * Not thread-safe.
+ */
+
+#include "timerwheel.h"
+
+#include <assert.h>
+
+/*
+ * Put timer into the slot matching its expiry relative to the current tick.
+ */
+static void
+timerwheel_place(timerwheel_t *tw, timerwheel_timer_t *timer) {
+	uint64_t delta;
+	size_t level, slot;
+
+	assert(timer->expiry >= tw->now);
+	delta = timer->expiry - tw->now;
+	for (level = 0; level < TIMERWHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << (TIMERWHEEL_BITS * (level + 1))))
+			break;
+	}
+	slot = (timer->expiry >> (TIMERWHEEL_BITS * level)) &
+	       (TIMERWHEEL_SLOTS - 1);
+	timer->list = &tw->slots[level][slot];
+	tommy_list_insert_tail(timer->list, &timer->node, timer->node.data);
+}
+
+void
+timerwheel_init(timerwheel_t *tw, uint64_t now) {
+	tw->now = now;
+	tw->cascades = 0;
+	for (size_t i = 0; i < TIMERWHEEL_LEVELS; i++) {
+		for (size_t j = 0; j < TIMERWHEEL_SLOTS; j++) {
+			tommy_list_init(&tw->slots[i][j]);
+		}
+	}
+}
+
+/*
+ * Arm timer to expire at tick expiry, which is moved to the next tick if it
+ * is not in the future.  The timer must not be pending.
+ */
+void
+timerwheel_add(timerwheel_t *tw, timerwheel_timer_t *timer, void *data,
+               uint64_t expiry) {
+	assert(!timer->list);
+	if (expiry <= tw->now)
+		expiry = tw->now + 1;
+	else if (expiry - tw->now >= TIMERWHEEL_RANGE)
+		expiry = tw->now + TIMERWHEEL_RANGE - 1;
+	timer->expiry = expiry;
+	timer->node.data = data;
+	timerwheel_place(tw, timer);
+}
+
+/*
+ * Disarm timer, or remove it from the list of expired timers it was handed
+ * out in.  Does nothing if the timer is not pending.
+ */
+void
+timerwheel_remove(timerwheel_timer_t *timer) {
+	if (!timer->list)
+		return;
+	tommy_list_remove_existing(timer->list, &timer->node);
+	timer->list = NULL;
+}
+
+/*
+ * Redistribute all timers in a slot of a higher level.
+ */
+static void
+timerwheel_cascade(timerwheel_t *tw, size_t level) {
+	tommy_list *list;
+	timerwheel_timer_t *timer;
+	size_t slot;
+
+	slot = (tw->now >> (TIMERWHEEL_BITS * level)) & (TIMERWHEEL_SLOTS - 1);
+	list = &tw->slots[level][slot];
+	while (!tommy_list_empty(list)) {
+		timer = (timerwheel_timer_t *)tommy_list_head(list);
+		tommy_list_remove_existing(list, &timer->node);
+		timerwheel_place(tw, timer);
+	}
+	tw->cascades++;
+}
+
+/*
+ * Advance the wheel to tick now and move all timers that expired on the way
+ * to the tail of list.  Expired timers remain pending on list until they are
+ * removed or re-added.
+ */
+void
+timerwheel_advance(timerwheel_t *tw, uint64_t now, tommy_list *expired) {
+	timerwheel_timer_t *timer;
+	tommy_list *list;
+	size_t level;
+
+	while (tw->now < now) {
+		tw->now++;
+		for (level = 1; level < TIMERWHEEL_LEVELS; level++) {
+			if (tw->now & ((1ULL << (TIMERWHEEL_BITS * level)) - 1))
+				break;
+		}
+		/* cascade from the highest level that wrapped downwards */
+		while (--level > 0)
+			timerwheel_cascade(tw, level);
+		list = &tw->slots[0][tw->now & (TIMERWHEEL_SLOTS - 1)];
+		while (!tommy_list_empty(list)) {
+			timer = (timerwheel_timer_t *)tommy_list_head(list);
+			tommy_list_remove_existing(list, &timer->node);
+			assert(timer->expiry == tw->now);
+			timer->list = expired;
+			tommy_list_insert_tail(expired, &timer->node,
+			                       timer->node.data);
+		}
+	}
+}
+
@@ -0,0 +1,43 @@
+/*-
+ * xnumon - monitor macOS for malicious activity
+ * https://www.roe.ch/xnumon
+ *
+ * Copyright (c) 2017-2018, Daniel Roethlisberger <daniel@roe.ch>.
+ * All rights reserved.
+ *
+ * Licensed under the Open Software License version 3.0.
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "tommylist.h"
+#include "attrib.h"
+
+#include <stdint.h>
+
+#define TIMERWHEEL_BITS         6
+#define TIMERWHEEL_SLOTS        (1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_LEVELS       3
+#define TIMERWHEEL_RANGE        (1ULL << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS))
+
+typedef struct {
+	tommy_node node;
+	uint64_t expiry;
+	tommy_list *list;       /* slot or expired list, NULL if not pending */
+} timerwheel_timer_t;
+
+typedef struct {
+	uint64_t now;
+	tommy_list slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+	uint64_t cascades;
+} timerwheel_t;
+
+void timerwheel_init(timerwheel_t *, uint64_t) NONNULL(1);
+void timerwheel_add(timerwheel_t *, timerwheel_timer_t *, void *, uint64_t)
+     NONNULL(1,2);
+void timerwheel_remove(timerwheel_timer_t *) NONNULL(1);
+void timerwheel_advance(timerwheel_t *, uint64_t, tommy_list *) NONNULL(1,3);
+
+#endif
+
@@ -14,6 +14,8 @@
 #include "queue.h"
 #include "log.h"
 #include "policy.h"
+#include "latency.h"
+#include "hashio.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -26,18 +28,27 @@ static logevt_header_t work_sentinel;
 
 static config_t *config = NULL;
 
+/*
+ * The work queue is strictly FIFO:  the subject and ancestor images of an
+ * event are acquired by the image_exec work items queued before it, and
+ * must be complete before the event is processed and handed over to the
+ * logger.  Priorities only apply to the log queue.
+ */
 void
 work_submit(void *data) {
 	logevt_header_t *hdr = data;
 
 	assert(hdr);
 	assert(hdr->le_free);
+	hdr->ts = latency_record_since(LATENCY_DISPATCH, hdr->code, &hdr->tv);
 	queue_enqueue(&work_queue, &hdr->node, hdr);
 }
 
 static void *
 work_thread(UNUSED void *arg) {
 	logevt_header_t *hdr;
+	uint64_t now;
+	int prio;
 
 #if 0	/* terra pericolosa */
 	(void)policy_thread_sched_standard();
@@ -45,9 +56,12 @@ work_thread(UNUSED void *arg) {
 	(void)policy_thread_diskio_standard();
 
 	for (;;) {
-		hdr = queue_dequeue(&work_queue);
+		hdr = queue_dequeue_prio(&work_queue, &prio);
 		if (hdr == &work_sentinel)
 			break;
+		now = latency_now();
+		queue_account_wait(&work_queue, prio,
+		                   now > hdr->ts ? now - hdr->ts : 0);
 		if (hdr->le_work) {
 			if (hdr->le_work(hdr) == -1) {
 				hdr->le_free(hdr);
@@ -60,6 +74,7 @@ work_thread(UNUSED void *arg) {
 		}
 		log_submit(hdr);
 	}
+	hashio_thread_fini();
 	return NULL;
 }
 
@@ -80,7 +95,7 @@ work_fini(void) {
 		return;
 
 	bzero(&work_sentinel, sizeof(work_sentinel));
-	queue_enqueue(&work_queue, &work_sentinel.node, &work_sentinel);
+	queue_enqueue_last(&work_queue, &work_sentinel.node, &work_sentinel);
 	if (pthread_join(work_thr, NULL) != 0) {
 		fprintf(stderr, "Failed to join worker thread - exiting\n");
 		exit(EXIT_FAILURE);
@@ -95,5 +110,6 @@ work_stats(work_stat_t *st) {
 	assert(st);
 
 	st->qsize = queue_size(&work_queue);
+	queue_lane_stats(&work_queue, st->lanes);
 }
 
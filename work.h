@@ -12,12 +12,14 @@
 #define WORK_H
 
 #include "config.h"
+#include "queue.h"
 #include "attrib.h"
 
 #include <stdint.h>
 
 typedef struct {
 	uint32_t qsize;
+	queue_lane_stat_t lanes[QUEUE_PRIOS];
 } work_stat_t;
 
 int work_init(config_t *) WUNRES;
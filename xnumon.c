@@ -32,13 +32,15 @@
  */
 #define XNUMON_PIDFILE "/var/run/xnumon.pid"
 
-#define OPTSTRING "o:l:f:1mdc:Vh"
+#define OPTSTRING "o:l:f:1mdt:c:Vh"
 
 static void
 fusage(FILE *f, const char *argv0) {
 	fprintf(f,
-"Usage: %s [-d] [-c cfgfile] [-olf1mVh]\n"
+"Usage: %s [-d] [-c cfgfile] [-t trail] [-olf1mVh]\n"
 " -d             launchd mode: adapt behaviour to launchd expectations\n"
+" -t trail       read audit records from trail (file or FIFO) instead of\n"
+"                /dev/auditpipe, e.g. as generated by auditgen\n"
 " -c cfgfile     load configuration plist from cfgfile instead of from\n"
 "                /Library/Application Support/ch.roe.xnumon/\n"
 "\n"
@@ -83,6 +85,7 @@ main(int argc, char *argv[]) {
 		case '1':
 		case 'm':
 		case 'd':
+		case 't':
 			break;
 		/* handled in first pass */
 		case 'c':
@@ -172,6 +175,15 @@ main(int argc, char *argv[]) {
 		case 'd':
 			cfg->launchd_mode = true;
 			break;
+		case 't':
+			if (cfg->trail)
+				free(cfg->trail);
+			cfg->trail = strdup(optarg);
+			if (!cfg->trail) {
+				fprintf(stderr, "Out of memory!\n");
+				goto errout;
+			}
+			break;
 		/* handled in first pass */
 		case 'c':
 		case 'V':